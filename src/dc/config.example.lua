@@ -1,9 +1,37 @@
 return {
     id = "dc",
+    -- required, 0 .. 1023, unique per process writing the same world
+    node = tonumber(os.getenv("FURIEND_DC_NODE")),
+    -- compress = { min_len = 64 }, -- pack published events, see event_codec
     redis = {
         ip4 = "172.20.0.3",
         port = 30303,
+        size = 4,
+        timeout = 5,
+        reconnect = { min_delay = 0.05, max_delay = 2 },
+        push = { concurrency = 1, queue_size = 4096, batch = 64 },
         password = "LocalPassword123",
         client_name = "dc",
     },
+    evlog = {
+        path = "/furiend/dc-events.evlog",
+        batch = 64, -- records per write + fdatasync
+        flush_interval = 1, -- seconds
+        replay = false, -- feed logged events through logic on start
+    },
+    snapshot = {
+        path = "/furiend/dc-world.snap",
+        interval = 600, -- seconds, rewritten to bound catch-up on restart
+    },
+    columnar = { "event" }, -- classes kept in typed column stores
+    stream = {
+        stream = "dc:events",
+        group = "dc",
+        consumer = "dc",
+        count = 256,
+        block_ms = 1000,
+        claim_idle_ms = 30000,
+        max_fails = 3, -- then the entry goes to dead_letter and is acked
+        dead_letter = "dc:events:dead",
+    },
 }
@@ -6,6 +6,8 @@ local log = require "log"
 local tensor = require "tensor"
 local error_kv = require "error_kv"
 
+local chat_id_path = tensor.compile "payload.event.*.chat.id"
+
 return function(dc, event)
     local world, rc = dc.world, dc.rc
 
@@ -19,13 +21,13 @@ log("event mutated to", e_mut)
 
     if event.from == "fe2" and event.type == "tg_bot_event" then
         local cmd_id = next_id(dc.cmd_ids, event.from)
-        local chat_id = tensor.unwrap(event, "payload.event.*.chat.id")
+        local chat_id = tensor.unwrap(event, chat_id_path)
 
         if not chat_id then
             error_kv("unable to find chat id in tg event")
         end
 
-        wait(rc:publish(event.from, json.stringify {
+        wait(rc:publish(event.from, dc.codec:pack(json.stringify {
             type = "cmd",
             from = dc.config.id,
             cmd = "sendChatAction",
@@ -34,6 +36,6 @@ log("event mutated to", e_mut)
                 chat_id = chat_id,
                 action = "typing",
             },
-        }))
+        })))
     end
 end
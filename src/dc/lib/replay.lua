@@ -0,0 +1,43 @@
+local evlog = require "evlog"
+local json = require "json"
+local logic = require "lib.logic"
+
+-- finished thread, stands in for a query that is not sent; wait -> nothing
+local function done()
+    local t = coroutine.create(function() end)
+
+    coroutine.resume(t)
+
+    return t
+end
+
+-- rc of replayed events: publishes and stream adds reached other services
+-- when the event was first handled, the rest goes to rc
+local function muted(rc)
+    local skip = {
+        publish = done,
+        xadd = done,
+    }
+
+    return setmetatable({}, {
+        __index = function(_, name)
+            return skip[name] or function(_, ...)
+                return rc[name](rc, ...)
+            end
+        end,
+    })
+end
+
+-- feeds logged events back through logic at full speed
+-- returns replayed events count
+return function(dc, path)
+    local events_n = 0
+    local replay_dc = setmetatable({ rc = muted(dc.rc) }, { __index = dc })
+
+    for payload in evlog.replay(path) do
+        logic(replay_dc, json.parse(payload))
+        events_n = events_n + 1
+    end
+
+    return events_n
+end
@@ -5,46 +5,61 @@ local load_entities = require "lib.world.load_entities"
 local link_classes = require "lib.world.link_classes"
 local link_objects = require "lib.world.link_objects"
 local link_mutators = require "lib.world.link_mutators"
-local check_id = require "lib.world.check_id"
-local check_key_name = require "lib.world.check_key_name"
+local mutator_index = require "lib.world.mutator_index"
+local object_index = require "lib.world.object_index"
+local columnar = require "lib.world.columnar"
+local compile_path = require "lib.world.compile_path"
+local changes = require "lib.world.changes"
+local encode_key = require "lib.world.encode_key"
 local check_obj_key = require "lib.world.check_obj_key"
+local compile_validators = require "lib.world.compile_validators"
 local ops = require "lib.world.ops"
 local warps = require "lib.world.warps"
 local types = require "lib.world.types"
 local error_kv = require "error_kv"
-local json = require "json"
+local log = require "log"
 local redis = require "redis"
 local tensor = require "tensor"
+local snapshot = require "snapshot"
+local time = require "time"
+local sleep = require "sleep"
 local async = require "async"
 local wait = async.wait
 
+local SNAPSHOT_CLOCK_SKEW = 5 -- seconds, changes are marked by other hosts
+local SNAPSHOT_INTERVAL = 600 -- seconds between snapshot refreshes
+local FLUSH_INTERVAL = 0.05 -- seconds, write-behind window
+local GEN_ID_RETRIES = 16 -- gen_id only grows, so a retry is a new id
+
 local proto = {}
 local mt = { __index = proto }
 
 function proto:stat()
     local classes_n = 0
-    local objects_n = 0
-    local mutators_n = 0
+    local index = self.index
+    local mutators_n = index:count("mut")
 
     for _ in pairs(self.classes) do
         classes_n = classes_n + 1
     end
 
-    for obj in pairs(self.objects) do
-        if obj.class.id == "mut" then
-            mutators_n = mutators_n + 1
-        else
-            objects_n = objects_n + 1
-        end
-    end
-
     return {
         classes_n = classes_n,
-        objects_n = objects_n,
+        objects_n = index.objects_n - mutators_n,
         mutators_n = mutators_n,
     }
 end
 
+-- objects of class_id passing all filters, see object_index
+-- filters: { { path = "age", op = "gte", values = { 18 } }, ... }
+function proto:query(class_id, filters)
+    return self.index:query(class_id, filters)
+end
+
+function proto:count(class_id)
+    return self.index:count(class_id)
+end
+
 function proto:load_classes()
     self.classes = load_entities(self.rc, key_prefix.class)
 end
@@ -53,6 +68,171 @@ function proto:load_objects()
     self.objects = load_entities(self.rc, key_prefix.object)
 end
 
+-- false if snapshot is missing, broken or classes changed after it was made
+function proto:load_snapshot(path)
+    local ok, root, ts = pcall(snapshot.read, path)
+
+    if not ok then
+        warn("world snapshot not loaded: " .. tostring(root))
+        return false
+    end
+
+    local rc = self.rc
+    local since = ts - SNAPSHOT_CLOCK_SKEW
+    local trimmed = wait(rc:query(changes.trimmed())) -- double or nil
+
+    if trimmed and tonumber(trimmed) > since + 0.001 then -- ms rounded
+        return false -- marks after this snapshot were dropped by a newer one
+    end
+
+    local changed = wait(rc:query(changes.since(since)))
+    local class_prefix, object_prefix = key_prefix.class, key_prefix.object
+
+    for _, key in ipairs(changed) do
+        if key:sub(1, #class_prefix) == class_prefix then
+            return false -- schemas are linked into every object
+        end
+    end
+
+    local queries = {}
+
+    for _, key in ipairs(changed) do
+        if key:sub(1, #object_prefix) == object_prefix then
+            queries[key:sub(#object_prefix + 1)] = rc:query(redis:pack {
+                "hgetall",
+                key,
+            }, key)
+        end
+    end
+
+    local objects = root.objects
+    local relink = {}
+    local deleted = {} -- deleted[obj] = true
+
+    for id, query in pairs(queries) do
+        local fields = wait(query)
+        local obj = objects[id]
+
+        if next(fields) == nil then
+            if obj then
+                deleted[obj] = true
+            end
+
+            objects[id] = nil
+        else
+            if obj then -- keep identity: other objects link to it
+                for key in pairs(obj) do
+                    obj[key] = nil
+                end
+            else
+                obj = {}
+                objects[id] = obj
+            end
+
+            for key, value in pairs(fields) do
+                obj[key] = value
+            end
+
+            relink[id] = obj
+        end
+    end
+
+    self.classes = root.classes
+    self.objects = objects
+
+    link_objects(relink, self.classes, objects)
+
+    if next(deleted) then
+        self:unlink_deleted(deleted)
+    end
+
+    return true
+end
+
+-- drops rel and rels links to deleted objects; the unlinked keys are
+-- saved by the next flush, so redis has no dangling ids either
+function proto:unlink_deleted(deleted)
+    local dirty = self.dirty
+
+    local function mark(obj, key)
+        local keys = dirty[obj]
+
+        if keys == true then
+            return
+        elseif not keys then
+            keys = {}
+            dirty[obj] = keys
+        end
+
+        keys[key] = true
+    end
+
+    for _, obj in pairs(self.objects) do
+        local class = obj.class
+
+        for key, value in pairs(obj) do
+            local schema = key ~= "class" and class[key]
+            local kind = type(schema) == "table" and schema.type
+
+            if kind == "rel" and deleted[value] then
+                obj[key] = nil
+                mark(obj, key)
+            elseif kind == "rels" then
+                local kept = {}
+
+                for _, rel_object in ipairs(value) do
+                    if not deleted[rel_object] then
+                        table.insert(kept, rel_object)
+                    end
+                end
+
+                if #kept < #value then
+                    obj[key] = kept
+                    mark(obj, key)
+                end
+            end
+        end
+    end
+end
+
+function proto:save_snapshot(path, ts)
+    return snapshot.write(path, {
+        classes = self.classes,
+        objects = self.objects,
+    }, ts)
+end
+
+-- snapshot at ts, then change marks it covers are trimmed
+-- on_snapshot(ts) is called before anything yields, see dc evlog checkpoint
+function proto:write_snapshot(ts)
+    self:save_snapshot(self.snapshot.path, ts)
+
+    if self.on_snapshot then
+        self.on_snapshot(ts)
+    end
+
+    local trim_mark, trim = changes.trim(ts - SNAPSHOT_CLOCK_SKEW)
+    local rc = self.rc
+
+    wait(rc:query(trim_mark)) -- before trim: old snapshots fall back
+    wait(rc:query(trim))
+end
+
+-- keeps catch-up window and the changes zset bounded between restarts
+function proto:snapshot_loop(interval)
+    while not self.closed do
+        wait(sleep(interval))
+
+        if not self.closed then
+            local ok, err = pcall(self.write_snapshot, self, time())
+
+            if not ok then
+                log("world snapshot failed", err)
+            end
+        end
+    end
+end
+
 function proto:create_object(class_id, blueprint)
     local objects = self.objects
     local class = self.classes[class_id]
@@ -74,103 +254,245 @@ function proto:create_object(class_id, blueprint)
                 blueprint = blueprint,
             })
         end
-    else
-        blueprint.id = tensor.gen_id(class_id, objects)
+    else -- ids of another node or a restart in the same ms can collide
+        local id = tensor.gen_id(class_id)
+        local retries = GEN_ID_RETRIES
+
+        while objects[id] do
+            if retries == 0 then
+                error_kv("unable to generate unique object id", {
+                    class_id = class_id,
+                    id = id,
+                })
+            end
+
+            retries = retries - 1
+            id = tensor.gen_id(class_id)
+        end
+
+        blueprint.id = id
     end
 
     self:validate_object(blueprint)
 
+    local store = self.columns[class_id]
+
+    if store then
+        blueprint = store:insert(blueprint)
+    end
+
     objects[blueprint.id] = blueprint
+    self.index:add(blueprint)
 
     return blueprint
 end
 
+-- compiled per class by compile_validators, no pcall per key
 function proto:validate_object(obj)
-    local validator = self.validate_object_key
+    local validator = self.validators[obj.class.id]
+    local err, key = validator(obj, self.objects, self.classes)
 
-    for key in pairs(obj) do
-        local ok, err = pcall(validator, self, obj, key)
+    if err then
+        error_kv("invalid object key: " .. err, {
+            obj = obj,
+            key = key,
+        })
+    end
+end
 
-        if not ok then
-            error_kv("invalid object key: " .. err, {
-                obj = obj,
-                key = key,
-            })
+-- write-behind: fields are written by the next flush
+-- keys: { key1, ... } to save only these, all fields if nil
+-- expire_s: nil or 0 = do not expire
+function proto:save_object(object, expire_s, keys)
+    local dirty = self.dirty
+    local dirty_keys = dirty[object]
+
+    if not keys then
+        dirty[object] = true
+    elseif dirty_keys ~= true then
+        if not dirty_keys then
+            dirty_keys = {}
+            dirty[object] = dirty_keys
+        end
+
+        for _, key in ipairs(keys) do
+            dirty_keys[key] = true
         end
     end
+
+    if expire_s and expire_s > 0 then
+        self.dirty_expires[object] = expire_s
+    end
+
+    self.index:update(object, keys)
 end
 
-function proto:validate_object_key(obj, key)
-    if key == "id" then
-        return check_id(obj.id)
+-- sets one field and marks it dirty; hot objects cost one write per flush
+function proto:set_key(object, key, value)
+    object[key] = value
+    self:save_object(object, nil, { key })
+end
+
+-- hset, hdel queries of one dirty object, raises if a key fails to encode
+local function encode_dirty(object, keys)
+    local record_key = key_prefix.object .. object.id
+    local hset = { "hset", record_key }
+    local hdel = { "hdel", record_key }
+
+    if keys == true then
+        keys = object
     end
 
-    if key == "class" then
-        assert(obj.class, "object class not found")
-        return check_id(obj.class.id)
+    for key in pairs(keys) do
+        if key == "id" then
+            -- key of the record
+        elseif object[key] == nil then
+            table.insert(hdel, key)
+        else
+            local value = encode_key(object, key)
+
+            if type(value) ~= "string" then -- would break the pipeline
+                error_kv("key is not encoded to string", {
+                    key = key,
+                    type = type(value),
+                })
+            end
+
+            table.insert(hset, key)
+            table.insert(hset, value)
+        end
     end
 
-    check_key_name(key)
+    return record_key, hset, hdel
+end
 
-    local schema = obj.class[key]
-    assert(schema, "key not found in class definition")
+-- into[object] = true wins over key sets, key sets are united
+local function merge_dirty(into, from)
+    for object, keys in pairs(from) do
+        local into_keys = into[object]
 
-    check_obj_key[schema.type](obj[key], self.objects, self.classes)
+        if keys == true or into_keys == true then
+            into[object] = true
+        elseif not into_keys then
+            into[object] = keys
+        else
+            for key in pairs(keys) do
+                into_keys[key] = true
+            end
+        end
+    end
 end
 
--- expire_s: nil or 0 = do not expire
-function proto:save_object(object, expire_s)
-    local record_key = key_prefix.object .. object.id
+-- pipelined HSET/HDEL + EXPIRE + change mark per dirty object
+-- an object that fails to encode is logged and dropped from dirty
+local function send_dirty(rc, dirty, expires)
+    local queries = {}
+    local objects_n = 0
 
-    local query = {
-        "hset",
-        record_key,
-    }
+    for object, keys in pairs(dirty) do
+        local ok, record_key, hset, hdel = pcall(encode_dirty, object, keys)
 
-    for key, value in pairs(object) do
-        if key ~= "id" then
-            table.insert(query, key)
+        if not ok then
+            log("world flush: object dropped", object.id, record_key)
 
-            if key == "class" then
-                table.insert(query, value.id)
-            elseif type(value) ~= "string" then
-                table.insert(query, json.stringify(value))
-            else
-                table.insert(query, value)
+            dirty[object] = nil -- not merged back on failure
+            expires[object] = nil
+        else
+            if #hset > 2 then
+                table.insert(queries, rc:query(redis:pack(hset), record_key))
+            end
+
+            if #hdel > 2 then
+                table.insert(queries, rc:query(redis:pack(hdel), record_key))
             end
+
+            local expire_s = expires[object]
+
+            if expire_s then
+                table.insert(queries, rc:query(redis:pack {
+                    "expire",
+                    record_key,
+                    tostring(expire_s),
+                }, record_key))
+            end
+
+            table.insert(queries, rc:query(changes.mark(record_key,
+                expire_s and time() + expire_s), record_key))
+
+            objects_n = objects_n + 1
         end
     end
 
-    wait(self.rc:query(redis:pack(query)))
+    for _, query in ipairs(queries) do
+        wait(query)
+    end
 
-    if expire_s and expire_s > 0 then
-        wait(self.rc:query(redis:pack {
-            "expire",
-            record_key,
-            tostring(expire_s),
-        }))
+    return objects_n
+end
+
+-- returns flushed objects count; on error the batch is merged back
+-- into dirty, so the next flush sends it again
+function proto:flush()
+    local dirty, expires = self.dirty, self.dirty_expires
+
+    if next(dirty) == nil then
+        return 0
+    end
+
+    self.dirty, self.dirty_expires = {}, {}
+
+    local ok, objects_n = pcall(send_dirty, self.rc, dirty, expires)
+
+    if not ok then
+        merge_dirty(self.dirty, dirty)
+
+        for object, expire_s in pairs(expires) do
+            self.dirty_expires[object] = self.dirty_expires[object]
+                or expire_s
+        end
+
+        error(objects_n, 0)
     end
+
+    return objects_n
 end
 
+-- stops flush loop, writes what is left
+function proto:close()
+    self.closed = true
+    return self:flush()
+end
+
+function proto:flush_loop(interval)
+    while not self.closed do
+        wait(sleep(interval))
+
+        local ok, err = pcall(self.flush, self)
+
+        if not ok then
+            log("world flush failed", err)
+        end
+    end
+end
+
+-- first mutator of obj class whose ifs all pass, see mutator_index
 function proto:mutate_any(obj)
-    local mutators = self.mutators[obj.class.id]
+    local index = self.mutators[obj.class.id]
 
-    if not mutators then
+    if not index then
         return
     end
 
-    for _, mut in ipairs(mutators) do
-        local mut_obj = self:mutate(obj, mut)
+    local mut = mutator_index.match(index, obj)
 
-        if mut_obj then
-            return mut_obj
-        end
+    if mut then
+        return self:warp(obj, mut)
     end
 end
 
 function proto:mutate(obj, mut)
     for _, ifx in ipairs(mut.ifs) do
-        local from = tensor.unwrap(obj, ifx.path)
+        local from = tensor.unwrap(obj, compile_path(ifx.path))
         local to = ifx.values
 
         if not ops[ifx.op](from, to) then
@@ -178,11 +500,16 @@ function proto:mutate(obj, mut)
         end
     end
 
+    return self:warp(obj, mut)
+end
+
+-- creates mut.to object from obj, ifs are not checked
+function proto:warp(obj, mut)
     local class = mut.to
     local blueprint = {}
 
     for _, warp in ipairs(mut.warps) do
-        local value = tensor.unwrap(obj, warp.from)
+        local value = tensor.unwrap(obj, compile_path(warp.from))
         local to = warp.to
         local schema = class[to]
 
@@ -197,6 +524,9 @@ return function(props)
 
     local world = setmetatable(props, mt)
 
+    world.dirty = {} -- dirty[object] = true (all fields) or { key = true }
+    world.dirty_expires = {} -- dirty_expires[object] = expire_s
+
     for _, field_type in ipairs(types) do
         assert(check_obj_key[field_type],
             "obj key validator missing for type: " .. field_type)
@@ -205,14 +535,39 @@ return function(props)
             "warp missing for type: " .. field_type)
     end
 
-    waitall(
-        promise(world.load_classes, world),
-        promise(world.load_objects, world)
-    )
+    local snapshot_conf = world.snapshot -- { path = "...", interval = s }
+    local loaded_at = time()
 
-    link_classes(world.classes)
-    link_objects(world.objects, world.classes)
+    if not (snapshot_conf and world:load_snapshot(snapshot_conf.path)) then
+        waitall(
+            promise(world.load_classes, world),
+            promise(world.load_objects, world)
+        )
+
+        link_classes(world.classes)
+        link_objects(world.objects, world.classes)
+    end
+
+    world.validators = compile_validators(world.classes)
+
+    world.columns = {} -- class_id -> column store, for classes in props.columnar
+
+    for _, class_id in ipairs(world.columnar or {}) do
+        world.columns[class_id] = columnar(class_id, world.classes,
+            world.objects)
+    end
+
+    world.index = object_index(world.objects)
     world.mutators = link_mutators(world.objects)
 
+    if snapshot_conf then
+        world:write_snapshot(loaded_at)
+
+        promise(world.snapshot_loop, world,
+            snapshot_conf.interval or SNAPSHOT_INTERVAL)
+    end
+
+    promise(world.flush_loop, world, world.flush_interval or FLUSH_INTERVAL)
+
     return world
 end
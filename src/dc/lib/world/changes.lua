@@ -0,0 +1,60 @@
+local redis = require "redis"
+local time = require "time"
+
+-- zset: entity key -> unix time of its last change
+-- dc snapshot catch-up reloads only keys changed after the snapshot
+local key = "w:changed"
+local trimmed_key = "w:changed:trimmed" -- zset: "ts" -> highest trimmed ts
+
+local changes = {
+    key = key,
+    trimmed_key = trimmed_key,
+}
+
+-- at: change time, defaults to now; key expiration time for expiring keys
+function changes.mark(entity_key, at)
+    return redis:pack {
+        "zadd",
+        key,
+        string.format("%.3f", at or time()),
+        entity_key,
+    }
+end
+
+function changes.since(ts)
+    return redis:pack {
+        "zrangebyscore",
+        key,
+        string.format("%.3f", ts),
+        "+inf",
+    }
+end
+
+-- marks up to ts are covered by a snapshot; a snapshot older than the
+-- trimmed ts can not catch up and needs a full load
+function changes.trim(ts)
+    local score = string.format("%.3f", ts)
+
+    return redis:pack {
+        "zadd",
+        trimmed_key,
+        "GT",
+        score,
+        "ts",
+    }, redis:pack {
+        "zremrangebyscore",
+        key,
+        "-inf",
+        score,
+    }
+end
+
+function changes.trimmed()
+    return redis:pack {
+        "zscore",
+        trimmed_key,
+        "ts",
+    }
+end
+
+return changes
@@ -2,11 +2,14 @@ local error_kv = require "error_kv"
 
 local expr = "^[a-z0-9_-]+$"
 
-return function(value)
-    if type(value) ~= "string" or not value:match(expr) then
-        error_kv("invalid id", {
-            id = value,
-            expected = expr,
-        })
-    end
-end
+-- check_id(value) raises, check_id.expr is for callers that report instead
+return setmetatable({ expr = expr }, {
+    __call = function(_, value)
+        if type(value) ~= "string" or not value:match(expr) then
+            error_kv("invalid id", {
+                id = value,
+                expected = expr,
+            })
+        end
+    end,
+})
@@ -1,41 +1,75 @@
 local array = require "array"
 
+-- checks return nil if value is valid, error message otherwise
+-- rel values may be tables or columnar proxies
+
+local function is_object(value)
+    local value_type = type(value)
+    return value_type == "table" or value_type == "userdata"
+end
+
 local function bool(value)
-    assert(type(value) == "boolean", "invalid bool")
+    if type(value) ~= "boolean" then
+        return "invalid bool"
+    end
 end
 
 local function int(value)
-    assert(math.type(value) == "integer", "invalid int")
+    if math.type(value) ~= "integer" then
+        return "invalid int"
+    end
 end
 
 local function float(value)
-    assert(math.type(value) == "float", "invalid float")
+    if math.type(value) ~= "float" then
+        return "invalid float"
+    end
 end
 
 local function str(value)
-    assert(type(value) == "string", "invalid str")
+    if type(value) ~= "string" then
+        return "invalid str"
+    end
 end
 
 local function table(value)
-    assert(type(value) == "table", "invalid table")
+    if type(value) ~= "table" then
+        return "invalid table"
+    end
 end
 
 local function rel(value, objects)
-    assert(type(value) == "table", "rel: invalid table")
-    assert(value == objects[value.id], "rel: not found")
+    if not is_object(value) then
+        return "rel: invalid table"
+    end
+
+    if value ~= objects[value.id] then
+        return "rel: not found"
+    end
 end
 
 local function rels(value, objects)
-    assert(array.is_array(value), "rels: invalid array")
+    if not array.is_array(value) then
+        return "rels: invalid array"
+    end
 
     for _, rel_obj in ipairs(value) do
-        rel(rel_obj, objects)
+        local err = rel(rel_obj, objects)
+
+        if err then
+            return err
+        end
     end
 end
 
 local function class(value, _, classes)
-    assert(type(value) == "table", "class: invalid table")
-    assert(value == classes[value.id], "class: not found")
+    if type(value) ~= "table" then
+        return "class: invalid table"
+    end
+
+    if value ~= classes[value.id] then
+        return "class: not found"
+    end
 end
 
 return {
@@ -0,0 +1,74 @@
+local columns = require "columns"
+
+-- schema type -> column type
+-- numbers, bools, strings and rel ids are typed columns, the rest
+-- stays a lua value per row
+local column_types = {
+    bool = "bool",
+    int = "int",
+    float = "float",
+    str = "str",
+    rel = "rel",
+    rels = "any",
+    table = "any",
+    class = "any",
+}
+
+local function relink(obj, replaced)
+    for key, schema in pairs(obj.class) do
+        if type(schema) ~= "table" then
+            -- id
+        elseif schema.type == "rel" then
+            local proxy = replaced[obj[key]]
+
+            if proxy then
+                obj[key] = proxy
+            end
+        elseif schema.type == "rels" then
+            local rels = obj[key]
+
+            if rels then
+                for i, rel in ipairs(rels) do
+                    rels[i] = replaced[rel] or rel
+                end
+            end
+        end
+    end
+end
+
+-- objects of class_id move into a column store
+-- objects[id] becomes a proxy, links of other objects are moved to it
+-- returns the store, see lua-clib/columns
+return function(class_id, classes, objects)
+    local class = classes[class_id]
+    assert(class, "columnar class not found: " .. tostring(class_id))
+
+    local keys = {}
+
+    for key, schema in pairs(class) do
+        if type(schema) == "table" then
+            keys[key] = assert(column_types[schema.type],
+                "column type not found for schema type")
+        end
+    end
+
+    local store = columns.new(class, keys, objects)
+    local replaced = {} -- table -> proxy
+
+    for id, obj in pairs(objects) do
+        if obj.class == class then
+            local proxy = store:insert(obj)
+
+            replaced[obj] = proxy
+            objects[id] = proxy
+        end
+    end
+
+    if next(replaced) then
+        for _, obj in pairs(objects) do
+            relink(obj, replaced)
+        end
+    end
+
+    return store
+end
@@ -0,0 +1,15 @@
+local tensor = require "tensor"
+
+local compiled = {} -- path -> tensor.compile(path)
+
+-- compiled paths are kept out of objects: snapshots and redis see strings
+return function(path)
+    local path_c = compiled[path]
+
+    if not path_c then
+        path_c = tensor.compile(path)
+        compiled[path] = path_c
+    end
+
+    return path_c
+end
@@ -0,0 +1,56 @@
+local check_id = require "lib.world.check_id"
+local check_obj_key = require "lib.world.check_obj_key"
+
+local ID_EXPR = check_id.expr
+
+-- class -> validator(obj, objects, classes) -> nil or err, key
+-- key names and schemas were checked by link_classes, so an object key
+-- is valid if its class has it and the value passes the type check
+local function compile(class)
+    local checks = {}
+
+    for key, schema in pairs(class) do
+        if type(schema) == "table" then
+            checks[key] = check_obj_key[schema.type]
+        end
+    end
+
+    return function(obj, objects, classes)
+        for key, value in pairs(obj) do
+            local err
+
+            if key == "id" then
+                if type(value) ~= "string" or not value:match(ID_EXPR) then
+                    err = "invalid id"
+                end
+            elseif key == "class" then
+                if value ~= class then
+                    err = "object class mismatch"
+                end
+            else
+                local check = checks[key]
+
+                if check then
+                    err = check(value, objects, classes)
+                else
+                    err = "key not found in class definition"
+                end
+            end
+
+            if err then
+                return err, key
+            end
+        end
+    end
+end
+
+-- validators[class_id] = validator, one per class after linking
+return function(classes)
+    local validators = {}
+
+    for id, class in pairs(classes) do
+        validators[id] = compile(class)
+    end
+
+    return validators
+end
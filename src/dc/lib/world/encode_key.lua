@@ -0,0 +1,48 @@
+local json = require "json"
+
+local encoders = {
+    bool = function(value)
+        return value and "true" or "false"
+    end,
+    int = tostring,
+    float = tostring,
+    str = function(value)
+        return value
+    end,
+    table = json.stringify,
+    rel = function(rel_object)
+        return rel_object.id
+    end,
+    rels = function(rel_objects)
+        local ids = {}
+
+        for i, rel_object in ipairs(rel_objects) do
+            ids[i] = rel_object.id
+        end
+
+        return json.stringify(ids)
+    end,
+    class = function(rel_class)
+        return rel_class.id
+    end,
+}
+
+-- inverse of link_objects: linked object key -> redis hash field value
+return function(obj, key)
+    local value = obj[key]
+
+    if key == "class" then
+        return value.id
+    end
+
+    local schema = obj.class[key]
+    local encoder = schema and encoders[schema.type]
+
+    if encoder then
+        return encoder(value)
+    elseif type(value) == "string" then
+        return value
+    else
+        return json.stringify(value)
+    end
+end
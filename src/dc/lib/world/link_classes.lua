@@ -7,6 +7,11 @@ local types = require "lib.world.types"
 
 local types_set = to_set(types)
 
+local index_types = { -- schema.index -> types it can be declared on
+    hash = to_set { "bool", "int", "float", "str" },
+    ordered = to_set { "int", "float" },
+}
+
 local function link_key(class, key, classes)
     if key == "id" then
         return check_id(class.id)
@@ -20,6 +25,12 @@ local function link_key(class, key, classes)
     local schema_type = schema.type
     assert(types_set[schema_type], "schema type not found")
 
+    if schema.index ~= nil then
+        local index_type = index_types[schema.index]
+        assert(index_type, "schema index not found")
+        assert(index_type[schema_type], "schema index not supported for type")
+    end
+
     if schema_type == "rel" or schema_type == "rels" then
         local rel_class = classes[schema.class]
         assert(rel_class, "rel class not found")
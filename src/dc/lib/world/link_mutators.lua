@@ -1,9 +1,25 @@
 local error_kv = require "error_kv"
 local array = require "array"
 local ops = require "lib.world.ops"
+local mutator_index = require "lib.world.mutator_index"
+local compile_path = require "lib.world.compile_path"
 local check_key_name = require "lib.world.check_key_name"
 
+local function check_path(mut, field, path)
+    if type(path) ~= "string" then
+        error_kv("bad path", {
+            mutator = mut,
+            field = field,
+            path = path,
+        })
+    end
+
+    compile_path(path) -- once, shared by all mutators
+end
+
 local function check_warp(mut, warp)
+    check_path(mut, "warp.from", warp.from)
+
     local ok, err = pcall(check_key_name, warp.to)
 
     if not ok then
@@ -22,7 +38,9 @@ local function check_warp(mut, warp)
 end
 
 local function check_if(mut, ifx)
-    local op, vals = ifx.op, ifx.vals
+    local op, values = ifx.op, ifx.values
+
+    check_path(mut, "if.path", ifx.path)
 
     if not ops[op] then
         error_kv("bad if.op", {
@@ -31,8 +49,15 @@ local function check_if(mut, ifx)
         })
     end
 
-    if op ~= "in" or not array.is_array(vals) or #vals == 0 then
-        error_kv("bad if.vals", {
+    -- link_objects converts "in" values to set
+    local ok = type(values) == "table" and next(values) ~= nil
+
+    if ok and op ~= "in" then
+        ok = array.is_array(values)
+    end
+
+    if not ok then
+        error_kv("bad if.values", {
             mutator = mut,
             ["if"] = ifx,
         })
@@ -71,25 +96,36 @@ local function check_mutator(mut)
     end
 end
 
+local function by_id(a, b)
+    return a.id < b.id
+end
+
+-- mutators[from_class_id] = mutator_index, mutators of a class
+-- are tried in id order
 return function(objects)
-    local mutators = {}
+    local lists = {}
 
     for _, obj in pairs(objects) do
-        if obj.class.id ~= "mut" then
-            return
-        end
+        if obj.class.id == "mut" then
+            check_mutator(obj)
 
-        check_mutator(obj)
+            local from_id = obj.from.id
+            local list = lists[from_id]
 
-        local from_id = obj.from.id
-        local list = mutators[from_id]
+            if not list then
+                list = {}
+                lists[from_id] = list
+            end
 
-        if not list then
-            list = {}
-            mutators[from_id] = list
+            table.insert(list, obj)
         end
+    end
+
+    local mutators = {}
 
-        table.insert(list, obj)
+    for from_id, list in pairs(lists) do
+        table.sort(list, by_id)
+        mutators[from_id] = mutator_index.build(list)
     end
 
     return mutators
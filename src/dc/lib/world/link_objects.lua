@@ -79,7 +79,10 @@ linkers = {
     end,
 }
 
-return function(objects, classes)
+-- all_objects: rel lookup table when only a subset of objects is linked
+return function(objects, classes, all_objects)
+    all_objects = all_objects or objects
+
     for id, obj in pairs(objects) do
         local class_id = obj.class
         local class = classes[class_id]
@@ -88,7 +91,7 @@ return function(objects, classes)
         obj.class = class
 
         for key in pairs(obj) do
-            local ok, err = pcall(link_key, obj, key, objects, classes)
+            local ok, err = pcall(link_key, obj, key, all_objects, classes)
 
             if not ok then
                 error_kv("object key link failed: " .. err, {
@@ -1,20 +1,9 @@
-local redis = require "redis"
 local async = require "async"
 local wait = async.wait
 
-return function(redis_client, prefix)
-    local keys = wait(redis_client:query("keys " .. prefix .. "*\r\n"))
-    local prefix_sub = 1 + #prefix
-    local entities = {}
-
-    for _, key in ipairs(keys) do
-        local id = key:sub(prefix_sub)
-        entities[id] = redis_client:query(redis:pack { "hgetall", key })
-    end
+local BATCH = 512 -- HGETALLs in flight
 
-    for id, query in pairs(entities) do
-        entities[id] = wait(query)
-    end
-
-    return entities
+-- redis_client is a redis.client or redis.pool
+return function(redis_client, prefix)
+    return wait(redis_client:load_hashes(prefix, BATCH))
 end
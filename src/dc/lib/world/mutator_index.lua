@@ -0,0 +1,305 @@
+local tensor = require "tensor"
+local equal = require "equal"
+local ops = require "lib.world.ops"
+local compile_path = require "lib.world.compile_path"
+
+local unwrap = tensor.unwrap
+
+-- mutators of one class -> decision index
+-- every mutator is filed under its most selective if, the anchor:
+--   eq: path -> value -> mutators, hash lookup
+--   in: path -> set member -> mutators, hash lookup
+--   gt, gte: path -> mutators sorted by threshold, binary search
+--   lt, lte: same, from the other end
+--   neq, no ifs: tried for every object
+-- NaN and table operands are not anchored, so they are checked linearly;
+-- a NaN value passes every range op and gets all range mutators of a path
+-- candidates are verified with ops in original order, so the result is
+-- the same first match as linear evaluation
+
+local NIL = {} -- cached unwrap result for missing paths
+
+local function keyable(value)
+    return value ~= nil and type(value) ~= "table" and value == value
+end
+
+local function push(map, key, mut_i)
+    local list = map[key]
+
+    if not list then
+        list = {}
+        map[key] = list
+    end
+
+    table.insert(list, mut_i)
+end
+
+local function path_node(index, path)
+    local node = index.paths[path]
+
+    if not node then
+        node = {
+            eq = {},
+            ["in"] = {},
+            above = {}, -- gt, gte: { threshold, mut_i }
+            below = {}, -- lt, lte: { threshold, mut_i }
+        }
+
+        index.paths[path] = node
+    end
+
+    return node
+end
+
+-- gt, gte: from above max value; lt, lte: from below min value
+local function range_threshold(ifx)
+    local op = ifx.op
+    local above = op == "gt" or op == "gte"
+    local threshold
+
+    for _, value in ipairs(ifx.values) do
+        if type(value) ~= "number" or value ~= value then
+            return
+        end
+
+        if not threshold
+            or (above and value > threshold)
+            or (not above and value < threshold)
+        then
+            threshold = value
+        end
+    end
+
+    return threshold, above
+end
+
+-- lower rank is more selective, nil if not indexable
+local function anchor_rank(ifx)
+    local op, values = ifx.op, ifx.values
+
+    if op == "eq" then
+        local value = values[1]
+
+        for i = 2, #values do
+            if not equal(values[i], value) then -- same test as ops.eq
+                return 0 -- never matches
+            end
+        end
+
+        if keyable(value) then
+            return 1
+        end
+    elseif op == "in" then
+        local n = 0
+
+        for value in pairs(values) do
+            if type(value) == "table" then
+                return
+            end
+
+            n = n + 1
+        end
+
+        return 1 + n
+    elseif op == "gt" or op == "gte" or op == "lt" or op == "lte" then
+        if range_threshold(ifx) then
+            return math.huge
+        end
+    end
+end
+
+local function add_anchor(index, mut_i, ifx)
+    local node = path_node(index, ifx.path)
+    local op = ifx.op
+
+    if op == "eq" then
+        push(node.eq, ifx.values[1], mut_i)
+    elseif op == "in" then
+        for value in pairs(ifx.values) do
+            push(node["in"], value, mut_i)
+        end
+    else
+        local threshold, above = range_threshold(ifx)
+        table.insert(above and node.above or node.below, { threshold, mut_i })
+    end
+end
+
+local function by_threshold(a, b)
+    return a[1] < b[1]
+end
+
+-- sorted { threshold, mut_i } -> parallel arrays for binary search
+local function finish_range(conds)
+    table.sort(conds, by_threshold)
+
+    local thresholds, muts = {}, {}
+
+    for i, cond in ipairs(conds) do
+        thresholds[i] = cond[1]
+        muts[i] = cond[2]
+    end
+
+    return { thresholds = thresholds, muts = muts }
+end
+
+local function build(mutators)
+    local index = {
+        mutators = mutators,
+        paths = {},
+        rest = {}, -- mutators without an anchor
+    }
+
+    for mut_i, mut in ipairs(mutators) do
+        local anchor, best_rank
+
+        for _, ifx in ipairs(mut.ifs) do
+            local rank = anchor_rank(ifx)
+
+            if rank and (not best_rank or rank < best_rank) then
+                anchor, best_rank = ifx, rank
+            end
+        end
+
+        if best_rank == 0 then
+            -- eq with different values never matches, not indexed
+        elseif anchor then
+            add_anchor(index, mut_i, anchor)
+        else
+            table.insert(index.rest, mut_i)
+        end
+    end
+
+    for _, node in pairs(index.paths) do
+        node.above = finish_range(node.above)
+        node.below = finish_range(node.below)
+    end
+
+    return index
+end
+
+local function append(candidates, list)
+    if list then
+        for _, mut_i in ipairs(list) do
+            table.insert(candidates, mut_i)
+        end
+    end
+end
+
+-- first position where threshold > from
+local function upper_bound(thresholds, from)
+    local lo, hi = 1, #thresholds + 1
+
+    while lo < hi do
+        local mid = (lo + hi) // 2
+
+        if thresholds[mid] <= from then
+            lo = mid + 1
+        else
+            hi = mid
+        end
+    end
+
+    return lo
+end
+
+-- first position where threshold >= from
+local function lower_bound(thresholds, from)
+    local lo, hi = 1, #thresholds + 1
+
+    while lo < hi do
+        local mid = (lo + hi) // 2
+
+        if thresholds[mid] < from then
+            lo = mid + 1
+        else
+            hi = mid
+        end
+    end
+
+    return lo
+end
+
+local function unwrap_cached(obj, path, cache)
+    local from = cache[path]
+
+    if from == nil then
+        from = unwrap(obj, compile_path(path))
+
+        if from == nil then
+            from = NIL
+        end
+
+        cache[path] = from
+    end
+
+    if from == NIL then
+        return nil
+    end
+
+    return from
+end
+
+local function verify(mut, obj, cache)
+    for _, ifx in ipairs(mut.ifs) do
+        local from = unwrap_cached(obj, ifx.path, cache)
+
+        if not ops[ifx.op](from, ifx.values) then
+            return false
+        end
+    end
+
+    return true
+end
+
+-- returns first matching mutator or nil
+local function match(index, obj)
+    local cache = {} -- path -> unwrapped value, each path read once
+    local candidates = {}
+
+    for path, node in pairs(index.paths) do
+        local from = unwrap_cached(obj, path, cache)
+
+        if keyable(from) then
+            append(candidates, node.eq[from])
+            append(candidates, node["in"][from])
+        end
+
+        if type(from) ~= "number" then
+            -- range ops are false
+        elseif from ~= from then -- NaN compares false, so ops pass it
+            append(candidates, node.above.muts)
+            append(candidates, node.below.muts)
+        else
+            local above, below = node.above, node.below
+            local muts = above.muts
+
+            for i = 1, upper_bound(above.thresholds, from) - 1 do
+                table.insert(candidates, muts[i])
+            end
+
+            muts = below.muts
+
+            for i = lower_bound(below.thresholds, from), #muts do
+                table.insert(candidates, muts[i])
+            end
+        end
+    end
+
+    append(candidates, index.rest)
+    table.sort(candidates)
+
+    local mutators = index.mutators
+
+    for _, mut_i in ipairs(candidates) do
+        local mut = mutators[mut_i]
+
+        if verify(mut, obj, cache) then
+            return mut
+        end
+    end
+end
+
+return {
+    build = build,
+    match = match,
+}
@@ -0,0 +1,464 @@
+local tensor = require "tensor"
+local to_set = require "to_set"
+local error_kv = require "error_kv"
+local ops = require "lib.world.ops"
+local compile_path = require "lib.world.compile_path"
+
+-- secondary indexes over world.objects:
+--   by_class[class_id] = { [obj] = true }, counts[class_id] = n
+--   opt-in per class key, declared in the schema:
+--     "index": "hash"    -- eq, in
+--     "index": "ordered" -- eq, gt, gte, lt, lte; int and float keys
+-- kept up to date by world create_object, save_object and set_key
+
+local proto = {}
+local mt = { __index = proto }
+
+local function keyable(value)
+    return value ~= nil and type(value) ~= "table" and value == value
+end
+
+-- class -> { { key, kind }, ... }, schemas do not change after link
+function proto:indexed_keys(class)
+    local keys = self.keys_cache[class]
+
+    if not keys then
+        keys = {}
+
+        for key, schema in pairs(class) do
+            if type(schema) == "table" and schema.index then
+                table.insert(keys, { key, schema.index })
+            end
+        end
+
+        self.keys_cache[class] = keys
+    end
+
+    return keys
+end
+
+function proto:field(class_id, key, kind)
+    local fields = self.fields[class_id]
+
+    if not fields then
+        fields = {}
+        self.fields[class_id] = fields
+    end
+
+    local field = fields[key]
+
+    if not field then
+        if kind == "hash" then
+            field = { kind = kind, map = {} } -- value -> { [obj] = true }
+        else
+            field = { kind = kind, values = {}, objs = {} } -- sorted by value
+        end
+
+        fields[key] = field
+    end
+
+    return field
+end
+
+-- first position where values[pos] >= value
+local function lower_bound(values, value)
+    local lo, hi = 1, #values + 1
+
+    while lo < hi do
+        local mid = (lo + hi) // 2
+
+        if values[mid] < value then
+            lo = mid + 1
+        else
+            hi = mid
+        end
+    end
+
+    return lo
+end
+
+-- first position where values[pos] > value
+local function upper_bound(values, value)
+    local lo, hi = 1, #values + 1
+
+    while lo < hi do
+        local mid = (lo + hi) // 2
+
+        if values[mid] <= value then
+            lo = mid + 1
+        else
+            hi = mid
+        end
+    end
+
+    return lo
+end
+
+-- bulk: ordered fields are appended and sorted once by finish_bulk
+local function field_add(field, obj, value, bulk)
+    if field.kind == "hash" then
+        local set = field.map[value]
+
+        if not set then
+            set = {}
+            field.map[value] = set
+        end
+
+        set[obj] = true
+    elseif bulk then
+        table.insert(field.values, value)
+        table.insert(field.objs, obj)
+    else
+        local pos = upper_bound(field.values, value)
+        table.insert(field.values, pos, value)
+        table.insert(field.objs, pos, obj)
+    end
+end
+
+local function field_remove(field, obj, value)
+    if field.kind == "hash" then
+        local set = field.map[value]
+        set[obj] = nil
+
+        if next(set) == nil then
+            field.map[value] = nil
+        end
+    else
+        local values, objs = field.values, field.objs
+
+        for pos = lower_bound(values, value), upper_bound(values, value) - 1 do
+            if objs[pos] == obj then
+                table.remove(values, pos)
+                table.remove(objs, pos)
+                return
+            end
+        end
+    end
+end
+
+local function indexable(kind, value)
+    if kind == "hash" then
+        return keyable(value)
+    end
+
+    return type(value) == "number" and value == value
+end
+
+function proto:add(obj, bulk)
+    local class = obj.class
+    local class_id = class.id
+    local by_class = self.by_class[class_id]
+
+    if not by_class then
+        by_class = {}
+        self.by_class[class_id] = by_class
+    end
+
+    if by_class[obj] then
+        return self:update(obj)
+    end
+
+    by_class[obj] = true
+    self.counts[class_id] = (self.counts[class_id] or 0) + 1
+    self.objects_n = self.objects_n + 1
+
+    local entry = {} -- key -> indexed value, to remove after the object changes
+
+    for _, item in ipairs(self:indexed_keys(class)) do
+        local key, kind = item[1], item[2]
+        local value = obj[key]
+
+        if indexable(kind, value) then
+            field_add(self:field(class_id, key, kind), obj, value, bulk)
+            entry[key] = value
+        end
+    end
+
+    self.entries[obj] = entry
+end
+
+local function by_value(a, b)
+    return a[1] < b[1]
+end
+
+function proto:finish_bulk()
+    for _, fields in pairs(self.fields) do
+        for _, field in pairs(fields) do
+            if field.kind == "ordered" then
+                local values, objs = field.values, field.objs
+                local sorted = {}
+
+                for i, value in ipairs(values) do
+                    sorted[i] = { value, objs[i] }
+                end
+
+                table.sort(sorted, by_value)
+
+                for i, pair in ipairs(sorted) do
+                    values[i], objs[i] = pair[1], pair[2]
+                end
+            end
+        end
+    end
+end
+
+function proto:remove(obj)
+    local class_id = obj.class.id
+    local by_class = self.by_class[class_id]
+
+    if not (by_class and by_class[obj]) then
+        return
+    end
+
+    by_class[obj] = nil
+    self.counts[class_id] = self.counts[class_id] - 1
+    self.objects_n = self.objects_n - 1
+
+    local fields = self.fields[class_id]
+
+    for key, value in pairs(self.entries[obj]) do
+        field_remove(fields[key], obj, value)
+    end
+
+    self.entries[obj] = nil
+end
+
+-- keys: { key1, ... } to reindex only these, all indexed keys if nil
+function proto:update(obj, keys)
+    local entry = self.entries[obj]
+
+    if not entry then
+        return self:add(obj)
+    end
+
+    local class = obj.class
+    local class_id = class.id
+
+    if keys then
+        keys = to_set(keys)
+    end
+
+    for _, item in ipairs(self:indexed_keys(class)) do
+        local key, kind = item[1], item[2]
+        local old, value = entry[key], obj[key]
+
+        if old ~= value and (not keys or keys[key]) then
+            local field = self:field(class_id, key, kind)
+
+            if old ~= nil then
+                field_remove(field, obj, old)
+                entry[key] = nil
+            end
+
+            if indexable(kind, value) then
+                field_add(field, obj, value)
+                entry[key] = value
+            end
+        end
+    end
+end
+
+local function append_set(candidates, set)
+    if set then
+        for obj in pairs(set) do
+            table.insert(candidates, obj)
+        end
+    end
+end
+
+local function append_range(candidates, field, first, last)
+    local objs = field.objs
+
+    for pos = first, last do
+        table.insert(candidates, objs[pos])
+    end
+end
+
+-- range of ordered field positions matching the filter, nil if unusable
+local function ordered_range(field, op, values)
+    local bound
+
+    for _, value in ipairs(values) do
+        if type(value) ~= "number" or value ~= value then
+            return
+        end
+
+        if not bound then
+            bound = value
+        elseif op == "eq" and value ~= bound then
+            return 1, 0 -- different values never match
+        elseif (op == "gt" or op == "gte") and value > bound then
+            bound = value
+        elseif (op == "lt" or op == "lte") and value < bound then
+            bound = value
+        end
+    end
+
+    if not bound then
+        return
+    end
+
+    local sorted = field.values
+
+    if op == "eq" then
+        return lower_bound(sorted, bound), upper_bound(sorted, bound) - 1
+    elseif op == "gt" then
+        return upper_bound(sorted, bound), #sorted
+    elseif op == "gte" then
+        return lower_bound(sorted, bound), #sorted
+    elseif op == "lt" then
+        return 1, lower_bound(sorted, bound) - 1
+    elseif op == "lte" then
+        return 1, upper_bound(sorted, bound) - 1
+    end
+end
+
+-- candidates from the usable index with the fewest of them, nil if none
+function proto:plan(class_id, filters)
+    local fields = self.fields[class_id]
+
+    if not fields then
+        return
+    end
+
+    local best, best_n
+
+    for _, filter in ipairs(filters) do
+        local field = fields[filter.path]
+        local op, values = filter.op, filter.values
+        local pick
+
+        if not field or #values == 0 then
+            -- not indexed, or empty eq/in/range which ops treat specially
+        elseif field.kind == "hash" and (op == "eq" or op == "in") then
+            local keys = op == "eq" and { values[1] } or values
+            local n = 0
+
+            if op == "eq" then
+                for i = 2, #values do
+                    if values[i] ~= values[1] then
+                        keys = {} -- different values never match
+                    end
+                end
+            end
+
+            for _, key in ipairs(keys) do
+                local set = keyable(key) and field.map[key]
+
+                if set then
+                    for _ in pairs(set) do
+                        n = n + 1
+                    end
+                end
+            end
+
+            pick = { n = n, hash = field, keys = keys }
+        elseif field.kind == "ordered" then
+            local first, last = ordered_range(field, op, values)
+
+            if first then
+                pick = {
+                    n = math.max(0, last - first + 1),
+                    ordered = field,
+                    first = first,
+                    last = last,
+                }
+            end
+        end
+
+        if pick and (not best_n or pick.n < best_n) then
+            best, best_n = pick, pick.n
+        end
+    end
+
+    if not best then
+        return
+    end
+
+    local candidates = {}
+
+    if best.hash then
+        for _, key in ipairs(best.keys) do
+            append_set(candidates, keyable(key) and best.hash.map[key])
+        end
+    else
+        append_range(candidates, best.ordered, best.first, best.last)
+    end
+
+    return candidates
+end
+
+-- query(class_id, { { path = "age", op = "gte", values = { 18 } }, ... })
+-- ops semantics, "in" values are an array; returns array of objects
+function proto:query(class_id, filters)
+    filters = filters or {}
+
+    local checks = {}
+
+    for i, filter in ipairs(filters) do
+        local op, values = filter.op, filter.values
+
+        if not ops[op] or type(values) ~= "table" then
+            error_kv("bad query filter", {
+                class_id = class_id,
+                filter = filter,
+            })
+        end
+
+        checks[i] = {
+            path = compile_path(filter.path),
+            op = ops[op],
+            values = op == "in" and to_set(values) or values,
+        }
+    end
+
+    local candidates = self:plan(class_id, filters)
+
+    if not candidates then
+        candidates = {}
+        append_set(candidates, self.by_class[class_id])
+    end
+
+    local found = {}
+    local unwrap = tensor.unwrap
+
+    for _, obj in ipairs(candidates) do
+        local ok = true
+
+        for _, check in ipairs(checks) do
+            if not check.op(unwrap(obj, check.path), check.values) then
+                ok = false
+                break
+            end
+        end
+
+        if ok then
+            table.insert(found, obj)
+        end
+    end
+
+    return found
+end
+
+function proto:count(class_id)
+    return self.counts[class_id] or 0
+end
+
+return function(objects)
+    local index = setmetatable({
+        by_class = {},
+        counts = {},
+        objects_n = 0,
+        fields = {}, -- fields[class_id][key] = hash or ordered field
+        entries = {}, -- entries[obj] = { key = indexed value }
+        keys_cache = setmetatable({}, { __mode = "k" }),
+    }, mt)
+
+    for _, obj in pairs(objects or {}) do
+        index:add(obj, true)
+    end
+
+    index:finish_bulk()
+
+    return index
+end
@@ -1,6 +1,29 @@
 local equal = require "equal"
 
+local valueset = equal.valueset
+
+-- if values are fixed once linked; a table "from" is checked against
+-- a valueset of them, built on first use, instead of equal() per value
+local value_sets = setmetatable({}, { __mode = "k" })
+local key_sets = setmetatable({}, { __mode = "k" })
+
+local function value_set(values)
+    local set = value_sets[values]
+
+    if not set then
+        set = valueset(values)
+        value_sets[values] = set
+    end
+
+    return set
+end
+
 local function eq(from, to)
+    if type(from) == "table" then
+        local set = value_set(to)
+        return #set == 0 or (#set == 1 and set:has(from))
+    end
+
     for _, value in ipairs(to) do
         if not equal(from, value) then
             return false
@@ -11,6 +34,10 @@ local function eq(from, to)
 end
 
 local function neq(from, to)
+    if type(from) == "table" then
+        return not value_set(to):has(from)
+    end
+
     for _, value in ipairs(to) do
         if equal(from, value) then
             return false
@@ -78,7 +105,23 @@ end
 
 local function inside(from, to)
     -- link_object converts "to" to set
-    return not not to[from]
+    if type(from) ~= "table" then
+        return not not to[from]
+    end
+
+    local set = key_sets[to]
+
+    if not set then
+        set = valueset()
+
+        for value in pairs(to) do
+            set:add(value)
+        end
+
+        key_sets[to] = set
+    end
+
+    return set:has(from)
 end
 
 return {
@@ -4,46 +4,163 @@ package.path = "/furiend/src/lua-lib/?.lua;/furiend/src/dc/?.lua"
 package.cpath = "/furiend/src/lua-clib/?/?.so"
 
 local async = require "async"
-local loop, wait = async.loop, async.wait
+local loop, wait, pwait = async.loop, async.wait, async.pwait
 local redis = require "redis"
 local log = require "log"
 local time = require "time"
 local json = require "json"
 local logic = require "lib.logic"
 local world = require "lib.world"
+local stream_consumer = require "stream_consumer"
+local evlog = require "evlog"
+local sleep = require "sleep"
+local promise = require "promise"
+local replay = require "lib.replay"
+local tensor = require "tensor"
+local event_codec = require "event_codec"
 
 local config = require "config"
 
 loop(function()
     log("started")
 
-    local rc = redis.client(config.redis)
+    if not config.node then -- pid based default is the same in containers
+        error("config.node is required: 0 .. 1023, unique per process")
+    end
 
-    wait(rc:connect())
-    log("connected to redis", config.redis.ip4, config.redis.port)
+    tensor.id_node(config.node)
+
+    local rc = redis.pool(config.redis)
 
-    wait(rc:hello(config.redis))
-    log("redis authorized", config.redis.client_name)
+    wait(rc:connect())
+    log("connected to redis", config.redis.ip4, config.redis.port,
+        config.redis.client_name, config.redis.size)
 
     local dc = {
         cmd_ids = {},
         config = config,
         rc = rc,
+        codec = event_codec(config.compress),
         world = world {
             rc = rc,
+            snapshot = config.snapshot,
+            columnar = config.columnar,
         },
     }
 
     log("world loaded", dc.world:stat())
 
-    wait(rc:subscribe(config.id, function(push)
-        local event = json.parse(push)
+    local evlog_conf = config.evlog
+
+    if evlog_conf then
+        if evlog_conf.replay then -- recovery: events are not logged twice
+            log("events replayed", replay(dc, evlog_conf.path))
+        end
+
+        dc.evlog = evlog.open(evlog_conf.path, evlog_conf.batch)
+
+        if config.snapshot then -- a snapshot covers all logged events
+            dc.world.on_snapshot = function()
+                log("events checkpointed", dc.evlog:truncate())
+            end
+
+            if evlog_conf.replay then -- not replayed again on next start
+                dc.world:write_snapshot(time())
+            end
+        else
+            log("evlog is not checkpointed without snapshot", evlog_conf.path)
+        end
+
+        promise(function() -- bounds loss of a partial batch on crash
+            while true do
+                wait(sleep(evlog_conf.flush_interval or 1))
+                dc.evlog:flush()
+            end
+        end)
+    end
+
+    local function on_push(push)
+        local event = json.parse(dc.codec:unpack(push))
         event.time = time()
+
+        if dc.evlog then
+            dc.evlog:append(json.stringify(event))
+        end
+
         logic(dc, event)
-    end))
+    end
+
+    local push_conf = config.redis.push
+
+    if push_conf and push_conf.batch and push_conf.batch > 0 then
+        wait(rc:subscribe(config.id, function(batch)
+            for _, push in ipairs(batch) do -- one bad event keeps the rest
+                local ok, err = pcall(on_push, push)
+
+                if not ok then
+                    log("push error", err, push)
+                end
+            end
+        end))
+    else
+        wait(rc:subscribe(config.id, on_push))
+    end
 
     log("redis subscribed", config.id)
 
+    if config.stream then -- durable events, XREADGROUP holds own connection
+        local sc = redis.client(config.redis)
+
+        dc.stream_rc = sc
+
+        wait(sc:connect())
+        wait(sc:hello(config.redis))
+
+        local function on_entry(_, fields)
+            on_push(fields.event)
+        end
+
+        promise(function() -- consumer retries redis errors, this sees bugs
+            while true do
+                local consumer = stream_consumer(sc, config.stream, on_entry)
+
+                log("redis stream consumer", config.stream.stream,
+                    config.stream.group)
+
+                log("redis stream consumer stopped", pwait(consumer))
+
+                if sc:stat().closed then -- shutdown
+                    break
+                end
+
+                wait(sleep(1))
+            end
+        end)
+    end
+
+    promise(function() -- shutdown: stop intake, then write what is left
+        log("shutdown", wait(async.signal("INT", "TERM")))
+
+        pwait(rc:unsubscribe(config.id))
+
+        if dc.stream_rc then
+            dc.stream_rc:close()
+        end
+
+        log("world closed", pcall(dc.world.close, dc.world))
+
+        if config.snapshot then -- clean stop: nothing to replay
+            log("world snapshot", pcall(dc.world.write_snapshot, dc.world,
+                time()))
+        end
+
+        if dc.evlog then
+            dc.evlog:close()
+        end
+
+        rc:close() -- join returns
+    end)
+
     logic(dc, {
         type = "start",
         from = config.id,
@@ -1,9 +1,14 @@
 return {
     id = "fe1",
     dc = "dc",
+    dc_stream = { stream = "dc:events", maxlen = 100000 },
+    -- compress = { min_len = 64 }, -- pack published events, see event_codec
     redis = {
         ip4 = "172.20.0.3",
         port = 30303,
+        size = 4,
+        timeout = 5,
+        reconnect = { min_delay = 0.05, max_delay = 2 },
         password = "LocalPassword123",
         client_name = "fe1",
     },
@@ -12,5 +17,6 @@ return {
         ip4_docker = "0.0.0.0",
         port = 18001,
         static = "/furiend/src/fe1/static",
+        -- static_max_bytes = 16777216, -- fs.cache, bigger files are not cached
     },
 }
@@ -1,22 +1,49 @@
-local fs = require "fs"
 local redis = require "redis"
 local async = require "async"
-local wait = async.wait
+local wait, pwait = async.wait, async.pwait
 local json_response = require "lib.json_response"
 local load_entities = require "world.load_entities"
 local types = require "world.types"
 local key_prefix = require "world.key_prefix"
+local changes = require "world.changes"
+
+-- mutations and the change marks dc catches up its world snapshot by,
+-- in one MULTI/EXEC round trip: a mark can't be lost after its mutation;
+-- queries are sent without yielding, so they stay contiguous on the
+-- member picked by the first marked key
+local function exec_marked(rc, mutations, marked_keys)
+    local route = marked_keys[1]
+    local queued = { rc:query(redis:pack { "multi" }, route) }
+
+    for _, mutation in ipairs(mutations) do
+        table.insert(queued, rc:query(redis:pack(mutation), route))
+    end
+
+    for _, key in ipairs(marked_keys) do
+        table.insert(queued, rc:query(changes.mark(key), route))
+    end
+
+    local exec = rc:query(redis:pack { "exec" }, route)
+
+    for _, query in ipairs(queued) do
+        pwait(query) -- a queueing error aborts exec, raised below
+    end
+
+    for _, result in ipairs(wait(exec)) do
+        if type(result) == "string" and result ~= "OK" then -- nested error
+            error(result)
+        end
+    end
+end
 
 local function cmd_delete_key(req, res, mode)
     local session = req.session
     local rc, dc, body = session.rc, session.dc, session.parsed_body
     local id, key = tostring(body.id), tostring(body.key)
 
-    wait(rc:query(redis:pack {
-        "hdel",
-        key_prefix[mode] .. id,
-        key,
-    }))
+    exec_marked(rc, {
+        { "hdel", key_prefix[mode] .. id, key },
+    }, { key_prefix[mode] .. id })
 
     dc("delete_key", {
         mode = mode,
@@ -32,10 +59,9 @@ local function cmd_delete_entity(req, res, mode)
     local rc, dc, body = session.rc, session.dc, session.parsed_body
     local id = tostring(body.id)
 
-    wait(rc:query(redis:pack {
-        "del",
-        key_prefix[mode] .. id,
-    }))
+    exec_marked(rc, {
+        { "del", key_prefix[mode] .. id },
+    }, { key_prefix[mode] .. id })
 
     dc("delete_entity", {
         mode = mode,
@@ -62,7 +88,7 @@ local function cmd_create_entity(req, res, mode)
         end
     end
 
-    wait(rc:query(redis:pack(query)))
+    exec_marked(rc, { query }, { key_prefix[mode] .. id })
 
     dc("create_entity", {
         mode = mode,
@@ -77,11 +103,9 @@ local function cmd_rename_entity(req, res, mode)
     local rc, dc, body = session.rc, session.dc, session.parsed_body
     local old_id, new_id = tostring(body.id), tostring(body.value)
 
-    wait(rc:query(redis:pack {
-        "rename",
-        key_prefix[mode] .. old_id,
-        key_prefix[mode] .. new_id,
-    }))
+    exec_marked(rc, {
+        { "rename", key_prefix[mode] .. old_id, key_prefix[mode] .. new_id },
+    }, { key_prefix[mode] .. old_id, key_prefix[mode] .. new_id })
 
     dc("rename_entity", {
         mode = mode,
@@ -109,12 +133,15 @@ local function cmd_set_key(req, res, mode)
         return cmd_rename_entity(req, res, mode)
     end
 
-    wait(rc:query(redis:pack {
-        "hset",
-        key_prefix[mode] .. id,
-        new_key,
-        value,
-    }))
+    local mutations = {
+        { "hset", key_prefix[mode] .. id, new_key, value },
+    }
+
+    if key ~= new_key then
+        table.insert(mutations, { "hdel", key_prefix[mode] .. id, key })
+    end
+
+    exec_marked(rc, mutations, { key_prefix[mode] .. id })
 
     dc("set_key", {
         mode = mode,
@@ -124,12 +151,6 @@ local function cmd_set_key(req, res, mode)
     })
 
     if key ~= new_key then
-        wait(rc:query(redis:pack {
-            "hdel",
-            key_prefix[mode] .. id,
-            key,
-        }))
-
         dc("delete_key", {
             reason = "rename",
             mode = mode,
@@ -156,27 +177,27 @@ end
 
 local function serve_html(req, res, path)
     res:push_header("Content-Type", "text/html")
-    res:set_body(fs.readfile(req.session.static .. path))
+    res:set_body(req.session.static:readfile(path))
 end
 
 local function serve_svg(req, res, path)
     res:push_header("Content-Type", "image/svg+xml")
-    res:set_body(fs.readfile(req.session.static .. path))
+    res:set_body(req.session.static:readfile(path))
 end
 
 local function serve_css(req, res, path)
     res:push_header("Content-Type", "text/css")
-    res:set_body(fs.readfile(req.session.static .. path))
+    res:set_body(req.session.static:readfile(path))
 end
 
 local function serve_js(req, res, path)
     res:push_header("Content-Type", "text/javascript")
-    res:set_body(fs.readfile(req.session.static .. path))
+    res:set_body(req.session.static:readfile(path))
 end
 
 local function serve_woff2(req, res, path)
     res:push_header("Content-Type", "font/woff2")
-    res:set_body(fs.readfile(req.session.static .. path))
+    res:set_body(req.session.static:readfile(path))
 end
 
 return function(req, res)
@@ -8,9 +8,11 @@ local async = require "async"
 local loop, wait = async.loop, async.wait
 local redis = require "redis"
 local http = require "http"
+local fs = require "fs"
 local log = require "log"
 local json = require "json"
 local waitall = require "waitall"
+local event_codec = require "event_codec"
 local json_response = require "lib.json_response"
 local serve_content = require "lib.serve_content"
 
@@ -20,7 +22,8 @@ local in_docker = os.getenv("IN_DOCKER")
 loop(function()
     log("env", in_docker and "in docker" or "not in docker")
 
-    local rc -- redis client
+    local rc -- redis pool
+    local codec = event_codec(config.compress)
 
     local dc = function(type, payload)
         local event = {
@@ -29,18 +32,24 @@ loop(function()
             payload = payload,
         }
 
-        wait(rc:publish(config.dc, json.stringify(event)))
+        local msg = codec:pack(json.stringify(event))
+
+        if config.dc_stream then
+            wait(rc:xadd(config.dc_stream.stream, {
+                event = msg,
+            }, config.dc_stream.maxlen))
+        else
+            wait(rc:publish(config.dc, msg))
+        end
     end
 
     -- redis
 
-    rc = redis.client(config.redis)
+    rc = redis.pool(config.redis)
 
     wait(rc:connect())
-    log("connected to redis", config.redis.ip4, config.redis.port)
-
-    wait(rc:hello(config.redis))
-    log("redis authorized", config.redis.client_name)
+    log("connected to redis", config.redis.ip4, config.redis.port,
+        config.redis.client_name, config.redis.size)
 
     dc "start"
 
@@ -54,11 +63,16 @@ loop(function()
 
     local server = http.server(serv_conf)
 
+    local static = fs.cache {
+        dir = serv_conf.static,
+        max_bytes = serv_conf.static_max_bytes,
+    }
+
     server:on_request(function(req, res)
         req.session = {
             rc = rc,
             dc = dc,
-            static = serv_conf.static,
+            static = static,
         }
 
         local body = req.body
@@ -1,6 +1,8 @@
 return {
     id = "fe2",
     dc = "dc",
+    dc_stream = { stream = "dc:events", maxlen = 100000 },
+    -- compress = { min_len = 64 }, -- pack published events, see event_codec
     redis = {
         ip4 = "172.20.0.3",
         port = 30303,
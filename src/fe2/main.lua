@@ -10,6 +10,7 @@ local log = require "log"
 local json = require "json"
 local dns = require "dns"
 local waitall = require "waitall"
+local event_codec = require "event_codec"
 local tgbot = require "telegram_bot"
 local tgwh = require "telegram_bot_webhook"
 local is_dc_cmd = require "lib.is_dc_cmd"
@@ -24,6 +25,7 @@ loop(function()
     local rc -- redis client
     local tg -- telegram bot api
     local wh -- telegram bot web hook
+    local codec = event_codec(config.compress)
 
     local dc = function(type, payload)
         local event = {
@@ -32,7 +34,15 @@ loop(function()
             payload = payload,
         }
 
-        wait(rc:publish(config.dc, json.stringify(event)))
+        local msg = codec:pack(json.stringify(event))
+
+        if config.dc_stream then
+            wait(rc:xadd(config.dc_stream.stream, {
+                event = msg,
+            }, config.dc_stream.maxlen))
+        else
+            wait(rc:publish(config.dc, msg))
+        end
     end
 
     local on_push = function(push)
@@ -46,7 +56,7 @@ loop(function()
     end
 
     local on_push_safe = function(push)
-        push = json.parse(push)
+        push = json.parse(codec:unpack(push))
         local ok, errmsg = pcall(on_push, push)
 
         if not ok then
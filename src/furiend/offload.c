@@ -0,0 +1,274 @@
+#include "offload.h"
+
+static int offload_gc(lua_State *L);
+static void *offload_worker(void *arg);
+static int offload_watch_start(lua_State *L);
+static int offload_watch_continue(lua_State *L, int status, lua_KContext ctx);
+static void offload_queue_push(luaF_job_queue *queue, luaF_job *job);
+
+// pool threads run jobs, the loop resumes waiting threads on the eventfd
+void luaF_offload_start(lua_State *L, int threads_n) {
+    if (unlikely(threads_n < 1 || threads_n > F_OFFLOAD_MAX_THREADS)) {
+        luaL_error(L, "offload: threads must be 1..%d: %d",
+            F_OFFLOAD_MAX_THREADS, threads_n);
+    }
+
+    if (unlikely(luaF_offload_pool(L) != NULL)) {
+        luaL_error(L, "offload: pool is already started");
+    }
+
+    int type = lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP);
+    lua_pop(L, 1); // lua_rawgeti
+
+    if (unlikely(type == LUA_TNIL)) {
+        luaL_error(L, "offload: loop is not running");
+    }
+
+    ud_offload *pool = luaF_new_ud_or_error(L,
+        sizeof(ud_offload), F_OFFLOAD_UV_N);
+
+    int pool_idx = lua_gettop(L);
+
+    memset(pool, 0, sizeof(ud_offload));
+    pool->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (unlikely(pool->efd < 0)) {
+        luaF_error_errno(L, "offload: eventfd failed; flags: %d",
+            EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    if (likely(luaL_newmetatable(L, F_MT_OFFLOAD))) {
+        lua_pushcfunction(L, offload_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, pool_idx);
+
+    lua_createtable(L, 0, 8);
+    lua_setiuservalue(L, pool_idx, F_OFFLOAD_UV_IDX_WAITERS);
+
+    for (int i = 0; i < threads_n; i++) {
+        int status = pthread_create(&pool->threads[i], NULL,
+            offload_worker, pool);
+
+        if (unlikely(status != 0)) {
+            errno = status;
+            luaF_error_errno(L, "offload: pthread_create failed; thread: %d",
+                i + 1); // gc joins the started ones
+        }
+
+        pool->threads_n++;
+    }
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, offload_watch_start);
+    lua_pushvalue(L, pool_idx);
+    lua_xmove(L, T, 1); // pool >> T
+
+    int status = lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    if (unlikely(status != LUA_YIELD)) {
+        luaL_error(L, "offload: watch failed; %s", lua_tostring(T, -1));
+    }
+
+    lua_pushvalue(L, pool_idx);
+    lua_rawseti(L, LUA_REGISTRYINDEX, F_RIDX_OFFLOAD);
+
+    lua_settop(L, pool_idx - 1);
+}
+
+// NULL if no pool was started yet
+ud_offload *luaF_offload_pool(lua_State *L) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_OFFLOAD);
+    ud_offload *pool = luaL_testudata(L, -1, F_MT_OFFLOAD);
+    lua_pop(L, 1); // lua_rawgeti
+
+    return pool;
+}
+
+// queues the job and yields L, k is called on the loop when job is done,
+// ctx of k is the job; the job and its inputs must be on the L stack
+int luaF_offload(lua_State *L, luaF_job *job, lua_KFunction k) {
+    if (unlikely(!lua_isyieldable(L))) {
+        luaL_error(L, "offload: current thread is not yieldable: %p",
+            (void *)L);
+    }
+
+    ud_offload *pool = luaF_offload_pool(L);
+
+    if (unlikely(pool == NULL)) {
+        luaF_offload_start(L, F_OFFLOAD_DEFAULT_THREADS);
+        pool = luaF_offload_pool(L);
+    }
+
+    luaL_checkstack(L, 3, "offload");
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_OFFLOAD);
+    lua_getiuservalue(L, -1, F_OFFLOAD_UV_IDX_WAITERS);
+    lua_pushthread(L);
+    lua_rawsetp(L, -2, job); // waiters[job] = L
+    lua_pop(L, 2); // lua_rawgeti, lua_getiuservalue
+
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    offload_queue_push(&pool->queued, job);
+    pool->queued_n++;
+    pool->submitted_n++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return lua_yieldk(L, 0, (lua_KContext)job, k);
+}
+
+// queued jobs are dropped, running ones are waited for
+static int offload_gc(lua_State *L) {
+    ud_offload *pool = luaL_checkudata(L, 1, F_MT_OFFLOAD);
+
+    if (pool->efd < 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threads_n; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pool->threads_n = 0;
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+
+    luaF_close_or_warning(L, pool->efd);
+    pool->efd = -1;
+
+    return 0;
+}
+
+static void *offload_worker(void *arg) {
+    ud_offload *pool = arg;
+    uint64_t one = 1;
+    sigset_t all;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL); // loop thread handles signals
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        while (!pool->stop && pool->queued.head == NULL) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+
+        if (unlikely(pool->stop)) {
+            break;
+        }
+
+        luaF_job *job = pool->queued.head;
+
+        pool->queued.head = job->next;
+        pool->queued_n--;
+        pool->running_n++;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        job->run(job);
+
+        pthread_mutex_lock(&pool->lock);
+
+        job->next = NULL;
+        offload_queue_push(&pool->done, job);
+        pool->running_n--;
+
+        // counter write never blocks before 2^64 - 2 unread jobs
+        if (unlikely(write(pool->efd, &one, sizeof(one)) < 0)) {
+            break; // efd is gone, the state is closing
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int offload_watch_start(lua_State *L) {
+    ud_offload *pool = lua_touserdata(L, F_OFFLOAD_IDX);
+
+    luaF_loop_watch(L, pool->efd, EPOLLIN, 0);
+
+    lua_settop(L, F_OFFLOAD_IDX);
+    return lua_yieldk(L, 0, 0, offload_watch_continue);
+}
+
+static int offload_watch_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)ctx;
+    (void)status;
+
+    luaF_loop_check_close(L);
+
+    ud_offload *pool = lua_touserdata(L, F_OFFLOAD_IDX);
+    int emask = lua_tointeger(L, F_LOOP_EMASK_REL_IDX);
+
+    if (unlikely(emask_has_errors(emask))) {
+        luaL_error(L, "offload: watch failed; fd: %d; %s",
+            pool->efd, emask_error_label(emask));
+    }
+
+    uint64_t done_n;
+
+    if (unlikely(read(pool->efd, &done_n, sizeof(done_n)) < 0)) {
+        if (unlikely(errno != EAGAIN && errno != EWOULDBLOCK)) {
+            luaF_error_errno(L, "offload: eventfd read failed; fd: %d",
+                pool->efd);
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    luaF_job *job = pool->done.head;
+    pool->done.head = NULL;
+    pool->done.tail = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    lua_settop(L, F_OFFLOAD_IDX);
+    lua_getiuservalue(L, F_OFFLOAD_IDX, F_OFFLOAD_UV_IDX_WAITERS);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_T_SUBS);
+
+    int waiters_idx = F_OFFLOAD_IDX + 1;
+    int t_subs_idx = F_OFFLOAD_IDX + 2;
+
+    while (job != NULL) {
+        luaF_job *next = job->next; // job can be collected after resume
+
+        pool->completed_n++;
+
+        lua_rawgetp(L, waiters_idx, job);
+        lua_pushnil(L);
+        lua_rawsetp(L, waiters_idx, job);
+
+        luaF_resume(L, t_subs_idx, lua_tothread(L, -1), -1, 0);
+
+        lua_settop(L, t_subs_idx);
+        job = next;
+    }
+
+    lua_settop(L, F_OFFLOAD_IDX);
+    return lua_yieldk(L, 0, 0, offload_watch_continue);
+}
+
+static void offload_queue_push(luaF_job_queue *queue, luaF_job *job) {
+    if (queue->head == NULL) {
+        queue->head = job;
+    } else {
+        queue->tail->next = job;
+    }
+
+    queue->tail = job;
+}
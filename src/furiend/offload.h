@@ -0,0 +1,56 @@
+#ifndef FURIEND_OFFLOAD_H
+#define FURIEND_OFFLOAD_H
+
+#include "shared.h"
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#define F_MT_OFFLOAD "offload*"
+
+#define F_OFFLOAD_DEFAULT_THREADS 4
+#define F_OFFLOAD_MAX_THREADS 64
+
+#define F_OFFLOAD_UV_IDX_WAITERS 1 // waiters[job lightuserdata] = thread
+#define F_OFFLOAD_UV_N 1
+
+#define F_OFFLOAD_IDX 1 // in the completion thread
+
+typedef struct luaF_job luaF_job;
+
+// runs on a pool thread: no lua calls, inputs stay pinned by the
+// waiting thread stack until the job is done
+typedef void (*luaF_job_fn)(luaF_job *job);
+
+// first member of module job structs
+struct luaF_job {
+    luaF_job_fn run;
+    luaF_job *next;
+};
+
+typedef struct {
+    luaF_job *head;
+    luaF_job *tail;
+} luaF_job_queue;
+
+// one per lua state, in the registry, shared by all modules
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // jobs queued or stop
+    pthread_t threads[F_OFFLOAD_MAX_THREADS];
+    int threads_n;
+    int efd; // eventfd, wakes the loop when jobs are done
+    int stop;
+    luaF_job_queue queued;
+    luaF_job_queue done;
+    lua_Integer queued_n;
+    lua_Integer running_n;
+    lua_Integer submitted_n;
+    lua_Integer completed_n;
+} ud_offload;
+
+void luaF_offload_start(lua_State *L, int threads_n);
+ud_offload *luaF_offload_pool(lua_State *L);
+int luaF_offload(lua_State *L, luaF_job *job, lua_KFunction k);
+
+#endif
@@ -260,7 +260,7 @@ void luaF_need_args(lua_State *L, int need_args_n, const char *label) {
 void luaF_min_max_args(lua_State *L, int min, int max, const char *label) {
     int args_n = lua_gettop(L);
 
-    if (unlikely(args_n < min && args_n > max)) {
+    if (unlikely(args_n < min || args_n > max)) {
         luaL_error(L, "%s: min args: %d; max args: %d; provided: %d",
             label, min, max, lua_gettop(L));
     }
@@ -563,20 +563,90 @@ const char *luaF_escape_string(
 
 // type must be already LUA_TTABLE
 int luaF_is_array(lua_State *L, int index) {
-    int next_idx = 1;
+    lua_Integer len;
+
+    if (luaF_table_kind(L, index, &len) != F_TABLE_ARRAY) {
+        return 0;
+    }
+
+    return len; // return array len, 0 - not array
+}
+
+// type must be already LUA_TTABLE
+// array: keys are exactly 1 .. lua_rawlen, len is set to it
+// map: any other key, found on the first one, so len is not set
+// F_TABLE_HINT metafield "array" or "object" skips the check;
+// a hinted array may have holes, they are nil
+int luaF_table_kind(lua_State *L, int index, lua_Integer *len) {
+    index = lua_absindex(L, index);
+
+    lua_Integer border = lua_rawlen(L, index);
+
+    if (unlikely(luaL_getmetafield(L, index, F_TABLE_HINT) != LUA_TNIL)) {
+        const char *hint = lua_tostring(L, -1);
+        lua_pop(L, 1); // luaL_getmetafield
+
+        if (hint && strcmp(hint, "array") == 0) {
+            *len = border;
+            return F_TABLE_ARRAY;
+        } else if (hint && strcmp(hint, "object") == 0) {
+            return F_TABLE_MAP;
+        }
+    }
+
+    lua_Integer keys_n = 0;
 
     lua_pushnil(L);
     while (lua_next(L, index)) {
-        if (!lua_isinteger(L, -2) || lua_tointeger(L, -2) != next_idx) {
-            lua_pop(L, 2); // lua_next (key, value)
+        lua_pop(L, 1); // lua_next (value)
+
+        if (!lua_isinteger(L, -1)) {
+            lua_pop(L, 1); // lua_next (key)
+            return F_TABLE_MAP;
+        }
+
+        lua_Integer key = lua_tointeger(L, -1);
+
+        if (key < 1 || key > border) {
+            lua_pop(L, 1); // lua_next (key)
+            return F_TABLE_MAP;
+        }
+
+        keys_n++;
+    }
+
+    if (keys_n == 0) {
+        *len = 0;
+        return F_TABLE_EMPTY;
+    }
+
+    if (keys_n != border) {
+        return F_TABLE_MAP; // holes
+    }
+
+    *len = border;
+    return F_TABLE_ARRAY;
+}
+
+// 1 - entered, 0 - ptr is already on the path (cycle), -1 - too deep
+// a table met again on another branch is not a cycle
+int luaF_visit(luaF_visited *visited, const void *ptr) {
+    for (int i = visited->n - 1; i >= 0; i--) {
+        if (visited->ptrs[i] == ptr) {
             return 0;
         }
+    }
 
-        next_idx++;
-        lua_pop(L, 1); // lua_next (value)
+    if (unlikely(visited->n == F_VISITED_MAX)) {
+        return -1;
     }
 
-    return next_idx - 1; // return array len, 0 - not array
+    visited->ptrs[visited->n++] = ptr;
+    return 1;
+}
+
+void luaF_unvisit(luaF_visited *visited) {
+    visited->n--;
 }
 
 void *luaF_malloc_or_error(lua_State *L, size_t size) {
@@ -614,3 +684,65 @@ int luaF_resume(
 
     return t_status;
 }
+
+// L waits for thread at t_idx to finish, then k is called with:
+// ..., thread, status, results or err msg
+// stack above t_idx is dropped
+int luaF_loop_wait(
+    lua_State *L,
+    int t_idx,
+    lua_KContext ctx,
+    lua_KFunction k
+) {
+    t_idx = lua_absindex(L, t_idx);
+    lua_settop(L, t_idx);
+
+    lua_State *T = lua_tothread(L, t_idx);
+
+    if (unlikely(T == NULL)) {
+        luaL_error(L, "loop wait: not a thread: %s", luaL_typename(L, t_idx));
+    }
+
+    int t_status = lua_status(T);
+
+    if (likely(t_status == LUA_YIELD)) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_T_SUBS); // t_subs
+        lua_pushvalue(L, t_idx); // t_subs, T
+
+        if (lua_rawget(L, -2) == LUA_TTABLE) { // T already has subs
+            lua_pushthread(L); // t_subs, subs, L
+            lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+        } else { // T has no subs
+            lua_pushvalue(L, t_idx); // t_subs, nil, T
+            lua_createtable(L, 1, 0); // t_subs, nil, T, subs
+            lua_pushthread(L); // t_subs, nil, T, subs, L
+            lua_rawseti(L, -2, 1); // subs[1] = L
+            lua_rawset(L, -4); // t_subs[T] = subs
+        }
+
+        lua_settop(L, t_idx);
+
+        return lua_yieldk(L, 0, ctx, k);
+    }
+
+    // T is already finished
+
+    int t_nres = t_status == LUA_OK ? lua_gettop(T) : 1; // 1: err msg
+
+    luaL_checkstack(L, t_nres + 1, "loop wait L");
+    luaL_checkstack(T, t_nres, "loop wait T");
+
+    lua_pushinteger(L, t_status);
+
+    if (t_status == LUA_OK) {
+        for (int index = 1; index <= t_nres; ++index) {
+            lua_pushvalue(T, index);
+        }
+    } else {
+        lua_pushvalue(T, -1); // err msg
+    }
+
+    lua_xmove(T, L, t_nres);
+
+    return k(L, LUA_OK, ctx);
+}
@@ -31,11 +31,20 @@ static_assert(sizeof(char) == 1, "sizeof(char) is not 1");
 #define F_RIDX_LOOP 1001
 #define F_RIDX_LOOP_FD_SUBS 1002 // fd_subs[fd] = sub
 #define F_RIDX_LOOP_T_SUBS 1003 // t_subs[thread] = { sub1, sub2, ... }
+#define F_RIDX_OFFLOAD 1004 // thread pool, see offload.h
 
 #define F_GETSOCKOPT_FAILED -1 // see get_socket_error_code
 
 #define F_ESC_STR_SUFFIX " ... (%lu more)"
 
+// luaF_table_kind
+#define F_TABLE_EMPTY 0
+#define F_TABLE_ARRAY 1
+#define F_TABLE_MAP 2
+#define F_TABLE_HINT "__jsontype" // metafield: "array" or "object"
+
+#define F_VISITED_MAX 256 // nesting limit of encoders
+
 #define inline __inline__
 
 #ifndef likely
@@ -50,6 +59,12 @@ typedef struct {
     int fd;
 } ud_loop;
 
+// tables on the path from the root to the current one, see luaF_visit
+typedef struct {
+    const void *ptrs[F_VISITED_MAX];
+    int n;
+} luaF_visited;
+
 #define luaF_warning(L, msg, ...) { \
     lua_pushfstring(L, msg __VA_OPT__(,) __VA_ARGS__); \
     lua_warning(L, lua_tostring(L, -1), 0); \
@@ -128,6 +143,9 @@ void luaF_loop_notify_t_subs(
     int t_status,
     int t_nres);
 int luaF_is_array(lua_State *L, int index);
+int luaF_table_kind(lua_State *L, int index, lua_Integer *len);
+int luaF_visit(luaF_visited *visited, const void *ptr);
+void luaF_unvisit(luaF_visited *visited);
 void *luaF_malloc_or_error(lua_State *L, size_t size);
 int luaF_resume(
     lua_State *L,
@@ -135,6 +153,11 @@ int luaF_resume(
     lua_State *T,
     int t_idx,
     int t_nargs);
+int luaF_loop_wait(
+    lua_State *L,
+    int t_idx,
+    lua_KContext ctx,
+    lua_KFunction k);
 
 #endif
 
@@ -6,6 +6,7 @@ LUAMOD_API int luaopen_array(lua_State *L) {
 }
 
 int array_is_array(lua_State *L) {
-    lua_pushboolean(L, luaF_is_array(L, 1));
+    lua_pushboolean(L,
+        lua_type(L, 1) == LUA_TTABLE && luaF_is_array(L, 1));
     return 1;
 }
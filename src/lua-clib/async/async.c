@@ -95,6 +95,89 @@ int async_pwait(lua_State *L) {
     return lua_gettop(L);
 }
 
+// offload { threads = 4 }
+// starts the pool for blocking and cpu heavy jobs of c modules,
+// otherwise the first job starts it with the default size
+int async_offload(lua_State *L) {
+    luaF_min_max_args(L, 0, 1, "offload");
+
+    lua_Integer threads_n = F_OFFLOAD_DEFAULT_THREADS;
+
+    if (!lua_isnoneornil(L, 1)) {
+        luaL_checktype(L, 1, LUA_TTABLE); // conf
+        lua_getfield(L, 1, "threads");
+        threads_n = luaL_optinteger(L, -1, F_OFFLOAD_DEFAULT_THREADS);
+    }
+
+    luaF_offload_start(L, threads_n);
+
+    return 0;
+}
+
+int async_offload_stat(lua_State *L) {
+    ud_offload *pool = luaF_offload_pool(L);
+
+    lua_createtable(L, 0, 5);
+
+    if (pool == NULL) {
+        return 1; // not started
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    lua_Integer queued_n = pool->queued_n;
+    lua_Integer running_n = pool->running_n;
+    pthread_mutex_unlock(&pool->lock);
+
+    luaF_set_kv_int(L, -1, "threads", pool->threads_n);
+    luaF_set_kv_int(L, -1, "queued", queued_n);
+    luaF_set_kv_int(L, -1, "running", running_n);
+    luaF_set_kv_int(L, -1, "submitted", pool->submitted_n);
+    luaF_set_kv_int(L, -1, "completed", pool->completed_n);
+
+    return 1;
+}
+
+// signal("INT", "TERM") -> T; wait(T) returns the name of the first
+// delivered one; the signals are blocked and read from a signalfd until
+// then, a second one gets the default action again
+int async_signal(lua_State *L) {
+    int args_n = lua_gettop(L);
+
+    if (unlikely(args_n < 1)) {
+        luaL_error(L, "signal: no signals");
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    for (int arg_idx = 1; arg_idx <= args_n; ++arg_idx) {
+        sigaddset(&mask,
+            signal_nums[luaL_checkoption(L, arg_idx, NULL, signal_names)]);
+    }
+
+    if (unlikely(sigprocmask(SIG_BLOCK, &mask, NULL) < 0)) {
+        luaF_error_errno(L, "signal: sigprocmask failed; signals: %d",
+            args_n);
+    }
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "signal: signalfd failed; flags: %d",
+            SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, signal_start);
+    lua_pushinteger(T, fd);
+    lua_pushlightuserdata(T, &mask); // copied by signal_start
+
+    lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
 static int loop_gc(lua_State *L) {
     ud_loop *loop = luaL_checkudata(L, 1, F_MT_LOOP);
 
@@ -315,3 +398,58 @@ static int pwait_continue(lua_State *L, int status, lua_KContext ctx) {
 
     return lua_gettop(L);
 }
+
+// fd, mask
+static int signal_start(lua_State *L) {
+    int fd = lua_tointeger(L, 1);
+    sigset_t *mask = lua_newuserdatauv(L, sizeof(sigset_t), 0);
+
+    memcpy(mask, lua_touserdata(L, 2), sizeof(sigset_t));
+    lua_replace(L, 2); // fd, mask ud
+
+    int status = luaF_loop_protected_watch(L, fd, EPOLLIN | EPOLLONESHOT, 0);
+
+    if (unlikely(status != LUA_OK)) {
+        luaF_close_or_warning(L, fd);
+        sigprocmask(SIG_UNBLOCK, mask, NULL);
+        lua_error(L);
+    }
+
+    return lua_yieldk(L, 0, 0, signal_continue);
+}
+
+// fd, mask ud, fd, emask
+static int signal_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)ctx;
+    (void)status;
+
+    int fd = lua_tointeger(L, F_LOOP_FD_REL_IDX);
+    sigset_t *mask = lua_touserdata(L, 2);
+    struct signalfd_siginfo info;
+    ssize_t len = read(fd, &info, sizeof(info));
+
+    luaF_close_or_warning(L, fd);
+    sigprocmask(SIG_UNBLOCK, mask, NULL);
+    luaF_loop_check_close(L);
+
+    int emask = lua_tointeger(L, F_LOOP_EMASK_REL_IDX);
+
+    if (unlikely(emask_has_errors(emask))) {
+        luaL_error(L, "signal: watch failed; fd: %d; %s",
+            fd, emask_error_label(emask));
+    }
+
+    if (unlikely(len != sizeof(info))) {
+        luaF_error_errno(L, "signal: signalfd read failed; fd: %d", fd);
+    }
+
+    for (int i = 0; signal_names[i]; ++i) {
+        if ((uint32_t)signal_nums[i] == info.ssi_signo) {
+            lua_pushstring(L, signal_names[i]);
+            return 1;
+        }
+    }
+
+    lua_pushinteger(L, info.ssi_signo);
+    return 1;
+}
@@ -2,6 +2,9 @@
 #define LUA_LIB_ASYNC_H
 
 #include <furiend/shared.h>
+#include <furiend/offload.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 
 #define EPOLL_WAIT_TIMEOUT_MS -1 // infinite: -1
 #define EPOLL_WAIT_MAX_EVENTS 256
@@ -11,6 +14,9 @@ LUAMOD_API int luaopen_async(lua_State *L);
 int async_loop(lua_State *L);
 int async_wait(lua_State *L);
 int async_pwait(lua_State *L);
+int async_offload(lua_State *L);
+int async_offload_stat(lua_State *L);
+int async_signal(lua_State *L);
 
 static int loop_gc(lua_State *L);
 static int loop_yield(lua_State *L, lua_State *MAIN, int nres, int epfd);
@@ -29,10 +35,24 @@ static int wait_error(lua_State *L, lua_State *T, int status);
 static int wait_continue(lua_State *L, int status, lua_KContext ctx);
 static int pwait_continue(lua_State *L, int status, lua_KContext ctx);
 
+static int signal_start(lua_State *L);
+static int signal_continue(lua_State *L, int status, lua_KContext ctx);
+
+static const char *const signal_names[] = {
+    "HUP", "INT", "QUIT", "TERM", "USR1", "USR2", NULL
+};
+
+static const int signal_nums[] = {
+    SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGUSR1, SIGUSR2
+};
+
 static const luaL_Reg async_index[] = {
     { "loop", async_loop },
     { "wait", async_wait },
     { "pwait", async_pwait },
+    { "offload", async_offload },
+    { "offload_stat", async_offload_stat },
+    { "signal", async_signal },
     { NULL, NULL }
 };
 
@@ -0,0 +1,980 @@
+#include "columns.h"
+
+static const char *const column_types[] = {
+    "int", "float", "bool", "str", "rel", "any", NULL
+};
+
+static const char *const scan_ops[] = {
+    "eq", "neq", "gt", "gte", "lt", "lte", NULL
+};
+
+enum { OP_EQ, OP_NEQ, OP_GT, OP_GTE, OP_LT, OP_LTE };
+
+LUAMOD_API int luaopen_columns(lua_State *L) {
+    if (likely(luaL_newmetatable(L, MT_COLUMNS))) {
+        lua_pushcfunction(L, columns_gc);
+        lua_setfield(L, -2, "__gc");
+        luaL_newlib(L, columns_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    if (likely(luaL_newmetatable(L, MT_COLUMNS_PROXY))) {
+        lua_pushcfunction(L, proxy_index);
+        lua_setfield(L, -2, "__index");
+        lua_pushcfunction(L, proxy_newindex);
+        lua_setfield(L, -2, "__newindex");
+        lua_pushcfunction(L, proxy_pairs);
+        lua_setfield(L, -2, "__pairs");
+        lua_pushcfunction(L, proxy_snapshot);
+        lua_setfield(L, -2, "__snapshot");
+    }
+
+    lua_pop(L, 2);
+
+    luaL_newlib(L, columns_index);
+
+    return 1;
+}
+
+// columns.new(class, { key = "int" | "float" | "bool" | "str" | "rel" | "any" },
+//     objects) -> store
+// objects: id -> object, where rel columns find related objects
+int columns_new(lua_State *L) {
+    luaF_need_args(L, 3, "columns.new");
+    luaL_checktype(L, 1, LUA_TTABLE); // class
+    luaL_checktype(L, 2, LUA_TTABLE); // keys
+    luaL_checktype(L, 3, LUA_TTABLE); // objects
+
+    int keys_n = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        luaL_checktype(L, -2, LUA_TSTRING);
+        luaL_checkoption(L, -1, NULL, column_types);
+        lua_pop(L, 1); // lua_next
+        ++keys_n;
+    }
+
+    ud_columns *store = luaF_new_ud_or_error(L, sizeof(ud_columns),
+        COLUMNS_UV_N); // 4
+
+    memset(store, 0, sizeof(ud_columns));
+    luaL_setmetatable(L, MT_COLUMNS);
+
+    if (keys_n > 0) {
+        store->cols = calloc(keys_n, sizeof(columns_column));
+
+        if (unlikely(store->cols == NULL)) {
+            luaF_error_errno(L, "columns calloc failed");
+        }
+    }
+
+    store->keys_n = keys_n;
+
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, 4, COLUMNS_UV_IDX_CLASS);
+    lua_pushvalue(L, 3);
+    lua_setiuservalue(L, 4, COLUMNS_UV_IDX_OBJECTS);
+
+    lua_createtable(L, keys_n, keys_n); // keys
+    lua_createtable(L, 0, keys_n); // any
+
+    int col_i = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, 2)) { // key, type
+        int type = luaL_checkoption(L, -1, NULL, column_types) + 1;
+
+        store->cols[col_i].type = type;
+        ++col_i;
+
+        lua_pushvalue(L, -2);
+        lua_pushinteger(L, col_i);
+        lua_rawset(L, 5); // keys[key] = col_i
+        lua_pushvalue(L, -2);
+        lua_rawseti(L, 5, col_i); // keys[col_i] = key
+
+        if (type == COLUMNS_TYPE_ANY) {
+            lua_createtable(L, 0, 0);
+            lua_rawseti(L, 6, col_i);
+        }
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    lua_setiuservalue(L, 4, COLUMNS_UV_IDX_ANY);
+    lua_setiuservalue(L, 4, COLUMNS_UV_IDX_KEYS);
+
+    int uv_tables[] = {
+        COLUMNS_UV_IDX_POOL,
+        COLUMNS_UV_IDX_IDS,
+        COLUMNS_UV_IDX_ROW_IDS,
+    };
+
+    for (size_t i = 0; i < sizeof(uv_tables) / sizeof(*uv_tables); ++i) {
+        lua_createtable(L, 0, 0);
+        lua_setiuservalue(L, 4, uv_tables[i]);
+    }
+
+    lua_createtable(L, 0, 0); // proxies, only the referenced ones live
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_setiuservalue(L, 4, COLUMNS_UV_IDX_PROXIES);
+
+    return 1; // store
+}
+
+static int columns_gc(lua_State *L) {
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+
+    for (int i = 0; i < store->keys_n; ++i) {
+        free(store->cols[i].data);
+        free(store->cols[i].set);
+    }
+
+    free(store->cols);
+    free(store->gens);
+    free(store->live);
+    free(store->free_rows);
+    free(store->pool_refs);
+    free(store->pool_free);
+
+    store->cols = NULL;
+    store->gens = NULL;
+    store->live = NULL;
+    store->free_rows = NULL;
+    store->pool_refs = NULL;
+    store->pool_free = NULL;
+    store->keys_n = 0;
+    store->cap = 0;
+    store->pool_cap = 0;
+
+    return 0;
+}
+
+static size_t cell_size(int type) {
+    switch (type) {
+        case COLUMNS_TYPE_INT: return sizeof(int64_t);
+        case COLUMNS_TYPE_FLOAT: return sizeof(double);
+        case COLUMNS_TYPE_BOOL: return sizeof(uint8_t);
+        case COLUMNS_TYPE_STR:
+        case COLUMNS_TYPE_REL: return sizeof(uint32_t);
+        default: return 0; // any: lua table
+    }
+}
+
+static void *grow_array(lua_State *L, void *array, size_t old_n, size_t n,
+    size_t size
+) {
+    void *grown = realloc(array, n * size);
+
+    if (unlikely(grown == NULL)) {
+        luaF_error_errno(L, "columns realloc failed; n: %d", (int)n);
+    }
+
+    memset((char *)grown + old_n * size, 0, (n - old_n) * size);
+
+    return grown;
+}
+
+// arrays are replaced one by one, so a failed realloc leaves a valid store
+static void grow(lua_State *L, ud_columns *store) {
+    uint32_t cap = store->cap;
+    uint32_t new_cap = cap ? cap * 2 : COLUMNS_START_CAP;
+
+    if (unlikely(new_cap <= cap)) {
+        luaL_error(L, "columns: too many rows");
+    }
+
+    for (int i = 0; i < store->keys_n; ++i) {
+        columns_column *col = &store->cols[i];
+        size_t size = cell_size(col->type);
+
+        if (size > 0) {
+            col->data = grow_array(L, col->data, cap, new_cap, size);
+        }
+
+        if (col->type == COLUMNS_TYPE_INT || col->type == COLUMNS_TYPE_FLOAT) {
+            col->set = grow_array(L, col->set, cap, new_cap, sizeof(uint8_t));
+        }
+    }
+
+    store->gens = grow_array(L, store->gens, cap, new_cap, sizeof(uint32_t));
+    store->live = grow_array(L, store->live, cap, new_cap, sizeof(uint8_t));
+    store->free_rows = grow_array(L, store->free_rows, cap, new_cap,
+        sizeof(uint32_t));
+
+    store->cap = new_cap;
+}
+
+static void pool_grow(lua_State *L, ud_columns *store) {
+    uint32_t cap = store->pool_cap;
+    uint32_t new_cap = cap ? cap * 2 : COLUMNS_START_CAP;
+
+    if (unlikely(new_cap <= cap)) {
+        luaL_error(L, "columns: too many strings");
+    }
+
+    store->pool_refs = grow_array(L, store->pool_refs, cap, new_cap,
+        sizeof(uint32_t));
+    store->pool_free = grow_array(L, store->pool_free, cap, new_cap,
+        sizeof(uint32_t));
+
+    store->pool_cap = new_cap;
+}
+
+// string -> pool index, strings are kept once per store while any cell
+// holds them; every call takes a reference, see pool_release
+static uint32_t intern(lua_State *L, ud_columns *store, int store_idx,
+    int str_idx
+) {
+    str_idx = lua_absindex(L, str_idx);
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_POOL); // pool
+    lua_pushvalue(L, str_idx);
+
+    if (lua_rawget(L, -2) == LUA_TNUMBER) { // pool, idx
+        uint32_t idx = lua_tointeger(L, -1);
+        lua_pop(L, 2);
+        store->pool_refs[idx]++;
+        return idx;
+    }
+
+    lua_pop(L, 1); // pool
+
+    uint32_t idx;
+
+    if (store->pool_free_n > 0) {
+        idx = store->pool_free[--store->pool_free_n];
+    } else {
+        if (store->pool_n + 1 >= store->pool_cap) {
+            pool_grow(L, store);
+        }
+
+        idx = ++store->pool_n;
+    }
+
+    store->pool_refs[idx] = 1;
+
+    lua_pushvalue(L, str_idx);
+    lua_pushinteger(L, idx);
+    lua_rawset(L, -3); // pool[str] = idx
+    lua_pushvalue(L, str_idx);
+    lua_rawseti(L, -2, idx); // pool[idx] = str
+    lua_pop(L, 1); // pool
+
+    return idx;
+}
+
+// drops a cell reference, the last one frees the string and its index
+static void pool_release(lua_State *L, ud_columns *store, int store_idx,
+    uint32_t idx
+) {
+    if (idx == 0 || --store->pool_refs[idx] > 0) {
+        return;
+    }
+
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_POOL); // pool
+    lua_rawgeti(L, -1, idx);
+    lua_pushnil(L);
+    lua_rawset(L, -3); // pool[str] = nil
+    lua_pushnil(L);
+    lua_rawseti(L, -2, idx); // pool[idx] = nil
+    lua_pop(L, 1); // pool
+
+    store->pool_free[store->pool_free_n++] = idx;
+}
+
+// pool index of an existing string, 0 if never interned
+static uint32_t pool_find(lua_State *L, int store_idx, int str_idx) {
+    str_idx = lua_absindex(L, str_idx);
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_POOL);
+    lua_pushvalue(L, str_idx);
+    lua_rawget(L, -2);
+
+    uint32_t idx = lua_tointeger(L, -1); // 0 for nil
+    lua_pop(L, 2);
+
+    return idx;
+}
+
+// column index for a key, 0 if the key has no column
+static int column_of(lua_State *L, int store_idx, int key_idx) {
+    key_idx = lua_absindex(L, key_idx);
+
+    if (lua_type(L, key_idx) != LUA_TSTRING) {
+        return 0;
+    }
+
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_KEYS);
+    lua_pushvalue(L, key_idx);
+    lua_rawget(L, -2);
+
+    int col_i = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+    lua_pop(L, 2);
+
+    return col_i;
+}
+
+static void push_pooled(lua_State *L, int store_idx, uint32_t idx) {
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_POOL);
+    lua_rawgeti(L, -1, idx);
+    lua_remove(L, -2);
+}
+
+static void push_cell(lua_State *L, ud_columns *store, int store_idx,
+    int col_i, uint32_t row
+) {
+    columns_column *col = &store->cols[col_i - 1];
+
+    switch (col->type) {
+        case COLUMNS_TYPE_INT:
+            if (col->set[row]) {
+                lua_pushinteger(L, ((int64_t *)col->data)[row]);
+            } else {
+                lua_pushnil(L);
+            }
+            return;
+        case COLUMNS_TYPE_FLOAT:
+            if (col->set[row]) {
+                lua_pushnumber(L, ((double *)col->data)[row]);
+            } else {
+                lua_pushnil(L);
+            }
+            return;
+        case COLUMNS_TYPE_BOOL: {
+            uint8_t value = ((uint8_t *)col->data)[row];
+
+            if (value) {
+                lua_pushboolean(L, value == 2);
+            } else {
+                lua_pushnil(L);
+            }
+            return;
+        }
+        case COLUMNS_TYPE_STR: {
+            uint32_t idx = ((uint32_t *)col->data)[row];
+
+            if (idx) {
+                push_pooled(L, store_idx, idx);
+            } else {
+                lua_pushnil(L);
+            }
+            return;
+        }
+        case COLUMNS_TYPE_REL: {
+            uint32_t idx = ((uint32_t *)col->data)[row];
+
+            if (idx) {
+                lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_OBJECTS);
+                push_pooled(L, store_idx, idx);
+                lua_rawget(L, -2);
+                lua_remove(L, -2); // objects
+            } else {
+                lua_pushnil(L);
+            }
+            return;
+        }
+        default: // any
+            lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_ANY);
+            lua_rawgeti(L, -1, col_i);
+            lua_rawgeti(L, -1, row);
+            lua_replace(L, -3);
+            lua_pop(L, 1);
+            return;
+    }
+}
+
+// raises for values the column can't hold; nil is always accepted
+static void check_cell(lua_State *L, ud_columns *store, int store_idx,
+    int col_i, int value_idx
+) {
+    int type = store->cols[col_i - 1].type;
+    int value_type = lua_type(L, value_idx);
+
+    if (value_type == LUA_TNIL || type == COLUMNS_TYPE_ANY) {
+        return;
+    }
+
+    int ok;
+
+    switch (type) {
+        case COLUMNS_TYPE_INT:
+            ok = lua_isinteger(L, value_idx);
+            break;
+        case COLUMNS_TYPE_FLOAT:
+            ok = value_type == LUA_TNUMBER;
+            break;
+        case COLUMNS_TYPE_BOOL:
+            ok = value_type == LUA_TBOOLEAN;
+            break;
+        case COLUMNS_TYPE_STR:
+            ok = value_type == LUA_TSTRING;
+            break;
+        default: // rel: object or its id
+            ok = value_type == LUA_TSTRING || value_type == LUA_TTABLE
+                || value_type == LUA_TUSERDATA;
+            break;
+    }
+
+    if (unlikely(!ok)) {
+        lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_KEYS);
+        lua_rawgeti(L, -1, col_i);
+
+        luaL_error(L, "columns: bad value for %s %s: %s",
+            column_types[type - 1], lua_tostring(L, -1),
+            luaL_typename(L, value_idx));
+    }
+}
+
+// value must pass check_cell
+static void set_cell(lua_State *L, ud_columns *store, int store_idx,
+    int col_i, uint32_t row, int value_idx
+) {
+    columns_column *col = &store->cols[col_i - 1];
+    int is_nil = lua_isnil(L, value_idx);
+
+    value_idx = lua_absindex(L, value_idx);
+
+    switch (col->type) {
+        case COLUMNS_TYPE_INT:
+            col->set[row] = !is_nil;
+            ((int64_t *)col->data)[row] = is_nil
+                ? 0
+                : lua_tointeger(L, value_idx);
+            return;
+        case COLUMNS_TYPE_FLOAT:
+            col->set[row] = !is_nil;
+            ((double *)col->data)[row] = is_nil
+                ? 0
+                : lua_tonumber(L, value_idx);
+            return;
+        case COLUMNS_TYPE_BOOL:
+            ((uint8_t *)col->data)[row] = is_nil
+                ? 0
+                : lua_toboolean(L, value_idx) + 1;
+            return;
+        case COLUMNS_TYPE_STR: {
+            uint32_t old_idx = ((uint32_t *)col->data)[row];
+
+            ((uint32_t *)col->data)[row] = is_nil
+                ? 0
+                : intern(L, store, store_idx, value_idx);
+
+            pool_release(L, store, store_idx, old_idx); // after: same string
+            return;
+        }
+        case COLUMNS_TYPE_REL: {
+            uint32_t old_idx = ((uint32_t *)col->data)[row];
+            uint32_t idx = 0;
+
+            if (!is_nil) {
+                if (lua_type(L, value_idx) == LUA_TSTRING) {
+                    idx = intern(L, store, store_idx, value_idx);
+                } else {
+                    if (unlikely(lua_getfield(L, value_idx, "id")
+                        != LUA_TSTRING
+                    )) {
+                        luaL_error(L, "columns: rel object has no id");
+                    }
+
+                    idx = intern(L, store, store_idx, -1);
+                    lua_pop(L, 1); // id
+                }
+            }
+
+            ((uint32_t *)col->data)[row] = idx;
+            pool_release(L, store, store_idx, old_idx);
+            return;
+        }
+        default: // any
+            lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_ANY);
+            lua_rawgeti(L, -1, col_i);
+            lua_pushvalue(L, value_idx);
+            lua_rawseti(L, -2, row);
+            lua_pop(L, 2);
+            return;
+    }
+}
+
+static void push_proxy(lua_State *L, ud_columns *store, int store_idx,
+    uint32_t row
+) {
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_PROXIES);
+
+    if (lua_rawgeti(L, -1, row) == LUA_TUSERDATA) {
+        lua_remove(L, -2); // proxies
+        return;
+    }
+
+    lua_pop(L, 1); // nil
+
+    ud_columns_proxy *proxy = luaF_new_ud_or_error(L,
+        sizeof(ud_columns_proxy), 1);
+
+    proxy->row = row;
+    proxy->gen = store->gens[row];
+
+    luaL_setmetatable(L, MT_COLUMNS_PROXY);
+    lua_pushvalue(L, store_idx);
+    lua_setiuservalue(L, -2, COLUMNS_PROXY_UV_IDX_STORE);
+
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, -3, row); // proxies[row] = proxy
+    lua_remove(L, -2); // proxies
+}
+
+// store.insert(fields) -> proxy
+// fields: { id = "...", key = value, ... }, class is implied by the store
+int columns_insert(lua_State *L) {
+    luaF_need_args(L, 2, "columns insert");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    if (unlikely(lua_getfield(L, 2, "id") != LUA_TSTRING)) { // 3: id
+        luaL_error(L, "columns: insert without string id");
+    }
+
+    lua_getiuservalue(L, 1, COLUMNS_UV_IDX_IDS); // 4: ids
+    lua_pushvalue(L, 3);
+
+    if (unlikely(lua_rawget(L, 4) != LUA_TNIL)) {
+        luaL_error(L, "columns: id already exists: %s", lua_tostring(L, 3));
+    }
+
+    lua_pop(L, 1); // lua_rawget
+
+    // check everything first: a failed insert leaves no half row
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        int col_i = column_of(L, 1, -2);
+
+        if (!col_i) {
+            if (lua_type(L, -2) != LUA_TSTRING || (
+                strcmp(lua_tostring(L, -2), "id") != 0
+                && strcmp(lua_tostring(L, -2), "class") != 0
+            )) {
+                luaL_error(L, "columns: key not found in class definition: %s",
+                    luaL_tolstring(L, -2, NULL));
+            }
+        } else {
+            check_cell(L, store, 1, col_i, -1);
+        }
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    uint32_t row;
+
+    if (store->free_n > 0) {
+        row = store->free_rows[--store->free_n];
+    } else {
+        if (store->rows_n == store->cap) {
+            grow(L, store);
+        }
+
+        row = store->rows_n++;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        int col_i = column_of(L, 1, -2);
+
+        if (col_i) {
+            set_cell(L, store, 1, col_i, row, -1);
+        }
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    store->live[row] = 1;
+    store->live_n++;
+
+    lua_pushvalue(L, 3);
+    lua_pushinteger(L, row);
+    lua_rawset(L, 4); // ids[id] = row
+
+    lua_getiuservalue(L, 1, COLUMNS_UV_IDX_ROW_IDS);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, row); // row_ids[row] = id
+    lua_pop(L, 1);
+
+    push_proxy(L, store, 1, row);
+
+    return 1; // proxy
+}
+
+// row of id, pushes nothing; -1 if not found
+static int64_t row_of(lua_State *L, int store_idx, int id_idx) {
+    id_idx = lua_absindex(L, id_idx);
+    lua_getiuservalue(L, store_idx, COLUMNS_UV_IDX_IDS);
+    lua_pushvalue(L, id_idx);
+    lua_rawget(L, -2);
+
+    int64_t row = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : -1;
+    lua_pop(L, 2);
+
+    return row;
+}
+
+// store:get(id) -> proxy or nil
+int columns_get(lua_State *L) {
+    luaF_need_args(L, 2, "columns get");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    int64_t row = row_of(L, 1, 2);
+
+    if (row < 0) {
+        return 0;
+    }
+
+    push_proxy(L, store, 1, row);
+
+    return 1;
+}
+
+// store:remove(id) -> removed; proxies of the row become stale
+int columns_remove(lua_State *L) {
+    luaF_need_args(L, 2, "columns remove");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    int64_t row = row_of(L, 1, 2);
+
+    if (row < 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_pushnil(L); // 3
+
+    for (int col_i = 1; col_i <= store->keys_n; ++col_i) {
+        set_cell(L, store, 1, col_i, row, 3);
+    }
+
+    store->live[row] = 0;
+    store->gens[row]++;
+    store->live_n--;
+    store->free_rows[store->free_n++] = row;
+
+    lua_getiuservalue(L, 1, COLUMNS_UV_IDX_IDS);
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+
+    int uv_rows[] = { COLUMNS_UV_IDX_ROW_IDS, COLUMNS_UV_IDX_PROXIES };
+
+    for (size_t i = 0; i < sizeof(uv_rows) / sizeof(*uv_rows); ++i) {
+        lua_getiuservalue(L, 1, uv_rows[i]);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, row);
+        lua_pop(L, 1);
+    }
+
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+int columns_count(lua_State *L) {
+    luaF_need_args(L, 1, "columns count");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+
+    lua_pushinteger(L, store->live_n);
+
+    return 1;
+}
+
+// ops semantics for one value: numbers of another subtype are not equal
+static int scan_match(lua_State *L, columns_column *col, uint32_t row,
+    int op, int value_idx, uint32_t pool_idx
+) {
+    int type = col->type;
+    int cmp; // from <=> value
+
+    if (type == COLUMNS_TYPE_INT || type == COLUMNS_TYPE_FLOAT) {
+        if (!col->set[row] || lua_type(L, value_idx) != LUA_TNUMBER) {
+            return op == OP_NEQ;
+        }
+
+        if (type == COLUMNS_TYPE_INT && lua_isinteger(L, value_idx)) {
+            int64_t from = ((int64_t *)col->data)[row];
+            lua_Integer value = lua_tointeger(L, value_idx);
+            cmp = (from > value) - (from < value);
+        } else {
+            double from = type == COLUMNS_TYPE_INT
+                ? (double)((int64_t *)col->data)[row]
+                : ((double *)col->data)[row];
+            double value = lua_tonumber(L, value_idx);
+            cmp = (from > value) - (from < value);
+
+            if ((op == OP_EQ || op == OP_NEQ)
+                && (type == COLUMNS_TYPE_FLOAT) == lua_isinteger(L, value_idx)
+            ) {
+                return op == OP_NEQ; // int vs float
+            }
+        }
+    } else {
+        int eq;
+
+        if (type == COLUMNS_TYPE_BOOL) {
+            uint8_t from = ((uint8_t *)col->data)[row];
+            eq = from && lua_isboolean(L, value_idx)
+                && (from == 2) == lua_toboolean(L, value_idx);
+        } else { // str, rel
+            uint32_t from = ((uint32_t *)col->data)[row];
+            eq = from && from == pool_idx;
+        }
+
+        return op == OP_EQ ? eq : !eq;
+    }
+
+    switch (op) {
+        case OP_EQ: return cmp == 0;
+        case OP_NEQ: return cmp != 0;
+        case OP_GT: return cmp > 0;
+        case OP_GTE: return cmp >= 0;
+        case OP_LT: return cmp < 0;
+        default: return cmp <= 0;
+    }
+}
+
+// store:scan(key, op, value) -> { proxy, ... } in row order
+// op: eq, neq for all typed columns; gt, gte, lt, lte for int and float
+int columns_scan(lua_State *L) {
+    luaF_need_args(L, 4, "columns scan");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+    int op = luaL_checkoption(L, 3, NULL, scan_ops);
+
+    int col_i = column_of(L, 1, 2);
+
+    if (unlikely(!col_i)) {
+        luaL_error(L, "columns: scan key not found: %s",
+            luaL_tolstring(L, 2, NULL));
+    }
+
+    columns_column *col = &store->cols[col_i - 1];
+    int type = col->type;
+
+    if (unlikely(type == COLUMNS_TYPE_ANY
+        || (op > OP_NEQ && type != COLUMNS_TYPE_INT
+            && type != COLUMNS_TYPE_FLOAT)
+    )) {
+        luaL_error(L, "columns: scan %s not supported for %s",
+            scan_ops[op], column_types[type - 1]);
+    }
+
+    uint32_t pool_idx = 0;
+
+    if (type == COLUMNS_TYPE_REL && lua_type(L, 4) != LUA_TSTRING
+        && !lua_isnil(L, 4)
+    ) {
+        lua_getfield(L, 4, "id");
+        lua_replace(L, 4);
+    }
+
+    if ((type == COLUMNS_TYPE_STR || type == COLUMNS_TYPE_REL)
+        && lua_type(L, 4) == LUA_TSTRING
+    ) {
+        pool_idx = pool_find(L, 1, 4); // 0: no row has it
+    }
+
+    lua_createtable(L, 0, 0); // 5: found
+    lua_Integer found_n = 0;
+
+    for (uint32_t row = 0; row < store->rows_n; ++row) {
+        if (store->live[row] && scan_match(L, col, row, op, 4, pool_idx)) {
+            push_proxy(L, store, 1, row);
+            lua_rawseti(L, 5, ++found_n);
+        }
+    }
+
+    return 1;
+}
+
+int columns_stat(lua_State *L) {
+    luaF_need_args(L, 1, "columns stat");
+    ud_columns *store = luaL_checkudata(L, 1, MT_COLUMNS);
+
+    size_t row_size = sizeof(uint32_t) * 2 + sizeof(uint8_t); // gen, free, live
+
+    for (int i = 0; i < store->keys_n; ++i) {
+        int type = store->cols[i].type;
+
+        row_size += cell_size(type);
+
+        if (type == COLUMNS_TYPE_INT || type == COLUMNS_TYPE_FLOAT) {
+            row_size += sizeof(uint8_t);
+        }
+    }
+
+    lua_createtable(L, 0, 4);
+    luaF_set_kv_int(L, -1, "rows", store->live_n);
+    luaF_set_kv_int(L, -1, "free", store->free_n);
+    luaF_set_kv_int(L, -1, "strings", store->pool_n - store->pool_free_n);
+    luaF_set_kv_int(L, -1, "bytes", row_size * store->cap
+        + sizeof(uint32_t) * 2 * store->pool_cap); // pool refs, free
+
+    return 1;
+}
+
+// store is left on top
+static ud_columns *proxy_store(lua_State *L, int proxy_idx,
+    ud_columns_proxy **proxy
+) {
+    *proxy = luaL_checkudata(L, proxy_idx, MT_COLUMNS_PROXY);
+    lua_getiuservalue(L, proxy_idx, COLUMNS_PROXY_UV_IDX_STORE);
+
+    ud_columns *store = lua_touserdata(L, -1);
+    uint32_t row = (*proxy)->row;
+
+    if (unlikely(row >= store->rows_n || !store->live[row]
+        || store->gens[row] != (*proxy)->gen
+    )) {
+        luaL_error(L, "columns: object was removed");
+    }
+
+    return store;
+}
+
+static int is_key(lua_State *L, int idx, const char *key) {
+    return lua_type(L, idx) == LUA_TSTRING
+        && strcmp(lua_tostring(L, idx), key) == 0;
+}
+
+// proxy.id, proxy.class, proxy[key]
+static int proxy_index(lua_State *L) {
+    ud_columns_proxy *proxy;
+    ud_columns *store = proxy_store(L, 1, &proxy); // proxy, key, store
+
+    if (is_key(L, 2, "id")) {
+        lua_getiuservalue(L, 3, COLUMNS_UV_IDX_ROW_IDS);
+        lua_rawgeti(L, -1, proxy->row);
+        return 1;
+    }
+
+    if (is_key(L, 2, "class")) {
+        lua_getiuservalue(L, 3, COLUMNS_UV_IDX_CLASS);
+        return 1;
+    }
+
+    int col_i = column_of(L, 3, 2);
+
+    if (!col_i) {
+        return 0;
+    }
+
+    push_cell(L, store, 3, col_i, proxy->row);
+
+    return 1;
+}
+
+static int proxy_newindex(lua_State *L) {
+    ud_columns_proxy *proxy;
+    ud_columns *store = proxy_store(L, 1, &proxy); // proxy, key, value, store
+
+    int col_i = column_of(L, 4, 2);
+
+    if (unlikely(!col_i)) {
+        if (is_key(L, 2, "id") || is_key(L, 2, "class")) {
+            luaL_error(L, "columns: id and class are read only");
+        }
+
+        luaL_error(L, "columns: key not found in class definition: %s",
+            luaL_tolstring(L, 2, NULL));
+    }
+
+    check_cell(L, store, 4, col_i, 3);
+    set_cell(L, store, 4, col_i, proxy->row, 3);
+
+    return 0;
+}
+
+static int proxy_pairs(lua_State *L) {
+    luaL_checkudata(L, 1, MT_COLUMNS_PROXY);
+
+    lua_pushcfunction(L, proxy_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+
+    return 3;
+}
+
+// id, class, then keys with non nil values in column order
+static int proxy_next(lua_State *L) {
+    lua_settop(L, 2); // proxy, key
+
+    ud_columns_proxy *proxy;
+    ud_columns *store = proxy_store(L, 1, &proxy); // proxy, key, store
+    int col_i;
+
+    if (lua_isnil(L, 2)) {
+        lua_pushliteral(L, "id");
+        lua_getiuservalue(L, 3, COLUMNS_UV_IDX_ROW_IDS);
+        lua_rawgeti(L, -1, proxy->row);
+        lua_remove(L, -2);
+        return 2;
+    } else if (is_key(L, 2, "id")) {
+        lua_pushliteral(L, "class");
+        lua_getiuservalue(L, 3, COLUMNS_UV_IDX_CLASS);
+        return 2;
+    } else if (is_key(L, 2, "class")) {
+        col_i = 1;
+    } else {
+        col_i = column_of(L, 3, 2);
+
+        if (unlikely(!col_i)) {
+            luaL_error(L, "columns: invalid key to next");
+        }
+
+        ++col_i;
+    }
+
+    for (; col_i <= store->keys_n; ++col_i) {
+        push_cell(L, store, 3, col_i, proxy->row); // proxy, key, store, value
+
+        if (!lua_isnil(L, -1)) {
+            lua_getiuservalue(L, 3, COLUMNS_UV_IDX_KEYS);
+            lua_rawgeti(L, -1, col_i); // value, keys, key
+            lua_replace(L, -2); // value, key
+            lua_insert(L, -2); // key, value
+            return 2;
+        }
+
+        lua_pop(L, 1);
+    }
+
+    return 0; // end
+}
+
+// snapshot.write hook: written as a plain table with the same fields
+static int proxy_snapshot(lua_State *L) {
+    lua_settop(L, 1);
+    lua_createtable(L, 0, 0); // proxy, obj
+
+    lua_pushcfunction(L, proxy_next);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+
+    while (1) { // proxy, obj, next, proxy, key
+        lua_pushvalue(L, 3);
+        lua_pushvalue(L, 4);
+        lua_pushvalue(L, 5);
+        lua_call(L, 2, 2); // ..., key, new_key, value
+
+        if (lua_isnil(L, -2)) {
+            break;
+        }
+
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2); // ..., key, new_key, new_key, value
+        lua_rawset(L, 2);
+        lua_replace(L, 5); // key = new_key
+    }
+
+    lua_settop(L, 2);
+
+    return 1; // obj
+}
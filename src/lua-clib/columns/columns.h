@@ -0,0 +1,108 @@
+#ifndef LUA_LIB_COLUMNS_H
+#define LUA_LIB_COLUMNS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <furiend/shared.h>
+
+#define MT_COLUMNS "columns*"
+#define MT_COLUMNS_PROXY "columns.proxy*"
+
+#define COLUMNS_UV_IDX_CLASS 1 // class table, proxy.class
+#define COLUMNS_UV_IDX_OBJECTS 2 // id -> object, resolves rel columns
+#define COLUMNS_UV_IDX_KEYS 3 // key -> column index, column index -> key
+#define COLUMNS_UV_IDX_POOL 4 // string -> pool index, pool index -> string
+#define COLUMNS_UV_IDX_IDS 5 // id -> row
+#define COLUMNS_UV_IDX_ROW_IDS 6 // row -> id
+#define COLUMNS_UV_IDX_PROXIES 7 // row -> proxy, weak, keeps identity
+#define COLUMNS_UV_IDX_ANY 8 // column index -> { row -> value }
+#define COLUMNS_UV_N 8
+
+#define COLUMNS_PROXY_UV_IDX_STORE 1
+#define COLUMNS_START_CAP 64
+
+#define COLUMNS_TYPE_INT 1 // int64 + set flag
+#define COLUMNS_TYPE_FLOAT 2 // double + set flag
+#define COLUMNS_TYPE_BOOL 3 // 0 nil, 1 false, 2 true
+#define COLUMNS_TYPE_STR 4 // pool index, 0 nil
+#define COLUMNS_TYPE_REL 5 // pool index of related object id, 0 nil
+#define COLUMNS_TYPE_ANY 6 // lua value in COLUMNS_UV_IDX_ANY
+
+typedef struct {
+    int type;
+    void *data;
+    uint8_t *set; // int and float only
+} columns_column;
+
+// rows are reused after remove; gen tells a reused row from the old one
+typedef struct {
+    int keys_n;
+    columns_column *cols;
+    uint32_t rows_n; // rows ever allocated
+    uint32_t cap;
+    uint32_t live_n;
+    uint32_t *gens;
+    uint8_t *live;
+    uint32_t *free_rows;
+    uint32_t free_n;
+    uint32_t pool_n; // pool indexes ever allocated
+    uint32_t pool_cap;
+    uint32_t *pool_refs; // pool index -> cells holding the string
+    uint32_t *pool_free; // released pool indexes, reused first
+    uint32_t pool_free_n;
+} ud_columns;
+
+typedef struct {
+    uint32_t row;
+    uint32_t gen;
+} ud_columns_proxy;
+
+LUAMOD_API int luaopen_columns(lua_State *L);
+
+int columns_new(lua_State *L);
+int columns_insert(lua_State *L);
+int columns_get(lua_State *L);
+int columns_remove(lua_State *L);
+int columns_count(lua_State *L);
+int columns_scan(lua_State *L);
+int columns_stat(lua_State *L);
+
+static int columns_gc(lua_State *L);
+static int proxy_index(lua_State *L);
+static int proxy_newindex(lua_State *L);
+static int proxy_pairs(lua_State *L);
+static int proxy_next(lua_State *L);
+static int proxy_snapshot(lua_State *L);
+
+static void grow(lua_State *L, ud_columns *store);
+static uint32_t intern(lua_State *L, ud_columns *store, int store_idx,
+    int str_idx);
+static void pool_release(lua_State *L, ud_columns *store, int store_idx,
+    uint32_t idx);
+static int column_of(lua_State *L, int store_idx, int key_idx);
+static void push_cell(lua_State *L, ud_columns *store, int store_idx,
+    int col_i, uint32_t row);
+static void set_cell(lua_State *L, ud_columns *store, int store_idx,
+    int col_i, uint32_t row, int value_idx);
+static void push_proxy(lua_State *L, ud_columns *store, int store_idx,
+    uint32_t row);
+static ud_columns *proxy_store(lua_State *L, int proxy_idx,
+    ud_columns_proxy **proxy);
+
+static const luaL_Reg columns_index[] = {
+    { "new", columns_new },
+    { NULL, NULL }
+};
+
+static const luaL_Reg columns_methods[] = {
+    { "insert", columns_insert },
+    { "get", columns_get },
+    { "remove", columns_remove },
+    { "count", columns_count },
+    { "scan", columns_scan },
+    { "stat", columns_stat },
+    { NULL, NULL }
+};
+
+#endif
@@ -0,0 +1,433 @@
+#include "compress.h"
+
+LUAMOD_API int luaopen_compress(lua_State *L) {
+    if (likely(luaL_newmetatable(L, MT_COMPRESS_CODEC))) {
+        lua_pushcfunction(L, codec_gc);
+        lua_setfield(L, -2, "__gc");
+
+        luaL_newlib(L, codec_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_pop(L, 1);
+
+    luaL_newlib(L, compress_index);
+    return 1;
+}
+
+// codec(config?) -> codec
+// config: { dict, dict_id, min_len, pack }
+// dict: up to 64k of typical messages, every side must use the same one
+// under the same dict_id (1 .. 255); pack = false turns packing off while
+// frames from other sides are still unpacked, this is how rollout starts
+int compress_codec(lua_State *L) {
+    luaF_min_max_args(L, 0, 1, "compress.codec");
+
+    if (lua_isnoneornil(L, 1)) {
+        lua_settop(L, 0);
+        lua_newtable(L);
+    } else {
+        luaL_checktype(L, 1, LUA_TTABLE);
+    }
+
+    lua_getfield(L, 1, "dict"); // 2
+    lua_getfield(L, 1, "dict_id"); // 3
+    lua_getfield(L, 1, "min_len"); // 4
+    lua_getfield(L, 1, "pack"); // 5
+
+    size_t dict_len = 0;
+    const char *dict = luaL_optlstring(L, 2, "", &dict_len);
+
+    if (unlikely(dict_len > COMPRESS_DICT_MAX_LEN)) {
+        luaL_error(L, "dict is too long: %d; max: %d",
+            (int)dict_len, COMPRESS_DICT_MAX_LEN);
+    }
+
+    lua_Integer dict_id = luaL_optinteger(L, 3, dict_len > 0 ? 1 : 0);
+
+    if (unlikely(dict_len > 0 ? dict_id < 1 || dict_id > 255 : dict_id != 0)) {
+        luaL_error(L, "invalid dict id: %d; 1 .. 255 with dict, 0 without",
+            (int)dict_id);
+    }
+
+    lua_Integer min_len = luaL_optinteger(L, 4, COMPRESS_DEFAULT_MIN_LEN);
+
+    if (unlikely(min_len < 1)) {
+        luaL_error(L, "invalid min len: %d", (int)min_len);
+    }
+
+    ud_compress_codec *codec = luaF_new_ud_or_error(L,
+        sizeof(ud_compress_codec), 0);
+
+    memset(codec, 0, sizeof(ud_compress_codec));
+    codec->work = luaF_strbuf_create(COMPRESS_BUF_START_SIZE);
+    codec->out = luaF_strbuf_create(COMPRESS_BUF_START_SIZE);
+    codec->dict_id = dict_id;
+    codec->min_len = min_len;
+    codec->pack = lua_isnil(L, 5) || lua_toboolean(L, 5);
+
+    luaL_setmetatable(L, MT_COMPRESS_CODEC);
+
+    if (dict_len > 0) { // stays in front of every message in work
+        luaF_strbuf_append(L, &codec->work, dict, dict_len);
+        codec->dict_len = dict_len;
+
+        const uint8_t *base = (const uint8_t *)codec->work.buf;
+
+        for (size_t pos = 0; pos + COMPRESS_MIN_MATCH <= dict_len; pos++) {
+            codec->dict_table[lz_hash(base + pos)] = pos + 1;
+        }
+    }
+
+    return 1;
+}
+
+// is_frame(msg) -> true if msg is packed by a codec
+int compress_is_frame(lua_State *L) {
+    luaF_need_args(L, 1, "compress.is_frame");
+
+    size_t len;
+    const char *msg = luaL_checklstring(L, 1, &len);
+
+    lua_pushboolean(L, len >= COMPRESS_HEAD_LEN
+        && memcmp(msg, COMPRESS_MAGIC, COMPRESS_MAGIC_LEN) == 0);
+
+    return 1;
+}
+
+// codec:pack(msg) -> frame or msg
+// msg is returned as is when packing is off, msg is short, or the frame
+// would not be smaller
+static int codec_pack(lua_State *L) {
+    luaF_need_args(L, 2, "codec pack");
+    ud_compress_codec *codec = luaL_checkudata(L, 1, MT_COMPRESS_CODEC);
+
+    size_t len;
+    const char *msg = luaL_checklstring(L, 2, &len);
+
+    if (!codec->pack || len < codec->min_len || len > COMPRESS_MAX_LEN) {
+        codec->plain_n++;
+        return 1;
+    }
+
+    double start = codec_now();
+
+    luaF_strbuf *work = &codec->work;
+    work->filled = codec->dict_len;
+    luaF_strbuf_append(L, work, msg, len);
+
+    luaF_strbuf *out_sb = &codec->out;
+    out_sb->filled = 0;
+    luaF_strbuf_ensure_space(L, out_sb,
+        COMPRESS_HEAD_LEN + len + len / 255 + 16); // lz4 worst case
+
+    uint8_t *out = (uint8_t *)out_sb->buf;
+
+    memcpy(out, COMPRESS_MAGIC, COMPRESS_MAGIC_LEN);
+    out[3] = codec->dict_id;
+
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (len >> (8 * i)) & 0xff;
+    }
+
+    memcpy(codec->table, codec->dict_table, sizeof(codec->table));
+
+    size_t packed_len = COMPRESS_HEAD_LEN + lz_compress(
+        (const uint8_t *)work->buf, codec->dict_len, work->filled,
+        out + COMPRESS_HEAD_LEN, codec->table);
+
+    codec->pack_sec += codec_now() - start;
+
+    if (packed_len >= len) {
+        codec->plain_n++;
+        return 1;
+    }
+
+    codec->packed_n++;
+    codec->raw_bytes += len;
+    codec->packed_bytes += packed_len;
+
+    lua_pushlstring(L, (const char *)out, packed_len);
+    return 1;
+}
+
+// codec:unpack(msg) -> msg
+// frames are unpacked, plain messages are returned as is
+static int codec_unpack(lua_State *L) {
+    luaF_need_args(L, 2, "codec unpack");
+    ud_compress_codec *codec = luaL_checkudata(L, 1, MT_COMPRESS_CODEC);
+
+    size_t len;
+    const char *msg = luaL_checklstring(L, 2, &len);
+
+    if (len < COMPRESS_HEAD_LEN
+        || memcmp(msg, COMPRESS_MAGIC, COMPRESS_MAGIC_LEN) != 0
+    ) {
+        return 1;
+    }
+
+    const uint8_t *head = (const uint8_t *)msg;
+    int dict_id = head[3];
+    size_t raw_len = 0;
+
+    for (int i = 3; i >= 0; i--) {
+        raw_len = (raw_len << 8) | head[4 + i];
+    }
+
+    if (unlikely(dict_id != 0 && dict_id != codec->dict_id)) {
+        luaL_error(L, "unknown dict id: %d; codec dict id: %d",
+            dict_id, codec->dict_id);
+    }
+
+    if (unlikely(raw_len == 0 || raw_len > COMPRESS_MAX_LEN)) {
+        luaL_error(L, "invalid frame len: %d", (int)raw_len);
+    }
+
+    double start = codec_now();
+
+    luaF_strbuf *work = &codec->work;
+    work->filled = codec->dict_len;
+    luaF_strbuf_ensure_space(L, work, raw_len);
+
+    uint8_t *dst = (uint8_t *)work->buf + codec->dict_len;
+    uint8_t *lowest = dict_id ? (uint8_t *)work->buf : dst;
+
+    if (unlikely(!lz_decompress(head + COMPRESS_HEAD_LEN,
+        len - COMPRESS_HEAD_LEN, lowest, dst, raw_len))
+    ) {
+        luaL_error(L, "corrupted frame");
+    }
+
+    codec->unpack_sec += codec_now() - start;
+    codec->unpacked_n++;
+
+    lua_pushlstring(L, (const char *)dst, raw_len);
+    return 1;
+}
+
+// codec:stat() -> { packed, plain, unpacked, raw_bytes, packed_bytes,
+//     ratio, pack_sec, unpack_sec }
+// ratio is raw / packed bytes of packed messages, sec is wall time spent
+// in the codec, it is cpu time as nothing inside blocks
+static int codec_stat(lua_State *L) {
+    luaF_need_args(L, 1, "codec stat");
+    ud_compress_codec *codec = luaL_checkudata(L, 1, MT_COMPRESS_CODEC);
+
+    lua_createtable(L, 0, 8);
+    luaF_set_kv_int(L, -1, "packed", codec->packed_n);
+    luaF_set_kv_int(L, -1, "plain", codec->plain_n);
+    luaF_set_kv_int(L, -1, "unpacked", codec->unpacked_n);
+    luaF_set_kv_int(L, -1, "raw_bytes", codec->raw_bytes);
+    luaF_set_kv_int(L, -1, "packed_bytes", codec->packed_bytes);
+
+    lua_pushnumber(L, codec->packed_bytes > 0
+        ? (double)codec->raw_bytes / codec->packed_bytes
+        : 0);
+
+    lua_setfield(L, -2, "ratio");
+
+    lua_pushnumber(L, codec->pack_sec);
+    lua_setfield(L, -2, "pack_sec");
+
+    lua_pushnumber(L, codec->unpack_sec);
+    lua_setfield(L, -2, "unpack_sec");
+
+    return 1;
+}
+
+static int codec_gc(lua_State *L) {
+    ud_compress_codec *codec = luaL_checkudata(L, 1, MT_COMPRESS_CODEC);
+
+    luaF_strbuf_free_buf(&codec->work);
+    luaF_strbuf_free_buf(&codec->out);
+
+    return 0;
+}
+
+static double codec_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t lz_hash(const uint8_t *ptr) {
+    uint32_t seq;
+    memcpy(&seq, ptr, sizeof(seq));
+
+    return (seq * 2654435761u) >> (32 - COMPRESS_HASH_LOG);
+}
+
+static uint8_t *lz_put_len(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+
+    *op++ = len;
+    return op;
+}
+
+// lz4 block of base[start .. end), matches may reach back into the dict
+// in front of start; table holds positions + 1 of seen 4 byte sequences
+static size_t lz_compress(const uint8_t *base, size_t start, size_t end,
+    uint8_t *out, uint32_t *table
+) {
+    uint8_t *op = out;
+    size_t anchor = start;
+    size_t ip = start;
+
+    if (end - start > COMPRESS_MF_LIMIT) {
+        size_t limit = end - COMPRESS_MF_LIMIT;
+        size_t match_limit = end - COMPRESS_LAST_LITERALS;
+
+        while (ip < limit) {
+            uint32_t hash = lz_hash(base + ip);
+            size_t ref = table[hash];
+            table[hash] = ip + 1;
+
+            if (ref == 0
+                || ip - (ref - 1) > 65535
+                || memcmp(base + ref - 1, base + ip, COMPRESS_MIN_MATCH) != 0
+            ) {
+                ip += 1 + ((ip - anchor) >> 6); // skips faster on no matches
+                continue;
+            }
+
+            ref--;
+
+            size_t match_len = COMPRESS_MIN_MATCH;
+
+            while (ip + match_len < match_limit
+                && base[ref + match_len] == base[ip + match_len]
+            ) {
+                match_len++;
+            }
+
+            size_t lit_len = ip - anchor;
+            size_t extra_len = match_len - COMPRESS_MIN_MATCH;
+
+            *op++ = (lit_len < 15 ? lit_len : 15) << 4
+                | (extra_len < 15 ? extra_len : 15);
+
+            if (lit_len >= 15) {
+                op = lz_put_len(op, lit_len - 15);
+            }
+
+            memcpy(op, base + anchor, lit_len);
+            op += lit_len;
+
+            size_t offset = ip - ref;
+            *op++ = offset & 0xff;
+            *op++ = offset >> 8;
+
+            if (extra_len >= 15) {
+                op = lz_put_len(op, extra_len - 15);
+            }
+
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    size_t lit_len = end - anchor; // last literals, no match
+    *op++ = (lit_len < 15 ? lit_len : 15) << 4;
+
+    if (lit_len >= 15) {
+        op = lz_put_len(op, lit_len - 15);
+    }
+
+    memcpy(op, base + anchor, lit_len);
+    op += lit_len;
+
+    return op - out;
+}
+
+// 1 - dst is filled exactly, 0 - corrupted block
+// matches may reach back to lowest, the dict in front of dst
+static int lz_decompress(const uint8_t *src, size_t src_len,
+    uint8_t *lowest, uint8_t *dst, size_t dst_len
+) {
+    const uint8_t *ip = src;
+    const uint8_t *ip_end = src + src_len;
+    uint8_t *op = dst;
+    uint8_t *op_end = dst + dst_len;
+
+    while (ip < ip_end) {
+        unsigned token = *ip++;
+        size_t lit_len = token >> 4;
+
+        if (lit_len == 15) {
+            unsigned byte;
+
+            do {
+                if (unlikely(ip >= ip_end)) {
+                    return 0;
+                }
+
+                byte = *ip++;
+                lit_len += byte;
+            } while (byte == 255);
+        }
+
+        if (unlikely((size_t)(ip_end - ip) < lit_len
+            || (size_t)(op_end - op) < lit_len)
+        ) {
+            return 0;
+        }
+
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+
+        if (ip == ip_end) {
+            break; // the last sequence has no match
+        }
+
+        if (unlikely(ip_end - ip < 2)) {
+            return 0;
+        }
+
+        size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+
+        if (unlikely(offset == 0 || (size_t)(op - lowest) < offset)) {
+            return 0;
+        }
+
+        size_t match_len = token & 15;
+
+        if (match_len == 15) {
+            unsigned byte;
+
+            do {
+                if (unlikely(ip >= ip_end)) {
+                    return 0;
+                }
+
+                byte = *ip++;
+                match_len += byte;
+            } while (byte == 255);
+        }
+
+        match_len += COMPRESS_MIN_MATCH;
+
+        if (unlikely((size_t)(op_end - op) < match_len)) {
+            return 0;
+        }
+
+        const uint8_t *ref = op - offset;
+
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+        } else { // overlapping, repeats the last offset bytes
+            for (size_t i = 0; i < match_len; i++) {
+                op[i] = ref[i];
+            }
+        }
+
+        op += match_len;
+    }
+
+    return op == op_end;
+}
@@ -0,0 +1,76 @@
+#ifndef LUA_LIB_COMPRESS_H
+#define LUA_LIB_COMPRESS_H
+
+#include <furiend/shared.h>
+#include <furiend/strbuf.h>
+#include <stdint.h>
+
+#define MT_COMPRESS_CODEC "compress.codec*"
+
+// frame: magic, dict id (0 - none), raw len u32 le, lz4 block
+// json and msgpack maps never start with \0, plain messages pass as is
+#define COMPRESS_MAGIC "\0FZ"
+#define COMPRESS_MAGIC_LEN 3
+#define COMPRESS_HEAD_LEN 8
+
+#define COMPRESS_DEFAULT_MIN_LEN 64 // shorter messages are not packed
+#define COMPRESS_MAX_LEN (64 * 1024 * 1024) // raw len of a frame
+#define COMPRESS_DICT_MAX_LEN 65535 // lz4 offsets are 16 bit
+#define COMPRESS_BUF_START_SIZE 4096
+
+#define COMPRESS_HASH_LOG 12
+#define COMPRESS_HASH_SIZE (1 << COMPRESS_HASH_LOG)
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_LAST_LITERALS 5 // lz4 block format end rules
+#define COMPRESS_MF_LIMIT 12
+
+typedef struct {
+    luaF_strbuf work; // dict, then the message being packed or unpacked
+    luaF_strbuf out; // packed frame
+    size_t dict_len;
+    int dict_id;
+    int pack; // 0 - pack passes messages as is, unpack still reads frames
+    size_t min_len;
+    uint32_t dict_table[COMPRESS_HASH_SIZE]; // dict positions + 1, 0 - none
+    uint32_t table[COMPRESS_HASH_SIZE];
+    lua_Integer packed_n;
+    lua_Integer plain_n; // short or not compressible
+    lua_Integer unpacked_n;
+    lua_Integer raw_bytes; // of packed messages
+    lua_Integer packed_bytes;
+    double pack_sec;
+    double unpack_sec;
+} ud_compress_codec;
+
+LUAMOD_API int luaopen_compress(lua_State *L);
+
+int compress_codec(lua_State *L);
+int compress_is_frame(lua_State *L);
+
+static int codec_pack(lua_State *L);
+static int codec_unpack(lua_State *L);
+static int codec_stat(lua_State *L);
+static int codec_gc(lua_State *L);
+
+static size_t lz_compress(const uint8_t *base, size_t start, size_t end,
+    uint8_t *out, uint32_t *table);
+static int lz_decompress(const uint8_t *src, size_t src_len,
+    uint8_t *lowest, uint8_t *dst, size_t dst_len);
+static uint8_t *lz_put_len(uint8_t *op, size_t len);
+static uint32_t lz_hash(const uint8_t *ptr);
+static double codec_now(void);
+
+static const luaL_Reg compress_index[] = {
+    { "codec", compress_codec },
+    { "is_frame", compress_is_frame },
+    { NULL, NULL }
+};
+
+static const luaL_Reg codec_methods[] = {
+    { "pack", codec_pack },
+    { "unpack", codec_unpack },
+    { "stat", codec_stat },
+    { NULL, NULL }
+};
+
+#endif
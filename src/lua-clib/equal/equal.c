@@ -1,10 +1,31 @@
 #include "equal.h"
 
+// equal(a, b) -> boolean, the module table is callable
 LUAMOD_API int luaopen_equal(lua_State *L) {
-    lua_pushcfunction(L, equal);
+    if (likely(luaL_newmetatable(L, MT_VALUESET))) {
+        lua_pushcfunction(L, valueset_len);
+        lua_setfield(L, -2, "__len");
+        luaL_newlib(L, valueset_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_pop(L, 1);
+
+    luaL_newlib(L, equal_index);
+
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, equal_call);
+    lua_setfield(L, -2, "__call");
+    lua_setmetatable(L, -2);
+
     return 1;
 }
 
+static int equal_call(lua_State *L) {
+    lua_remove(L, 1); // module table
+    return equal(L);
+}
+
 static int equal(lua_State *L) {
     luaF_need_args(L, 2, "equal");
 
@@ -116,3 +137,322 @@ static int is_equal(lua_State *L, int a_idx, int b_idx, int cache_idx) {
                 lua_typename(L, a_type), a_type);
     }
 }
+
+// both values must be absolute indexes
+static int values_equal(lua_State *L, int a_idx, int b_idx) {
+    if (lua_type(L, a_idx) != LUA_TTABLE || lua_type(L, b_idx) != LUA_TTABLE) {
+        return is_equal(L, a_idx, b_idx, 0); // cache is for tables only
+    }
+
+    lua_createtable(L, 0, 2);
+    int result = is_equal(L, a_idx, b_idx, lua_gettop(L));
+    lua_pop(L, 1); // cache
+
+    return result;
+}
+
+// hash(value) -> integer
+// equal values give equal hashes: tables are hashed by content in any
+// key order, integers and floats differ, functions, threads and userdata
+// by identity; does not depend on table addresses or the process
+int equal_hash(lua_State *L) {
+    luaF_need_args(L, 1, "equal.hash");
+
+    luaF_visited visited = { .n = 0 };
+    lua_pushinteger(L, (lua_Integer)hash_value(L, 1, &visited));
+
+    return 1;
+}
+
+static uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static uint64_t hash_bytes(const char *str, size_t len) {
+    uint64_t h = HASH_SEED_STR ^ (len * HASH_SEED_NIL);
+    uint64_t chunk;
+
+    for (; len >= sizeof(chunk); str += sizeof(chunk), len -= sizeof(chunk)) {
+        memcpy(&chunk, str, sizeof(chunk));
+        h = (h ^ hash_mix(chunk)) * HASH_SEED_BOOL;
+    }
+
+    if (len > 0) {
+        chunk = 0;
+        memcpy(&chunk, str, len);
+        h = (h ^ hash_mix(chunk)) * HASH_SEED_BOOL;
+    }
+
+    return hash_mix(h);
+}
+
+static uint64_t hash_value(lua_State *L, int idx, luaF_visited *visited) {
+    switch (lua_type(L, idx)) {
+        case LUA_TNONE:
+        case LUA_TNIL:
+            return HASH_SEED_NIL;
+        case LUA_TBOOLEAN:
+            return hash_mix(HASH_SEED_BOOL + lua_toboolean(L, idx));
+        case LUA_TNUMBER: {
+            if (lua_isinteger(L, idx)) {
+                return hash_mix(HASH_SEED_INT ^ lua_tointeger(L, idx));
+            }
+
+            double num = lua_tonumber(L, idx);
+            num = num == 0 ? 0 : num; // -0 equals 0
+
+            uint64_t bits;
+            memcpy(&bits, &num, sizeof(bits));
+
+            return hash_mix(HASH_SEED_FLOAT ^ bits);
+        } case LUA_TSTRING: {
+            size_t len;
+            const char *str = lua_tolstring(L, idx, &len);
+
+            return hash_bytes(str, len);
+        } case LUA_TTABLE: {
+            const void *ptr = lua_topointer(L, idx);
+            int entered = luaF_visit(visited, ptr);
+
+            if (entered == 0) { // by distance, same shaped loops hash equal
+                for (int i = visited->n - 1; i >= 0; i--) {
+                    if (visited->ptrs[i] == ptr) {
+                        return hash_mix(HASH_SEED_CYCLE + visited->n - i);
+                    }
+                }
+            } else if (unlikely(entered < 0)) {
+                luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
+            }
+
+            luaL_checkstack(L, 3, "equal.hash");
+
+            uint64_t sum = 0; // of entries, does not depend on the order
+            uint64_t n = 0;
+
+            lua_pushnil(L);
+            while (lua_next(L, idx)) {
+                int top = lua_gettop(L);
+                uint64_t key_hash = hash_value(L, top - 1, visited);
+                uint64_t value_hash = hash_value(L, top, visited);
+
+                sum += hash_mix(key_hash ^ (value_hash * HASH_SEED_INT));
+                n++;
+
+                lua_pop(L, 1); // lua_next
+            }
+
+            luaF_unvisit(visited);
+            return hash_mix(HASH_SEED_TABLE ^ (sum + n));
+        } default: // LUA_TFUNCTION LUA_TTHREAD LUA_TUSERDATA LUA_TLIGHTUSERDATA
+            return hash_mix(HASH_SEED_PTR
+                ^ (uint64_t)(uintptr_t)lua_topointer(L, idx));
+    }
+}
+
+// valueset(values?) -> set of deep values, equal() decides membership
+// values are not copied, changing a table inside the set breaks it
+int equal_valueset(lua_State *L) {
+    luaF_min_max_args(L, 0, 1, "equal.valueset");
+
+    int has_values = !lua_isnoneornil(L, 1); // 1 is the set without args
+
+    if (has_values) {
+        luaL_checktype(L, 1, LUA_TTABLE);
+    }
+
+    ud_valueset *set = luaF_new_ud_or_error(L, sizeof(ud_valueset),
+        VALUESET_UV_N);
+
+    set->n = 0;
+    luaL_setmetatable(L, MT_VALUESET);
+
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, VALUESET_UV_IDX_FIRST);
+    lua_newtable(L);
+    lua_setiuservalue(L, -2, VALUESET_UV_IDX_MORE);
+
+    if (!has_values) {
+        return 1;
+    }
+
+    int set_idx = lua_gettop(L);
+    lua_Integer values_n = lua_rawlen(L, 1);
+
+    for (lua_Integer i = 1; i <= values_n; i++) {
+        lua_rawgeti(L, 1, i);
+
+        if (!lua_isnil(L, -1)) {
+            valueset_insert(L, set, set_idx, lua_gettop(L));
+        }
+
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    return 1;
+}
+
+// set:add(value) -> true if added, false if an equal value is in the set
+static int valueset_add(lua_State *L) {
+    luaF_need_args(L, 2, "valueset add");
+    ud_valueset *set = luaL_checkudata(L, 1, MT_VALUESET);
+
+    if (unlikely(lua_isnil(L, 2))) {
+        luaL_error(L, "valueset: nil value");
+    }
+
+    lua_settop(L, 2);
+    lua_pushboolean(L, valueset_insert(L, set, 1, 2));
+
+    return 1;
+}
+
+// set:has(value) -> boolean
+static int valueset_has(lua_State *L) {
+    luaF_need_args(L, 2, "valueset has");
+    luaL_checkudata(L, 1, MT_VALUESET);
+    lua_settop(L, 2);
+
+    lua_Integer hash;
+    lua_pushboolean(L, valueset_find(L, 1, 2, &hash) != 0);
+
+    return 1;
+}
+
+// set:remove(value) -> true if removed
+// the last value with the same hash takes the place of the removed one
+static int valueset_remove(lua_State *L) {
+    luaF_need_args(L, 2, "valueset remove");
+    ud_valueset *set = luaL_checkudata(L, 1, MT_VALUESET);
+    lua_settop(L, 2);
+
+    lua_Integer hash;
+    int pos = valueset_find(L, 1, 2, &hash);
+
+    if (pos == 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_getiuservalue(L, 1, VALUESET_UV_IDX_MORE); // 3
+    lua_rawgeti(L, 3, hash); // 4: more values or nil
+    lua_getiuservalue(L, 1, VALUESET_UV_IDX_FIRST); // 5
+
+    if (lua_isnil(L, 4)) { // the only value with the hash
+        lua_pushnil(L);
+        lua_rawseti(L, 5, hash);
+    } else {
+        lua_Integer more_n = lua_rawlen(L, 4);
+
+        lua_rawgeti(L, 4, more_n); // last
+        lua_rawseti(L, pos < 0 ? 5 : 4, pos < 0 ? hash : pos);
+        lua_pushnil(L);
+        lua_rawseti(L, 4, more_n);
+
+        if (more_n == 1) {
+            lua_pushnil(L);
+            lua_rawseti(L, 3, hash);
+        }
+    }
+
+    set->n--;
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int valueset_len(lua_State *L) {
+    ud_valueset *set = luaL_checkudata(L, 1, MT_VALUESET);
+    lua_pushinteger(L, set->n);
+
+    return 1;
+}
+
+// 0 - not found, -1 - first value of the hash, n - more[hash][n]
+// hash of value_idx is set either way; indexes must be absolute
+static int valueset_find(lua_State *L, int set_idx, int value_idx,
+    lua_Integer *hash
+) {
+    luaF_visited visited = { .n = 0 };
+    *hash = hash_value(L, value_idx, &visited);
+
+    luaL_checkstack(L, 4, "valueset");
+    lua_getiuservalue(L, set_idx, VALUESET_UV_IDX_FIRST);
+
+    if (lua_rawgeti(L, -1, *hash) == LUA_TNIL) {
+        lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+        return 0;
+    }
+
+    int found = values_equal(L, lua_gettop(L), value_idx);
+    lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+
+    if (found) {
+        return -1;
+    }
+
+    lua_getiuservalue(L, set_idx, VALUESET_UV_IDX_MORE);
+
+    if (lua_rawgeti(L, -1, *hash) == LUA_TNIL) {
+        lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+        return 0;
+    }
+
+    int more_idx = lua_gettop(L);
+    lua_Integer more_n = lua_rawlen(L, more_idx);
+
+    for (lua_Integer i = 1; i <= more_n; i++) {
+        lua_rawgeti(L, more_idx, i);
+        found = values_equal(L, lua_gettop(L), value_idx);
+        lua_pop(L, 1); // lua_rawgeti
+
+        if (found) {
+            lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+            return i;
+        }
+    }
+
+    lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+    return 0;
+}
+
+// 1 - added, 0 - an equal value is in the set
+static int valueset_insert(lua_State *L, ud_valueset *set, int set_idx,
+    int value_idx
+) {
+    lua_Integer hash;
+
+    if (valueset_find(L, set_idx, value_idx, &hash)) {
+        return 0;
+    }
+
+    lua_getiuservalue(L, set_idx, VALUESET_UV_IDX_FIRST);
+
+    if (lua_rawgeti(L, -1, hash) == LUA_TNIL) {
+        lua_pushvalue(L, value_idx);
+        lua_rawseti(L, -3, hash);
+        lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+    } else { // hash collision, rare
+        lua_pop(L, 2); // lua_getiuservalue, lua_rawgeti
+        lua_getiuservalue(L, set_idx, VALUESET_UV_IDX_MORE);
+
+        if (lua_rawgeti(L, -1, hash) == LUA_TNIL) {
+            lua_pop(L, 1); // lua_rawgeti
+            lua_createtable(L, 1, 0);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, hash);
+        }
+
+        lua_pushvalue(L, value_idx);
+        lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+        lua_pop(L, 2); // lua_getiuservalue, more values
+    }
+
+    set->n++;
+    return 1;
+}
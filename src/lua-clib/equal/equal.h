@@ -2,10 +2,63 @@
 #define LUA_LIB_EQUAL_H
 
 #include <furiend/shared.h>
+#include <stdint.h>
+
+#define MT_VALUESET "equal.valueset*"
+
+#define VALUESET_UV_IDX_FIRST 1 // hash -> first value
+#define VALUESET_UV_IDX_MORE 2 // hash -> { other values with the hash }
+#define VALUESET_UV_N 2
+
+// type seeds, equal values of different types never share a hash
+#define HASH_SEED_NIL 0x9e3779b97f4a7c15ULL
+#define HASH_SEED_BOOL 0xbf58476d1ce4e5b9ULL
+#define HASH_SEED_INT 0x94d049bb133111ebULL
+#define HASH_SEED_FLOAT 0x2545f4914f6cdd1dULL
+#define HASH_SEED_STR 0x6a09e667f3bcc909ULL
+#define HASH_SEED_TABLE 0xbb67ae8584caa73bULL
+#define HASH_SEED_CYCLE 0x3c6ef372fe94f82bULL
+#define HASH_SEED_PTR 0xa54ff53a5f1d36f1ULL
+
+typedef struct {
+    lua_Integer n;
+} ud_valueset;
 
 LUAMOD_API int luaopen_equal(lua_State *L);
 
+int equal_hash(lua_State *L);
+int equal_valueset(lua_State *L);
+
 static int equal(lua_State *L);
+static int equal_call(lua_State *L);
 static int is_equal(lua_State *L, int a_idx, int b_idx, int cache_idx);
+static int values_equal(lua_State *L, int a_idx, int b_idx);
+
+static uint64_t hash_mix(uint64_t h);
+static uint64_t hash_bytes(const char *str, size_t len);
+static uint64_t hash_value(lua_State *L, int idx, luaF_visited *visited);
+
+static int valueset_add(lua_State *L);
+static int valueset_has(lua_State *L);
+static int valueset_remove(lua_State *L);
+static int valueset_len(lua_State *L);
+static int valueset_find(lua_State *L, int set_idx, int value_idx,
+    lua_Integer *hash);
+static int valueset_insert(lua_State *L, ud_valueset *set, int set_idx,
+    int value_idx);
+
+static const luaL_Reg equal_index[] = {
+    { "hash", equal_hash },
+    { "valueset", equal_valueset },
+    { NULL, NULL }
+};
+
+static const luaL_Reg valueset_methods[] = {
+    { "add", valueset_add },
+    { "has", valueset_has },
+    { "remove", valueset_remove },
+    { "len", valueset_len },
+    { NULL, NULL }
+};
 
 #endif
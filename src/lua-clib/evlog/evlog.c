@@ -0,0 +1,410 @@
+#include "evlog.h"
+
+static uint32_t crc32c_table[256];
+
+LUAMOD_API int luaopen_evlog(lua_State *L) {
+    crc32c_init();
+
+    if (likely(luaL_newmetatable(L, MT_EVLOG))) {
+        lua_pushcfunction(L, evlog_close);
+        lua_setfield(L, -2, "__gc");
+        luaL_newlib(L, evlog_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    if (likely(luaL_newmetatable(L, MT_EVLOG_REPLAY))) {
+        lua_pushcfunction(L, evlog_replay_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushcfunction(L, evlog_replay_call);
+        lua_setfield(L, -2, "__call");
+    }
+
+    lua_pop(L, 2);
+
+    luaL_newlib(L, evlog_index);
+
+    return 1;
+}
+
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (EVLOG_CRC32C_POLY & -(crc & 1));
+        }
+
+        crc32c_table[i] = crc;
+    }
+}
+
+static uint32_t crc32c(const char *buf, size_t len) {
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; ++i) {
+        crc = crc32c_table[(crc ^ (unsigned char)buf[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+// size of header + records that pass length and checksum checks
+static size_t valid_size(const char *addr, size_t size) {
+    size_t pos = sizeof(evlog_header);
+
+    while (size - pos >= sizeof(evlog_record_header)) {
+        evlog_record_header rh;
+        memcpy(&rh, addr + pos, sizeof(rh));
+
+        if (rh.len > size - pos - sizeof(rh)) {
+            break; // torn
+        }
+
+        if (crc32c(addr + pos + sizeof(rh), rh.len) != rh.crc) {
+            break; // corrupted
+        }
+
+        pos += sizeof(rh) + rh.len;
+    }
+
+    return pos;
+}
+
+// evlog.open(path[, batch]) -> log
+// torn tail of a crashed writer is cut off, appends continue after it
+int evlog_open(lua_State *L) {
+    luaF_min_max_args(L, 1, 2, "evlog.open");
+    const char *path = luaL_checkstring(L, 1);
+    lua_Integer batch = luaL_optinteger(L, 2, EVLOG_DEFAULT_BATCH);
+    luaL_argcheck(L, batch > 0 && batch <= INT_MAX, 2, "bad batch size");
+
+    ud_evlog *evlog = luaF_new_ud_or_error(L, sizeof(ud_evlog), 0);
+
+    evlog->fd = -1;
+    evlog->batch = batch;
+    evlog->pending = 0;
+    evlog->buf = luaF_strbuf_create(EVLOG_BUF_START_SIZE);
+    evlog->records = 0;
+    evlog->syncs = 0;
+    evlog->bytes = 0;
+
+    luaL_setmetatable(L, MT_EVLOG);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "evlog open failed; path: %s", path);
+    }
+
+    evlog->fd = fd; // closed by gc from here
+
+    struct stat st;
+
+    if (unlikely(fstat(fd, &st) != 0)) {
+        luaF_error_errno(L, "evlog fstat failed; path: %s", path);
+    }
+
+    size_t size = st.st_size;
+
+    if (size == 0) {
+        evlog_header header = {
+            .magic = EVLOG_MAGIC,
+            .version = EVLOG_VERSION,
+        };
+
+        luaF_strbuf_append(L, &evlog->buf, (const char *)&header,
+            sizeof(header));
+        evlog_write_buf(L, evlog);
+
+        return 1; // log
+    }
+
+    if (unlikely(size < sizeof(evlog_header))) {
+        luaL_error(L, "not an evlog; path: %s", path);
+    }
+
+    char *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (unlikely(addr == MAP_FAILED)) {
+        luaF_error_errno(L, "evlog mmap failed; path: %s", path);
+    }
+
+    evlog_header header;
+    memcpy(&header, addr, sizeof(header));
+
+    size_t valid = header.magic == EVLOG_MAGIC
+        && header.version == EVLOG_VERSION
+        ? valid_size(addr, size)
+        : 0;
+
+    if (unlikely(munmap(addr, size) != 0)) {
+        luaF_warning_errno(L, "evlog munmap failed; path: %s", path);
+    }
+
+    if (unlikely(valid == 0)) {
+        luaL_error(L, "not an evlog or version mismatch; path: %s", path);
+    }
+
+    if (unlikely(valid < size)) {
+        luaF_warning(L, "evlog: cutting torn tail: %d bytes; path: %s",
+            (int)(size - valid), path);
+
+        if (unlikely(ftruncate(fd, valid) != 0)) {
+            luaF_error_errno(L, "evlog ftruncate failed; path: %s", path);
+        }
+    }
+
+    evlog->bytes = valid;
+
+    return 1; // log
+}
+
+// log:append(payload): written with fdatasync every batch records
+int evlog_append(lua_State *L) {
+    luaF_need_args(L, 2, "evlog append");
+    ud_evlog *evlog = luaL_checkudata(L, 1, MT_EVLOG);
+    size_t len;
+    const char *payload = luaL_checklstring(L, 2, &len);
+
+    if (unlikely(evlog->fd < 0)) {
+        luaL_error(L, "evlog is closed");
+    }
+
+    if (unlikely(len > EVLOG_MAX_RECORD_LEN)) {
+        luaL_error(L, "evlog record is too long: %d", len);
+    }
+
+    evlog_record_header rh = {
+        .len = len,
+        .crc = crc32c(payload, len),
+    };
+
+    luaF_strbuf_append(L, &evlog->buf, (const char *)&rh, sizeof(rh));
+
+    if (likely(len > 0)) {
+        luaF_strbuf_append(L, &evlog->buf, payload, len);
+    }
+
+    evlog->records++;
+
+    if (++evlog->pending >= evlog->batch) {
+        evlog_write_buf(L, evlog);
+    }
+
+    return 0;
+}
+
+// log:flush() -> records written
+int evlog_flush(lua_State *L) {
+    luaF_need_args(L, 1, "evlog flush");
+    ud_evlog *evlog = luaL_checkudata(L, 1, MT_EVLOG);
+
+    int pending = evlog->pending;
+
+    if (likely(evlog->fd >= 0 && pending > 0)) {
+        evlog_write_buf(L, evlog);
+    }
+
+    lua_pushinteger(L, pending);
+
+    return 1;
+}
+
+// log:truncate() -> records dropped; checkpoint: the caller has a snapshot
+// covering everything logged so far, pending records are dropped too
+int evlog_truncate(lua_State *L) {
+    luaF_need_args(L, 1, "evlog truncate");
+    ud_evlog *evlog = luaL_checkudata(L, 1, MT_EVLOG);
+
+    if (unlikely(evlog->fd < 0)) {
+        luaL_error(L, "evlog is closed");
+    }
+
+    lua_Integer dropped = evlog->records;
+
+    evlog->buf.filled = 0;
+    evlog->pending = 0;
+    evlog->records = 0;
+
+    // O_APPEND: next write goes right after the header
+    if (unlikely(ftruncate(evlog->fd, sizeof(evlog_header)) != 0)) {
+        luaF_error_errno(L, "evlog ftruncate failed; fd: %d", evlog->fd);
+    }
+
+    if (unlikely(fdatasync(evlog->fd) != 0)) {
+        luaF_error_errno(L, "evlog fdatasync failed; fd: %d", evlog->fd);
+    }
+
+    evlog->bytes = sizeof(evlog_header);
+    evlog->syncs++;
+
+    lua_pushinteger(L, dropped);
+
+    return 1;
+}
+
+// one write for the whole batch, then fdatasync
+static void evlog_write_buf(lua_State *L, ud_evlog *evlog) {
+    luaF_strbuf *sb = &evlog->buf;
+    size_t written_total = 0;
+
+    while (written_total < sb->filled) {
+        ssize_t written = write(evlog->fd, sb->buf + written_total,
+            sb->filled - written_total);
+
+        if (unlikely(written < 0)) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            luaF_error_errno(L, "evlog write failed");
+        }
+
+        written_total += written;
+    }
+
+    if (unlikely(fdatasync(evlog->fd) != 0)) {
+        luaF_error_errno(L, "evlog fdatasync failed");
+    }
+
+    evlog->bytes += sb->filled;
+    evlog->syncs++;
+    evlog->pending = 0;
+    sb->filled = 0;
+}
+
+int evlog_stat(lua_State *L) {
+    luaF_need_args(L, 1, "evlog stat");
+    ud_evlog *evlog = luaL_checkudata(L, 1, MT_EVLOG);
+
+    lua_createtable(L, 0, 4);
+    luaF_set_kv_int(L, -1, "records", evlog->records);
+    luaF_set_kv_int(L, -1, "pending", evlog->pending);
+    luaF_set_kv_int(L, -1, "syncs", evlog->syncs);
+    luaF_set_kv_int(L, -1, "bytes", evlog->bytes);
+
+    return 1;
+}
+
+// pending records are flushed
+int evlog_close(lua_State *L) {
+    ud_evlog *evlog = luaL_checkudata(L, 1, MT_EVLOG);
+
+    if (evlog->fd >= 0) {
+        if (evlog->pending > 0) {
+            evlog_write_buf(L, evlog);
+        }
+
+        luaF_close_or_warning(L, evlog->fd);
+        evlog->fd = -1;
+    }
+
+    luaF_strbuf_free_buf(&evlog->buf);
+
+    return 0;
+}
+
+// evlog.replay(path) -> iterator: for payload in evlog.replay(path) do
+// stops at the end or at the first torn or corrupted record
+int evlog_replay(lua_State *L) {
+    luaF_need_args(L, 1, "evlog.replay");
+    const char *path = luaL_checkstring(L, 1);
+
+    ud_evlog_replay *replay = luaF_new_ud_or_error(L,
+        sizeof(ud_evlog_replay), 0);
+
+    replay->addr = NULL;
+    replay->size = 0;
+    replay->pos = sizeof(evlog_header);
+
+    luaL_setmetatable(L, MT_EVLOG_REPLAY);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "evlog open failed; path: %s", path);
+    }
+
+    struct stat st;
+
+    if (unlikely(fstat(fd, &st) != 0)) {
+        luaF_close_or_warning(L, fd);
+        luaF_error_errno(L, "evlog fstat failed; path: %s", path);
+    }
+
+    if (unlikely((size_t)st.st_size < sizeof(evlog_header))) {
+        luaF_close_or_warning(L, fd);
+        luaL_error(L, "not an evlog; path: %s", path);
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    luaF_close_or_warning(L, fd); // mapping holds the file
+
+    if (unlikely(addr == MAP_FAILED)) {
+        luaF_error_errno(L, "evlog mmap failed; path: %s", path);
+    }
+
+    replay->addr = addr;
+    replay->size = st.st_size;
+
+    madvise(replay->addr, replay->size, MADV_SEQUENTIAL);
+
+    evlog_header header;
+    memcpy(&header, replay->addr, sizeof(header));
+
+    if (unlikely(header.magic != EVLOG_MAGIC
+        || header.version != EVLOG_VERSION
+    )) {
+        luaL_error(L, "not an evlog or version mismatch; path: %s", path);
+    }
+
+    return 1; // iterator
+}
+
+static int evlog_replay_gc(lua_State *L) {
+    ud_evlog_replay *replay = luaL_checkudata(L, 1, MT_EVLOG_REPLAY);
+
+    if (replay->addr != NULL) {
+        if (unlikely(munmap(replay->addr, replay->size) != 0)) {
+            luaF_warning_errno(L, "evlog munmap failed");
+        }
+
+        replay->addr = NULL;
+    }
+
+    return 0;
+}
+
+static int evlog_replay_call(lua_State *L) {
+    ud_evlog_replay *replay = luaL_checkudata(L, 1, MT_EVLOG_REPLAY);
+
+    if (unlikely(replay->addr == NULL)) {
+        return 0; // after gc
+    }
+
+    size_t left = replay->size - replay->pos;
+    evlog_record_header rh;
+
+    if (left >= sizeof(rh)) {
+        const char *pos = replay->addr + replay->pos;
+
+        memcpy(&rh, pos, sizeof(rh));
+
+        if (likely(rh.len <= left - sizeof(rh)
+            && crc32c(pos + sizeof(rh), rh.len) == rh.crc
+        )) {
+            lua_pushlstring(L, pos + sizeof(rh), rh.len);
+            replay->pos += sizeof(rh) + rh.len;
+
+            return 1; // payload
+        }
+
+        luaF_warning(L, "evlog replay: torn or corrupted record at %d",
+            (int)replay->pos);
+    }
+
+    evlog_replay_gc(L); // end
+
+    return 0;
+}
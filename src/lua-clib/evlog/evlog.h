@@ -0,0 +1,87 @@
+#ifndef LUA_LIB_EVLOG_H
+#define LUA_LIB_EVLOG_H
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <furiend/shared.h>
+#include <furiend/strbuf.h>
+
+#define MT_EVLOG "evlog*"
+#define MT_EVLOG_REPLAY "evlog.replay*"
+
+#define EVLOG_MAGIC 0x4c455746 // "FWEL", also rejects foreign byte order
+#define EVLOG_VERSION 1
+
+#define EVLOG_DEFAULT_BATCH 64 // records per write + fdatasync
+#define EVLOG_BUF_START_SIZE 65536
+#define EVLOG_MAX_RECORD_LEN 0x7fffffff
+
+#define EVLOG_CRC32C_POLY 0x82f63b78 // reflected Castagnoli
+
+// file: header, records in native byte order
+// record: uint32 len, uint32 crc32c of payload, payload
+// a torn or corrupted tail ends replay and is cut off on open
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} evlog_header;
+
+typedef struct {
+    uint32_t len;
+    uint32_t crc;
+} evlog_record_header;
+
+typedef struct {
+    int fd;
+    int batch;
+    int pending; // records in buf
+    luaF_strbuf buf;
+    lua_Integer records; // appended since open or truncate
+    lua_Integer syncs;
+    lua_Integer bytes; // file size
+} ud_evlog;
+
+typedef struct {
+    char *addr;
+    size_t size;
+    size_t pos;
+} ud_evlog_replay;
+
+LUAMOD_API int luaopen_evlog(lua_State *L);
+
+int evlog_open(lua_State *L);
+int evlog_replay(lua_State *L);
+int evlog_append(lua_State *L);
+int evlog_flush(lua_State *L);
+int evlog_truncate(lua_State *L);
+int evlog_stat(lua_State *L);
+int evlog_close(lua_State *L);
+
+static int evlog_replay_gc(lua_State *L);
+static int evlog_replay_call(lua_State *L);
+
+static uint32_t crc32c(const char *buf, size_t len);
+static void crc32c_init(void);
+static size_t valid_size(const char *addr, size_t size);
+static void evlog_write_buf(lua_State *L, ud_evlog *evlog);
+
+static const luaL_Reg evlog_index[] = {
+    { "open", evlog_open },
+    { "replay", evlog_replay },
+    { NULL, NULL }
+};
+
+static const luaL_Reg evlog_methods[] = {
+    { "append", evlog_append },
+    { "flush", evlog_flush },
+    { "truncate", evlog_truncate },
+    { "stat", evlog_stat },
+    { "close", evlog_close },
+    { NULL, NULL }
+};
+
+#endif
@@ -8,6 +8,15 @@ LUAMOD_API int luaopen_fs(lua_State *L) {
         lua_setfield(L, -2, "__call");
     }
 
+    if (likely(luaL_newmetatable(L, MT_FS_CACHE))) {
+        lua_pushcfunction(L, fs_cache_close);
+        lua_setfield(L, -2, "__gc");
+        luaL_newlib(L, fs_cache_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_pop(L, 2);
+
     luaL_newlib(L, fs_index);
 
     lua_createtable(L, 0, 9);
@@ -103,8 +112,12 @@ int fs_readfile(lua_State *L) {
     luaF_need_args(L, 1, "readfile");
     luaL_checktype(L, 1, LUA_TSTRING);
 
-    const char *path = lua_tostring(L, 1);
+    fs_read_path(L, lua_tostring(L, 1));
 
+    return 1;
+}
+
+static void fs_read_path(lua_State *L, const char *path) {
     if (unlikely(strlen(path) == 0)) {
         luaL_error(L, "path is NULL");
     }
@@ -123,7 +136,7 @@ int fs_readfile(lua_State *L) {
 
     if (unlikely(size == 0)) {
         lua_pushliteral(L, "");
-        return 1;
+        return;
     }
 
     char *buf = luaF_malloc_or_error(L, size);
@@ -158,8 +171,6 @@ int fs_readfile(lua_State *L) {
     lua_pushlstring(L, buf, size);
 
     free(buf);
-
-    return 1;
 }
 
 int fs_parse_path(lua_State *L) {
@@ -187,3 +198,399 @@ int fs_parse_path(lua_State *L) {
     lua_pushliteral(L, ""); // ext
     return 2; // name without ext, ext
 }
+
+// cache { dir = "/path", max_bytes = 16777216 } -> cache
+// needs the async loop, dir changes are read from inotify on it
+int fs_cache(lua_State *L) {
+    luaF_need_args(L, 1, "fs cache");
+    luaL_checktype(L, 1, LUA_TTABLE); // conf
+
+    lua_getfield(L, 1, "dir");
+
+    if (unlikely(lua_type(L, -1) != LUA_TSTRING)) {
+        luaL_error(L, "fs cache: dir is not a string");
+    }
+
+    lua_getfield(L, 1, "max_bytes");
+    lua_Integer max_bytes = luaL_optinteger(L, -1, FS_CACHE_DEFAULT_MAX_BYTES);
+
+    if (unlikely(max_bytes < 0)) {
+        luaL_error(L, "fs cache: max_bytes is negative: %I", max_bytes);
+    }
+
+    lua_pop(L, 1); // max_bytes
+    lua_replace(L, 1); // conf -> dir
+
+    const char *dir = lua_tostring(L, 1);
+
+    ud_fs_cache *cache = luaF_new_ud_or_error(L,
+        sizeof(ud_fs_cache), FS_CACHE_UV_N);
+
+    memset(cache, 0, sizeof(ud_fs_cache));
+    cache->fd = -1;
+    cache->wd = -1;
+    cache->max_bytes = max_bytes;
+
+    luaL_setmetatable(L, MT_FS_CACHE);
+
+    lua_insert(L, 1); // dir, cache -> cache, dir
+    lua_setiuservalue(L, 1, FS_CACHE_UV_IDX_DIR);
+
+    lua_createtable(L, 0, 8);
+    lua_setiuservalue(L, 1, FS_CACHE_UV_IDX_FILES);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "inotify_init1 failed; dir: %s", dir);
+    }
+
+    cache->fd = fd;
+    cache->wd = inotify_add_watch(fd, dir, FS_CACHE_WATCH_MASK);
+
+    if (unlikely(cache->wd < 0)) {
+        luaF_error_errno(L, "inotify_add_watch failed; dir: %s", dir);
+    }
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, 1, FS_CACHE_UV_IDX_WATCH);
+
+    lua_pushcfunction(T, fs_cache_watch_start);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, T, 1); // cache >> T
+
+    int status = lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    if (unlikely(status != LUA_YIELD)) {
+        luaL_error(L, "fs cache watch failed; dir: %s; %s",
+            dir, lua_tostring(T, -1));
+    }
+
+    lua_settop(L, 1);
+
+    return 1; // cache
+}
+
+// cache:readfile("/index.html") -> contents
+// only names directly in dir are cached, nested paths are read as is
+static int fs_cache_readfile(lua_State *L) {
+    luaF_need_args(L, 2, "fs cache readfile");
+    ud_fs_cache *cache = luaL_checkudata(L, 1, MT_FS_CACHE);
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    size_t len;
+    const char *name = lua_tolstring(L, 2, &len);
+
+    while (len > 0 && *name == '/') {
+        name++;
+        len--;
+    }
+
+    lua_settop(L, 2);
+    lua_getiuservalue(L, 1, FS_CACHE_UV_IDX_FILES); // 3
+    lua_getiuservalue(L, 1, FS_CACHE_UV_IDX_DIR); // 4
+
+    int is_cacheable = cache->wd >= 0 && len > 0 && !memchr(name, '/', len);
+
+    if (likely(is_cacheable)) {
+        lua_pushlstring(L, name, len); // 5
+
+        if (likely(lua_rawget(L, 3) == LUA_TSTRING)) {
+            cache->hits++;
+            return 1; // contents
+        }
+
+        lua_pop(L, 1); // lua_rawget
+    }
+
+    cache->misses++;
+
+    lua_pushfstring(L, "%s/%s", lua_tostring(L, 4), name);
+    fs_read_path(L, lua_tostring(L, -1));
+
+    size_t size = lua_rawlen(L, -1);
+
+    if (likely(is_cacheable && size <= cache->max_bytes - cache->bytes)) {
+        lua_pushlstring(L, name, len);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, 3);
+
+        cache->bytes += size;
+        cache->files_n++;
+    }
+
+    return 1; // contents
+}
+
+static int fs_cache_stat(lua_State *L) {
+    luaF_need_args(L, 1, "fs cache stat");
+    ud_fs_cache *cache = luaL_checkudata(L, 1, MT_FS_CACHE);
+
+    lua_createtable(L, 0, 7);
+    luaF_set_kv_int(L, -1, "hits", cache->hits);
+    luaF_set_kv_int(L, -1, "misses", cache->misses);
+    luaF_set_kv_int(L, -1, "invalidations", cache->invalidations);
+    luaF_set_kv_int(L, -1, "files", cache->files_n);
+    luaF_set_kv_int(L, -1, "bytes", cache->bytes);
+    luaF_set_kv_int(L, -1, "max_bytes", cache->max_bytes);
+
+    lua_pushboolean(L, cache->wd >= 0);
+    lua_setfield(L, -2, "watching");
+
+    return 1;
+}
+
+// stops the watch, later reads go to disk
+static int fs_cache_close(lua_State *L) {
+    ud_fs_cache *cache = luaL_checkudata(L, 1, MT_FS_CACHE);
+
+    if (cache->fd < 0) {
+        return 0;
+    }
+
+    // the watch thread stays yielded forever, let fd_subs forget it
+    if (lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_FD_SUBS) == LUA_TTABLE) {
+        lua_pushnil(L);
+        lua_rawseti(L, -2, cache->fd);
+    }
+
+    lua_pop(L, 1); // lua_rawgeti
+
+    luaF_close_or_warning(L, cache->fd);
+    cache->fd = -1;
+    cache->wd = -1;
+
+    fs_cache_reset(L, cache, 1);
+
+    return 0;
+}
+
+static int fs_cache_watch_start(lua_State *L) {
+    ud_fs_cache *cache = lua_touserdata(L, FS_CACHE_IDX);
+
+    luaF_loop_watch(L, cache->fd, EPOLLIN, 0);
+
+    lua_settop(L, FS_CACHE_IDX);
+    return lua_yieldk(L, 0, 0, fs_cache_watch_continue);
+}
+
+static int fs_cache_watch_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)ctx;
+    (void)status;
+
+    luaF_loop_check_close(L);
+
+    ud_fs_cache *cache = lua_touserdata(L, FS_CACHE_IDX);
+    int emask = lua_tointeger(L, F_LOOP_EMASK_REL_IDX);
+
+    if (unlikely(cache->fd < 0)) {
+        return 0; // closed
+    }
+
+    if (unlikely(emask_has_errors(emask))) {
+        cache->wd = -1; // no invalidation anymore, reads bypass the cache
+        fs_cache_reset(L, cache, FS_CACHE_IDX);
+        luaL_error(L, "fs cache watch failed; fd: %d; %s",
+            cache->fd, emask_error_label(emask));
+    }
+
+    fs_cache_read_events(L, cache, FS_CACHE_IDX);
+
+    lua_settop(L, FS_CACHE_IDX);
+    return lua_yieldk(L, 0, 0, fs_cache_watch_continue);
+}
+
+static void fs_cache_read_events(lua_State *L, ud_fs_cache *cache,
+    int cache_idx
+) {
+    char buf[FS_CACHE_EVENTS_BUF_SIZE]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (1) {
+        ssize_t len = read(cache->fd, buf, sizeof(buf));
+
+        if (unlikely(len < 0)) {
+            if (likely(errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return; // drained
+            }
+
+            if (errno == EINTR) {
+                continue;
+            }
+
+            cache->wd = -1; // same as a failed watch
+            fs_cache_reset(L, cache, cache_idx);
+            luaF_error_errno(L, "inotify read failed; fd: %d", cache->fd);
+        }
+
+        const struct inotify_event *event;
+
+        for (char *pos = buf; pos < buf + len;
+            pos += sizeof(struct inotify_event) + event->len
+        ) {
+            event = (const struct inotify_event *)pos;
+
+            if (unlikely(event->mask & FS_CACHE_RESET_MASK)) {
+                if (!(event->mask & IN_Q_OVERFLOW)) {
+                    cache->wd = -1; // dir is gone, stop caching
+                }
+
+                fs_cache_reset(L, cache, cache_idx);
+            } else if (event->len > 0) {
+                fs_cache_drop(L, cache, cache_idx, event->name);
+            }
+        }
+    }
+}
+
+static void fs_cache_drop(lua_State *L, ud_fs_cache *cache, int cache_idx,
+    const char *name
+) {
+    lua_getiuservalue(L, cache_idx, FS_CACHE_UV_IDX_FILES);
+    lua_pushstring(L, name);
+
+    if (lua_rawget(L, -2) == LUA_TSTRING) {
+        cache->bytes -= lua_rawlen(L, -1);
+        cache->files_n--;
+        cache->invalidations++;
+
+        lua_pushstring(L, name);
+        lua_pushnil(L);
+        lua_rawset(L, -4);
+    }
+
+    lua_pop(L, 2); // lua_getiuservalue, lua_rawget
+}
+
+static void fs_cache_reset(lua_State *L, ud_fs_cache *cache, int cache_idx) {
+    cache->invalidations += cache->files_n;
+    cache->files_n = 0;
+    cache->bytes = 0;
+
+    lua_createtable(L, 0, 8);
+    lua_setiuservalue(L, cache_idx, FS_CACHE_UV_IDX_FILES);
+}
+
+// readfile_offload(path) -> thread, wait(thread) -> contents
+// the file is read on the async.offload pool, the loop is not blocked
+int fs_readfile_offload(lua_State *L) {
+    luaF_need_args(L, 1, "readfile_offload");
+    luaL_checktype(L, 1, LUA_TSTRING);
+
+    if (unlikely(lua_rawlen(L, 1) == 0)) {
+        luaL_error(L, "path is NULL");
+    }
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_insert(L, 1); // path, T -> T, path
+    lua_pushcfunction(T, fs_read_job_start);
+    lua_xmove(L, T, 1); // path >> T
+
+    lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+static int fs_read_job_start(lua_State *L) {
+    ud_fs_read_job *job = luaF_new_ud_or_error(L, sizeof(ud_fs_read_job), 0);
+
+    memset(job, 0, sizeof(ud_fs_read_job));
+    job->job.run = fs_read_job_run;
+    job->path = lua_tostring(L, 1);
+
+    return luaF_offload(L, &job->job, fs_read_job_continue);
+}
+
+static int fs_read_job_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_fs_read_job *job = (ud_fs_read_job *)ctx;
+
+    if (unlikely(job->failed != NULL)) {
+        free(job->buf);
+        job->buf = NULL;
+
+        if (job->err == 0) {
+            luaL_error(L, "%s; path: %s", job->failed, job->path);
+        }
+
+        errno = job->err;
+        luaF_error_errno(L, "%s failed; path: %s", job->failed, job->path);
+    }
+
+    if (job->len == 0) {
+        lua_pushliteral(L, "");
+    } else {
+        lua_pushlstring(L, job->buf, job->len);
+    }
+
+    free(job->buf);
+    job->buf = NULL;
+
+    return 1; // contents
+}
+
+// pool thread, no lua calls
+static void fs_read_job_run(luaF_job *base) {
+    ud_fs_read_job *job = (ud_fs_read_job *)base;
+    struct stat st;
+
+    int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+
+    if (unlikely(fd < 0)) {
+        job->failed = "open";
+        job->err = errno;
+        return;
+    }
+
+    if (unlikely(fstat(fd, &st) != 0)) {
+        job->failed = "fstat";
+        job->err = errno;
+        close(fd);
+        return;
+    }
+
+    if (unlikely(!S_ISREG(st.st_mode))) {
+        job->failed = "not a regular file";
+        close(fd);
+        return;
+    }
+
+    size_t size = st.st_size;
+
+    if (size > 0) {
+        job->buf = malloc(size);
+
+        if (unlikely(job->buf == NULL)) {
+            job->failed = "malloc";
+            job->err = errno;
+            close(fd);
+            return;
+        }
+    }
+
+    while (job->len < size) {
+        ssize_t read_n = read(fd, job->buf + job->len, size - job->len);
+
+        if (unlikely(read_n < 0)) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            job->failed = "read";
+            job->err = errno;
+            break;
+        }
+
+        if (unlikely(read_n == 0)) {
+            break; // truncated meanwhile, keep what was read
+        }
+
+        job->len += read_n;
+    }
+
+    close(fd);
+}
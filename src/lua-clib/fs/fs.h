@@ -7,30 +7,102 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <furiend/shared.h>
+#include <furiend/offload.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
 
 #define MT_DIR "dir*"
+#define MT_FS_CACHE "fs.cache*"
 
 #define DIR_UV_IDX_PATH 1
 
+#define FS_CACHE_UV_IDX_DIR 1
+#define FS_CACHE_UV_IDX_FILES 2 // name -> contents
+#define FS_CACHE_UV_IDX_WATCH 3 // thread reading inotify events
+#define FS_CACHE_UV_N 3
+
+#define FS_CACHE_IDX 1 // in the watch thread
+
+#define FS_CACHE_DEFAULT_MAX_BYTES (16 * 1024 * 1024)
+#define FS_CACHE_EVENTS_BUF_SIZE 4096
+
+#define FS_CACHE_WATCH_MASK ( \
+    IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | \
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+    IN_DELETE_SELF | IN_MOVE_SELF)
+
+// the watch is gone or events were lost, every entry is suspect
+#define FS_CACHE_RESET_MASK ( \
+    IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)
+
 typedef struct {
     DIR *dir;
 } ud_dir;
 
+// contents of files directly in dir, kept as lua strings
+typedef struct {
+    int fd; // inotify
+    int wd; // -1: dir is not watched, files are read as is
+    size_t max_bytes;
+    size_t bytes;
+    lua_Integer files_n;
+    lua_Integer hits;
+    lua_Integer misses;
+    lua_Integer invalidations;
+} ud_fs_cache;
+
+// readfile_offload job, path is pinned by the job thread stack
+typedef struct {
+    luaF_job job;
+    const char *path;
+    char *buf;
+    size_t len;
+    const char *failed; // NULL - ok, else the failed call
+    int err; // errno of the failed call
+} ud_fs_read_job;
+
 LUAMOD_API int luaopen_fs(lua_State *L);
 
 int fs_readdir(lua_State *L);
 int fs_readfile(lua_State *L);
 int fs_parse_path(lua_State *L);
+int fs_cache(lua_State *L);
+int fs_readfile_offload(lua_State *L);
 
 static int fs_dir_gc(lua_State *L);
 static int fs_dir_call(lua_State *L);
+static void fs_read_path(lua_State *L, const char *path);
+
+static int fs_cache_readfile(lua_State *L);
+static int fs_cache_stat(lua_State *L);
+static int fs_cache_close(lua_State *L);
+static int fs_cache_watch_start(lua_State *L);
+static int fs_cache_watch_continue(lua_State *L, int status, lua_KContext ctx);
+static void fs_cache_read_events(lua_State *L, ud_fs_cache *cache,
+    int cache_idx);
+static void fs_cache_drop(lua_State *L, ud_fs_cache *cache, int cache_idx,
+    const char *name);
+static void fs_cache_reset(lua_State *L, ud_fs_cache *cache, int cache_idx);
+
+static int fs_read_job_start(lua_State *L);
+static int fs_read_job_continue(lua_State *L, int status, lua_KContext ctx);
+static void fs_read_job_run(luaF_job *job);
 
 static const luaL_Reg fs_index[] = {
     { "readdir", fs_readdir },
     { "readfile", fs_readfile },
+    { "readfile_offload", fs_readfile_offload },
     { "parse_path", fs_parse_path },
+    { "cache", fs_cache },
     { "type", NULL }, // just reserve space
     { NULL, NULL }
 };
 
+static const luaL_Reg fs_cache_methods[] = {
+    { "readfile", fs_cache_readfile },
+    { "stat", fs_cache_stat },
+    { "close", fs_cache_close },
+    { NULL, NULL }
+};
+
 #endif
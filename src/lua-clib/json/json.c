@@ -1,43 +1,509 @@
 #include "json.h"
 
 LUAMOD_API int luaopen_json(lua_State *L) {
-    luaL_newlib(L, json_index);
+    if (likely(luaL_newmetatable(L, MT_JSON_LAZY))) {
+        luaL_setfuncs(L, json_lazy_mt, 0);
+    }
+
+    if (likely(luaL_newmetatable(L, MT_JSON_DOC))) {
+        lua_pushcfunction(L, json_doc_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    if (likely(luaL_newmetatable(L, MT_JSON_BUF))) {
+        lua_pushcfunction(L, json_buf_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    if (likely(luaL_newmetatable(L, MT_JSON_PARSER))) {
+        lua_pushcfunction(L, json_parser_gc);
+        lua_setfield(L, -2, "__gc");
+
+        luaL_newlib(L, json_parser_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_pop(L, 4);
+
+    luaL_newlibtable(L, json_index);
+
+    ud_json_buf *buf = luaF_new_ud_or_error(L, sizeof(ud_json_buf), 0);
+    buf->sb = luaF_strbuf_create(JSON_BUF_START_SIZE);
+    luaL_setmetatable(L, MT_JSON_BUF);
+
+    luaL_setfuncs(L, json_index, 1); // buf is upvalue 1 of every function
     return 1;
 }
 
-int json_parse(lua_State *L) {
-    luaF_need_args(L, 1, "json.parse");
-    luaL_checktype(L, 1, LUA_TSTRING);
+static int json_buf_gc(lua_State *L) {
+    ud_json_buf *buf = luaL_checkudata(L, 1, MT_JSON_BUF);
+    luaF_strbuf_free_buf(&buf->sb);
+
+    return 0;
+}
+
+static int json_doc_gc(lua_State *L) {
+    ud_json_doc *ud = luaL_checkudata(L, 1, MT_JSON_DOC);
+    yyjson_doc_free(ud->doc);
+    ud->doc = NULL;
 
+    return 0;
+}
+
+static yyjson_doc *json_read(lua_State *L, int idx, const yyjson_alc *alc) {
     size_t len;
-    const char *json = lua_tolstring(L, 1, &len);
+    const char *json = lua_tolstring(L, idx, &len);
 
     int flags = YYJSON_READ_NOFLAG;
     yyjson_read_err err;
-    yyjson_doc *doc = yyjson_read_opts((char *)json, len, flags, NULL, &err);
+    yyjson_doc *doc = yyjson_read_opts((char *)json, len, flags, alc, &err);
 
     if (unlikely(!doc)) {
         luaL_error(L, "%s (%d)", err.msg, err.code);
     }
 
+    return doc;
+}
+
+int json_parse(lua_State *L) {
+    luaF_need_args(L, 1, "json.parse");
+    luaL_checktype(L, 1, LUA_TSTRING);
+
+    yyjson_doc *doc = json_read(L, 1, NULL);
+
     json_parse_value(L, yyjson_doc_get_root(doc));
     yyjson_doc_free(doc);
 
     return 1;
 }
 
+// parse_offload(json) -> thread, wait(thread) -> value
+// for multi-MB bodies: yyjson reads on the async.offload pool,
+// only the conversion to lua values runs on the loop
+int json_parse_offload(lua_State *L) {
+    luaF_need_args(L, 1, "json.parse_offload");
+    luaL_checktype(L, 1, LUA_TSTRING);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_insert(L, 1); // json, T -> T, json
+    lua_pushcfunction(T, json_job_start);
+    lua_xmove(L, T, 1); // json >> T
+
+    lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+static int json_job_start(lua_State *L) {
+    ud_json_job *job = luaF_new_ud_or_error(L, sizeof(ud_json_job), 0);
+
+    job->job.run = json_job_run;
+    job->json = lua_tolstring(L, 1, &job->len);
+    job->doc = NULL;
+
+    return luaF_offload(L, &job->job, json_job_continue);
+}
+
+static int json_job_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_json_job *job = (ud_json_job *)ctx;
+
+    if (unlikely(!job->doc)) {
+        luaL_error(L, "%s (%d)", job->err.msg, job->err.code);
+    }
+
+    json_parse_value(L, yyjson_doc_get_root(job->doc));
+    yyjson_doc_free(job->doc);
+    job->doc = NULL;
+
+    return 1;
+}
+
+// pool thread, no lua calls
+static void json_job_run(luaF_job *base) {
+    ud_json_job *job = (ud_json_job *)base;
+
+    job->doc = yyjson_read_opts((char *)job->json, job->len,
+        YYJSON_READ_NOFLAG, NULL, &job->err);
+}
+
+// parse_lazy(json) -> proxy of the root object or array, or a scalar
+// the doc stays parsed in a userdata, values become lua values on index
+// or pairs; proxies are read only, equal values give different proxies
+int json_parse_lazy(lua_State *L) {
+    luaF_need_args(L, 1, "json.parse_lazy");
+    luaL_checktype(L, 1, LUA_TSTRING);
+
+    ud_json_doc *ud = luaF_new_ud_or_error(L, sizeof(ud_json_doc), 0);
+    ud->doc = NULL;
+    luaL_setmetatable(L, MT_JSON_DOC); // json, doc
+
+    ud->doc = json_read(L, 1, NULL);
+
+    json_push_lazy(L, yyjson_doc_get_root(ud->doc), 2);
+
+    return 1;
+}
+
+// get(json or proxy, "payload.event.*.chat.id") -> value
+// tensor.unwrap path rules; digits index arrays from 1
+// a string is parsed and freed, found objects and arrays become tables;
+// from a proxy they stay proxies of the same doc
+int json_get(lua_State *L) {
+    luaF_need_args(L, 2, "json.get");
+
+    size_t path_len;
+    const char *path = luaL_checklstring(L, 2, &path_len);
+
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        yyjson_doc *doc = json_read(L, 1, NULL);
+        yyjson_val *found = json_walk(yyjson_doc_get_root(doc), path,
+            path_len);
+
+        if (found) {
+            json_parse_value(L, found);
+        } else {
+            lua_pushnil(L);
+        }
+
+        yyjson_doc_free(doc);
+        return 1;
+    }
+
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+    yyjson_val *found = json_walk(lazy->val, path, path_len);
+
+    if (!found) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_getiuservalue(L, 1, JSON_LAZY_UV_IDX_DOC); // doc
+    json_push_lazy(L, found, lua_gettop(L));
+
+    return 1;
+}
+
+// materialize(proxy) -> tables, like parse of the same json
+int json_materialize(lua_State *L) {
+    luaF_need_args(L, 1, "json.materialize");
+
+    if (lua_type(L, 1) != LUA_TUSERDATA) {
+        return 1; // already a lua value
+    }
+
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+    json_parse_value(L, lazy->val);
+
+    return 1;
+}
+
+// parser(mode?) -> parser for a json stream fed in chunks
+// "values" (default): top level values one after another, separated by
+// whitespace, e.g. newline delimited json logs
+// "array": elements of one top level array, the array is never held whole
+int json_parser(lua_State *L) {
+    const char *mode_str = luaL_optstring(L, 1, "values");
+    int mode;
+
+    if (strcmp(mode_str, "values") == 0) {
+        mode = JSON_PARSER_VALUES;
+    } else if (strcmp(mode_str, "array") == 0) {
+        mode = JSON_PARSER_ARRAY;
+    } else {
+        return luaL_error(L, "unknown json parser mode: %s", mode_str);
+    }
+
+    ud_json_parser *parser = luaF_new_ud_or_error(L,
+        sizeof(ud_json_parser), 0);
+
+    memset(parser, 0, sizeof(ud_json_parser));
+    parser->sb = luaF_strbuf_create(JSON_PARSER_START_SIZE);
+    parser->mode = mode;
+    parser->stage = mode == JSON_PARSER_ARRAY
+        ? JSON_PARSER_OPEN
+        : JSON_PARSER_FIRST;
+
+    luaL_setmetatable(L, MT_JSON_PARSER);
+    return 1;
+}
+
+// parser:feed(chunk) -> values, n
+// chunks may split the stream anywhere; values completed by the chunk are
+// parsed at once, only the unfinished one is kept; json null leaves a hole
+static int json_parser_feed(lua_State *L) {
+    ud_json_parser *parser = luaL_checkudata(L, 1, MT_JSON_PARSER);
+
+    size_t len;
+    const char *chunk = luaL_checklstring(L, 2, &len);
+
+    if (unlikely(parser->failed)) {
+        luaL_error(L, "json parser: stream is broken by an earlier error");
+    }
+
+    lua_settop(L, 2);
+    lua_newtable(L); // values
+    lua_Integer values_n = 0;
+
+    if (len > 0) {
+        luaF_strbuf_append(L, &parser->sb, chunk, len);
+        json_parser_scan(L, parser, 3, &values_n);
+    }
+
+    lua_pushinteger(L, values_n);
+    return 2;
+}
+
+// parser:finish() -> values, n
+// ends the stream: a trailing number, true, false or null is emitted,
+// an unfinished value or array errors; the parser is ready for a new stream
+static int json_parser_finish(lua_State *L) {
+    ud_json_parser *parser = luaL_checkudata(L, 1, MT_JSON_PARSER);
+
+    if (unlikely(parser->failed)) {
+        luaL_error(L, "json parser: stream is broken by an earlier error");
+    }
+
+    lua_settop(L, 1);
+    lua_newtable(L); // values
+    lua_Integer values_n = 0;
+
+    if (parser->in_value) {
+        if (!parser->is_scalar) {
+            json_parser_fail(L, parser, "unexpected end of value");
+        }
+
+        json_parser_emit(L, parser, 0, parser->sb.filled, 2, &values_n);
+    }
+
+    if (parser->mode == JSON_PARSER_ARRAY
+        && parser->stage != JSON_PARSER_DONE
+    ) {
+        json_parser_fail(L, parser, "unexpected end of array");
+    }
+
+    parser->sb.filled = 0;
+    parser->scan_pos = 0;
+    parser->stage = parser->mode == JSON_PARSER_ARRAY
+        ? JSON_PARSER_OPEN
+        : JSON_PARSER_FIRST;
+
+    lua_pushinteger(L, values_n);
+    return 2;
+}
+
+static int json_parser_gc(lua_State *L) {
+    ud_json_parser *parser = luaL_checkudata(L, 1, MT_JSON_PARSER);
+    luaF_strbuf_free_buf(&parser->sb);
+
+    return 0;
+}
+
+static void json_parser_fail(lua_State *L, ud_json_parser *parser,
+    const char *msg
+) {
+    parser->failed = 1;
+    luaL_error(L, "json parser: %s", msg);
+}
+
+// finds value bounds only: strings, escapes and bracket depth;
+// yyjson validates each found value
+static void json_parser_scan(lua_State *L, ud_json_parser *parser,
+    int values_idx, lua_Integer *values_n
+) {
+    const char *buf = parser->sb.buf;
+    size_t len = parser->sb.filled;
+    size_t start = 0; // an unfinished value is shifted to 0 after each feed
+    size_t i = parser->scan_pos;
+
+    while (i < len) {
+        char c = buf[i];
+
+        if (parser->in_escape) {
+            parser->in_escape = 0;
+            i++;
+            continue;
+        }
+
+        if (parser->in_str) {
+            while (i < len && buf[i] != '"' && buf[i] != '\\') {
+                i++;
+            }
+
+            if (i == len) {
+                break;
+            }
+
+            if (buf[i] == '\\') {
+                parser->in_escape = 1;
+            } else {
+                parser->in_str = 0;
+
+                if (parser->depth == 0) { // top level string
+                    json_parser_emit(L, parser, start, i + 1,
+                        values_idx, values_n);
+                }
+            }
+
+            i++;
+            continue;
+        }
+
+        if (parser->in_value && parser->is_scalar) {
+            switch (c) {
+                case ' ': case '\t': case '\r': case '\n':
+                case ',': case ']': case '}': case '[': case '{': case '"':
+                    json_parser_emit(L, parser, start, i,
+                        values_idx, values_n);
+                    continue; // the delimiter is read between values
+                default:
+                    i++;
+                    continue;
+            }
+        }
+
+        if (parser->in_value) {
+            switch (c) {
+                case '"':
+                    parser->in_str = 1;
+                    break;
+                case '{': case '[':
+                    parser->depth++;
+                    break;
+                case '}': case ']':
+                    if (--parser->depth == 0) {
+                        json_parser_emit(L, parser, start, i + 1,
+                            values_idx, values_n);
+                    }
+
+                    break;
+            }
+
+            i++;
+            continue;
+        }
+
+        switch (c) { // between values
+            case ' ': case '\t': case '\r': case '\n':
+                i++;
+                continue;
+        }
+
+        switch (parser->stage) {
+            case JSON_PARSER_OPEN:
+                if (unlikely(c != '[')) {
+                    json_parser_fail(L, parser, "'[' expected");
+                }
+
+                parser->stage = JSON_PARSER_FIRST;
+                i++;
+                continue;
+            case JSON_PARSER_FIRST:
+                if (c == ']' && parser->mode == JSON_PARSER_ARRAY) {
+                    parser->stage = JSON_PARSER_DONE;
+                    i++;
+                    continue;
+                }
+
+                break;
+            case JSON_PARSER_COMMA:
+                if (c == ',') {
+                    parser->stage = JSON_PARSER_NEXT;
+                } else if (likely(c == ']')) {
+                    parser->stage = JSON_PARSER_DONE;
+                } else {
+                    json_parser_fail(L, parser, "',' or ']' expected");
+                }
+
+                i++;
+                continue;
+            case JSON_PARSER_DONE:
+                json_parser_fail(L, parser, "data after the array");
+        }
+
+        parser->in_value = 1;
+        start = i;
+
+        switch (c) {
+            case '{': case '[':
+                parser->depth = 1;
+                break;
+            case '"':
+                parser->in_str = 1;
+                break;
+            case ',': case ']': case '}': case ':':
+                json_parser_fail(L, parser, "value expected");
+                break;
+            default:
+                parser->is_scalar = 1;
+        }
+
+        i++;
+    }
+
+    size_t consumed = parser->in_value ? start : len;
+
+    if (consumed > 0) {
+        luaF_strbuf_shift(L, &parser->sb, consumed);
+    }
+
+    parser->scan_pos = len - consumed;
+}
+
+static void json_parser_emit(lua_State *L, ud_json_parser *parser,
+    size_t start, size_t end, int values_idx, lua_Integer *values_n
+) {
+    yyjson_read_err err;
+    yyjson_doc *doc = yyjson_read_opts(parser->sb.buf + start, end - start,
+        YYJSON_READ_NOFLAG, NULL, &err);
+
+    if (unlikely(!doc)) {
+        parser->failed = 1;
+        luaL_error(L, "json parser: %s (%d)", err.msg, err.code);
+    }
+
+    json_parse_value(L, yyjson_doc_get_root(doc));
+    yyjson_doc_free(doc);
+    lua_rawseti(L, values_idx, ++(*values_n));
+
+    parser->in_value = 0;
+    parser->is_scalar = 0;
+    parser->depth = 0;
+
+    if (parser->mode == JSON_PARSER_ARRAY) {
+        parser->stage = JSON_PARSER_COMMA;
+    }
+}
+
+// walks the value once, writes into the reused buffer
 int json_stringify(lua_State *L) {
     luaF_need_args(L, 1, "json.stringify");
 
-    int cache_index = 0;
+    ud_json_buf *buf = lua_touserdata(L, lua_upvalueindex(1));
+    luaF_strbuf *sb = &buf->sb;
+    sb->filled = 0;
+
+    luaF_visited visited = { .n = 0 };
+    json_write(L, sb, 1, &visited);
+    lua_pushlstring(L, sb->buf, sb->filled);
 
-    if (likely(lua_type(L, 1) == LUA_TTABLE)) {
-        lua_createtable(L, 0, 1);
-        cache_index = lua_gettop(L);
+    if (unlikely(sb->capacity > JSON_BUF_KEEP_SIZE)) {
+        luaF_strbuf_free_buf(sb);
+        *sb = luaF_strbuf_create(JSON_BUF_START_SIZE);
     }
 
+    return 1;
+}
+
+// the former path: builds a yyjson mutable doc, kept for comparison
+int json_stringify_yyjson(lua_State *L) {
+    luaF_need_args(L, 1, "json.stringify_yyjson");
+
+    luaF_visited visited = { .n = 0 };
     yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
-    yyjson_mut_val *value = json_stringify_value(L, doc, 1, cache_index);
+    yyjson_mut_val *value = json_stringify_value(L, doc, 1, &visited);
 
     yyjson_mut_doc_set_root(doc, value);
 
@@ -116,11 +582,23 @@ static void json_parse_value(lua_State *L, yyjson_val *value) {
     }
 }
 
+// errors on a table that is already on the path, or on too deep nesting
+static void json_enter(lua_State *L, luaF_visited *visited, int idx) {
+    const void *ptr = lua_topointer(L, idx);
+    int entered = luaF_visit(visited, ptr);
+
+    if (unlikely(entered == 0)) {
+        luaL_error(L, "circular table: %p", ptr);
+    } else if (unlikely(entered < 0)) {
+        luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
+    }
+}
+
 static yyjson_mut_val *json_stringify_value(
     lua_State *L,
     yyjson_mut_doc *doc,
     int index,
-    int cache_index
+    luaF_visited *visited
 ) {
     switch (lua_type(L, index)) {
         case LUA_TNONE:
@@ -139,7 +617,14 @@ static yyjson_mut_val *json_stringify_value(
             const char *str = lua_tolstring(L, index, &len);
             return yyjson_mut_strn(doc, str, len);
         } case LUA_TTABLE:
-            return json_stringify_table(L, doc, index, cache_index);
+            return json_stringify_table(L, doc, index, visited);
+        case LUA_TUSERDATA: {
+            ud_json_lazy *lazy = luaL_testudata(L, index, MT_JSON_LAZY);
+
+            if (lazy) {
+                return yyjson_val_mut_copy(doc, lazy->val);
+            }
+        } // fallthrough
         default: // LUA_TFUNCTION LUA_TTHREAD LUA_TUSERDATA LUA_TLIGHTUSERDATA
             luaF_warning(L, "json.stringify: type is not supported; type: %s",
                 luaL_typename(L, index));
@@ -151,31 +636,25 @@ static yyjson_mut_val *json_stringify_table(
     lua_State *L,
     yyjson_mut_doc *doc,
     int index,
-    int cache_index
+    luaF_visited *visited
 ) {
     luaL_checkstack(L, 4, "json.stringify");
+    json_enter(L, visited, index);
 
-    const void *cache_key = lua_topointer(L, index);
+    lua_Integer arr_n;
 
-    if (unlikely(lua_rawgetp(L, cache_index, cache_key) != LUA_TNIL)) {
-        luaL_error(L, "circular table: %p", cache_key);
-    }
-
-    lua_pop(L, 1); // lua_rawgetp
-    lua_pushboolean(L, 1);
-    lua_rawsetp(L, cache_index, cache_key);
-
-    if (unlikely(luaF_is_array(L, index))) {
+    if (unlikely(luaF_table_kind(L, index, &arr_n) == F_TABLE_ARRAY)) {
         yyjson_mut_val *arr = yyjson_mut_arr(doc);
         yyjson_mut_val *val;
 
-        lua_pushnil(L);
-        while (lua_next(L, index)) {
-            val = json_stringify_value(L, doc, lua_gettop(L), cache_index);
+        for (lua_Integer i = 1; i <= arr_n; i++) {
+            lua_rawgeti(L, index, i);
+            val = json_stringify_value(L, doc, lua_gettop(L), visited);
             yyjson_mut_arr_add_val(arr, val);
-            lua_pop(L, 1); // lua_next
+            lua_pop(L, 1); // lua_rawgeti
         }
 
+        luaF_unvisit(visited);
         return arr;
     }
 
@@ -192,12 +671,621 @@ static yyjson_mut_val *json_stringify_table(
 
         size_t key_len;
         const char *key = lua_tolstring(L, lua_gettop(L) - 1, &key_len);
-        val = json_stringify_value(L, doc, lua_gettop(L), cache_index);
+        val = json_stringify_value(L, doc, lua_gettop(L), visited);
 
         yyjson_mut_obj_add(obj, yyjson_mut_strn(doc, key, key_len), val);
 
         lua_pop(L, 1); // lua_next
     }
 
+    luaF_unvisit(visited);
     return obj;
 }
+
+// containers become proxies that keep the doc at doc_idx alive
+static void json_push_lazy(lua_State *L, yyjson_val *value, int doc_idx) {
+    if (!yyjson_is_ctn(value)) {
+        json_parse_value(L, value);
+        return;
+    }
+
+    ud_json_lazy *lazy = luaF_new_ud_or_error(L, sizeof(ud_json_lazy), 1);
+    lazy->val = value;
+    luaL_setmetatable(L, MT_JSON_LAZY);
+
+    lua_pushvalue(L, doc_idx);
+    lua_setiuservalue(L, -2, JSON_LAZY_UV_IDX_DOC);
+}
+
+static int json_lazy_index(lua_State *L) {
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+    yyjson_val *found = NULL;
+
+    if (yyjson_is_obj(lazy->val)) {
+        if (lua_type(L, 2) == LUA_TSTRING) {
+            size_t key_len;
+            const char *key = lua_tolstring(L, 2, &key_len);
+            found = yyjson_obj_getn(lazy->val, key, key_len);
+        }
+    } else if (lua_isinteger(L, 2)) { // array
+        lua_Integer i = lua_tointeger(L, 2);
+
+        if (i >= 1 && (size_t)i <= yyjson_arr_size(lazy->val)) {
+            found = yyjson_arr_get(lazy->val, i - 1);
+        }
+    }
+
+    if (!found) {
+        return 0;
+    }
+
+    lua_getiuservalue(L, 1, JSON_LAZY_UV_IDX_DOC);
+    json_push_lazy(L, found, lua_gettop(L));
+
+    return 1;
+}
+
+// arrays have a length, objects have 0 like tables with string keys
+static int json_lazy_len(lua_State *L) {
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+
+    lua_pushinteger(L, yyjson_is_arr(lazy->val)
+        ? (lua_Integer)yyjson_arr_size(lazy->val) : 0);
+
+    return 1;
+}
+
+static int json_lazy_pairs(lua_State *L) {
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+
+    ud_json_lazy_iter *iter = luaF_new_ud_or_error(L,
+        sizeof(ud_json_lazy_iter), 0);
+    iter->n = 0;
+
+    if (yyjson_is_obj(lazy->val)) {
+        yyjson_obj_iter_init(lazy->val, &iter->obj);
+    } else {
+        yyjson_arr_iter_init(lazy->val, &iter->arr);
+    }
+
+    lua_pushcclosure(L, json_lazy_next, 1); // iter
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+
+    return 3;
+}
+
+// upvalue iter walks the doc in order, the key argument is not needed
+static int json_lazy_next(lua_State *L) {
+    ud_json_lazy *lazy = luaL_checkudata(L, 1, MT_JSON_LAZY);
+    ud_json_lazy_iter *iter = lua_touserdata(L, lua_upvalueindex(1));
+    yyjson_val *value;
+
+    if (yyjson_is_obj(lazy->val)) {
+        yyjson_val *key = yyjson_obj_iter_next(&iter->obj);
+
+        if (!key) {
+            return 0;
+        }
+
+        lua_pushlstring(L, yyjson_get_str(key), yyjson_get_len(key));
+        value = yyjson_obj_iter_get_val(key);
+    } else {
+        value = yyjson_arr_iter_next(&iter->arr);
+
+        if (!value) {
+            return 0;
+        }
+
+        lua_pushinteger(L, ++iter->n);
+    }
+
+    lua_getiuservalue(L, 1, JSON_LAZY_UV_IDX_DOC);
+    json_push_lazy(L, value, lua_gettop(L)); // key, doc, value
+    lua_remove(L, -2); // key, value
+
+    return 2;
+}
+
+// key of an object, or 1 based index of an array
+static yyjson_val *json_child(yyjson_val *value, const char *key,
+    size_t key_len
+) {
+    if (yyjson_is_obj(value)) {
+        return yyjson_obj_getn(value, key, key_len);
+    }
+
+    if (!yyjson_is_arr(value) || key_len == 0 || key_len > 18) {
+        return NULL;
+    }
+
+    size_t i = 0;
+
+    for (size_t pos = 0; pos < key_len; pos++) {
+        if (key[pos] < '0' || key[pos] > '9') {
+            return NULL;
+        }
+
+        i = i * 10 + (key[pos] - '0');
+    }
+
+    if (i < 1 || i > yyjson_arr_size(value)) {
+        return NULL;
+    }
+
+    return yyjson_arr_get(value, i - 1);
+}
+
+// same rules as tensor.unwrap: "*" followed by a dot tries every child
+// and gives the first non null result, the last segment is a key
+static yyjson_val *json_walk(yyjson_val *value, const char *path,
+    size_t path_len
+) {
+    while (path_len > 0) {
+        if (unlikely(!yyjson_is_ctn(value))) {
+            return NULL;
+        }
+
+        const char *pos = memchr(path, '.', path_len);
+
+        if (!pos) {
+            return json_child(value, path, path_len);
+        }
+
+        size_t chunk_len = pos - path;
+
+        if (chunk_len == 1 && *path == '*') {
+            path += 2;
+            path_len -= 2;
+
+            yyjson_val *child, *found;
+
+            if (yyjson_is_obj(value)) {
+                yyjson_obj_iter iter = yyjson_obj_iter_with(value);
+                yyjson_val *key;
+
+                while ((key = yyjson_obj_iter_next(&iter))) {
+                    child = yyjson_obj_iter_get_val(key);
+                    found = json_walk(child, path, path_len);
+
+                    if (found && !yyjson_is_null(found)) {
+                        return found;
+                    }
+                }
+            } else {
+                yyjson_arr_iter iter = yyjson_arr_iter_with(value);
+
+                while ((child = yyjson_arr_iter_next(&iter))) {
+                    found = json_walk(child, path, path_len);
+
+                    if (found && !yyjson_is_null(found)) {
+                        return found;
+                    }
+                }
+            }
+
+            return NULL;
+        }
+
+        value = json_child(value, path, chunk_len);
+
+        if (!value) {
+            return NULL;
+        }
+
+        path += chunk_len + 1; // 1 for dot
+        path_len -= chunk_len + 1; // 1 for dot
+    }
+
+    return value;
+}
+
+static char *json_reserve(lua_State *L, luaF_strbuf *sb, size_t len) {
+    if (unlikely(!sb->buf || sb->capacity - sb->filled < len)) {
+        luaF_strbuf_ensure_space(L, sb, len);
+    }
+
+    return sb->buf + sb->filled;
+}
+
+static void json_put(lua_State *L, luaF_strbuf *sb, const char *data,
+    size_t len
+) {
+    memcpy(json_reserve(L, sb, len), data, len);
+    sb->filled += len;
+}
+
+// same output as the yyjson path with YYJSON_WRITE_ESCAPE_UNICODE
+static void json_write(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited
+) {
+    switch (lua_type(L, idx)) {
+        case LUA_TNONE:
+        case LUA_TNIL:
+            json_put(L, sb, "null", 4);
+            return;
+        case LUA_TBOOLEAN:
+            if (lua_toboolean(L, idx)) {
+                json_put(L, sb, "true", 4);
+            } else {
+                json_put(L, sb, "false", 5);
+            }
+
+            return;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) {
+                json_write_int(L, sb, lua_tointeger(L, idx));
+            } else {
+                json_write_real(L, sb, lua_tonumber(L, idx));
+            }
+
+            return;
+        case LUA_TSTRING: {
+            size_t len;
+            const char *str = lua_tolstring(L, idx, &len);
+            json_write_str(L, sb, str, len);
+            return;
+        } case LUA_TTABLE:
+            json_write_table(L, sb, idx, visited);
+            return;
+        case LUA_TUSERDATA: {
+            ud_json_lazy *lazy = luaL_testudata(L, idx, MT_JSON_LAZY);
+
+            if (lazy) {
+                json_write_lazy(L, sb, lazy);
+                return;
+            }
+        } // fallthrough
+        default: // LUA_TFUNCTION LUA_TTHREAD LUA_TUSERDATA LUA_TLIGHTUSERDATA
+            luaF_warning(L, "json.stringify: type is not supported; type: %s",
+                luaL_typename(L, idx));
+            json_put(L, sb, "null", 4);
+    }
+}
+
+static void json_write_table(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited
+) {
+    luaL_checkstack(L, 4, "json.stringify");
+    json_enter(L, visited, idx);
+
+    lua_Integer arr_n;
+    int kind = luaF_table_kind(L, idx, &arr_n);
+
+    if (unlikely(kind == F_TABLE_ARRAY)) {
+        json_put(L, sb, "[", 1);
+
+        for (lua_Integer i = 1; i <= arr_n; i++) {
+            if (i > 1) {
+                json_put(L, sb, ",", 1);
+            }
+
+            lua_rawgeti(L, idx, i);
+            json_write(L, sb, lua_gettop(L), visited);
+            lua_pop(L, 1); // lua_rawgeti
+        }
+
+        json_put(L, sb, "]", 1);
+        luaF_unvisit(visited);
+        return;
+    }
+
+    int first = 1;
+
+    json_put(L, sb, "{", 1);
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) { // k, v
+        if (unlikely(lua_type(L, -2) != LUA_TSTRING)) {
+            luaL_error(L, "key is not a string; type: %s; key: %s",
+                luaL_typename(L, -2),
+                lua_tostring(L, -2));
+        }
+
+        if (!first) {
+            json_put(L, sb, ",", 1);
+        }
+
+        first = 0;
+
+        size_t key_len;
+        const char *key = lua_tolstring(L, -2, &key_len);
+
+        json_write_str(L, sb, key, key_len);
+        json_put(L, sb, ":", 1);
+        json_write(L, sb, lua_gettop(L), visited);
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    json_put(L, sb, "}", 1);
+    luaF_unvisit(visited);
+}
+
+static void json_write_int(lua_State *L, luaF_strbuf *sb, lua_Integer num) {
+    char tmp[JSON_NUM_MAX_LEN];
+    int n = 0;
+    uint64_t u = num < 0 ? -(uint64_t)num : (uint64_t)num;
+
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    char *out = json_reserve(L, sb, n + 1);
+    char *start = out;
+
+    if (num < 0) {
+        *out++ = '-';
+    }
+
+    while (n) {
+        *out++ = tmp[--n];
+    }
+
+    sb->filled += out - start;
+}
+
+// shortest digits that read back to the same double; plain notation
+// while the decimal point is within 21 digits, like yyjson and js:
+// 1.0, -0.0, 0.0001234, 1e28, -1.234e-9
+static void json_write_real(lua_State *L, luaF_strbuf *sb, double num) {
+    if (unlikely(!isfinite(num))) {
+        luaL_error(L, "nan or inf number is not allowed");
+    }
+
+    char tmp[JSON_NUM_MAX_LEN];
+    int prec;
+
+    for (prec = 15; prec < 17; prec++) {
+        snprintf(tmp, sizeof(tmp), "%.*e", prec - 1, num);
+
+        if (strtod(tmp, NULL) == num) {
+            break;
+        }
+    }
+
+    if (prec == 17) {
+        snprintf(tmp, sizeof(tmp), "%.*e", prec - 1, num);
+    }
+
+    // tmp: [-]d.ddde[+-]xx
+    const char *pos = tmp;
+    int neg = *pos == '-';
+    pos += neg;
+
+    char digits[JSON_NUM_MAX_LEN];
+    int digits_n = 0;
+
+    for (; *pos != 'e'; pos++) {
+        if (*pos != '.') {
+            digits[digits_n++] = *pos;
+        }
+    }
+
+    while (digits_n > 1 && digits[digits_n - 1] == '0') {
+        digits_n--;
+    }
+
+    int dot_pos = atoi(pos + 1) + 1; // digits before the decimal point
+    char *out = json_reserve(L, sb, JSON_NUM_MAX_LEN * 2);
+    char *start = out;
+
+    if (neg) {
+        *out++ = '-';
+    }
+
+    if (-6 < dot_pos && dot_pos <= 21) {
+        if (dot_pos <= 0) {
+            *out++ = '0';
+            *out++ = '.';
+
+            for (int i = dot_pos; i < 0; i++) {
+                *out++ = '0';
+            }
+
+            memcpy(out, digits, digits_n);
+            out += digits_n;
+        } else if (dot_pos < digits_n) {
+            memcpy(out, digits, dot_pos);
+            out += dot_pos;
+            *out++ = '.';
+            memcpy(out, digits + dot_pos, digits_n - dot_pos);
+            out += digits_n - dot_pos;
+        } else {
+            memcpy(out, digits, digits_n);
+            out += digits_n;
+
+            for (int i = digits_n; i < dot_pos; i++) {
+                *out++ = '0';
+            }
+
+            *out++ = '.';
+            *out++ = '0';
+        }
+    } else {
+        *out++ = digits[0];
+
+        if (digits_n > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, digits_n - 1);
+            out += digits_n - 1;
+        }
+
+        out += snprintf(out, JSON_NUM_MAX_LEN, "e%d", dot_pos - 1);
+    }
+
+    sb->filled += out - start;
+}
+
+// code point of the utf-8 sequence at str, 0 if it is not valid
+static uint32_t json_utf8_decode(const unsigned char *str, size_t len,
+    int *seq_len
+) {
+    unsigned char c = str[0];
+    uint32_t cp;
+    int n;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        cp = c & 0x1F;
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        cp = c & 0x0F;
+        n = 3;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        cp = c & 0x07;
+        n = 4;
+    } else {
+        return 0;
+    }
+
+    if ((size_t)n > len) {
+        return 0;
+    }
+
+    for (int i = 1; i < n; i++) {
+        if ((str[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+
+        cp = (cp << 6) | (str[i] & 0x3F);
+    }
+
+    if ((n == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)))
+        || (n == 4 && (cp < 0x10000 || cp > 0x10FFFF))
+    ) {
+        return 0; // overlong, surrogate or out of range
+    }
+
+    *seq_len = n;
+    return cp;
+}
+
+static char *json_write_u(char *out, uint32_t cp) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    *out++ = '\\';
+    *out++ = 'u';
+    *out++ = hex[(cp >> 12) & 0xF];
+    *out++ = hex[(cp >> 8) & 0xF];
+    *out++ = hex[(cp >> 4) & 0xF];
+    *out++ = hex[cp & 0xF];
+
+    return out;
+}
+
+// runs without quotes, backslashes, control or non ascii bytes are copied
+// 16 bytes at a time with sse2, the rest is escaped byte by byte;
+// non ascii is written as \uXXXX, invalid utf-8 is an error
+static void json_write_str(lua_State *L, luaF_strbuf *sb, const char *str,
+    size_t len
+) {
+    const unsigned char *src = (const unsigned char *)str;
+    char *out = json_reserve(L, sb, len * 6 + 2); // \u00XX for each byte
+    char *start = out;
+    size_t i = 0;
+
+    *out++ = '"';
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+#endif
+
+    while (i < len) {
+#ifdef __SSE2__
+        while (i + 16 <= len) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(src + i));
+
+            // signed compare: bytes >= 0x80 are negative, so below space
+            __m128i bad = _mm_or_si128(
+                _mm_cmplt_epi8(chunk, space),
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(chunk, quote),
+                    _mm_cmpeq_epi8(chunk, backslash)));
+
+            int mask = _mm_movemask_epi8(bad);
+
+            _mm_storeu_si128((__m128i *)out, chunk);
+
+            if (likely(!mask)) {
+                out += 16;
+                i += 16;
+                continue;
+            }
+
+            int skip = __builtin_ctz(mask);
+            out += skip;
+            i += skip;
+            break;
+        }
+
+        if (i >= len) {
+            break;
+        }
+#endif
+
+        unsigned char c = src[i];
+
+        if (likely(c >= 0x20 && c < 0x80 && c != '"' && c != '\\')) {
+            *out++ = c;
+            i++;
+            continue;
+        }
+
+        switch (c) {
+            case '"': *out++ = '\\'; *out++ = '"'; break;
+            case '\\': *out++ = '\\'; *out++ = '\\'; break;
+            case '\b': *out++ = '\\'; *out++ = 'b'; break;
+            case '\f': *out++ = '\\'; *out++ = 'f'; break;
+            case '\n': *out++ = '\\'; *out++ = 'n'; break;
+            case '\r': *out++ = '\\'; *out++ = 'r'; break;
+            case '\t': *out++ = '\\'; *out++ = 't'; break;
+            default:
+                if (c < 0x20) {
+                    out = json_write_u(out, c);
+                    break;
+                }
+
+                int seq_len;
+                uint32_t cp = json_utf8_decode(src + i, len - i, &seq_len);
+
+                if (unlikely(!cp)) {
+                    luaL_error(L, "invalid utf-8 string; pos: %d", (int)i);
+                }
+
+                if (cp < 0x10000) {
+                    out = json_write_u(out, cp);
+                } else {
+                    cp -= 0x10000;
+                    out = json_write_u(out, 0xD800 + (cp >> 10));
+                    out = json_write_u(out, 0xDC00 + (cp & 0x3FF));
+                }
+
+                i += seq_len - 1;
+        }
+
+        i++;
+    }
+
+    *out++ = '"';
+    sb->filled += out - start;
+}
+
+static void json_write_lazy(lua_State *L, luaF_strbuf *sb,
+    ud_json_lazy *lazy
+) {
+    size_t len;
+    char *json = yyjson_val_write(lazy->val, YYJSON_WRITE_ESCAPE_UNICODE,
+        &len);
+
+    if (unlikely(!json)) {
+        luaL_error(L, "json.stringify: failed to write lazy value");
+    }
+
+    char *out = json_reserve(L, sb, len + 1);
+    memcpy(out, json, len);
+    sb->filled += len;
+    free(json);
+}
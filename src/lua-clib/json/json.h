@@ -3,31 +3,180 @@
 
 #include <yyjson.h>
 #include <furiend/shared.h>
+#include <furiend/strbuf.h>
+#include <furiend/offload.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define MT_JSON "json*"
+#define MT_JSON_LAZY "json.lazy*"
+#define MT_JSON_DOC "json.doc*"
+#define MT_JSON_BUF "json.buf*"
+#define MT_JSON_PARSER "json.parser*"
+
+#define JSON_BUF_START_SIZE 4096
+#define JSON_BUF_KEEP_SIZE (1 << 20) // larger buffers are freed after use
+#define JSON_NUM_MAX_LEN 32
+
+#define JSON_LAZY_UV_IDX_DOC 1 // ud_json_doc that owns val
+
+#define JSON_PARSER_START_SIZE 4096
+
+#define JSON_PARSER_VALUES 0 // top level values, e.g. newline delimited
+#define JSON_PARSER_ARRAY 1 // elements of one top level array
+
+#define JSON_PARSER_OPEN 0 // '[' is next
+#define JSON_PARSER_FIRST 1 // value or ']' is next, values mode stays here
+#define JSON_PARSER_COMMA 2 // ',' or ']' is next
+#define JSON_PARSER_NEXT 3 // value is next
+#define JSON_PARSER_DONE 4 // ']' was read
+
+// the doc is read with the default allocator, it grows with the values
+// instead of the worst case pool of yyjson_read_max_memory_usage
+typedef struct {
+    yyjson_doc *doc;
+} ud_json_doc;
+
+// object or array inside a doc, scalars are pushed as lua values
+typedef struct {
+    yyjson_val *val;
+} ud_json_lazy;
+
+typedef struct {
+    lua_Integer n; // array index for pairs
+    union {
+        yyjson_arr_iter arr;
+        yyjson_obj_iter obj;
+    };
+} ud_json_lazy_iter;
+
+// upvalue of the module functions, reused by stringify
+typedef struct {
+    luaF_strbuf sb;
+} ud_json_buf;
+
+// pending bytes start at the current value, offsets are into sb
+typedef struct {
+    luaF_strbuf sb;
+    size_t scan_pos; // bytes of sb already scanned
+    int mode;
+    int stage;
+    int in_value;
+    int in_str;
+    int in_escape;
+    int is_scalar; // number, true, false or null, ends on a delimiter
+    int depth;
+    int failed; // the stream is broken after an error
+} ud_json_parser;
+
+// parse_offload job, json is pinned by the job thread stack;
+// the doc is read on a pool thread, lua values are made on the loop
+typedef struct {
+    luaF_job job;
+    const char *json;
+    size_t len;
+    yyjson_doc *doc;
+    yyjson_read_err err;
+} ud_json_job;
 
 LUAMOD_API int luaopen_json(lua_State *L);
 
 int json_parse(lua_State *L);
 int json_stringify(lua_State *L);
+int json_stringify_yyjson(lua_State *L);
+int json_parse_lazy(lua_State *L);
+int json_get(lua_State *L);
+int json_materialize(lua_State *L);
+int json_parser(lua_State *L);
+int json_parse_offload(lua_State *L);
 
+static yyjson_doc *json_read(lua_State *L, int idx, const yyjson_alc *alc);
 static void json_parse_value(lua_State *L, yyjson_val *value);
 
+static int json_lazy_index(lua_State *L);
+static int json_lazy_len(lua_State *L);
+static int json_lazy_pairs(lua_State *L);
+static int json_lazy_next(lua_State *L);
+static void json_push_lazy(lua_State *L, yyjson_val *value, int doc_idx);
+static yyjson_val *json_walk(yyjson_val *value, const char *path,
+    size_t path_len);
+static yyjson_val *json_child(yyjson_val *value, const char *key,
+    size_t key_len);
+
+static int json_job_start(lua_State *L);
+static int json_job_continue(lua_State *L, int status, lua_KContext ctx);
+static void json_job_run(luaF_job *job);
+
+static int json_parser_feed(lua_State *L);
+static int json_parser_finish(lua_State *L);
+static int json_parser_gc(lua_State *L);
+static void json_parser_scan(lua_State *L, ud_json_parser *parser,
+    int values_idx, lua_Integer *values_n);
+static void json_parser_emit(lua_State *L, ud_json_parser *parser,
+    size_t start, size_t end, int values_idx, lua_Integer *values_n);
+static void json_parser_fail(lua_State *L, ud_json_parser *parser,
+    const char *msg);
+
+static int json_buf_gc(lua_State *L);
+static int json_doc_gc(lua_State *L);
+static void json_write(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited);
+static void json_write_table(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited);
+static char *json_reserve(lua_State *L, luaF_strbuf *sb, size_t len);
+static void json_put(lua_State *L, luaF_strbuf *sb, const char *data,
+    size_t len);
+static void json_write_str(lua_State *L, luaF_strbuf *sb, const char *str,
+    size_t len);
+static void json_write_int(lua_State *L, luaF_strbuf *sb, lua_Integer num);
+static void json_write_real(lua_State *L, luaF_strbuf *sb, double num);
+static uint32_t json_utf8_decode(const unsigned char *str, size_t len,
+    int *seq_len);
+static char *json_write_u(char *out, uint32_t cp);
+static void json_write_lazy(lua_State *L, luaF_strbuf *sb,
+    ud_json_lazy *lazy);
+
+static void json_enter(lua_State *L, luaF_visited *visited, int idx);
+
 static yyjson_mut_val *json_stringify_value(
     lua_State *L,
     yyjson_mut_doc *doc,
     int index,
-    int cache_index);
+    luaF_visited *visited);
 
 static yyjson_mut_val *json_stringify_table(
     lua_State *L,
     yyjson_mut_doc *doc,
     int index,
-    int cache_index);
+    luaF_visited *visited);
 
 static const luaL_Reg json_index[] = {
     { "parse", json_parse },
     { "stringify", json_stringify },
+    { "stringify_yyjson", json_stringify_yyjson },
+    { "parse_lazy", json_parse_lazy },
+    { "get", json_get },
+    { "materialize", json_materialize },
+    { "parser", json_parser },
+    { "parse_offload", json_parse_offload },
+    { NULL, NULL }
+};
+
+static const luaL_Reg json_parser_methods[] = {
+    { "feed", json_parser_feed },
+    { "finish", json_parser_finish },
+    { NULL, NULL }
+};
+
+static const luaL_Reg json_lazy_mt[] = {
+    { "__index", json_lazy_index },
+    { "__len", json_lazy_len },
+    { "__pairs", json_lazy_pairs },
     { NULL, NULL }
 };
 
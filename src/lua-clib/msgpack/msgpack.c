@@ -0,0 +1,487 @@
+#include "msgpack.h"
+
+LUAMOD_API int luaopen_msgpack(lua_State *L) {
+    if (likely(luaL_newmetatable(L, MT_MSGPACK_BUF))) {
+        lua_pushcfunction(L, msgpack_buf_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_pop(L, 1);
+
+    luaL_newlibtable(L, msgpack_index);
+
+    ud_msgpack_buf *buf = luaF_new_ud_or_error(L,
+        sizeof(ud_msgpack_buf), 0);
+
+    buf->sb = luaF_strbuf_create(MSGPACK_BUF_START_SIZE);
+    luaL_setmetatable(L, MT_MSGPACK_BUF);
+
+    luaL_setfuncs(L, msgpack_index, 1); // buf is upvalue 1 of every function
+    return 1;
+}
+
+static int msgpack_buf_gc(lua_State *L) {
+    ud_msgpack_buf *buf = luaL_checkudata(L, 1, MT_MSGPACK_BUF);
+    luaF_strbuf_free_buf(&buf->sb);
+
+    return 0;
+}
+
+// pack(value) -> string
+// same value mapping as json.stringify: tables are arrays or maps with
+// string keys, integers and floats keep their subtype
+int msgpack_pack(lua_State *L) {
+    luaF_need_args(L, 1, "msgpack.pack");
+
+    ud_msgpack_buf *buf = lua_touserdata(L, lua_upvalueindex(1));
+    luaF_strbuf *sb = &buf->sb;
+    sb->filled = 0;
+
+    luaF_visited visited = { .n = 0 };
+    msgpack_write(L, sb, 1, &visited);
+    lua_pushlstring(L, sb->buf, sb->filled);
+
+    if (unlikely(sb->capacity > MSGPACK_BUF_KEEP_SIZE)) {
+        luaF_strbuf_free_buf(sb);
+        *sb = luaF_strbuf_create(MSGPACK_BUF_START_SIZE);
+    }
+
+    return 1;
+}
+
+// unpack(data, pos?) -> value, next pos
+// pos is 1 based; values packed one after another are read by passing
+// the returned pos back; strings are pushed straight from data
+int msgpack_unpack(lua_State *L) {
+    luaF_min_max_args(L, 1, 2, "msgpack.unpack");
+
+    size_t len;
+    const char *data = luaL_checklstring(L, 1, &len);
+    lua_Integer pos = luaL_optinteger(L, 2, 1);
+
+    if (unlikely(pos < 1 || (size_t)pos > len)) {
+        luaL_error(L, "msgpack.unpack: no data at pos; pos: %I; len: %I",
+            pos, (lua_Integer)len);
+    }
+
+    msgpack_reader reader = {
+        .data = (const unsigned char *)data,
+        .len = len,
+        .pos = pos - 1,
+        .depth = 0,
+    };
+
+    msgpack_read(L, &reader);
+    lua_pushinteger(L, reader.pos + 1);
+
+    return 2;
+}
+
+static unsigned char *msgpack_reserve(lua_State *L, luaF_strbuf *sb,
+    size_t len
+) {
+    if (unlikely(!sb->buf || sb->capacity - sb->filled < len)) {
+        luaF_strbuf_ensure_space(L, sb, len);
+    }
+
+    return (unsigned char *)sb->buf + sb->filled;
+}
+
+static void msgpack_put_be(unsigned char *out, uint64_t num, int len) {
+    for (int i = len - 1; i >= 0; i--) {
+        out[i] = num & 0xff;
+        num >>= 8;
+    }
+}
+
+static void msgpack_write(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited
+) {
+    switch (lua_type(L, idx)) {
+        case LUA_TNONE:
+        case LUA_TNIL:
+            *msgpack_reserve(L, sb, 1) = MSGPACK_NIL;
+            sb->filled++;
+            return;
+        case LUA_TBOOLEAN:
+            *msgpack_reserve(L, sb, 1) = lua_toboolean(L, idx)
+                ? MSGPACK_TRUE
+                : MSGPACK_FALSE;
+
+            sb->filled++;
+            return;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, idx)) {
+                msgpack_write_int(L, sb, lua_tointeger(L, idx));
+            } else {
+                double num = lua_tonumber(L, idx);
+                uint64_t bits;
+                memcpy(&bits, &num, sizeof(bits));
+
+                unsigned char *out = msgpack_reserve(L, sb, 9);
+                out[0] = MSGPACK_FLOAT64;
+                msgpack_put_be(out + 1, bits, 8);
+                sb->filled += 9;
+            }
+
+            return;
+        case LUA_TSTRING: {
+            size_t len;
+            const char *str = lua_tolstring(L, idx, &len);
+            msgpack_write_str(L, sb, str, len);
+            return;
+        } case LUA_TTABLE:
+            msgpack_write_table(L, sb, idx, visited);
+            return;
+        default: // LUA_TFUNCTION LUA_TTHREAD LUA_TUSERDATA LUA_TLIGHTUSERDATA
+            luaF_warning(L, "msgpack.pack: type is not supported; type: %s",
+                luaL_typename(L, idx));
+
+            *msgpack_reserve(L, sb, 1) = MSGPACK_NIL;
+            sb->filled++;
+    }
+}
+
+static void msgpack_write_table(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited
+) {
+    luaL_checkstack(L, 4, "msgpack.pack");
+
+    const void *ptr = lua_topointer(L, idx);
+    int entered = luaF_visit(visited, ptr);
+
+    if (unlikely(entered == 0)) {
+        luaL_error(L, "circular table: %p", ptr);
+    } else if (unlikely(entered < 0)) {
+        luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
+    }
+
+    lua_Integer arr_n;
+    int kind = luaF_table_kind(L, idx, &arr_n);
+
+    if (unlikely(kind == F_TABLE_ARRAY)) {
+        msgpack_write_head(L, sb, MSGPACK_FIXARRAY, MSGPACK_ARRAY16, arr_n);
+
+        for (lua_Integer i = 1; i <= arr_n; i++) {
+            lua_rawgeti(L, idx, i);
+            msgpack_write(L, sb, lua_gettop(L), visited);
+            lua_pop(L, 1); // lua_rawgeti
+        }
+
+        luaF_unvisit(visited);
+        return;
+    }
+
+    size_t keys_n = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) { // k, v
+        if (unlikely(lua_type(L, -2) != LUA_TSTRING)) {
+            luaL_error(L, "key is not a string; type: %s; key: %s",
+                luaL_typename(L, -2),
+                lua_tostring(L, -2));
+        }
+
+        keys_n++;
+        lua_pop(L, 1); // lua_next
+    }
+
+    msgpack_write_head(L, sb, MSGPACK_FIXMAP, MSGPACK_MAP16, keys_n);
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) { // k, v
+        size_t key_len;
+        const char *key = lua_tolstring(L, -2, &key_len);
+
+        msgpack_write_str(L, sb, key, key_len);
+        msgpack_write(L, sb, lua_gettop(L), visited);
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    luaF_unvisit(visited);
+}
+
+// smallest format that holds num
+static void msgpack_write_int(lua_State *L, luaF_strbuf *sb,
+    lua_Integer num
+) {
+    unsigned char *out = msgpack_reserve(L, sb, 9);
+    int len;
+
+    if (num >= 0) {
+        if (num <= 0x7f) { // positive fixint
+            out[0] = num;
+            sb->filled++;
+            return;
+        } else if (num <= UINT8_MAX) {
+            out[0] = MSGPACK_UINT8;
+            len = 1;
+        } else if (num <= UINT16_MAX) {
+            out[0] = MSGPACK_UINT16;
+            len = 2;
+        } else if (num <= UINT32_MAX) {
+            out[0] = MSGPACK_UINT32;
+            len = 4;
+        } else {
+            out[0] = MSGPACK_UINT64;
+            len = 8;
+        }
+    } else {
+        if (num >= -32) { // negative fixint
+            out[0] = (uint8_t)num;
+            sb->filled++;
+            return;
+        } else if (num >= INT8_MIN) {
+            out[0] = MSGPACK_INT8;
+            len = 1;
+        } else if (num >= INT16_MIN) {
+            out[0] = MSGPACK_INT16;
+            len = 2;
+        } else if (num >= INT32_MIN) {
+            out[0] = MSGPACK_INT32;
+            len = 4;
+        } else {
+            out[0] = MSGPACK_INT64;
+            len = 8;
+        }
+    }
+
+    msgpack_put_be(out + 1, (uint64_t)num, len);
+    sb->filled += 1 + len;
+}
+
+static void msgpack_write_str(lua_State *L, luaF_strbuf *sb,
+    const char *str, size_t len
+) {
+    unsigned char *out = msgpack_reserve(L, sb, len + 5);
+    int head_len;
+
+    if (len < 32) {
+        out[0] = MSGPACK_FIXSTR | len;
+        head_len = 1;
+    } else if (len <= UINT8_MAX) {
+        out[0] = MSGPACK_STR8;
+        out[1] = len;
+        head_len = 2;
+    } else if (len <= UINT16_MAX) {
+        out[0] = MSGPACK_STR16;
+        msgpack_put_be(out + 1, len, 2);
+        head_len = 3;
+    } else if (likely(len <= UINT32_MAX)) {
+        out[0] = MSGPACK_STR32;
+        msgpack_put_be(out + 1, len, 4);
+        head_len = 5;
+    } else {
+        luaL_error(L, "string is too long: %I", (lua_Integer)len);
+        return;
+    }
+
+    memcpy(out + head_len, str, len);
+    sb->filled += head_len + len;
+}
+
+// array or map head, type16 + 1 is the 32 bit type
+static void msgpack_write_head(lua_State *L, luaF_strbuf *sb,
+    unsigned char fix, unsigned char type16, size_t n
+) {
+    unsigned char *out = msgpack_reserve(L, sb, 5);
+
+    if (n < 16) {
+        out[0] = fix | n;
+        sb->filled++;
+    } else if (n <= UINT16_MAX) {
+        out[0] = type16;
+        msgpack_put_be(out + 1, n, 2);
+        sb->filled += 3;
+    } else if (likely(n <= UINT32_MAX)) {
+        out[0] = type16 + 1;
+        msgpack_put_be(out + 1, n, 4);
+        sb->filled += 5;
+    } else {
+        luaL_error(L, "table is too large: %I", (lua_Integer)n);
+    }
+}
+
+static const unsigned char *msgpack_take(lua_State *L,
+    msgpack_reader *reader, size_t len
+) {
+    if (unlikely(reader->len - reader->pos < len)) {
+        luaL_error(L, "msgpack.unpack: unexpected end; pos: %I; need: %I",
+            (lua_Integer)reader->pos + 1, (lua_Integer)len);
+    }
+
+    const unsigned char *data = reader->data + reader->pos;
+    reader->pos += len;
+
+    return data;
+}
+
+static uint64_t msgpack_get_be(lua_State *L, msgpack_reader *reader,
+    int len
+) {
+    const unsigned char *data = msgpack_take(L, reader, len);
+    uint64_t num = 0;
+
+    for (int i = 0; i < len; i++) {
+        num = (num << 8) | data[i];
+    }
+
+    return num;
+}
+
+static void msgpack_read(lua_State *L, msgpack_reader *reader) {
+    unsigned char type = *msgpack_take(L, reader, 1);
+
+    if (type <= 0x7f) { // positive fixint
+        lua_pushinteger(L, type);
+        return;
+    } else if (type >= MSGPACK_NEG_FIXINT) {
+        lua_pushinteger(L, (int8_t)type);
+        return;
+    } else if (type < MSGPACK_FIXARRAY) {
+        msgpack_read_map(L, reader, type & 0x0f);
+        return;
+    } else if (type < MSGPACK_FIXSTR) {
+        msgpack_read_array(L, reader, type & 0x0f);
+        return;
+    } else if (type < MSGPACK_NIL) {
+        size_t len = type & 0x1f;
+        lua_pushlstring(L, (const char *)msgpack_take(L, reader, len), len);
+        return;
+    }
+
+    size_t len;
+
+    switch (type) {
+        case MSGPACK_NIL:
+            lua_pushnil(L);
+            return;
+        case MSGPACK_FALSE:
+            lua_pushboolean(L, 0);
+            return;
+        case MSGPACK_TRUE:
+            lua_pushboolean(L, 1);
+            return;
+        case MSGPACK_FLOAT32: {
+            uint32_t bits = msgpack_get_be(L, reader, 4);
+            float num;
+            memcpy(&num, &bits, sizeof(num));
+            lua_pushnumber(L, num);
+            return;
+        } case MSGPACK_FLOAT64: {
+            uint64_t bits = msgpack_get_be(L, reader, 8);
+            double num;
+            memcpy(&num, &bits, sizeof(num));
+            lua_pushnumber(L, num);
+            return;
+        } case MSGPACK_UINT8:
+            lua_pushinteger(L, msgpack_get_be(L, reader, 1));
+            return;
+        case MSGPACK_UINT16:
+            lua_pushinteger(L, msgpack_get_be(L, reader, 2));
+            return;
+        case MSGPACK_UINT32:
+            lua_pushinteger(L, msgpack_get_be(L, reader, 4));
+            return;
+        case MSGPACK_UINT64: {
+            uint64_t num = msgpack_get_be(L, reader, 8);
+
+            if (likely(num <= (uint64_t)LUA_MAXINTEGER)) {
+                lua_pushinteger(L, num);
+            } else { // does not fit, like a json number of the same size
+                lua_pushnumber(L, (lua_Number)num);
+            }
+
+            return;
+        } case MSGPACK_INT8:
+            lua_pushinteger(L, (int8_t)msgpack_get_be(L, reader, 1));
+            return;
+        case MSGPACK_INT16:
+            lua_pushinteger(L, (int16_t)msgpack_get_be(L, reader, 2));
+            return;
+        case MSGPACK_INT32:
+            lua_pushinteger(L, (int32_t)msgpack_get_be(L, reader, 4));
+            return;
+        case MSGPACK_INT64:
+            lua_pushinteger(L, (int64_t)msgpack_get_be(L, reader, 8));
+            return;
+        case MSGPACK_STR8:
+        case MSGPACK_BIN8:
+            len = msgpack_get_be(L, reader, 1);
+            break;
+        case MSGPACK_STR16:
+        case MSGPACK_BIN16:
+            len = msgpack_get_be(L, reader, 2);
+            break;
+        case MSGPACK_STR32:
+        case MSGPACK_BIN32:
+            len = msgpack_get_be(L, reader, 4);
+            break;
+        case MSGPACK_ARRAY16:
+            msgpack_read_array(L, reader, msgpack_get_be(L, reader, 2));
+            return;
+        case MSGPACK_ARRAY32:
+            msgpack_read_array(L, reader, msgpack_get_be(L, reader, 4));
+            return;
+        case MSGPACK_MAP16:
+            msgpack_read_map(L, reader, msgpack_get_be(L, reader, 2));
+            return;
+        case MSGPACK_MAP32:
+            msgpack_read_map(L, reader, msgpack_get_be(L, reader, 4));
+            return;
+        default: // ext types, 0xc1
+            luaL_error(L, "msgpack.unpack: type is not supported: 0x%x; "
+                "pos: %I", type, (lua_Integer)reader->pos);
+            return;
+    }
+
+    lua_pushlstring(L, (const char *)msgpack_take(L, reader, len), len);
+}
+
+static void msgpack_read_array(lua_State *L, msgpack_reader *reader,
+    size_t n
+) {
+    luaL_checkstack(L, 4, "msgpack.unpack");
+
+    if (unlikely(++reader->depth > F_VISITED_MAX)) {
+        luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
+    }
+
+    if (unlikely(n > reader->len - reader->pos)) { // 1 byte per value min
+        luaL_error(L, "msgpack.unpack: bad array size: %I", (lua_Integer)n);
+    }
+
+    lua_createtable(L, n, 0);
+
+    for (size_t i = 1; i <= n; i++) {
+        msgpack_read(L, reader);
+        lua_rawseti(L, -2, i);
+    }
+
+    reader->depth--;
+}
+
+static void msgpack_read_map(lua_State *L, msgpack_reader *reader,
+    size_t n
+) {
+    luaL_checkstack(L, 4, "msgpack.unpack");
+
+    if (unlikely(++reader->depth > F_VISITED_MAX)) {
+        luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
+    }
+
+    if (unlikely(n > (reader->len - reader->pos) / 2)) { // 2 bytes min
+        luaL_error(L, "msgpack.unpack: bad map size: %I", (lua_Integer)n);
+    }
+
+    lua_createtable(L, 0, n);
+
+    for (size_t i = 0; i < n; i++) {
+        msgpack_read(L, reader); // key
+        msgpack_read(L, reader); // value
+        lua_rawset(L, -3);
+    }
+
+    reader->depth--;
+}
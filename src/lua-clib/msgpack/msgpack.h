@@ -0,0 +1,92 @@
+#ifndef LUA_LIB_MSGPACK_H
+#define LUA_LIB_MSGPACK_H
+
+#include <furiend/shared.h>
+#include <furiend/strbuf.h>
+#include <stdint.h>
+
+#define MT_MSGPACK_BUF "msgpack.buf*"
+
+#define MSGPACK_BUF_START_SIZE 4096
+#define MSGPACK_BUF_KEEP_SIZE (1 << 20) // larger buffers are freed after use
+
+#define MSGPACK_NIL 0xc0
+#define MSGPACK_FALSE 0xc2
+#define MSGPACK_TRUE 0xc3
+#define MSGPACK_BIN8 0xc4
+#define MSGPACK_BIN16 0xc5
+#define MSGPACK_BIN32 0xc6
+#define MSGPACK_FLOAT32 0xca
+#define MSGPACK_FLOAT64 0xcb
+#define MSGPACK_UINT8 0xcc
+#define MSGPACK_UINT16 0xcd
+#define MSGPACK_UINT32 0xce
+#define MSGPACK_UINT64 0xcf
+#define MSGPACK_INT8 0xd0
+#define MSGPACK_INT16 0xd1
+#define MSGPACK_INT32 0xd2
+#define MSGPACK_INT64 0xd3
+#define MSGPACK_STR8 0xd9
+#define MSGPACK_STR16 0xda
+#define MSGPACK_STR32 0xdb
+#define MSGPACK_ARRAY16 0xdc
+#define MSGPACK_ARRAY32 0xdd
+#define MSGPACK_MAP16 0xde
+#define MSGPACK_MAP32 0xdf
+
+#define MSGPACK_FIXMAP 0x80 // 1000xxxx
+#define MSGPACK_FIXARRAY 0x90 // 1001xxxx
+#define MSGPACK_FIXSTR 0xa0 // 101xxxxx
+#define MSGPACK_NEG_FIXINT 0xe0 // 111xxxxx
+
+// upvalue of the module functions, reused by pack
+typedef struct {
+    luaF_strbuf sb;
+} ud_msgpack_buf;
+
+// input of unpack, pos moves as values are read
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    int depth;
+} msgpack_reader;
+
+LUAMOD_API int luaopen_msgpack(lua_State *L);
+
+int msgpack_pack(lua_State *L);
+int msgpack_unpack(lua_State *L);
+
+static int msgpack_buf_gc(lua_State *L);
+
+static void msgpack_write(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited);
+static void msgpack_write_table(lua_State *L, luaF_strbuf *sb, int idx,
+    luaF_visited *visited);
+static void msgpack_write_int(lua_State *L, luaF_strbuf *sb,
+    lua_Integer num);
+static void msgpack_write_str(lua_State *L, luaF_strbuf *sb,
+    const char *str, size_t len);
+static void msgpack_write_head(lua_State *L, luaF_strbuf *sb,
+    unsigned char fix, unsigned char type16, size_t n);
+static unsigned char *msgpack_reserve(lua_State *L, luaF_strbuf *sb,
+    size_t len);
+static void msgpack_put_be(unsigned char *out, uint64_t num, int len);
+
+static void msgpack_read(lua_State *L, msgpack_reader *reader);
+static void msgpack_read_array(lua_State *L, msgpack_reader *reader,
+    size_t n);
+static void msgpack_read_map(lua_State *L, msgpack_reader *reader,
+    size_t n);
+static const unsigned char *msgpack_take(lua_State *L,
+    msgpack_reader *reader, size_t len);
+static uint64_t msgpack_get_be(lua_State *L, msgpack_reader *reader,
+    int len);
+
+static const luaL_Reg msgpack_index[] = {
+    { "pack", msgpack_pack },
+    { "unpack", msgpack_unpack },
+    { NULL, NULL }
+};
+
+#endif
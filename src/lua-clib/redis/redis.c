@@ -8,6 +8,13 @@ LUAMOD_API int luaopen_redis(lua_State *L) {
     luaL_newlib(L, redis_client_index);
     lua_setfield(L, -2, "__index");
 
+    luaL_newmetatable(L, MT_REDIS_POOL);
+
+    lua_pushcfunction(L, redis_pool_gc);
+    lua_setfield(L, -2, "__gc");
+    luaL_newlib(L, redis_pool_index);
+    lua_setfield(L, -2, "__index");
+
     luaL_newmetatable(L, MT_REDIS);
 
     lua_pushcfunction(L, redis_gc);
@@ -99,11 +106,112 @@ int redis_client(lua_State *L) {
 
     client->fd = -1;
     client->connected = 0;
+    client->closed = 0;
     client->can_write = 0;
 
     client->next_query_id = 1;
     client->next_answer_id = 1;
 
+    client->tracking = 0;
+    client->cache_hits = 0;
+    client->cache_misses = 0;
+    client->cache_invalidations = 0;
+    client->cache_entries = 0;
+    client->cache_bytes = 0;
+    client->cache_evictions = 0;
+    client->cache_max_entries = CACHE_DEFAULT_MAX_ENTRIES;
+    client->cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+    client->cache_lru_head = 0;
+    client->cache_tick = 0;
+
+    if (lua_getfield(L, 1, "cache") == LUA_TTABLE) {
+        // { max_entries, max_bytes }, 0 - unlimited
+        lua_getfield(L, -1, "max_entries");
+        lua_getfield(L, -2, "max_bytes");
+
+        client->cache_max_entries = luaL_optinteger(L, -2,
+            CACHE_DEFAULT_MAX_ENTRIES);
+        lua_Integer max_bytes = luaL_optinteger(L, -1,
+            CACHE_DEFAULT_MAX_BYTES);
+
+        if (unlikely(client->cache_max_entries < 0 || max_bytes < 0)) {
+            luaL_error(L, "invalid cache limits: %I entries, %I bytes",
+                client->cache_max_entries, max_bytes);
+        }
+
+        client->cache_max_bytes = max_bytes;
+
+        lua_pop(L, 2); // lua_getfield
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    lua_getfield(L, 1, "timeout");
+    client->timeout = luaL_optnumber(L, -1, 0);
+    lua_pop(L, 1); // lua_getfield
+
+    client->reconnect = lua_getfield(L, 1, "reconnect") == LUA_TTABLE;
+    client->reconnecting = 0;
+    client->reconnect_attempt = 0;
+    client->reconnect_max_attempts = 0;
+    client->reconnect_min_delay = RECONNECT_DEFAULT_MIN_DELAY;
+    client->reconnect_max_delay = RECONNECT_DEFAULT_MAX_DELAY;
+
+    if (client->reconnect) { // { min_delay, max_delay, attempts }
+        lua_getfield(L, -1, "min_delay");
+        lua_getfield(L, -2, "max_delay");
+        lua_getfield(L, -3, "attempts");
+
+        client->reconnect_min_delay = luaL_optnumber(L, -3,
+            RECONNECT_DEFAULT_MIN_DELAY);
+        client->reconnect_max_delay = luaL_optnumber(L, -2,
+            RECONNECT_DEFAULT_MAX_DELAY);
+        client->reconnect_max_attempts = luaL_optinteger(L, -1, 0);
+
+        lua_pop(L, 3); // lua_getfield
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    client->push_concurrency = 0;
+    client->push_queue_size = PUSH_DEFAULT_QUEUE_SIZE;
+    client->push_overflow = PUSH_OVERFLOW_BLOCK;
+    client->push_batch = 0;
+    client->push_running = 0;
+    client->push_head = 0;
+    client->push_queued = 0;
+    client->push_blocked = 0;
+    client->push_dropped = 0;
+
+    if (lua_getfield(L, 1, "push") == LUA_TTABLE) {
+        // { concurrency, queue_size, overflow, batch }
+        lua_getfield(L, -1, "concurrency");
+        lua_getfield(L, -2, "queue_size");
+        lua_getfield(L, -3, "overflow");
+        lua_getfield(L, -4, "batch");
+
+        client->push_concurrency = luaL_optinteger(L, -4, 0);
+        client->push_queue_size = luaL_optinteger(L, -3,
+            PUSH_DEFAULT_QUEUE_SIZE);
+        client->push_overflow = luaL_checkoption(L, -2, "block",
+            push_overflow_opts);
+        client->push_batch = luaL_optinteger(L, -1, 0);
+
+        if (unlikely(client->push_queue_size < 1)) {
+            luaL_error(L, "invalid push queue size: %d; min: %d",
+                client->push_queue_size, 1);
+        }
+
+        lua_pop(L, 4); // lua_getfield
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    client->jitter_seed = (uintptr_t)client ^ time(NULL);
+    client->reconnects = 0;
+    client->timeouts = 0;
+    client->replayed = 0;
+
     client->pack_buf = luaF_strbuf_create(PACK_BUF_START_SIZE);
     client->send_buf = luaF_strbuf_create(SEND_BUF_START_SIZE);
     client->recv_buf = luaF_strbuf_create(RECV_BUF_START_SIZE);
@@ -119,22 +227,52 @@ int redis_client(lua_State *L) {
     lua_createtable(L, 0, 2); // expect 2 push cbs at once
     lua_setiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS);
 
+    lua_createtable(L, CACHE_CMD_N, 0);
+    for (int cmd_i = 1; cmd_i <= CACHE_CMD_N; ++cmd_i) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, cmd_i);
+    }
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+
+    lua_createtable(L, CACHE_CMD_N, 0);
+    for (int cmd_i = 1; cmd_i <= CACHE_CMD_N; ++cmd_i) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, cmd_i);
+    }
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CACHE_TICKS);
+
+    lua_newtable(L);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+
+    lua_createtable(L, 0, client->reconnect ? 8 : 0);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS);
+
+    lua_createtable(L, client->push_concurrency > 0
+        ? 2 * client->push_queue_size : 0, 0);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_PUSH_QUEUE);
+
     return 1;
 }
 
 int redis_client_gc(lua_State *L) {
     ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    client->closed = 1;
 
     luaF_strbuf_free_buf(&client->pack_buf);
     luaF_strbuf_free_buf(&client->send_buf);
     luaF_strbuf_free_buf(&client->recv_buf);
 
-    if (unlikely(client->fd < 0)) {
+    if (unlikely(client->fd < 0 && !client->reconnecting)) {
         return 0;
     }
 
-    luaF_close_or_warning(L, client->fd);
-    client->fd = -1;
+    if (likely(client->fd >= 0)) {
+        luaF_close_or_warning(L, client->fd);
+        client->fd = -1;
+    }
+
+    client->reconnecting = 0; // stops reconnect thread
+    client->tracking = 0; // no more invalidations, cache is stale
 
     lua_settop(L, 2); // client, error msg or nil
     lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
@@ -155,6 +293,13 @@ int redis_client_gc(lua_State *L) {
         int sub_idx = lua_gettop(L);
         lua_State *sub = lua_tothread(L, sub_idx);
 
+        if (unlikely(sub == NULL // dropped answer placeholder
+            || lua_status(sub) != LUA_YIELD // load_hashes: already failed
+        )) {
+            lua_pop(L, 1); // lua_next
+            continue;
+        }
+
         lua_pushboolean(sub, 0);
         lua_pushstring(sub, lua_isstring(L, errmsg_idx)
             ? lua_tostring(L, errmsg_idx) // gc called from router
@@ -185,21 +330,26 @@ int redis_connect(lua_State *L) {
         return 1;
     }
 
+    router_spawn(L, 1);
+    lua_settop(L, 2); // client, T
+
+    return 1; // T
+}
+
+static void router_spawn(lua_State *L, int client_idx) {
     lua_State *router = luaF_new_thread_or_error(L);
 
     lua_pushcfunction(router, router_start);
-    lua_pushvalue(L, 1); // client
+    lua_pushvalue(L, client_idx); // client
     lua_xmove(L, router, 1); // client >> router
 
-    status = lua_resume(router, L, 1, &(int){0}); // should yield, 0 nres
+    int status = lua_resume(router, L, 1, &(int){0}); // should yield, 0 nres
 
     if (unlikely(status != LUA_YIELD)) {
         luaL_error(L, "router init failed: %s", lua_tostring(router, -1));
     }
 
-    lua_settop(L, 2); // client, T, router -> client, T
-
-    return 1; // T
+    lua_pop(L, 1); // router
 }
 
 static int connect_start(lua_State *L) {
@@ -213,6 +363,22 @@ static int connect_start(lua_State *L) {
         luaL_error(L, "already connecting");
     }
 
+    lua_pushcfunction(L, open_socket);
+    lua_pushvalue(L, 1); // client
+    lua_call(L, 1, 0);
+
+    lua_pushthread(L);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD);
+
+    lua_settop(L, 1); // client
+
+    return lua_yieldk(L, 0, 0, connect_continue);
+}
+
+// client; nonblocking connect, router_on_connect reports the result
+static int open_socket(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+
     lua_getiuservalue(L, 1, REDIS_UV_IDX_CONFIG);
 
     lua_getfield(L, 2, "ip4");
@@ -240,12 +406,7 @@ static int connect_start(lua_State *L) {
         luaF_error_errno(L, "connect failed; addr: %s:%d", ip4, port);
     }
 
-    lua_pushthread(L);
-    lua_setiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD);
-
-    lua_settop(L, 1); // client
-
-    return lua_yieldk(L, 0, 0, connect_continue);
+    return 0;
 }
 
 static int connect_continue(lua_State *L, int status, lua_KContext ctx) {
@@ -282,7 +443,7 @@ static int router_continue(lua_State *L, int status, lua_KContext ctx) {
     if (unlikely(status != LUA_OK)) {
         lua_insert(L, 2); // client, ? <- err msg
         lua_settop(L, 2); // client, err msg
-        return redis_client_gc(L);
+        return client_drop(L);
     }
 
     lua_settop(L, 1); // client
@@ -320,7 +481,7 @@ static int router_process_event(lua_State *L) {
         }
     }
 
-    if (emask & EPOLLIN) {
+    if ((emask & EPOLLIN) && likely(!client->push_blocked)) {
         router_read(L, client, t_subs_idx);
     }
 
@@ -381,6 +542,10 @@ static void router_read(
         }
 
         luaF_strbuf_shift(L, sb, parsed);
+
+        if (unlikely(client->push_blocked)) {
+            return; // push workers resume reading, see push_resume_read
+        }
     }
 }
 
@@ -390,9 +555,11 @@ static int router_parse(
     int t_subs_idx
 ) {
     lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS);
     lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
 
-    int push_cbs_idx = lua_gettop(L) - 1;
+    int push_cbs_idx = lua_gettop(L) - 2;
+    int q_texts_idx = lua_gettop(L) - 1;
     int q_subs_idx = lua_gettop(L);
 
     size_t total_parsed = 0;
@@ -424,23 +591,19 @@ static int router_parse(
                 lua_rawget(L, push_cbs_idx); // cb
                 lua_rawgeti(L, data_idx, RESP_PUSH_PAYLOAD_IDX); // cb, payload
 
-                lua_State *T = luaF_new_thread_or_error(L); // cb, payload, T
-
-                lua_insert(L, lua_gettop(L) - 2); // T, cb, payload
-                lua_xmove(L, T, 2); // cb, payload >> T
-
-                int nres;
-                int status = lua_resume(T, L, 1, &nres);
+                if (likely(lua_isfunction(L, -2))) { // else unsubscribed
+                    push_dispatch(L, client, lua_gettop(L) - 1, lua_gettop(L));
+                }
 
-                if (unlikely(status == LUA_YIELD)) {
-                    if (unlikely(nres > 0)) {
-                        lua_pop(T, nres);
-                    }
-                } else if (unlikely(status != LUA_OK)) {
-                    luaL_error(L, "push callback error: %s",
-                        lua_tostring(T, -1));
+                if (unlikely(client->push_blocked || client->fd < 0)) {
+                    return total_parsed; // resumed by push worker
                 }
 
+                continue;
+            } else if (strcmp(lua_tostring(L, -1), "invalidate") == 0) {
+                lua_rawgeti(L, data_idx, RESP_PUSH_CH_NAME_IDX); // keys|nil
+                cache_invalidate(L, client, lua_gettop(L));
+
                 continue;
             } else { // notify "subscribe" cmd with this push
                 lua_pop(L, 1); // lua_rawgeti RESP_PUSH_TYPE_IDX
@@ -449,26 +612,36 @@ static int router_parse(
         }
 
         lua_Integer answer_id = client->next_answer_id++;
+        int sub_type = lua_rawgeti(L, q_subs_idx, answer_id);
 
-        if (unlikely(lua_rawgeti(L, q_subs_idx, answer_id) != LUA_TTHREAD)) {
+        if (unlikely(sub_type != LUA_TTHREAD && sub_type != LUA_TBOOLEAN)) {
             luaL_error(L, "query thread not found by id: %d", answer_id);
         }
 
         lua_pushnil(L);
         lua_rawseti(L, q_subs_idx, answer_id); // subs[answer_id] = nil
 
+        if (client->reconnect) {
+            lua_pushnil(L);
+            lua_rawseti(L, q_texts_idx, answer_id); // q_texts[answer_id] = nil
+        }
+
+        if (unlikely(sub_type == LUA_TBOOLEAN)) {
+            continue; // timed out or resent on reconnect: drop answer
+        }
+
         int sub_idx = lua_gettop(L) - 2;
         lua_insert(L, sub_idx); // data, type, sub -> sub, data, type
         lua_State *sub = lua_tothread(L, sub_idx);
 
+        if (unlikely(lua_status(sub) != LUA_YIELD)) {
+            continue; // load_hashes failed with more answers in flight
+        }
+
         lua_pushboolean(sub, 1);
         lua_xmove(L, sub, 2); // data, type >> sub
 
-        int sub_nres;
-        int sub_status = lua_resume(sub, L, 3, &sub_nres); // doesn't yield
-
-        luaF_loop_notify_t_subs(L, t_subs_idx,
-            sub, sub_idx, sub_status, sub_nres);
+        luaF_resume(L, t_subs_idx, sub, sub_idx, 3); // load_hashes yields
 
         if (unlikely(client->fd < 0)) {
             break; // lua_resume could trigger client gc
@@ -478,17 +651,24 @@ static int router_parse(
     return total_parsed;
 }
 
+// client:query(query[, timeout])
 int redis_query(lua_State *L) {
-    luaF_need_args(L, 2, "query");
+    luaF_min_max_args(L, 2, 3, "query");
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
     luaL_checktype(L, 2, LUA_TSTRING);
 
+    lua_Number timeout = luaL_optnumber(L, 3, client->timeout);
+
+    lua_settop(L, 2); // client, query
+
     lua_State *T = luaF_new_thread_or_error(L);
 
     lua_insert(L, 1); // client, query, T -> T, client, query
     lua_pushcfunction(T, query_start);
     lua_xmove(L, T, 2); // client, query >> T
+    lua_pushnumber(T, timeout);
 
-    lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+    lua_resume(T, L, 3, &(int){0}); // should yield, 0 nres
 
     return 1;
 }
@@ -498,7 +678,9 @@ static int query_start(lua_State *L) {
     size_t query_len;
     const char *query = lua_tolstring(L, 2, &query_len);
 
-    if (unlikely(!client->connected)) {
+    if (unlikely(!client->reconnecting
+        && (!client->connected || client->fd < 0)
+    )) {
         luaL_error(L, "not connected");
     }
 
@@ -510,6 +692,50 @@ static int query_start(lua_State *L) {
         luaL_error(L, "query should end with \\r\\n");
     }
 
+    lua_Number timeout = lua_isnoneornil(L, 3)
+        ? client->timeout
+        : lua_tonumber(L, 3);
+
+    int replayable = client->reconnect
+        && query_is_idempotent(query, query_len);
+
+    client_send(L, client, query, query_len);
+
+    lua_Integer query_id = client->next_query_id++;
+
+    if (replayable) {
+        lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS);
+        lua_pushvalue(L, 2); // query
+        lua_rawseti(L, -2, query_id); // q_texts[query_id] = query
+        lua_pop(L, 1); // lua_getiuservalue
+    }
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
+    lua_pushboolean(L, 0); // drop answer if timer fails
+    lua_rawseti(L, -2, query_id);
+
+    int tmt_fd = timeout > 0 ? luaF_set_timeout(L, timeout) : -1;
+
+    lua_pushthread(L);
+    lua_rawseti(L, -2, query_id);
+
+    lua_settop(L, 1);
+
+    if (tmt_fd >= 0) {
+        lua_pushinteger(L, tmt_fd);
+        return lua_yieldk(L, 0, 1, query_continue); // 1: deadline is set
+    }
+
+    return lua_yieldk(L, 0, 0, query_continue);
+}
+
+// sends now or appends to send_buf until socket is writable again
+static void client_send(
+    lua_State *L,
+    ud_redis_client *client,
+    const char *query,
+    size_t query_len
+) {
     if (likely(client->can_write)) {
         while (query_len > 0) {
             ssize_t sent = send(client->fd, query, query_len, MSG_NOSIGNAL);
@@ -517,7 +743,9 @@ static int query_start(lua_State *L) {
             if (unlikely(sent == 0)) {
                 luaL_error(L, "server dropped out during client send");
             } else if (sent < 0) {
-                if (unlikely(errno != EAGAIN && errno != EWOULDBLOCK)) {
+                if (unlikely(errno != EAGAIN && errno != EWOULDBLOCK
+                    && !client->reconnect // router will reconnect and replay
+                )) {
                     luaF_error_errno(L, "query failed");
                 }
 
@@ -534,16 +762,6 @@ static int query_start(lua_State *L) {
     if (unlikely(query_len > 0)) {
         luaF_strbuf_append(L, &client->send_buf, query, query_len);
     }
-
-    lua_Integer query_id = client->next_query_id++;
-
-    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
-    lua_pushthread(L);
-    lua_rawseti(L, -2, query_id);
-
-    lua_settop(L, 1);
-
-    return lua_yieldk(L, 0, 0, query_continue);
 }
 
 static void router_process_send_buf(lua_State *L, ud_redis_client *client) {
@@ -568,137 +786,719 @@ static void router_process_send_buf(lua_State *L, ud_redis_client *client) {
     }
 }
 
+// client, [tmt_fd], is_ok, data, type
+// client, tmt_fd, tmt_fd, emask
 static int query_continue(lua_State *L, int status, lua_KContext ctx) {
-    (void)ctx;
     (void)status;
 
+    if (ctx) { // deadline is set
+        luaF_close_or_warning(L, lua_tointeger(L, 2));
+
+        if (unlikely(lua_type(L, 3) != LUA_TBOOLEAN)) { // tmt
+            query_unsub(L);
+
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                ud_redis_client *client = lua_touserdata(L, 1);
+                client->timeouts++;
+
+                lua_pushliteral(L, "query timeout");
+            } // else it is loop.gc error
+
+            return lua_error(L);
+        }
+    }
+
     error_if_dead(L);
 
     return 2; // data, type
 }
 
-int redis_subscribe(lua_State *L) {
-    luaF_need_args(L, 3, "subscribe");
-    luaL_checktype(L, 2, LUA_TSTRING); // channel name
-    luaL_checktype(L, 3, LUA_TFUNCTION); // on push callback
+// answer for current thread will be dropped by router
+static void query_unsub(lua_State *L) {
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS);
+    lua_pushthread(L);
 
-    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS); // ud, ch, cb, cbs
-    lua_insert(L, 2); // ud, cbs, ch, cb
-    lua_pushvalue(L, 3); // ud, cbs, ch, cb, ch
-    lua_insert(L, 2); // ud, ch, cbs, ch, cb
-    lua_rawset(L, 3); // push_cbs[ch_name] = on_push
-    lua_pop(L, 1); // ud, ch
+    int q_subs_idx = lua_gettop(L) - 2;
+    int q_texts_idx = lua_gettop(L) - 1;
+    int self_idx = lua_gettop(L);
 
-    lua_createtable(L, 2, 0);
-    lua_insert(L, 2); // ud, table, ch_name
+    lua_pushnil(L);
+    while (lua_next(L, q_subs_idx)) {
+        if (lua_rawequal(L, -1, self_idx)) {
+            lua_pop(L, 1); // value
+            lua_pushvalue(L, -1); // query_id
+            lua_pushboolean(L, 0);
+            lua_rawset(L, q_subs_idx); // q_subs[query_id] = false
+            lua_pushnil(L);
+            lua_rawset(L, q_texts_idx); // q_texts[query_id] = nil
+            break;
+        }
 
-    lua_pushliteral(L, "SUBSCRIBE");
-    lua_rawseti(L, 2, 1); // table[1] = "subscribe"
-    lua_rawseti(L, 2, 2); // table[2] = ch_name
+        lua_pop(L, 1); // value
+    }
 
-    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
-    luaF_strbuf *sb = &client->pack_buf;
-    sb->filled = 0;
+    lua_settop(L, q_subs_idx - 1);
+}
 
-    resp_pack(L, sb, 2);
-    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
-    lua_insert(L, 2); // ud, query, table
-    lua_pop(L, 1); // ud, query
+// runs cb in a new worker or queues it when all workers are busy
+static void push_dispatch(
+    lua_State *L,
+    ud_redis_client *client,
+    int cb_idx,
+    int payload_idx
+) {
+    int can_run = client->push_concurrency == 0
+        || (client->push_running < client->push_concurrency
+            && client->push_queued == 0);
+
+    if (likely(can_run)) {
+        lua_State *T = luaF_new_thread_or_error(L);
+
+        lua_pushcfunction(T, push_worker_start);
+        lua_pushvalue(L, 1); // client
+        lua_pushvalue(L, cb_idx);
+        lua_pushvalue(L, payload_idx);
+        lua_xmove(L, T, 3); // client, cb, payload >> T
+        lua_pop(L, 1); // T
+
+        int nres;
+        int status = lua_resume(T, L, 3, &nres);
+
+        if (unlikely(status == LUA_YIELD && nres > 0)) {
+            lua_pop(T, nres);
+        } else if (unlikely(status != LUA_OK && status != LUA_YIELD)) {
+            luaL_error(L, "push worker error: %s", lua_tostring(T, -1));
+        }
 
-    lua_pushcfunction(L, redis_query); // ud, query, fn
-    lua_insert(L, 1); // fn, ud, query
-    lua_call(L, 2, 1); // thread
+        return;
+    }
 
-    return 1; // thread
+    if (unlikely(client->push_queued == client->push_queue_size)) {
+        if (client->push_overflow == PUSH_OVERFLOW_ERROR) {
+            luaL_error(L, "push queue overflow; size: %d",
+                client->push_queue_size);
+        }
+
+        // PUSH_OVERFLOW_DROP, block never gets here: reading stops when full
+
+        lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_QUEUE);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, 2 * client->push_head + 1);
+        lua_pushnil(L);
+        lua_rawseti(L, -2, 2 * client->push_head + 2);
+        lua_pop(L, 1); // lua_getiuservalue
+
+        client->push_head = (client->push_head + 1) % client->push_queue_size;
+        client->push_queued--;
+        client->push_dropped++;
+    }
+
+    int slot = (client->push_head + client->push_queued)
+        % client->push_queue_size;
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_QUEUE);
+    lua_pushvalue(L, cb_idx);
+    lua_rawseti(L, -2, 2 * slot + 1);
+    lua_pushvalue(L, payload_idx);
+    lua_rawseti(L, -2, 2 * slot + 2);
+    lua_pop(L, 1); // lua_getiuservalue
+
+    client->push_queued++;
+
+    if (client->push_queued == client->push_queue_size
+        && client->push_overflow == PUSH_OVERFLOW_BLOCK
+    ) {
+        client->push_blocked = 1;
+    }
 }
 
-int redis_unsubscribe(lua_State *L) {
-    luaF_need_args(L, 2, "unsubscribe");
-    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+// pushes cb and payload (or payloads of the same cb in batch mode)
+static int push_queue_take(lua_State *L, ud_redis_client *client) {
+    if (client->push_queued == 0) {
+        return 0;
+    }
 
-    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS); // ud, ch, cbs
-    lua_pushvalue(L, 2); // ud, ch, cbs, ch
-    lua_pushnil(L); // ud, ch, cbs, ch, nil
-    lua_rawset(L, 3); // push_cbs[ch_name] = nil
-    lua_pop(L, 1); // ud, ch
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_QUEUE);
 
-    lua_createtable(L, 2, 0);
-    lua_insert(L, 2); // ud, table, ch_name
+    int queue_idx = lua_gettop(L);
+    int batch_n = 0;
 
-    lua_pushliteral(L, "UNSUBSCRIBE");
-    lua_rawseti(L, 2, 1); // table[1] = "unsubscribe"
-    lua_rawseti(L, 2, 2); // table[2] = ch_name
+    while (client->push_queued > 0) {
+        int cb_i = 2 * client->push_head + 1;
 
-    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
-    luaF_strbuf *sb = &client->pack_buf;
-    sb->filled = 0;
+        lua_rawgeti(L, queue_idx, cb_i);
 
-    resp_pack(L, sb, 2);
-    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
-    lua_insert(L, 2); // ud, query, table
-    lua_pop(L, 1); // ud, query
+        if (batch_n > 0 && !lua_rawequal(L, -1, queue_idx + 1)) {
+            lua_pop(L, 1); // another cb, next batch
+            break;
+        }
 
-    lua_pushcfunction(L, redis_query); // ud, query, fn
-    lua_insert(L, 1); // fn, ud, query
-    lua_call(L, 2, 1); // thread
+        if (batch_n > 0) {
+            lua_pop(L, 1); // same cb
+        }
 
-    return 1; // thread
-}
+        lua_rawgeti(L, queue_idx, cb_i + 1); // payload
 
-int redis_publish(lua_State *L) {
-    luaF_need_args(L, 3, "publish");
-    luaL_checktype(L, 2, LUA_TSTRING); // channel name
-    luaL_checktype(L, 3, LUA_TSTRING); // message
+        lua_pushnil(L);
+        lua_rawseti(L, queue_idx, cb_i);
+        lua_pushnil(L);
+        lua_rawseti(L, queue_idx, cb_i + 1);
 
-    lua_createtable(L, 3, 0); // ud, ch_name, payload, table
-    lua_insert(L, 2); // ud, table, ch_name, payload
-    lua_insert(L, 3); // ud, table, payload, ch_name
+        client->push_head = (client->push_head + 1) % client->push_queue_size;
+        client->push_queued--;
 
-    lua_pushliteral(L, "PUBLISH");
-    lua_rawseti(L, 2, 1); // table[1] = "publish"
-    lua_rawseti(L, 2, 2); // table[2] = ch_name
-    lua_rawseti(L, 2, 3); // table[3] = payload
+        if (client->push_batch == 0) {
+            break; // queue, cb, payload
+        }
 
-    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
-    luaF_strbuf *sb = &client->pack_buf;
-    sb->filled = 0;
+        if (batch_n == 0) {
+            lua_createtable(L, client->push_batch, 0); // cb, payload, batch
+            lua_insert(L, -2); // cb, batch, payload
+        }
 
-    resp_pack(L, sb, 2);
-    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
-    lua_insert(L, 2); // ud, query, table
-    lua_pop(L, 1); // ud, query
+        lua_rawseti(L, queue_idx + 2, ++batch_n);
 
-    lua_pushcfunction(L, redis_query); // ud, query, fn
-    lua_insert(L, 1); // fn, ud, query
-    lua_call(L, 2, 1); // thread
+        if (batch_n == client->push_batch) {
+            break;
+        }
+    }
 
-    return 1; // thread
+    lua_remove(L, queue_idx);
+
+    return 1; // cb, payload or batch
 }
 
-// HELLO [protover [AUTH username password] [SETNAME clientname]]
-int redis_hello(lua_State *L) {
-    luaF_need_args(L, 2, "hello");
-    luaL_checktype(L, 2, LUA_TTABLE); // params
+// client, cb, payload
+static int push_worker_start(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
 
-    lua_getfield(L, 2, "protocol_version"); // 3
-    lua_getfield(L, 2, "username"); // 4
-    lua_getfield(L, 2, "password"); // 5
-    lua_getfield(L, 2, "client_name"); // 6
+    client->push_running++;
 
-    int protocol_version = luaL_optinteger(L, 3, DEFAULT_RESP_VER);
-    const char *username = lua_tostring(L, 4);
-    const char *password = lua_tostring(L, 5);
-    const char *client_name = lua_tostring(L, 6);
+    if (client->push_batch > 0) {
+        lua_createtable(L, client->push_batch, 0);
+        lua_insert(L, 3); // client, cb, batch, payload
+        lua_rawseti(L, 3, 1);
+    }
 
-    int mode = 0;
-    if (username && strlen(username)) mode += 1;
-    if (password && strlen(password)) mode += 10;
-    if (client_name && strlen(client_name)) mode += 100;
+    int status = lua_pcallk(L, 1, 0, 0, 0, push_worker_continue);
 
-    switch (mode) {
-        case 0: // only proto ver
-            lua_pushfstring(L, "HELLO %d" RESP_SEP,
-                protocol_version);
+    return push_worker_continue(L, status, 0);
+}
+
+// drains the queue after each callback
+static int push_worker_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)ctx;
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    while (1) {
+        if (unlikely(status != LUA_OK && status != LUA_YIELD)) {
+            luaF_warning(L, "push callback error: %s", lua_tostring(L, -1));
+        }
+
+        lua_settop(L, 1); // client
+
+        if (unlikely(client->push_blocked
+            && client->push_queued < client->push_queue_size
+        )) {
+            lua_pushcfunction(L, push_resume_read);
+            lua_pushvalue(L, 1); // client
+
+            if (unlikely(lua_pcall(L, 1, 0, 0) != LUA_OK)) {
+                lua_pushcfunction(L, client_drop);
+                lua_insert(L, -2); // fn, err msg
+                lua_pushvalue(L, 1); // fn, err msg, client
+                lua_insert(L, -2); // fn, client, err msg
+                lua_call(L, 2, 0);
+            }
+        }
+
+        if (!push_queue_take(L, client)) {
+            break;
+        }
+
+        status = lua_pcallk(L, 1, 0, 0, 0, push_worker_continue);
+    }
+
+    client->push_running--;
+
+    return 0;
+}
+
+// client; parses what router left in recv_buf and drains the socket
+static int push_resume_read(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    client->push_blocked = 0;
+
+    if (unlikely(client->fd < 0)) {
+        return 0;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_T_SUBS);
+
+    int t_subs_idx = lua_gettop(L);
+    size_t parsed = router_parse(L, client, t_subs_idx);
+
+    if (unlikely(client->fd < 0)) {
+        return 0;
+    }
+
+    luaF_strbuf_shift(L, &client->recv_buf, parsed);
+
+    if (likely(!client->push_blocked)) {
+        router_read(L, client, t_subs_idx);
+    }
+
+    return 0;
+}
+
+// first word of inline or resp array query: "get k\r\n", "*2\r\n$3\r\nget..."
+static int query_is_idempotent(const char *query, size_t query_len) {
+    const char *cmd = query;
+    size_t cmd_len = 0;
+
+    if (query[0] == '*') {
+        const char *bulk = memchr(query, '$', query_len);
+
+        if (bulk == NULL) {
+            return 0;
+        }
+
+        cmd = memchr(bulk, '\n', query_len - (bulk - query));
+
+        if (cmd == NULL) {
+            return 0;
+        }
+
+        cmd_len = strtoul(bulk + 1, NULL, 10);
+        ++cmd; // skip \n
+    } else {
+        while (cmd_len < query_len
+            && cmd[cmd_len] != ' '
+            && cmd[cmd_len] != '\r'
+        ) {
+            ++cmd_len;
+        }
+    }
+
+    if (cmd_len == 0 || cmd_len > QUERY_CMD_MAX_LEN
+        || cmd + cmd_len > query + query_len
+    ) {
+        return 0;
+    }
+
+    for (const char *const *name = idempotent_cmds; *name; ++name) {
+        if (strlen(*name) == cmd_len && strncasecmp(*name, cmd, cmd_len) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// client, err msg; called by router when connection fails
+static int client_drop(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    if (!client->reconnect || client->fd < 0
+        || (!client->connected && !client->reconnecting) // first connect
+    ) {
+        return redis_client_gc(L);
+    }
+
+    luaF_close_or_warning(L, client->fd);
+
+    client->fd = -1;
+    client->connected = 0;
+    client->can_write = 0;
+    client->send_buf.filled = 0;
+    client->recv_buf.filled = 0;
+
+    lua_pushnil(L);
+    cache_invalidate(L, client, 3); // flush: invalidations are lost
+    lua_settop(L, 2); // client, err msg
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS); // 3
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS); // 4
+    lua_createtable(L, 8, 0); // 5: new q_subs
+    lua_createtable(L, 8, 0); // 6: new q_texts
+    lua_createtable(L, 8, 0); // 7: failed threads
+    lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_T_SUBS); // 8
+
+    lua_Integer first_id = client->next_answer_id;
+    lua_Integer last_id = client->next_query_id;
+    luaF_strbuf *sb = &client->send_buf;
+
+    client->next_answer_id = 1;
+    client->next_query_id = 1;
+
+    // resent first, answers are dropped
+
+    if (lua_getiuservalue(L, 1, REDIS_UV_IDX_HELLO_Q) == LUA_TSTRING) {
+        size_t len;
+        const char *query = lua_tolstring(L, -1, &len);
+
+        luaF_strbuf_append(L, sb, query, len);
+        lua_pushboolean(L, 0);
+        lua_rawseti(L, 5, client->next_query_id++);
+    }
+
+    if (lua_getiuservalue(L, 1, REDIS_UV_IDX_TRACKING_Q) == LUA_TSTRING) {
+        size_t len;
+        const char *query = lua_tolstring(L, -1, &len);
+
+        luaF_strbuf_append(L, sb, query, len);
+        lua_pushboolean(L, 0);
+        lua_rawseti(L, 5, client->next_query_id++);
+
+        client->tracking = 1; // cached answers arrive after tracking is on
+    }
+
+    lua_settop(L, 8);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS);
+
+    lua_pushnil(L);
+    while (lua_next(L, 9)) { // ch_name, on_push
+        lua_pop(L, 1); // ch_name
+
+        lua_createtable(L, 2, 0);
+        lua_pushliteral(L, "SUBSCRIBE");
+        lua_rawseti(L, -2, 1);
+        lua_pushvalue(L, -2); // ch_name
+        lua_rawseti(L, -2, 2);
+
+        client->pack_buf.filled = 0;
+        resp_pack(L, &client->pack_buf, lua_gettop(L));
+        luaF_strbuf_append(L, sb, client->pack_buf.buf,
+            client->pack_buf.filled);
+        lua_pop(L, 1); // query parts
+
+        lua_pushboolean(L, 0);
+        lua_rawseti(L, 5, client->next_query_id++);
+    }
+
+    lua_settop(L, 8);
+
+    // replay idempotent queries, fail the rest
+
+    for (lua_Integer id = first_id; id < last_id; ++id) {
+        if (lua_rawgeti(L, 3, id) != LUA_TTHREAD) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (lua_rawgeti(L, 4, id) != LUA_TSTRING) {
+            lua_pop(L, 1); // lua_rawgeti q_texts
+            lua_rawseti(L, 7, lua_rawlen(L, 7) + 1); // failed += thread
+            continue;
+        }
+
+        size_t len;
+        const char *query = lua_tolstring(L, -1, &len);
+        luaF_strbuf_append(L, sb, query, len);
+
+        lua_rawseti(L, 6, client->next_query_id);
+        lua_rawseti(L, 5, client->next_query_id++);
+
+        client->replayed++;
+    }
+
+    lua_pushvalue(L, 5);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS);
+    lua_pushvalue(L, 6);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS);
+
+    int failed_n = lua_rawlen(L, 7);
+
+    for (int i = 1; i <= failed_n; ++i) {
+        lua_rawgeti(L, 7, i);
+
+        int sub_idx = lua_gettop(L);
+        lua_State *sub = lua_tothread(L, sub_idx);
+
+        if (unlikely(lua_status(sub) != LUA_YIELD)) {
+            lua_settop(L, 8);
+            continue; // already failed
+        }
+
+        lua_pushboolean(sub, 0);
+        lua_pushfstring(sub, "connection lost: %s", lua_tostring(L, 2));
+        lua_pushinteger(sub, 0); // fake type
+
+        luaF_resume(L, 8, sub, sub_idx, 3);
+        lua_settop(L, 8);
+    }
+
+    if (lua_getiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD) == LUA_TTHREAD) {
+        int sub_idx = lua_gettop(L);
+        lua_State *sub = lua_tothread(L, sub_idx);
+
+        lua_pushboolean(sub, 0);
+        lua_pushvalue(L, 2); // err msg
+        lua_xmove(L, sub, 1);
+        lua_pushinteger(sub, 0);
+
+        luaF_resume(L, 8, sub, sub_idx, 3); // reconnect attempt failed
+
+        return 0;
+    }
+
+    client->reconnecting = 1;
+    client->reconnect_attempt = 0;
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, reconnect_start);
+    lua_pushvalue(L, 1); // client
+    lua_xmove(L, T, 1); // client >> T
+
+    lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    return 0;
+}
+
+// exponential backoff with equal jitter: [delay / 2, delay]
+static lua_Number reconnect_delay(ud_redis_client *client) {
+    int shift = client->reconnect_attempt < 16 ? client->reconnect_attempt : 16;
+    lua_Number delay = client->reconnect_min_delay * (1 << shift);
+
+    if (delay > client->reconnect_max_delay) {
+        delay = client->reconnect_max_delay;
+    }
+
+    lua_Number jitter = (lua_Number)rand_r(&client->jitter_seed) / RAND_MAX;
+
+    return delay * (0.5 + 0.5 * jitter);
+}
+
+// client
+static int reconnect_start(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    lua_settop(L, 1); // client
+    lua_pushnil(L);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD);
+
+    if (unlikely(!client->reconnecting)) {
+        return 0; // client was closed
+    }
+
+    if (unlikely(client->reconnect_max_attempts > 0
+        && client->reconnect_attempt >= client->reconnect_max_attempts
+    )) {
+        lua_pushcfunction(L, redis_client_gc);
+        lua_pushvalue(L, 1); // client
+        lua_pushfstring(L, "reconnect failed; attempts: %d",
+            client->reconnect_attempt);
+        lua_call(L, 2, 0);
+
+        return 0;
+    }
+
+    int tmt_fd = luaF_set_timeout(L, reconnect_delay(client));
+    client->reconnect_attempt++;
+
+    lua_pushinteger(L, tmt_fd);
+
+    return lua_yieldk(L, 0, RECONNECT_STEP_SLEEP, reconnect_continue);
+}
+
+// sleep: client, tmt_fd, tmt_fd, emask
+// connect: client, [is_ok, err msg, type] - no args on success
+static int reconnect_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    if (ctx == RECONNECT_STEP_SLEEP) {
+        luaF_close_or_warning(L, lua_tointeger(L, 2));
+
+        if (unlikely(!client->reconnecting || lua_type(L, -1) != LUA_TNUMBER)) {
+            return 0; // client or loop was closed
+        }
+
+        lua_settop(L, 1); // client
+        lua_pushcfunction(L, open_socket);
+        lua_pushvalue(L, 1); // client
+
+        if (unlikely(lua_pcall(L, 1, 0, 0) != LUA_OK)) {
+            if (client->fd >= 0) {
+                luaF_close_or_warning(L, client->fd);
+                client->fd = -1;
+            }
+
+            return reconnect_start(L); // next attempt
+        }
+
+        router_spawn(L, 1);
+
+        lua_pushthread(L);
+        lua_setiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD);
+
+        return lua_yieldk(L, 0, RECONNECT_STEP_CONNECT, reconnect_continue);
+    }
+
+    if (lua_gettop(L) > 1) {
+        return reconnect_start(L); // next attempt or client was closed
+    }
+
+    lua_pushnil(L);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CONN_THREAD);
+
+    client->connected = 1;
+    client->reconnecting = 0;
+    client->reconnect_attempt = 0;
+    client->reconnects++;
+
+    return 0;
+}
+
+int redis_stat(lua_State *L) {
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+
+    lua_createtable(L, 0, 10);
+    luaF_set_kv_int(L, -1, "reconnects", client->reconnects);
+    luaF_set_kv_int(L, -1, "timeouts", client->timeouts);
+    luaF_set_kv_int(L, -1, "replayed", client->replayed);
+    luaF_set_kv_int(L, -1, "pending",
+        client->next_query_id - client->next_answer_id);
+    luaF_set_kv_int(L, -1, "push_running", client->push_running);
+    luaF_set_kv_int(L, -1, "push_queued", client->push_queued);
+    luaF_set_kv_int(L, -1, "push_dropped", client->push_dropped);
+    lua_pushboolean(L, client->connected && client->fd >= 0);
+    lua_setfield(L, -2, "connected");
+    lua_pushboolean(L, client->reconnecting);
+    lua_setfield(L, -2, "reconnecting");
+    lua_pushboolean(L, client->closed);
+    lua_setfield(L, -2, "closed");
+
+    return 1;
+}
+
+int redis_subscribe(lua_State *L) {
+    luaF_need_args(L, 3, "subscribe");
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+    luaL_checktype(L, 3, LUA_TFUNCTION); // on push callback
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS); // ud, ch, cb, cbs
+    lua_insert(L, 2); // ud, cbs, ch, cb
+    lua_pushvalue(L, 3); // ud, cbs, ch, cb, ch
+    lua_insert(L, 2); // ud, ch, cbs, ch, cb
+    lua_rawset(L, 3); // push_cbs[ch_name] = on_push
+    lua_pop(L, 1); // ud, ch
+
+    lua_createtable(L, 2, 0);
+    lua_insert(L, 2); // ud, table, ch_name
+
+    lua_pushliteral(L, "SUBSCRIBE");
+    lua_rawseti(L, 2, 1); // table[1] = "subscribe"
+    lua_rawseti(L, 2, 2); // table[2] = ch_name
+
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, 2);
+    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
+    lua_insert(L, 2); // ud, query, table
+    lua_pop(L, 1); // ud, query
+
+    lua_pushcfunction(L, redis_query); // ud, query, fn
+    lua_insert(L, 1); // fn, ud, query
+    lua_call(L, 2, 1); // thread
+
+    return 1; // thread
+}
+
+int redis_unsubscribe(lua_State *L) {
+    luaF_need_args(L, 2, "unsubscribe");
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_PUSH_CBS); // ud, ch, cbs
+    lua_pushvalue(L, 2); // ud, ch, cbs, ch
+    lua_pushnil(L); // ud, ch, cbs, ch, nil
+    lua_rawset(L, 3); // push_cbs[ch_name] = nil
+    lua_pop(L, 1); // ud, ch
+
+    lua_createtable(L, 2, 0);
+    lua_insert(L, 2); // ud, table, ch_name
+
+    lua_pushliteral(L, "UNSUBSCRIBE");
+    lua_rawseti(L, 2, 1); // table[1] = "unsubscribe"
+    lua_rawseti(L, 2, 2); // table[2] = ch_name
+
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, 2);
+    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
+    lua_insert(L, 2); // ud, query, table
+    lua_pop(L, 1); // ud, query
+
+    lua_pushcfunction(L, redis_query); // ud, query, fn
+    lua_insert(L, 1); // fn, ud, query
+    lua_call(L, 2, 1); // thread
+
+    return 1; // thread
+}
+
+int redis_publish(lua_State *L) {
+    luaF_need_args(L, 3, "publish");
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+    luaL_checktype(L, 3, LUA_TSTRING); // message
+
+    lua_createtable(L, 3, 0); // ud, ch_name, payload, table
+    lua_insert(L, 2); // ud, table, ch_name, payload
+    lua_insert(L, 3); // ud, table, payload, ch_name
+
+    lua_pushliteral(L, "PUBLISH");
+    lua_rawseti(L, 2, 1); // table[1] = "publish"
+    lua_rawseti(L, 2, 2); // table[2] = ch_name
+    lua_rawseti(L, 2, 3); // table[3] = payload
+
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, 2);
+    lua_pushlstring(L, sb->buf, sb->filled); // ud, table, query
+    lua_insert(L, 2); // ud, query, table
+    lua_pop(L, 1); // ud, query
+
+    lua_pushcfunction(L, redis_query); // ud, query, fn
+    lua_insert(L, 1); // fn, ud, query
+    lua_call(L, 2, 1); // thread
+
+    return 1; // thread
+}
+
+// HELLO [protover [AUTH username password] [SETNAME clientname]]
+int redis_hello(lua_State *L) {
+    luaF_need_args(L, 2, "hello");
+    luaL_checktype(L, 2, LUA_TTABLE); // params
+
+    lua_getfield(L, 2, "protocol_version"); // 3
+    lua_getfield(L, 2, "username"); // 4
+    lua_getfield(L, 2, "password"); // 5
+    lua_getfield(L, 2, "client_name"); // 6
+
+    int protocol_version = luaL_optinteger(L, 3, DEFAULT_RESP_VER);
+    const char *username = lua_tostring(L, 4);
+    const char *password = lua_tostring(L, 5);
+    const char *client_name = lua_tostring(L, 6);
+
+    int mode = 0;
+    if (username && strlen(username)) mode += 1;
+    if (password && strlen(password)) mode += 10;
+    if (client_name && strlen(client_name)) mode += 100;
+
+    switch (mode) {
+        case 0: // only proto ver
+            lua_pushfstring(L, "HELLO %d" RESP_SEP,
+                protocol_version);
             break;
         case 1: // username
             return luaL_error(L, "password is not set");
@@ -723,39 +1523,1665 @@ int redis_hello(lua_State *L) {
                     protocol_version, username, password, client_name);
             break;
         default:
-            return luaL_error(L, "internal error");
+            return luaL_error(L, "internal error");
+    }
+
+    lua_insert(L, 2); // ud, query, ...
+    lua_settop(L, 2); // ud, query
+    lua_pushvalue(L, 2);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_HELLO_Q); // resent on reconnect
+    lua_pushcfunction(L, redis_query); // ud, query, fn
+    lua_insert(L, 1); // fn, ud, query
+    lua_call(L, 2, 1); // thread
+
+    return 1; // thread
+}
+
+int redis_ping(lua_State *L) {
+    luaF_need_args(L, 1, "ping"); // ud
+    lua_pushliteral(L, "PING" RESP_SEP); // ud, q
+
+    lua_State *T = luaF_new_thread_or_error(L); // ud, q, t
+
+    lua_insert(L, 1); // t, ud, q
+    lua_pushcfunction(T, query_start);
+    lua_xmove(L, T, 2); // ud, q >> t
+
+    lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+
+    return 1;
+}
+
+int redis_join(lua_State *L) {
+    luaF_need_args(L, 1, "join");
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, join_start);
+    lua_insert(L, 1);
+    lua_xmove(L, T, 1);
+    lua_resume(T, L, 1, &(int){0});
+
+    return 1;
+}
+
+static int join_start(lua_State *L) {
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+
+    if (client->fd == -1) {
+        return 0;
+    }
+
+    lua_pushthread(L);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_JOIN_THREAD);
+
+    return lua_yieldk(L, 0, 0, join_continue);
+}
+
+static int join_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+
+    error_if_dead(L);
+
+    return 0;
+}
+
+static void error_if_dead(lua_State *L) {
+    if (lua_gettop(L) >= 3) {
+        int status = lua_toboolean(L, -3);
+        int type = lua_tointeger(L, -1);
+
+        if (unlikely(!status || type == RESP_ERR || type == RESP_BULK_ERR)) {
+            lua_pop(L, 1); // -type
+            lua_error(L); // -1 = err msg
+        }
+    }
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    if (unlikely(client->fd == -1)) {
+        luaL_error(L, "redis socket was closed");
+    }
+
+    int code = get_socket_error_code(client->fd);
+
+    if (unlikely(code != 0)) {
+        luaF_push_error_socket(L, client->fd, "connection failed", code);
+        lua_error(L);
+    }
+}
+
+// params: { bcast = bool, prefixes = { ... }, noloop = bool }
+int redis_tracking(lua_State *L) {
+    luaF_need_args(L, 2, "tracking");
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TTABLE); // params
+
+    lua_createtable(L, 8, 0); // query parts
+    int parts_idx = lua_gettop(L);
+    int parts_n = 0;
+
+    lua_pushliteral(L, "CLIENT");
+    lua_rawseti(L, parts_idx, ++parts_n);
+    lua_pushliteral(L, "TRACKING");
+    lua_rawseti(L, parts_idx, ++parts_n);
+    lua_pushliteral(L, "ON");
+    lua_rawseti(L, parts_idx, ++parts_n);
+
+    if (lua_getfield(L, 2, "bcast") != LUA_TNIL && lua_toboolean(L, -1)) {
+        lua_pushliteral(L, "BCAST");
+        lua_rawseti(L, parts_idx, ++parts_n);
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    if (lua_getfield(L, 2, "prefixes") == LUA_TTABLE) {
+        int prefixes_n = lua_rawlen(L, -1);
+
+        for (int i = 1; i <= prefixes_n; ++i) {
+            lua_pushliteral(L, "PREFIX");
+            lua_rawseti(L, parts_idx, ++parts_n);
+            lua_rawgeti(L, -1, i);
+            lua_rawseti(L, parts_idx, ++parts_n);
+        }
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    if (lua_getfield(L, 2, "noloop") != LUA_TNIL && lua_toboolean(L, -1)) {
+        lua_pushliteral(L, "NOLOOP");
+        lua_rawseti(L, parts_idx, ++parts_n);
+    }
+
+    lua_pop(L, 1); // lua_getfield
+
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, parts_idx);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushlstring(L, sb->buf, sb->filled); // query
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_TRACKING_Q); // resent on reconnect
+
+    lua_pushcfunction(T, tracking_start);
+    lua_pushvalue(L, 1); // client
+    lua_xmove(L, T, 1); // client >> T
+    lua_xmove(L, T, 1); // query >> T
+
+    lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+// client, query
+static int tracking_start(lua_State *L) {
+    lua_pushcfunction(L, redis_query);
+    lua_insert(L, 1); // fn, client, query
+    lua_pushvalue(L, 2); // fn, client, query, client
+    lua_insert(L, 1); // client, fn, client, query
+    lua_call(L, 2, 1); // client, thread
+
+    return luaF_loop_wait(L, 2, 0, tracking_continue);
+}
+
+// client, thread, status, data, type or err msg
+static int tracking_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+
+    if (unlikely(lua_tointeger(L, 3) != LUA_OK)) {
+        return lua_error(L); // err msg is on top
+    }
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+    client->tracking = client->fd >= 0;
+
+    return 2; // data, type
+}
+
+// serves "get" and "hgetall" from local memory when tracking is on
+// returned hgetall tables are shared with the cache: treat as read-only
+int redis_cached(lua_State *L) {
+    luaF_need_args(L, 3, "cached");
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    int cmd_i = luaL_checkoption(L, 2, NULL, cache_cmds);
+    luaL_checktype(L, 3, LUA_TSTRING); // key
+
+    lua_settop(L, 3); // client, cmd, key
+
+    if (likely(client->tracking)) {
+        lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+        lua_rawgeti(L, -1, cmd_i + 1);
+        lua_pushvalue(L, 3); // cache, entries, key
+
+        if (lua_rawget(L, -2) != LUA_TNIL) { // hit
+            client->cache_hits++;
+            cache_touch(L, client, cmd_i, 3);
+
+            lua_State *T = luaF_new_thread_or_error(L); // .., data, T
+
+            lua_insert(L, -2); // T, data
+            lua_xmove(L, T, 1); // data >> T, T is finished
+            lua_pushinteger(T, cache_cmds_type[cmd_i]);
+
+            return 1; // T
+        }
+
+        lua_settop(L, 3);
+    }
+
+    client->cache_misses++;
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, cached_start);
+    lua_pushvalue(L, 1); // client
+    lua_xmove(L, T, 1); // client >> T
+    lua_pushinteger(T, cmd_i);
+    lua_pushvalue(L, 3); // key
+    lua_xmove(L, T, 1); // key >> T
+
+    lua_resume(T, L, 3, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+// client, cmd_i, key
+static int cached_start(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+    int cmd_i = lua_tointeger(L, 2);
+
+    lua_createtable(L, 2, 0);
+    lua_pushstring(L, cache_cmds_resp[cmd_i]);
+    lua_rawseti(L, -2, 1);
+    lua_pushvalue(L, 3); // key
+    lua_rawseti(L, -2, 2);
+
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, lua_gettop(L));
+    lua_pop(L, 1); // parts
+
+    lua_pushcfunction(L, redis_query);
+    lua_pushvalue(L, 1); // client
+    lua_pushlstring(L, sb->buf, sb->filled); // query
+    lua_call(L, 2, 1); // client, cmd_i, key, thread
+
+    return luaF_loop_wait(L, 4, 0, cached_continue);
+}
+
+// client, cmd_i, key, thread, status, data, type or err msg
+static int cached_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+
+    if (unlikely(lua_tointeger(L, 5) != LUA_OK)) {
+        return lua_error(L); // err msg is on top
+    }
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    if (likely(client->tracking && !lua_isnil(L, 6))) {
+        cache_store(L, client, lua_tointeger(L, 2), 3, 6);
+    }
+
+    return 2; // data, type
+}
+
+// cache[cmd_i][key] = data, client should be at 1,
+// least recently used entries are evicted past the cache limits
+static void cache_store(
+    lua_State *L,
+    ud_redis_client *client,
+    int cmd_i,
+    int key_idx,
+    int data_idx
+) {
+    key_idx = lua_absindex(L, key_idx);
+    data_idx = lua_absindex(L, data_idx);
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+    lua_rawgeti(L, -1, cmd_i + 1); // cache, entries
+    lua_pushvalue(L, key_idx);
+
+    if (lua_rawget(L, -2) == LUA_TNIL) {
+        client->cache_entries++;
+    } else {
+        client->cache_bytes -= cache_value_size(L, -1);
+    }
+
+    lua_pop(L, 1); // lua_rawget
+
+    lua_pushvalue(L, key_idx);
+    lua_pushvalue(L, data_idx);
+    lua_rawset(L, -3); // entries[key] = data
+    lua_pop(L, 2); // cache, entries
+
+    client->cache_bytes += lua_rawlen(L, key_idx) + cache_value_size(L, data_idx);
+
+    cache_touch(L, client, cmd_i, key_idx);
+
+    if (cache_over_limit(client)) {
+        cache_evict(L, client);
+    }
+}
+
+// appends an lru record for the key, its previous records become stale:
+// a record is live while ticks[cmd_i][key] points at it
+static void cache_touch(
+    lua_State *L,
+    ud_redis_client *client,
+    int cmd_i,
+    int key_idx
+) {
+    key_idx = lua_absindex(L, key_idx);
+    luaL_checkstack(L, 4, "cache");
+
+    lua_Integer tick = client->cache_tick++;
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_TICKS);
+    lua_rawgeti(L, -1, cmd_i + 1); // ticks, cmd ticks
+    lua_pushvalue(L, key_idx);
+    lua_pushinteger(L, tick);
+    lua_rawset(L, -3); // ticks[cmd_i][key] = tick
+    lua_pop(L, 2); // ticks, cmd ticks
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+    lua_pushinteger(L, cmd_i);
+    lua_rawseti(L, -2, 2 * tick + 1);
+    lua_pushvalue(L, key_idx);
+    lua_rawseti(L, -2, 2 * tick + 2);
+    lua_pop(L, 1); // lru
+
+    if (client->cache_tick - client->cache_lru_head
+        > 2 * client->cache_entries + CACHE_LRU_SLACK
+    ) { // mostly stale records of hot keys
+        cache_lru_compact(L, client);
+    }
+}
+
+static int cache_over_limit(ud_redis_client *client) {
+    return (client->cache_max_entries > 0
+            && client->cache_entries > client->cache_max_entries)
+        || (client->cache_max_bytes > 0
+            && client->cache_bytes > client->cache_max_bytes);
+}
+
+// pops lru records from the head, live ones drop their entries
+static void cache_evict(lua_State *L, ud_redis_client *client) {
+    luaL_checkstack(L, 8, "cache");
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_TICKS);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+
+    int lru_idx = lua_gettop(L);
+    int ticks_idx = lru_idx - 1;
+    int cache_idx = lru_idx - 2;
+
+    while (cache_over_limit(client)
+        && client->cache_lru_head < client->cache_tick
+    ) {
+        lua_Integer tick = client->cache_lru_head++;
+
+        lua_rawgeti(L, lru_idx, 2 * tick + 1);
+        int cmd_i = lua_tointeger(L, -1);
+        lua_rawgeti(L, lru_idx, 2 * tick + 2); // cmd_i, key
+
+        lua_pushnil(L);
+        lua_rawseti(L, lru_idx, 2 * tick + 1);
+        lua_pushnil(L);
+        lua_rawseti(L, lru_idx, 2 * tick + 2);
+
+        lua_rawgeti(L, ticks_idx, cmd_i + 1); // cmd_i, key, cmd ticks
+        lua_pushvalue(L, -2);
+
+        if (lua_rawget(L, -2) != LUA_TNUMBER
+            || lua_tointeger(L, -1) != tick
+        ) { // stale: key was used again or invalidated
+            lua_settop(L, lru_idx);
+            continue;
+        }
+
+        lua_pop(L, 1); // lua_rawget
+        lua_pushvalue(L, -2);
+        lua_pushnil(L);
+        lua_rawset(L, -3); // ticks[cmd_i][key] = nil
+
+        lua_rawgeti(L, cache_idx, cmd_i + 1); // cmd_i, key, cmd ticks, entries
+        lua_pushvalue(L, -3);
+        lua_rawget(L, -2); // data
+
+        client->cache_evictions++;
+        client->cache_entries--;
+        client->cache_bytes -= lua_rawlen(L, -4) + cache_value_size(L, -1);
+
+        lua_pop(L, 1); // data
+        lua_pushvalue(L, -3);
+        lua_pushnil(L);
+        lua_rawset(L, -3); // entries[key] = nil
+
+        lua_settop(L, lru_idx);
+    }
+
+    lua_settop(L, cache_idx - 1);
+}
+
+// rebuilds lru with live records only, ticks are renumbered from 0
+static void cache_lru_compact(lua_State *L, ud_redis_client *client) {
+    luaL_checkstack(L, 8, "cache");
+
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_TICKS);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+    lua_createtable(L, 2 * client->cache_entries, 0);
+
+    int new_idx = lua_gettop(L);
+    int lru_idx = new_idx - 1;
+    int ticks_idx = new_idx - 2;
+
+    lua_Integer new_tick = 0; // never above tick, so not mistaken for live
+
+    for (lua_Integer tick = client->cache_lru_head;
+        tick < client->cache_tick; ++tick
+    ) {
+        lua_rawgeti(L, lru_idx, 2 * tick + 1);
+        int cmd_i = lua_tointeger(L, -1);
+        lua_rawgeti(L, lru_idx, 2 * tick + 2); // cmd_i, key
+        lua_rawgeti(L, ticks_idx, cmd_i + 1); // cmd_i, key, cmd ticks
+        lua_pushvalue(L, -2);
+
+        if (lua_rawget(L, -2) == LUA_TNUMBER
+            && lua_tointeger(L, -1) == tick
+        ) {
+            lua_pop(L, 1); // lua_rawget
+            lua_pushvalue(L, -2);
+            lua_pushinteger(L, new_tick);
+            lua_rawset(L, -3); // ticks[cmd_i][key] = new_tick
+
+            lua_pushinteger(L, cmd_i);
+            lua_rawseti(L, new_idx, 2 * new_tick + 1);
+            lua_pushvalue(L, -2); // key
+            lua_rawseti(L, new_idx, 2 * new_tick + 2);
+
+            new_tick++;
+        }
+
+        lua_settop(L, new_idx);
+    }
+
+    lua_setiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+    lua_pop(L, 2); // ticks, lru
+
+    client->cache_lru_head = 0;
+    client->cache_tick = new_tick;
+}
+
+// keys_idx: array of invalidated keys or nil to flush everything
+static void cache_invalidate(lua_State *L, ud_redis_client *client, int keys_idx) {
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE_TICKS);
+
+    int cache_idx = lua_gettop(L) - 1;
+    int ticks_idx = cache_idx + 1;
+
+    if (lua_isnil(L, keys_idx)) { // FLUSHALL or tracking table overflow
+        for (int cmd_i = 1; cmd_i <= CACHE_CMD_N; ++cmd_i) {
+            lua_newtable(L);
+            lua_rawseti(L, cache_idx, cmd_i);
+            lua_newtable(L);
+            lua_rawseti(L, ticks_idx, cmd_i);
+        }
+
+        lua_newtable(L);
+        lua_setiuservalue(L, 1, REDIS_UV_IDX_CACHE_LRU);
+
+        client->cache_invalidations += client->cache_entries;
+        client->cache_entries = 0;
+        client->cache_bytes = 0;
+        client->cache_lru_head = 0;
+        client->cache_tick = 0;
+
+        lua_settop(L, cache_idx - 1);
+
+        return;
+    }
+
+    int keys_n = lua_rawlen(L, keys_idx);
+
+    for (int cmd_i = 1; cmd_i <= CACHE_CMD_N; ++cmd_i) {
+        lua_rawgeti(L, ticks_idx, cmd_i); // cmd ticks
+        lua_rawgeti(L, cache_idx, cmd_i); // entries
+
+        for (int i = 1; i <= keys_n; ++i) {
+            lua_rawgeti(L, keys_idx, i); // entries, key
+            lua_pushvalue(L, -1); // entries, key, key
+
+            if (lua_rawget(L, -3) == LUA_TNIL) { // entries, key, data
+                lua_pop(L, 2);
+                continue;
+            }
+
+            client->cache_invalidations++;
+            client->cache_entries--;
+            client->cache_bytes -= lua_rawlen(L, -2)
+                + cache_value_size(L, -1);
+
+            lua_pop(L, 1); // entries, key
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -5); // ticks[key] = nil, its lru record is stale
+            lua_pushnil(L);
+            lua_rawset(L, -3); // entries[key] = nil
+        }
+
+        lua_pop(L, 2); // cmd ticks, entries
+    }
+
+    lua_settop(L, cache_idx - 1);
+}
+
+// strings are counted by length, hgetall maps by their keys and values
+static size_t cache_value_size(lua_State *L, int idx) {
+    idx = lua_absindex(L, idx);
+
+    if (lua_type(L, idx) != LUA_TTABLE) {
+        return lua_type(L, idx) == LUA_TSTRING
+            ? lua_rawlen(L, idx)
+            : sizeof(lua_Number);
+    }
+
+    size_t size = 0;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        size += lua_type(L, -1) == LUA_TSTRING ? lua_rawlen(L, -1) : 0;
+        size += lua_type(L, -2) == LUA_TSTRING ? lua_rawlen(L, -2) : 0;
+        lua_pop(L, 1);
+    }
+
+    return size;
+}
+
+static void push_cache_stat(
+    lua_State *L,
+    lua_Integer hits,
+    lua_Integer misses,
+    lua_Integer invalidations,
+    lua_Integer evictions,
+    lua_Integer entries,
+    size_t bytes
+) {
+    lua_Integer total = hits + misses;
+
+    lua_createtable(L, 0, 7);
+    luaF_set_kv_int(L, -1, "hits", hits);
+    luaF_set_kv_int(L, -1, "misses", misses);
+    luaF_set_kv_int(L, -1, "invalidations", invalidations);
+    luaF_set_kv_int(L, -1, "evictions", evictions);
+    luaF_set_kv_int(L, -1, "entries", entries);
+    luaF_set_kv_int(L, -1, "bytes", bytes);
+    lua_pushnumber(L, total > 0 ? (lua_Number)hits / total : 0);
+    lua_setfield(L, -2, "hit_rate");
+}
+
+int redis_cache_stat(lua_State *L) {
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+
+    push_cache_stat(L,
+        client->cache_hits,
+        client->cache_misses,
+        client->cache_invalidations,
+        client->cache_evictions,
+        client->cache_entries,
+        client->cache_bytes);
+
+    return 1;
+}
+
+// streams: commands take bulk strings only, numbers are converted
+static void stream_push_arg(lua_State *L, int parts_idx, int arg_idx) {
+    luaL_tolstring(L, arg_idx, NULL);
+    lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+}
+
+// parts table is packed and sent, returns thread
+static int stream_query(
+    lua_State *L,
+    int parts_idx,
+    int kind,
+    lua_Number timeout
+) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+    luaF_strbuf *sb = &client->pack_buf;
+    sb->filled = 0;
+
+    resp_pack(L, sb, parts_idx);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, stream_start);
+    lua_pushvalue(L, 1); // client
+    lua_xmove(L, T, 1); // client >> T
+    lua_pushlstring(T, sb->buf, sb->filled); // query
+    lua_pushinteger(T, kind);
+    lua_pushnumber(T, timeout);
+
+    lua_resume(T, L, 4, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+// client, query, kind, timeout
+static int stream_start(lua_State *L) {
+    int kind = lua_tointeger(L, 3);
+
+    lua_pushcfunction(L, redis_query);
+    lua_pushvalue(L, 1); // client
+    lua_pushvalue(L, 2); // query
+    lua_pushvalue(L, 4); // timeout
+    lua_call(L, 3, 1); // client, query, kind, timeout, thread
+
+    return luaF_loop_wait(L, 5, kind, stream_continue);
+}
+
+// client, query, kind, timeout, thread, status, data, type or err msg
+static int stream_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    if (unlikely(lua_tointeger(L, 6) != LUA_OK)) {
+        if (ctx == STREAM_KIND_GROUP
+            && strstr(lua_tostring(L, -1), "BUSYGROUP") != NULL
+        ) {
+            lua_pushboolean(L, 1);
+            return 1; // group already exists
+        }
+
+        return lua_error(L); // err msg is on top
+    }
+
+    switch (ctx) {
+        case STREAM_KIND_GROUP:
+            lua_pushboolean(L, 1);
+            return 1; // created, same as BUSYGROUP
+        case STREAM_KIND_READ:
+            if (lua_type(L, 7) != LUA_TTABLE) {
+                lua_createtable(L, 0, 0);
+                return 1; // BLOCK expired: no entries
+            }
+
+            lua_pushnil(L);
+
+            if (!lua_next(L, 7)) { // stream name, entries
+                lua_createtable(L, 0, 0);
+                return 1;
+            }
+
+            stream_push_entries(L, lua_gettop(L));
+            return 1; // entries
+        case STREAM_KIND_CLAIM:
+            lua_rawgeti(L, 7, 1); // next start id
+            lua_rawgeti(L, 7, 2); // raw entries
+            stream_push_entries(L, lua_gettop(L));
+            lua_remove(L, -2); // raw entries
+            return 2; // next start id, entries
+        default:
+            return 2; // data, type
+    }
+}
+
+// [[id, [k, v, ...]], ...] -> { { id, { k = v } }, ... }
+static void stream_push_entries(lua_State *L, int entries_idx) {
+    int entries_n = lua_type(L, entries_idx) == LUA_TTABLE
+        ? lua_rawlen(L, entries_idx)
+        : 0;
+
+    lua_createtable(L, entries_n, 0);
+
+    int result_idx = lua_gettop(L);
+    int result_n = 0;
+
+    for (int i = 1; i <= entries_n; ++i) {
+        lua_rawgeti(L, entries_idx, i); // raw entry
+
+        if (unlikely(lua_rawgeti(L, -1, 2) != LUA_TTABLE)) {
+            lua_pop(L, 2); // entry was deleted but still pending
+            continue;
+        }
+
+        int fields_n = lua_rawlen(L, -1);
+
+        lua_createtable(L, 2, 0); // raw entry, raw fields, entry
+        lua_rawgeti(L, -3, 1);
+        lua_rawseti(L, -2, 1); // entry[1] = id
+
+        lua_createtable(L, 0, fields_n / 2);
+
+        for (int k = 1; k < fields_n; k += 2) {
+            lua_rawgeti(L, -3, k);
+            lua_rawgeti(L, -4, k + 1);
+            lua_rawset(L, -3); // fields[k] = v
+        }
+
+        lua_rawseti(L, -2, 2); // entry[2] = fields
+        lua_rawseti(L, result_idx, ++result_n);
+        lua_pop(L, 2); // raw entry, raw fields
+    }
+}
+
+// client:xgroup(stream, group[, start_id]) -> true: creates group and stream
+// an existing group also gives true
+int redis_xgroup(lua_State *L) {
+    luaF_min_max_args(L, 3, 4, "xgroup");
+    luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
+    luaL_checktype(L, 3, LUA_TSTRING); // group
+
+    lua_settop(L, 4);
+    lua_createtable(L, 6, 0);
+
+    int parts_idx = lua_gettop(L);
+
+    lua_pushliteral(L, "XGROUP");
+    lua_rawseti(L, parts_idx, 1);
+    lua_pushliteral(L, "CREATE");
+    lua_rawseti(L, parts_idx, 2);
+    stream_push_arg(L, parts_idx, 2);
+    stream_push_arg(L, parts_idx, 3);
+
+    if (lua_isnoneornil(L, 4)) {
+        lua_pushliteral(L, "$");
+        lua_rawseti(L, parts_idx, 5);
+    } else {
+        stream_push_arg(L, parts_idx, 4);
+    }
+
+    lua_pushliteral(L, "MKSTREAM");
+    lua_rawseti(L, parts_idx, 6);
+
+    return stream_query(L, parts_idx, STREAM_KIND_GROUP, 0);
+}
+
+// client:xadd(stream, { k = v, ... }[, maxlen]) -> id
+int redis_xadd(lua_State *L) {
+    luaF_min_max_args(L, 3, 4, "xadd");
+    luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
+    luaL_checktype(L, 3, LUA_TTABLE); // fields
+
+    lua_Integer maxlen = luaL_optinteger(L, 4, 0);
+
+    lua_createtable(L, 8, 0);
+
+    int parts_idx = lua_gettop(L);
+
+    lua_pushliteral(L, "XADD");
+    lua_rawseti(L, parts_idx, 1);
+    stream_push_arg(L, parts_idx, 2);
+
+    if (maxlen > 0) { // approximate trim is O(1) amortized
+        lua_pushliteral(L, "MAXLEN");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+        lua_pushliteral(L, "~");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+        lua_pushinteger(L, maxlen);
+        stream_push_arg(L, parts_idx, -1);
+        lua_pop(L, 1);
+    }
+
+    lua_pushliteral(L, "*");
+    lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+
+    lua_pushnil(L);
+    while (lua_next(L, 3)) { // key, value
+        stream_push_arg(L, parts_idx, -2);
+        stream_push_arg(L, parts_idx, -1);
+        lua_pop(L, 1); // value
+    }
+
+    return stream_query(L, parts_idx, STREAM_KIND_RAW, 0);
+}
+
+// client:xreadgroup(group, consumer, stream[, count[, block_ms[, id]]])
+// -> { { id, fields }, ... }; id ">" reads new entries, "0" own pending
+int redis_xreadgroup(lua_State *L) {
+    luaF_min_max_args(L, 4, 7, "xreadgroup");
+    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // group
+    luaL_checktype(L, 3, LUA_TSTRING); // consumer
+    luaL_checktype(L, 4, LUA_TSTRING); // stream
+
+    lua_Integer count = luaL_optinteger(L, 5, 0);
+    lua_Integer block_ms = luaL_optinteger(L, 6, -1);
+
+    lua_settop(L, 7);
+    lua_createtable(L, 11, 0);
+
+    int parts_idx = lua_gettop(L);
+
+    lua_pushliteral(L, "XREADGROUP");
+    lua_rawseti(L, parts_idx, 1);
+    lua_pushliteral(L, "GROUP");
+    lua_rawseti(L, parts_idx, 2);
+    stream_push_arg(L, parts_idx, 2);
+    stream_push_arg(L, parts_idx, 3);
+
+    if (count > 0) {
+        lua_pushliteral(L, "COUNT");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+        stream_push_arg(L, parts_idx, 5);
+    }
+
+    if (block_ms >= 0) {
+        lua_pushliteral(L, "BLOCK");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+        stream_push_arg(L, parts_idx, 6);
+    }
+
+    lua_pushliteral(L, "STREAMS");
+    lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+    stream_push_arg(L, parts_idx, 4);
+
+    if (lua_isnil(L, 7)) {
+        lua_pushliteral(L, ">");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+    } else {
+        stream_push_arg(L, parts_idx, 7);
+    }
+
+    // deadline should not fire before BLOCK expires
+    lua_Number timeout = client->timeout > 0 && block_ms > 0
+        ? client->timeout + block_ms / 1000.0
+        : client->timeout;
+
+    return stream_query(L, parts_idx, STREAM_KIND_READ, timeout);
+}
+
+// client:xack(stream, group, { id, ... }): one round-trip for a batch
+int redis_xack(lua_State *L) {
+    luaF_need_args(L, 4, "xack");
+    luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
+    luaL_checktype(L, 3, LUA_TSTRING); // group
+    luaL_checktype(L, 4, LUA_TTABLE); // ids
+
+    int ids_n = lua_rawlen(L, 4);
+
+    if (unlikely(ids_n == 0)) {
+        luaL_error(L, "xack: no ids");
+    }
+
+    lua_createtable(L, 3 + ids_n, 0);
+
+    int parts_idx = lua_gettop(L);
+
+    lua_pushliteral(L, "XACK");
+    lua_rawseti(L, parts_idx, 1);
+    stream_push_arg(L, parts_idx, 2);
+    stream_push_arg(L, parts_idx, 3);
+
+    for (int i = 1; i <= ids_n; ++i) {
+        lua_rawgeti(L, 4, i);
+        stream_push_arg(L, parts_idx, -1);
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    return stream_query(L, parts_idx, STREAM_KIND_RAW, 0);
+}
+
+// client:xautoclaim(stream, group, consumer, min_idle_ms, start[, count])
+// -> next_start, { { id, fields }, ... }
+int redis_xautoclaim(lua_State *L) {
+    luaF_min_max_args(L, 6, 7, "xautoclaim");
+    luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
+    luaL_checktype(L, 3, LUA_TSTRING); // group
+    luaL_checktype(L, 4, LUA_TSTRING); // consumer
+    luaL_checkinteger(L, 5); // min idle time
+    luaL_checktype(L, 6, LUA_TSTRING); // start id
+
+    lua_settop(L, 7);
+    lua_createtable(L, 8, 0);
+
+    int parts_idx = lua_gettop(L);
+
+    lua_pushliteral(L, "XAUTOCLAIM");
+    lua_rawseti(L, parts_idx, 1);
+
+    for (int arg_idx = 2; arg_idx <= 6; ++arg_idx) {
+        stream_push_arg(L, parts_idx, arg_idx);
+    }
+
+    if (!lua_isnil(L, 7)) {
+        lua_pushliteral(L, "COUNT");
+        lua_rawseti(L, parts_idx, lua_rawlen(L, parts_idx) + 1);
+        stream_push_arg(L, parts_idx, 7);
+    }
+
+    return stream_query(L, parts_idx, STREAM_KIND_CLAIM, 0);
+}
+
+// client:load_hashes(prefix[, batch]) -> { [key without prefix] = fields }
+// keys are walked with SCAN MATCH, HGETALLs are pipelined in windows of
+// batch and decoded as they arrive; empty hashes are skipped
+int redis_load_hashes(lua_State *L) {
+    luaF_min_max_args(L, 2, 3, "load_hashes");
+    luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+    luaL_checktype(L, 2, LUA_TSTRING); // prefix
+    lua_Integer batch = luaL_optinteger(L, 3, LOAD_DEFAULT_BATCH);
+    luaL_argcheck(L, batch > 0 && batch <= INT_MAX, 3, "bad batch size");
+
+    lua_settop(L, 2); // client, prefix
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_insert(L, 1); // client, prefix, T -> T, client, prefix
+    lua_pushcfunction(T, load_start);
+    lua_xmove(L, T, 2); // client, prefix >> T
+    lua_pushinteger(T, batch);
+
+    lua_resume(T, L, 3, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+// client, prefix, batch
+static int load_start(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+
+    if (unlikely(!client->reconnecting
+        && (!client->connected || client->fd < 0)
+    )) {
+        luaL_error(L, "not connected");
+    }
+
+    int batch = lua_tointeger(L, 3);
+
+    lua_settop(L, 2);
+
+    redis_load_state *state = luaF_new_ud_or_error(L,
+        sizeof(redis_load_state), 0); // 3
+
+    state->batch = batch;
+    state->scanning = 0;
+    state->scan_done = 0;
+    state->pend_head = state->pend_tail = 1;
+    state->exp_head = state->exp_tail = 1;
+
+    lua_createtable(L, 0, 0); // 4: out
+    lua_createtable(L, batch, 0); // 5: pending keys
+    lua_createtable(L, batch, 0); // 6: expect[i] = key or false for SCAN
+    lua_pushliteral(L, "0"); // 7: cursor
+    lua_pushnil(L); // 8: first err msg
+
+    lua_createtable(L, 2, 0); // 9: HGETALL parts
+    lua_pushliteral(L, "HGETALL");
+    lua_rawseti(L, -2, 1);
+
+    lua_createtable(L, 6, 0); // 10: SCAN parts
+    lua_pushliteral(L, "SCAN");
+    lua_rawseti(L, -2, 1);
+    lua_pushliteral(L, "MATCH");
+    lua_rawseti(L, -2, 3);
+    lua_pushvalue(L, 2); // prefix
+    lua_pushliteral(L, "*");
+    lua_concat(L, 2);
+    lua_rawseti(L, -2, 4);
+    lua_pushliteral(L, "COUNT");
+    lua_rawseti(L, -2, 5);
+    lua_pushfstring(L, "%d", batch); // commands take bulk strings only
+    lua_rawseti(L, -2, 6);
+
+    return load_fill(L);
+}
+
+// parts on top are packed and popped, current thread is the answer sub;
+// q_subs and q_texts are at LOAD_STACK_N + 1, + 2
+static void load_pack(lua_State *L, ud_redis_client *client, luaF_strbuf *sb) {
+    size_t start = sb->filled;
+
+    resp_pack(L, sb, lua_gettop(L));
+    lua_pop(L, 1); // parts
+
+    if (client->reconnect) { // SCAN and HGETALL are replayable
+        lua_pushlstring(L, sb->buf + start, sb->filled - start);
+        lua_rawseti(L, LOAD_STACK_N + 2, client->next_query_id);
+    }
+
+    lua_pushthread(L);
+    lua_rawseti(L, LOAD_STACK_N + 1, client->next_query_id++);
+}
+
+// sends next HGETALL window and SCAN page in one write,
+// yields for the next answer or returns out when nothing is in flight
+static int load_fill(lua_State *L) {
+    ud_redis_client *client = lua_touserdata(L, 1);
+    redis_load_state *state = lua_touserdata(L, 3);
+    luaF_strbuf *sb = &client->pack_buf;
+
+    lua_settop(L, LOAD_STACK_N);
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_SUBS); // +1
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_Q_TEXTS); // +2
+    lua_getiuservalue(L, 1, REDIS_UV_IDX_CACHE);
+    lua_rawgeti(L, -1, CACHE_CMD_HGETALL + 1);
+    lua_remove(L, -2); // +3: cached hashes
+
+    sb->filled = 0;
+
+    lua_Integer in_flight = state->exp_tail - state->exp_head
+        - state->scanning;
+
+    if (in_flight <= state->batch / 2) { // refill window in bulk
+        while (in_flight < state->batch
+            && state->pend_head < state->pend_tail
+        ) {
+            lua_rawgeti(L, 5, state->pend_head); // key
+            lua_pushnil(L);
+            lua_rawseti(L, 5, state->pend_head++);
+
+            if (client->tracking) {
+                lua_pushvalue(L, -1); // key
+
+                if (lua_rawget(L, LOAD_STACK_N + 3) != LUA_TNIL) { // hit
+                    client->cache_hits++;
+                    cache_touch(L, client, CACHE_CMD_HGETALL, -2);
+
+                    size_t prefix_len = lua_rawlen(L, 2);
+                    size_t key_len;
+                    const char *key = lua_tolstring(L, -2, &key_len);
+
+                    lua_pushlstring(L, key + prefix_len, key_len - prefix_len);
+                    lua_insert(L, -2);
+                    lua_rawset(L, 4); // out[id] = data
+                    lua_pop(L, 1); // key
+
+                    continue;
+                }
+
+                lua_pop(L, 1); // lua_rawget
+                client->cache_misses++;
+            }
+
+            lua_pushvalue(L, -1); // key
+            lua_rawseti(L, 9, 2);
+            lua_rawseti(L, 6, state->exp_tail++); // expect += key
+
+            lua_pushvalue(L, 9);
+            load_pack(L, client, sb);
+
+            ++in_flight;
+        }
+    }
+
+    if (!state->scanning && !state->scan_done
+        && state->pend_tail - state->pend_head < state->batch
+    ) {
+        lua_pushvalue(L, 7); // cursor
+        lua_rawseti(L, 10, 2);
+        lua_pushboolean(L, 0);
+        lua_rawseti(L, 6, state->exp_tail++); // expect += SCAN
+
+        lua_pushvalue(L, 10);
+        load_pack(L, client, sb);
+
+        state->scanning = 1;
+    }
+
+    if (sb->filled > 0) {
+        client_send(L, client, sb->buf, sb->filled);
+    }
+
+    lua_settop(L, LOAD_STACK_N);
+
+    if (state->exp_head == state->exp_tail) { // done
+        if (unlikely(!lua_isnil(L, 8))) {
+            lua_pushvalue(L, 8);
+            return lua_error(L);
+        }
+
+        lua_settop(L, 4);
+        return 1; // out
+    }
+
+    return lua_yieldk(L, 0, 0, load_continue);
+}
+
+// LOAD_STACK_N slots, is_ok, data, type
+// LOAD_STACK_N slots, false, err msg, 0: client gc or connection lost
+static int load_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+
+    int data_idx = LOAD_STACK_N + 2;
+
+    if (unlikely(!lua_toboolean(L, LOAD_STACK_N + 1))) {
+        lua_settop(L, data_idx);
+        return lua_error(L); // err msg
+    }
+
+    ud_redis_client *client = lua_touserdata(L, 1);
+    redis_load_state *state = lua_touserdata(L, 3);
+    int type = lua_tointeger(L, LOAD_STACK_N + 3);
+
+    lua_rawgeti(L, 6, state->exp_head); // key or false
+    lua_pushnil(L);
+    lua_rawseti(L, 6, state->exp_head++);
+
+    int expect_idx = lua_gettop(L);
+    int is_scan = !lua_toboolean(L, expect_idx);
+
+    if (unlikely(type == RESP_ERR || type == RESP_BULK_ERR)) {
+        if (lua_isnil(L, 8)) {
+            lua_pushvalue(L, data_idx);
+            lua_replace(L, 8); // drain answers in flight, then fail
+        }
+
+        if (is_scan) {
+            state->scanning = 0;
+            state->scan_done = 1;
+        }
+    } else if (is_scan) { // [cursor, [key, ...]]
+        state->scanning = 0;
+
+        lua_rawgeti(L, data_idx, 1);
+        state->scan_done = strcmp(lua_tostring(L, -1), "0") == 0;
+        lua_replace(L, 7); // cursor
+
+        lua_rawgeti(L, data_idx, 2);
+
+        int keys_idx = lua_gettop(L);
+        int keys_n = lua_rawlen(L, keys_idx);
+
+        for (int i = 1; i <= keys_n; ++i) {
+            lua_rawgeti(L, keys_idx, i);
+            lua_rawseti(L, 5, state->pend_tail++);
+        }
+    } else if (lua_type(L, data_idx) == LUA_TTABLE) { // HGETALL
+        lua_pushnil(L);
+
+        if (lua_next(L, data_idx)) { // gone between SCAN and HGETALL if empty
+            lua_pop(L, 2); // lua_next
+
+            size_t prefix_len = lua_rawlen(L, 2);
+            size_t key_len;
+            const char *key = lua_tolstring(L, expect_idx, &key_len);
+
+            lua_pushlstring(L, key + prefix_len, key_len - prefix_len);
+            lua_pushvalue(L, data_idx);
+            lua_rawset(L, 4); // out[id] = data
+
+            if (client->tracking) {
+                cache_store(L, client, CACHE_CMD_HGETALL, expect_idx, data_idx);
+            }
+        }
+    }
+
+    return load_fill(L);
+}
+
+// members are connected lazily: query members on pool:connect,
+// subscriber member on first pool:subscribe
+int redis_pool(lua_State *L) {
+    luaF_need_args(L, 1, "redis.pool");
+    luaL_checktype(L, 1, LUA_TTABLE); // config (same as redis.client + size)
+
+    lua_getfield(L, 1, "size");
+    int size = luaL_optinteger(L, 2, POOL_DEFAULT_SIZE);
+    lua_pop(L, 1); // lua_getfield
+
+    if (unlikely(size < 1 || size > POOL_MAX_SIZE)) {
+        luaL_error(L, "invalid pool size: %d; min: %d; max: %d",
+            size, 1, POOL_MAX_SIZE);
     }
 
-    lua_insert(L, 2); // ud, query, ...
-    lua_settop(L, 2); // ud, query
-    lua_pushcfunction(L, redis_query); // ud, query, fn
-    lua_insert(L, 1); // fn, ud, query
-    lua_call(L, 2, 1); // thread
+    ud_redis_pool *pool = luaF_new_ud_or_error(L,
+        sizeof(ud_redis_pool), POOL_UV_IDX_N);
 
-    return 1; // thread
+    pool->size = size;
+    pool->closed = 0;
+    pool->next_member = 0;
+
+    luaL_setmetatable(L, MT_REDIS_POOL);
+
+    lua_insert(L, 1); // config, pool -> pool, config
+    lua_setiuservalue(L, 1, POOL_UV_IDX_CONFIG);
+
+    lua_createtable(L, size, 1); // +1 for subscriber
+    lua_setiuservalue(L, 1, POOL_UV_IDX_MEMBERS);
+
+    lua_createtable(L, size, 1);
+    lua_setiuservalue(L, 1, POOL_UV_IDX_RECONNECTS);
+
+    lua_createtable(L, 0, 2); // expect 2 channels at once
+    lua_setiuservalue(L, 1, POOL_UV_IDX_CHANNELS);
+
+    return 1;
 }
 
-int redis_ping(lua_State *L) {
-    luaF_need_args(L, 1, "ping"); // ud
-    lua_pushliteral(L, "PING" RESP_SEP); // ud, q
+int redis_pool_gc(lua_State *L) {
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
 
-    lua_State *T = luaF_new_thread_or_error(L); // ud, q, t
+    if (unlikely(pool->closed)) {
+        return 0;
+    }
 
-    lua_insert(L, 1); // t, ud, q
-    lua_pushcfunction(T, query_start);
-    lua_xmove(L, T, 2); // ud, q >> t
+    pool->closed = 1;
+
+    lua_settop(L, 1); // pool
+    lua_getiuservalue(L, 1, POOL_UV_IDX_MEMBERS);
+
+    int members_idx = 2;
+
+    lua_pushnil(L);
+    while (lua_next(L, members_idx)) {
+        lua_pushcfunction(L, redis_client_gc); // i, client, fn
+        lua_insert(L, -2); // i, fn, client
+        lua_call(L, 1, 0);
+    }
+
+    lua_getiuservalue(L, 1, POOL_UV_IDX_JOIN_THREAD);
+
+    int sub_idx = lua_gettop(L);
+    lua_State *sub = lua_tothread(L, sub_idx);
+
+    if (sub != NULL && lua_status(sub) == LUA_YIELD) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, F_RIDX_LOOP_T_SUBS);
+        luaF_resume(L, lua_gettop(L), sub, sub_idx, 0);
+    }
+
+    return 0;
+}
+
+int redis_pool_connect(lua_State *L) {
+    luaF_need_args(L, 1, "pool connect");
+    luaL_checkudata(L, 1, MT_REDIS_POOL);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, pool_connect_start);
+    lua_pushvalue(L, 1); // pool
+    lua_xmove(L, T, 1); // pool >> T
+
+    lua_resume(T, L, 1, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+static int pool_connect_start(lua_State *L) {
+    ud_redis_pool *pool = lua_touserdata(L, 1);
+
+    if (unlikely(pool->closed)) {
+        luaL_error(L, "pool is closed");
+    }
+
+    for (int member_i = 1; member_i <= pool->size; ++member_i) {
+        if (!pool_push_member(L, 1, member_i)) {
+            pool_spawn_member(L, 1, member_i);
+        }
+
+        lua_pop(L, 1); // member or thread
+    }
+
+    return pool_connect_continue(L, LUA_OK, 0);
+}
+
+// pool, [thread, status, results or err msg]
+// ctx: last waited member
+static int pool_connect_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    if (lua_gettop(L) > 1 && unlikely(lua_tointeger(L, 3) != LUA_OK)) {
+        return lua_error(L); // err msg is on top
+    }
+
+    ud_redis_pool *pool = lua_touserdata(L, 1);
+
+    lua_settop(L, 1); // pool
+    lua_getiuservalue(L, 1, POOL_UV_IDX_RECONNECTS);
+
+    for (int member_i = ctx + 1; member_i <= pool->size; ++member_i) {
+        if (lua_rawgeti(L, 2, member_i) == LUA_TTHREAD) {
+            lua_remove(L, 2); // pool, thread
+            return luaF_loop_wait(L, 2, member_i, pool_connect_continue);
+        }
+
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    return 0;
+}
+
+// pushes member client, returns 1 if it is connected and alive
+static int pool_push_member(lua_State *L, int pool_idx, int member_i) {
+    lua_getiuservalue(L, pool_idx, POOL_UV_IDX_MEMBERS);
+    int type = lua_rawgeti(L, -1, member_i);
+    lua_remove(L, -2); // lua_getiuservalue
+
+    if (unlikely(type != LUA_TUSERDATA)) {
+        return 0;
+    }
+
+    ud_redis_client *client = lua_touserdata(L, -1);
+
+    return client->reconnecting || (client->connected && client->fd >= 0);
+}
+
+// pushes member connect thread: already running or a new one
+static void pool_spawn_member(lua_State *L, int pool_idx, int member_i) {
+    pool_idx = lua_absindex(L, pool_idx);
+
+    lua_getiuservalue(L, pool_idx, POOL_UV_IDX_RECONNECTS);
+
+    if (lua_rawgeti(L, -1, member_i) == LUA_TTHREAD
+        && lua_status(lua_tothread(L, -1)) == LUA_YIELD
+    ) {
+        lua_remove(L, -2); // lua_getiuservalue
+        return; // already reconnecting
+    }
+
+    lua_pop(L, 1); // lua_rawgeti
+
+    lua_State *T = luaF_new_thread_or_error(L); // reconnects, T
+
+    lua_pushcfunction(T, member_connect_start);
+    lua_pushvalue(L, pool_idx);
+    lua_xmove(L, T, 1); // pool >> T
+    lua_pushinteger(T, member_i);
+
+    lua_pushvalue(L, -1); // reconnects, T, T
+    lua_rawseti(L, -3, member_i); // reconnects[member_i] = T
+    lua_remove(L, -2); // lua_getiuservalue
 
     lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+}
 
-    return 1;
+// pool, member_i
+static int member_connect_start(lua_State *L) {
+    lua_getiuservalue(L, 1, POOL_UV_IDX_CONFIG); // 3
+
+    lua_pushcfunction(L, redis_client);
+    lua_pushvalue(L, 3); // config
+    lua_call(L, 1, 1); // 4: client
+
+    lua_pushcfunction(L, redis_connect);
+    lua_pushvalue(L, 4); // client
+    lua_call(L, 1, 1); // 5: connect thread
+
+    return luaF_loop_wait(L, 5, MEMBER_STEP_CONNECT, member_connect_continue);
 }
 
-int redis_join(lua_State *L) {
-    luaF_need_args(L, 1, "join");
+// pool, member_i, config, client, thread, status, results or err msg
+static int member_connect_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_redis_pool *pool = lua_touserdata(L, 1);
+
+    if (unlikely(lua_tointeger(L, 6) != LUA_OK || pool->closed)) {
+        if (lua_tointeger(L, 6) == LUA_OK) {
+            lua_pushliteral(L, "pool is closed");
+        }
+
+        lua_pushcfunction(L, redis_client_gc);
+        lua_pushvalue(L, 4); // client
+        lua_call(L, 1, 0);
+
+        return lua_error(L); // err msg is on top
+    }
+
+    lua_settop(L, 4); // pool, member_i, config, client
+
+    int member_i = lua_tointeger(L, 2);
+
+    if (ctx == MEMBER_STEP_CONNECT) {
+        lua_pushcfunction(L, redis_hello);
+        lua_pushvalue(L, 4); // client
+        lua_pushvalue(L, 3); // config
+        lua_call(L, 2, 1); // 5: hello thread
+
+        return luaF_loop_wait(L, 5, MEMBER_STEP_HELLO, member_connect_continue);
+    }
+
+    if (ctx == MEMBER_STEP_HELLO && member_i != POOL_SUB_MEMBER
+        && lua_getfield(L, 3, "tracking") == LUA_TTABLE
+    ) {
+        lua_pushcfunction(L, redis_tracking);
+        lua_pushvalue(L, 4); // client
+        lua_pushvalue(L, 5); // tracking params
+        lua_call(L, 2, 1); // 6: tracking thread
+        lua_remove(L, 5); // 5: tracking thread
+
+        return luaF_loop_wait(L, 5, MEMBER_STEP_TRACKING,
+            member_connect_continue);
+    }
+
+    lua_settop(L, 4); // pool, member_i, config, client
+
+    if (member_i == POOL_SUB_MEMBER) { // restore subscriptions
+        lua_getiuservalue(L, 1, POOL_UV_IDX_CHANNELS); // 5
+
+        lua_pushnil(L);
+        while (lua_next(L, 5)) { // ch_name, on_push
+            lua_pushcfunction(L, redis_subscribe);
+            lua_pushvalue(L, 4); // client
+            lua_pushvalue(L, -4); // ch_name
+            lua_pushvalue(L, -4); // on_push
+            lua_call(L, 3, 1); // subscribe thread, answer is not awaited
+            lua_pop(L, 2); // thread, on_push
+        }
+
+        lua_pop(L, 1); // lua_getiuservalue
+
+        lua_State *T = luaF_new_thread_or_error(L);
+
+        lua_pushcfunction(T, sub_watch_start);
+        lua_pushvalue(L, 1); // pool
+        lua_pushvalue(L, 4); // client
+        lua_xmove(L, T, 2); // pool, client >> T
+
+        lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+        lua_pop(L, 1); // T
+    }
+
+    lua_getiuservalue(L, 1, POOL_UV_IDX_MEMBERS);
+    lua_pushvalue(L, 4); // client
+    lua_rawseti(L, -2, member_i); // members[member_i] = client
+    lua_pop(L, 1); // lua_getiuservalue
+
+    return 1; // client
+}
+
+// pool, client: pushes stop arriving once the sub member client is gone,
+// so it is respawned without waiting for the next subscribe
+static int sub_watch_start(lua_State *L) {
+    lua_pushcfunction(L, redis_join);
+    lua_pushvalue(L, 2); // client
+    lua_call(L, 1, 1); // 3: join thread
+
+    return luaF_loop_wait(L, 3, SUB_WATCH_STEP_JOIN, sub_watch_continue);
+}
+
+// join, connect: pool, client, thread, status, results or err msg
+// sleep: pool, client, tmt_fd, tmt_fd, emask or err msg
+static int sub_watch_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_redis_pool *pool = lua_touserdata(L, 1);
+
+    if (ctx == SUB_WATCH_STEP_SLEEP) {
+        luaF_close_or_warning(L, lua_tointeger(L, 3));
+
+        if (unlikely(lua_type(L, -1) != LUA_TNUMBER)) {
+            return 0; // loop was closed
+        }
+    }
+
+    if (pool->closed) {
+        return 0;
+    }
+
+    if (ctx == SUB_WATCH_STEP_CONNECT) {
+        if (likely(lua_tointeger(L, 4) == LUA_OK)) {
+            return 0; // new member has its own watch
+        }
+
+        luaF_warning(L, "redis pool: subscriber reconnect failed: %s",
+            lua_tostring(L, -1));
+
+        lua_settop(L, 2); // pool, client
+        lua_pushinteger(L, luaF_set_timeout(L, SUB_WATCH_RETRY_DELAY));
+
+        return lua_yieldk(L, 0, SUB_WATCH_STEP_SLEEP, sub_watch_continue);
+    }
+
+    if (ctx == SUB_WATCH_STEP_JOIN) {
+        luaF_warning(L, "redis pool: subscriber connection lost: %s",
+            lua_isstring(L, -1) ? lua_tostring(L, -1) : "closed");
+    }
+
+    lua_settop(L, 2); // pool, client
+    pool_spawn_member(L, 1, POOL_SUB_MEMBER); // 3: connect thread
+
+    return luaF_loop_wait(L, 3, SUB_WATCH_STEP_CONNECT, sub_watch_continue);
+}
+
+// calls fn(member, ...args) where args are at [first_arg_idx, top]
+// returns member thread, or a thread that reconnects member first
+static int pool_dispatch(
+    lua_State *L,
+    int member_i,
+    lua_CFunction fn,
+    int first_arg_idx
+) {
+    ud_redis_pool *pool = lua_touserdata(L, 1);
+
+    if (unlikely(pool->closed)) {
+        luaL_error(L, "pool is closed");
+    }
+
+    int args_n = lua_gettop(L) - first_arg_idx + 1;
+
+    if (likely(pool_push_member(L, 1, member_i))) { // args, member
+        lua_pushcfunction(L, fn); // args, member, fn
+        lua_insert(L, first_arg_idx); // fn, args, member
+        lua_insert(L, first_arg_idx + 1); // fn, member, args
+        lua_call(L, args_n + 1, 1);
+
+        return 1; // thread
+    }
+
+    lua_pop(L, 1); // pool_push_member
 
     lua_State *T = luaF_new_thread_or_error(L);
 
-    lua_pushcfunction(T, join_start);
+    lua_insert(L, first_arg_idx); // T, args
+    lua_pushcfunction(T, dispatch_start);
+    lua_pushvalue(L, 1); // pool
+    lua_xmove(L, T, 1); // pool >> T
+    lua_pushinteger(T, member_i);
+    lua_pushcfunction(T, fn);
+    lua_xmove(L, T, args_n); // args >> T
+
+    lua_resume(T, L, 3 + args_n, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+// pool, member_i, fn, args
+static int dispatch_start(lua_State *L) {
+    pool_spawn_member(L, 1, lua_tointeger(L, 2));
+
+    int t_idx = lua_gettop(L);
+
+    return luaF_loop_wait(L, t_idx, t_idx, dispatch_on_member);
+}
+
+// pool, member_i, fn, args, thread, status, member or err msg
+// ctx: thread idx
+static int dispatch_on_member(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    int t_idx = ctx;
+
+    if (unlikely(lua_tointeger(L, t_idx + 1) != LUA_OK)) {
+        return lua_error(L); // err msg is on top
+    }
+
+    lua_settop(L, t_idx + 2); // pool, member_i, fn, args, thread, status, member
+    lua_replace(L, t_idx); // pool, member_i, fn, args, member, status
+    lua_pop(L, 1); // pool, member_i, fn, args, member
+    lua_insert(L, 4); // pool, member_i, fn, member, args
+    lua_call(L, lua_gettop(L) - 3, 1); // pool, member_i, thread
+
+    return luaF_loop_wait(L, 3, 3, dispatch_on_result);
+}
+
+// pool, member_i, thread, status, results or err msg
+static int dispatch_on_result(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+    (void)ctx;
+
+    if (unlikely(lua_tointeger(L, 4) != LUA_OK)) {
+        return lua_error(L); // err msg is on top
+    }
+
+    return lua_gettop(L) - 4; // results
+}
+
+// FNV-1a of the key or round-robin if key_idx is 0
+static int pool_pick_member(lua_State *L, ud_redis_pool *pool, int key_idx) {
+    if (key_idx == 0) {
+        return pool->next_member++ % pool->size + 1;
+    }
+
+    size_t key_len;
+    const char *key = luaL_checklstring(L, key_idx, &key_len);
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < key_len; ++i) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619U;
+    }
+
+    return hash % pool->size + 1;
+}
+
+// pool:query(query[, key])
+int redis_pool_query(lua_State *L) {
+    int args_n = lua_gettop(L);
+
+    if (unlikely(args_n != 2 && args_n != 3)) {
+        luaL_error(L, "pool query: need args: 2 or 3; provided: %d", args_n);
+    }
+
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING);
+
+    int member_i = pool_pick_member(L, pool, args_n == 3 ? 3 : 0);
+
+    lua_settop(L, 2); // pool, query
+
+    return pool_dispatch(L, member_i, redis_query, 2);
+}
+
+int redis_pool_subscribe(lua_State *L) {
+    luaF_need_args(L, 3, "pool subscribe");
+    luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+    luaL_checktype(L, 3, LUA_TFUNCTION); // on push callback
+
+    lua_settop(L, 3);
+    lua_pushvalue(L, 1); // pool, ch_name, on_push, pool
+
+    return pool_dispatch(L, POOL_SUB_MEMBER, pool_member_subscribe, 2);
+}
+
+// member, ch_name, on_push, pool
+// the channel is replayed by member connect only after it was sent once,
+// so a subscribe waiting for the member is not sent twice
+static int pool_member_subscribe(lua_State *L) {
+    lua_getiuservalue(L, 4, POOL_UV_IDX_CHANNELS);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_rawset(L, -3); // channels[ch_name] = on_push
+    lua_settop(L, 3); // member, ch_name, on_push
+
+    return redis_subscribe(L);
+}
+
+int redis_pool_unsubscribe(lua_State *L) {
+    luaF_need_args(L, 2, "pool unsubscribe");
+    luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+
+    lua_getiuservalue(L, 1, POOL_UV_IDX_CHANNELS);
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, -3); // channels[ch_name] = nil
+    lua_pop(L, 1); // lua_getiuservalue
+
+    return pool_dispatch(L, POOL_SUB_MEMBER, redis_unsubscribe, 2);
+}
+
+int redis_pool_publish(lua_State *L) {
+    luaF_need_args(L, 3, "pool publish");
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // channel name
+    luaL_checktype(L, 3, LUA_TSTRING); // message
+
+    return pool_dispatch(L, pool_pick_member(L, pool, 0), redis_publish, 2);
+}
+
+int redis_pool_join(lua_State *L) {
+    luaF_need_args(L, 1, "pool join");
+    luaL_checkudata(L, 1, MT_REDIS_POOL);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_pushcfunction(T, pool_join_start);
     lua_insert(L, 1);
     lua_xmove(L, T, 1);
     lua_resume(T, L, 1, &(int){0});
@@ -763,49 +3189,93 @@ int redis_join(lua_State *L) {
     return 1;
 }
 
-static int join_start(lua_State *L) {
-    ud_redis_client *client = luaL_checkudata(L, 1, MT_REDIS_CLIENT);
+static int pool_join_start(lua_State *L) {
+    ud_redis_pool *pool = lua_touserdata(L, 1);
 
-    if (client->fd == -1) {
+    if (pool->closed) {
         return 0;
     }
 
     lua_pushthread(L);
-    lua_setiuservalue(L, 1, REDIS_UV_IDX_JOIN_THREAD);
+    lua_setiuservalue(L, 1, POOL_UV_IDX_JOIN_THREAD);
 
-    return lua_yieldk(L, 0, 0, join_continue);
+    return lua_yieldk(L, 0, 0, pool_join_continue);
 }
 
-static int join_continue(lua_State *L, int status, lua_KContext ctx) {
+static int pool_join_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)L;
     (void)status;
     (void)ctx;
 
-    error_if_dead(L);
+    return 0; // pool was closed
+}
 
-    return 0;
+// pool:cached(cmd, key): member is picked by key like in pool:query
+int redis_pool_cached(lua_State *L) {
+    luaF_need_args(L, 3, "pool cached");
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checkoption(L, 2, NULL, cache_cmds);
+    luaL_checktype(L, 3, LUA_TSTRING); // key
+
+    lua_settop(L, 3);
+
+    return pool_dispatch(L, pool_pick_member(L, pool, 3), redis_cached, 2);
 }
 
-static void error_if_dead(lua_State *L) {
-    if (lua_gettop(L) >= 3) {
-        int status = lua_toboolean(L, -3);
-        int type = lua_tointeger(L, -1);
+int redis_pool_cache_stat(lua_State *L) {
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
 
-        if (unlikely(!status || type == RESP_ERR || type == RESP_BULK_ERR)) {
-            lua_pop(L, 1); // -type
-            lua_error(L); // -1 = err msg
+    lua_Integer hits = 0, misses = 0, invalidations = 0, evictions = 0;
+    lua_Integer entries = 0;
+    size_t bytes = 0;
+
+    lua_getiuservalue(L, 1, POOL_UV_IDX_MEMBERS);
+
+    for (int member_i = 1; member_i <= pool->size; ++member_i) {
+        if (lua_rawgeti(L, -1, member_i) == LUA_TUSERDATA) {
+            ud_redis_client *client = lua_touserdata(L, -1);
+
+            hits += client->cache_hits;
+            misses += client->cache_misses;
+            invalidations += client->cache_invalidations;
+            evictions += client->cache_evictions;
+            entries += client->cache_entries;
+            bytes += client->cache_bytes;
         }
+
+        lua_pop(L, 1); // lua_rawgeti
     }
 
-    ud_redis_client *client = lua_touserdata(L, 1);
+    push_cache_stat(L, hits, misses, invalidations, evictions, entries,
+        bytes);
 
-    if (unlikely(client->fd == -1)) {
-        luaL_error(L, "redis socket was closed");
-    }
+    return 1;
+}
 
-    int code = get_socket_error_code(client->fd);
+// pool:xadd(stream, fields[, maxlen]): member is picked by stream key
+int redis_pool_xadd(lua_State *L) {
+    luaF_min_max_args(L, 3, 4, "pool xadd");
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
 
-    if (unlikely(code != 0)) {
-        luaF_push_error_socket(L, client->fd, "connection failed", code);
-        lua_error(L);
-    }
+    return pool_dispatch(L, pool_pick_member(L, pool, 2), redis_xadd, 2);
+}
+
+int redis_pool_xack(lua_State *L) {
+    luaF_need_args(L, 4, "pool xack");
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // stream
+
+    return pool_dispatch(L, pool_pick_member(L, pool, 2), redis_xack, 2);
+}
+
+// pool:load_hashes(prefix[, batch]): SCAN walks the whole keyspace, any member
+// the prefix picks the member, so repeated loads of a prefix hit the
+// cache of the same member instead of filling every member's
+int redis_pool_load_hashes(lua_State *L) {
+    luaF_min_max_args(L, 2, 3, "pool load_hashes");
+    ud_redis_pool *pool = luaL_checkudata(L, 1, MT_REDIS_POOL);
+    luaL_checktype(L, 2, LUA_TSTRING); // prefix
+
+    return pool_dispatch(L, pool_pick_member(L, pool, 2), redis_load_hashes, 2);
 }
@@ -4,25 +4,85 @@
 #define _GNU_SOURCE
 
 #include <string.h>
+#include <strings.h>
 #include <furiend/shared.h>
 #include <furiend/strbuf.h>
 #include "resp.h"
 
 #define MT_REDIS "redis*"
 #define MT_REDIS_CLIENT "redis.client*"
+#define MT_REDIS_POOL "redis.pool*"
 
 #define REDIS_UV_IDX_CONFIG 1
 #define REDIS_UV_IDX_Q_SUBS 2
 #define REDIS_UV_IDX_PUSH_CBS 3
 #define REDIS_UV_IDX_CONN_THREAD 4
 #define REDIS_UV_IDX_JOIN_THREAD 5
-#define REDIS_UV_IDX_N 5
+#define REDIS_UV_IDX_CACHE 6 // cache[cmd_i][key] = data
+#define REDIS_UV_IDX_Q_TEXTS 7 // q_texts[query_id] = replayable query
+#define REDIS_UV_IDX_HELLO_Q 8 // resent first after reconnect
+#define REDIS_UV_IDX_TRACKING_Q 9 // resent after hello
+#define REDIS_UV_IDX_PUSH_QUEUE 10 // ring: [2 * slot + 1] = cb, [+ 2] = payload
+#define REDIS_UV_IDX_CACHE_TICKS 11 // ticks[cmd_i][key] = last use tick
+#define REDIS_UV_IDX_CACHE_LRU 12 // lru[2 * tick + 1] = cmd_i, [+ 2] = key
+#define REDIS_UV_IDX_N 12
+
+#define POOL_UV_IDX_CONFIG 1
+#define POOL_UV_IDX_MEMBERS 2 // members[i] = client
+#define POOL_UV_IDX_RECONNECTS 3 // reconnects[i] = thread
+#define POOL_UV_IDX_CHANNELS 4 // channels[ch_name] = on_push
+#define POOL_UV_IDX_JOIN_THREAD 5
+#define POOL_UV_IDX_N 5
+
+#define POOL_DEFAULT_SIZE 4
+#define POOL_MAX_SIZE 64
+#define POOL_SUB_MEMBER 0 // dedicated connection for subscriptions
+
+#define MEMBER_STEP_CONNECT 1
+#define MEMBER_STEP_HELLO 2
+#define MEMBER_STEP_TRACKING 3
+
+#define SUB_WATCH_STEP_JOIN 1 // sub member client is gone
+#define SUB_WATCH_STEP_CONNECT 2
+#define SUB_WATCH_STEP_SLEEP 3
+#define SUB_WATCH_RETRY_DELAY 1 // seconds between failed respawns
+
+#define CACHE_CMD_GET 0
+#define CACHE_CMD_HGETALL 1
+#define CACHE_CMD_N 2
+
+// redis.client { cache = { max_entries, max_bytes } }, 0 - unlimited;
+// the cache is per connection: every pool member keeps its own
+#define CACHE_DEFAULT_MAX_ENTRIES 65536
+#define CACHE_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+#define CACHE_LRU_SLACK 64 // stale lru records allowed over 2 * entries
 
 #define PACK_BUF_START_SIZE 8192
 #define SEND_BUF_START_SIZE 8192
 #define RECV_BUF_START_SIZE 8192
 #define RECV_BUF_MIN_SIZE 2048
 
+#define RECONNECT_DEFAULT_MIN_DELAY 0.05
+#define RECONNECT_DEFAULT_MAX_DELAY 2.0
+#define RECONNECT_STEP_SLEEP 1
+#define RECONNECT_STEP_CONNECT 2
+
+#define QUERY_CMD_MAX_LEN 32
+
+#define PUSH_DEFAULT_QUEUE_SIZE 1024
+
+#define PUSH_OVERFLOW_BLOCK 0 // stop reading socket until queue drains
+#define PUSH_OVERFLOW_DROP 1 // drop oldest queued push
+#define PUSH_OVERFLOW_ERROR 2 // fail connection
+
+#define STREAM_KIND_RAW 0
+#define STREAM_KIND_GROUP 1 // BUSYGROUP is not an error
+#define STREAM_KIND_READ 2 // { stream = entries } -> entries
+#define STREAM_KIND_CLAIM 3 // next_id, entries, ... -> next_id, entries
+
+#define LOAD_DEFAULT_BATCH 256
+#define LOAD_STACK_N 10 // load_hashes thread slots, answer is pushed above
+
 #define DEFAULT_RESP_VER 3
 #define DEFAULT_USERNAME "default"
 
@@ -33,14 +93,62 @@ typedef struct {
 typedef struct {
     int fd;
     int connected;
+    int closed; // close, gc or a failure without reconnect, final
     int can_write;
     lua_Integer next_query_id;
     lua_Integer next_answer_id;
     luaF_strbuf pack_buf;
     luaF_strbuf send_buf;
     luaF_strbuf recv_buf;
+    int tracking; // CLIENT TRACKING is on, cache is usable
+    lua_Integer cache_hits;
+    lua_Integer cache_misses;
+    lua_Integer cache_invalidations;
+    lua_Integer cache_entries;
+    size_t cache_bytes; // approx: keys + string values
+    lua_Integer cache_evictions;
+    lua_Integer cache_max_entries; // 0 - unlimited
+    size_t cache_max_bytes; // 0 - unlimited
+    lua_Integer cache_lru_head; // lru records before head are evicted
+    lua_Integer cache_tick; // next lru record
+    lua_Number timeout; // per query, 0 - no deadline
+    int reconnect; // reconnect policy is set
+    int reconnecting;
+    int reconnect_attempt;
+    int reconnect_max_attempts; // 0 - unlimited
+    lua_Number reconnect_min_delay;
+    lua_Number reconnect_max_delay;
+    unsigned int jitter_seed;
+    lua_Integer reconnects;
+    lua_Integer timeouts;
+    lua_Integer replayed;
+    int push_concurrency; // 0 - unlimited, no queue
+    int push_queue_size;
+    int push_overflow;
+    int push_batch; // 0 - cb(payload), N - cb({ payload, ... })
+    int push_running;
+    int push_head;
+    int push_queued;
+    int push_blocked; // queue is full, router stopped reading
+    lua_Integer push_dropped;
 } ud_redis_client;
 
+typedef struct {
+    int batch; // max HGETALLs in flight
+    int scanning; // SCAN is in flight
+    int scan_done; // cursor returned to "0"
+    lua_Integer pend_head; // pending[pend_head..pend_tail) are not sent yet
+    lua_Integer pend_tail;
+    lua_Integer exp_head; // expect[exp_head..exp_tail) are in flight
+    lua_Integer exp_tail;
+} redis_load_state;
+
+typedef struct {
+    int size; // query members: 1..size
+    int closed;
+    unsigned int next_member; // round-robin cursor
+} ud_redis_pool;
+
 LUAMOD_API int luaopen_redis(lua_State *L);
 
 int redis_pack(lua_State *L);
@@ -56,16 +164,47 @@ int redis_join(lua_State *L);
 int redis_subscribe(lua_State *L);
 int redis_publish(lua_State *L);
 int redis_unsubscribe(lua_State *L);
+int redis_tracking(lua_State *L);
+int redis_cached(lua_State *L);
+int redis_cache_stat(lua_State *L);
+int redis_stat(lua_State *L);
+int redis_xgroup(lua_State *L);
+int redis_xadd(lua_State *L);
+int redis_xreadgroup(lua_State *L);
+int redis_xack(lua_State *L);
+int redis_xautoclaim(lua_State *L);
+int redis_load_hashes(lua_State *L);
+int redis_pool(lua_State *L);
+int redis_pool_gc(lua_State *L);
+int redis_pool_connect(lua_State *L);
+int redis_pool_query(lua_State *L);
+int redis_pool_join(lua_State *L);
+int redis_pool_subscribe(lua_State *L);
+int redis_pool_publish(lua_State *L);
+int redis_pool_unsubscribe(lua_State *L);
+int redis_pool_cached(lua_State *L);
+int redis_pool_cache_stat(lua_State *L);
+int redis_pool_xadd(lua_State *L);
+int redis_pool_xack(lua_State *L);
+int redis_pool_load_hashes(lua_State *L);
 
 static void error_if_dead(lua_State *L);
 static int connect_start(lua_State *L);
 static int connect_continue(lua_State *L, int status, lua_KContext ctx);
+static int open_socket(lua_State *L);
+static void router_spawn(lua_State *L, int client_idx);
 static int router_start(lua_State *L);
 static int router_continue(lua_State *L, int status, lua_KContext ctx);
 static int router_process_event(lua_State *L);
 static void router_on_connect(lua_State *L, int t_subs_idx);
 static void router_process_send_buf(lua_State *L, ud_redis_client *client);
 
+static void client_send(
+    lua_State *L,
+    ud_redis_client *client,
+    const char *query,
+    size_t query_len);
+
 static void router_read(
     lua_State *L,
     ud_redis_client *client,
@@ -78,12 +217,109 @@ static int router_parse(
 
 static int query_start(lua_State *L);
 static int query_continue(lua_State *L, int status, lua_KContext ctx);
+static void query_unsub(lua_State *L);
+static int query_is_idempotent(const char *query, size_t query_len);
+
+static void push_dispatch(
+    lua_State *L,
+    ud_redis_client *client,
+    int cb_idx,
+    int payload_idx);
+
+static int push_queue_take(lua_State *L, ud_redis_client *client);
+static int push_worker_start(lua_State *L);
+static int push_worker_continue(lua_State *L, int status, lua_KContext ctx);
+static int push_resume_read(lua_State *L);
+
+static void stream_push_arg(lua_State *L, int parts_idx, int arg_idx);
+static int stream_query(lua_State *L, int parts_idx, int kind, lua_Number timeout);
+static int stream_start(lua_State *L);
+static int stream_continue(lua_State *L, int status, lua_KContext ctx);
+static void stream_push_entries(lua_State *L, int entries_idx);
+
+static int client_drop(lua_State *L);
+static lua_Number reconnect_delay(ud_redis_client *client);
+static int reconnect_start(lua_State *L);
+static int reconnect_continue(lua_State *L, int status, lua_KContext ctx);
 
 static int join_start(lua_State *L);
 static int join_continue(lua_State *L, int status, lua_KContext ctx);
 
+static int tracking_start(lua_State *L);
+static int tracking_continue(lua_State *L, int status, lua_KContext ctx);
+static int cached_start(lua_State *L);
+static int cached_continue(lua_State *L, int status, lua_KContext ctx);
+static void cache_invalidate(lua_State *L, ud_redis_client *client, int keys_idx);
+static size_t cache_value_size(lua_State *L, int idx);
+static void cache_touch(lua_State *L, ud_redis_client *client, int cmd_i,
+    int key_idx);
+static void cache_evict(lua_State *L, ud_redis_client *client);
+static int cache_over_limit(ud_redis_client *client);
+static void cache_lru_compact(lua_State *L, ud_redis_client *client);
+static void push_cache_stat(lua_State *L, lua_Integer hits, lua_Integer misses,
+    lua_Integer invalidations, lua_Integer evictions, lua_Integer entries,
+    size_t bytes);
+
+static int load_start(lua_State *L);
+static int load_fill(lua_State *L);
+static void load_pack(lua_State *L, ud_redis_client *client, luaF_strbuf *sb);
+static int load_continue(lua_State *L, int status, lua_KContext ctx);
+
+static void cache_store(
+    lua_State *L,
+    ud_redis_client *client,
+    int cmd_i,
+    int key_idx,
+    int data_idx);
+
+static int pool_pick_member(lua_State *L, ud_redis_pool *pool, int key_idx);
+static int pool_push_member(lua_State *L, int pool_idx, int member_i);
+static void pool_spawn_member(lua_State *L, int pool_idx, int member_i);
+
+static int pool_dispatch(
+    lua_State *L,
+    int member_i,
+    lua_CFunction fn,
+    int first_arg_idx);
+
+static int member_connect_start(lua_State *L);
+static int member_connect_continue(lua_State *L, int status, lua_KContext ctx);
+static int sub_watch_start(lua_State *L);
+static int sub_watch_continue(lua_State *L, int status, lua_KContext ctx);
+static int pool_member_subscribe(lua_State *L);
+static int dispatch_start(lua_State *L);
+static int dispatch_on_member(lua_State *L, int status, lua_KContext ctx);
+static int dispatch_on_result(lua_State *L, int status, lua_KContext ctx);
+static int pool_connect_start(lua_State *L);
+static int pool_connect_continue(lua_State *L, int status, lua_KContext ctx);
+static int pool_join_start(lua_State *L);
+static int pool_join_continue(lua_State *L, int status, lua_KContext ctx);
+
+static const char *const cache_cmds[] = { "get", "hgetall", NULL };
+static const char *const cache_cmds_resp[] = { "GET", "HGETALL" };
+static const int cache_cmds_type[] = { RESP_BULK, RESP_MAP };
+
+static const char *const push_overflow_opts[] = {
+    "block", "drop", "error", NULL
+};
+
+// replayed after reconnect if sent but not answered yet;
+// SUBSCRIBE is not here, channels are resubscribed from push_cbs
+static const char *const idempotent_cmds[] = {
+    "GET", "MGET", "STRLEN", "EXISTS", "TTL", "PTTL", "TYPE",
+    "HGET", "HMGET", "HGETALL", "HKEYS", "HVALS", "HLEN", "HEXISTS",
+    "LRANGE", "LLEN", "LINDEX",
+    "SMEMBERS", "SISMEMBER", "SCARD",
+    "ZRANGE", "ZRANGEBYSCORE", "ZSCORE", "ZCARD",
+    "XRANGE", "XREVRANGE", "XLEN",
+    "SCAN", "HSCAN", "SSCAN", "ZSCAN", "KEYS",
+    "PING", "ECHO", "TIME", "DBSIZE", "INFO", "LASTSAVE",
+    NULL
+};
+
 static const luaL_Reg redis_index[] = {
     { "client", redis_client },
+    { "pool", redis_pool },
     { "pack", redis_pack },
     { "unpack", redis_unpack },
     { "type", NULL }, // just reserve space
@@ -99,8 +335,34 @@ static const luaL_Reg redis_client_index[] = {
     { "subscribe", redis_subscribe },
     { "publish", redis_publish },
     { "unsubscribe", redis_unsubscribe },
+    { "tracking", redis_tracking },
+    { "cached", redis_cached },
+    { "cache_stat", redis_cache_stat },
+    { "stat", redis_stat },
+    { "xgroup", redis_xgroup },
+    { "xadd", redis_xadd },
+    { "xreadgroup", redis_xreadgroup },
+    { "xack", redis_xack },
+    { "xautoclaim", redis_xautoclaim },
+    { "load_hashes", redis_load_hashes },
     { "close", redis_client_gc },
     { NULL, NULL }
 };
 
+static const luaL_Reg redis_pool_index[] = {
+    { "connect", redis_pool_connect },
+    { "query", redis_pool_query },
+    { "join", redis_pool_join },
+    { "subscribe", redis_pool_subscribe },
+    { "publish", redis_pool_publish },
+    { "unsubscribe", redis_pool_unsubscribe },
+    { "cached", redis_pool_cached },
+    { "cache_stat", redis_pool_cache_stat },
+    { "xadd", redis_pool_xadd },
+    { "xack", redis_pool_xack },
+    { "load_hashes", redis_pool_load_hashes },
+    { "close", redis_pool_gc },
+    { NULL, NULL }
+};
+
 #endif
@@ -451,53 +451,73 @@ static void pack_number(lua_State *L, luaF_strbuf *sb, int index) {
     }
 }
 
+static void pack_value(lua_State *L, luaF_strbuf *sb, int index,
+    luaF_visited *visited); // tables recurse into it
+
 // *<number-of-elements>\r\n<element-1>...<element-n>
-static void pack_array(lua_State *L, luaF_strbuf *sb, int index, int keys_n) {
+static void pack_array(lua_State *L, luaF_strbuf *sb, int index,
+    lua_Integer keys_n, luaF_visited *visited
+) {
     pack_len(L, sb, '*', keys_n);
 
+    for (lua_Integer i = 1; i <= keys_n; i++) {
+        lua_rawgeti(L, index, i);
+        pack_value(L, sb, lua_gettop(L), visited);
+        lua_pop(L, 1); // lua_rawgeti
+    }
+}
+
+// %<number-of-entries>\r\n<key-1><value-1>...<key-n><value-n>
+static void pack_map(lua_State *L, luaF_strbuf *sb, int index,
+    luaF_visited *visited
+) {
+    int keys_n = 0;
+
     lua_pushnil(L);
     while (lua_next(L, index)) {
-        resp_pack(L, sb, index + 2);
+        keys_n++;
         lua_pop(L, 1); // lua_next
     }
-}
 
-// %<number-of-entries>\r\n<key-1><value-1>...<key-n><value-n>
-static void pack_map(lua_State *L, luaF_strbuf *sb, int index, int keys_n) {
     pack_len(L, sb, '%', keys_n);
 
     lua_pushnil(L);
     while (lua_next(L, index)) {
-        resp_pack(L, sb, index + 1);
-        resp_pack(L, sb, index + 2);
+        pack_value(L, sb, lua_gettop(L) - 1, visited);
+        pack_value(L, sb, lua_gettop(L), visited);
         lua_pop(L, 1); // lua_next
     }
 }
 
-static void pack_table(lua_State *L, luaF_strbuf *sb, int index) {
-    int is_array = 1;
-    int next_idx = 1;
+// arrays by luaF_table_kind, an empty table is an empty array
+static void pack_table(lua_State *L, luaF_strbuf *sb, int index,
+    luaF_visited *visited
+) {
+    luaL_checkstack(L, 4, "resp_pack");
 
-    lua_pushnil(L);
-    while (lua_next(L, index)) {
-        if (unlikely(is_array && (
-            !lua_isinteger(L, -2) || lua_tointeger(L, -2) != next_idx
-        ))) {
-            is_array = 0;
-        }
+    int entered = luaF_visit(visited, lua_topointer(L, index));
 
-        next_idx++;
-        lua_pop(L, 1); // lua_next
+    if (unlikely(entered == 0)) {
+        luaL_error(L, "circular table: %p", lua_topointer(L, index));
+    } else if (unlikely(entered < 0)) {
+        luaL_error(L, "max depth exceeded: %d", F_VISITED_MAX);
     }
 
-    if (likely(is_array)) {
-        pack_array(L, sb, index, next_idx - 1);
+    lua_Integer keys_n = 0;
+    int kind = luaF_table_kind(L, index, &keys_n);
+
+    if (likely(kind != F_TABLE_MAP)) {
+        pack_array(L, sb, index, keys_n, visited);
     } else {
-        pack_map(L, sb, index, next_idx - 1);
+        pack_map(L, sb, index, visited);
     }
+
+    luaF_unvisit(visited);
 }
 
-void resp_pack(lua_State *L, luaF_strbuf *sb, int index) {
+static void pack_value(lua_State *L, luaF_strbuf *sb, int index,
+    luaF_visited *visited
+) {
     switch (lua_type(L, index)) {
         case LUA_TNONE:
         case LUA_TNIL:
@@ -513,10 +533,15 @@ void resp_pack(lua_State *L, luaF_strbuf *sb, int index) {
             pack_string(L, sb, index);
             return;
         case LUA_TTABLE:
-            pack_table(L, sb, index);
+            pack_table(L, sb, index, visited);
             return;
         default: // LUA_TLIGHTUSERDATA LUA_TFUNCTION LUA_TUSERDATA LUA_TTHREAD
             luaL_error(L, "type not supported: %s",
                 luaL_typename(L, index));
     }
 }
+
+void resp_pack(lua_State *L, luaF_strbuf *sb, int index) {
+    luaF_visited visited = { .n = 0 };
+    pack_value(L, sb, lua_absindex(L, index), &visited);
+}
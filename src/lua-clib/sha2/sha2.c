@@ -1,81 +1,348 @@
 #include "sha2.h"
 
 LUAMOD_API int luaopen_sha2(lua_State *L) {
+    if (likely(luaL_newmetatable(L, MT_SHA2))) {
+        luaL_newlib(L, sha2_methods);
+        lua_setfield(L, -2, "__index");
+    }
+
+    lua_pop(L, 1);
+
     luaL_newlib(L, sha2_index);
+
+    #ifdef SHA2_HAS_SHA_NI
+        lua_pushliteral(L, "sha-ni");
+    #else
+        lua_pushliteral(L, "scalar");
+    #endif
+
+    lua_setfield(L, -2, "sha256_impl"); // picked at build by -march=native
+
     return 1;
 }
 
-int sha512(lua_State *L) {
-    luaF_need_args(L, 1, "sha512");
-    luaL_checktype(L, 1, LUA_TSTRING); // phrase to hash
+// new("sha256" or "sha512", impl?) -> ctx
+// impl "scalar" skips hardware code paths, for benchmarks
+int sha2_new(lua_State *L) {
+    luaF_min_max_args(L, 1, 2, "sha2.new");
+
+    static const char *const algs[] = { "sha256", "sha512", NULL };
+    static const char *const impls[] = { "scalar", "sha-ni", NULL };
+
+    int alg = luaL_checkoption(L, 1, NULL, algs);
+    int impl = SHA2_IMPL_SCALAR;
+
+    if (lua_isnoneornil(L, 2)) {
+        impl = sha2_best_impl(alg);
+    } else {
+        impl = luaL_checkoption(L, 2, NULL, impls);
+
+        #ifdef SHA2_HAS_SHA_NI
+            int has_impl = impl == SHA2_IMPL_SCALAR || alg == SHA2_256;
+        #else
+            int has_impl = impl == SHA2_IMPL_SCALAR;
+        #endif
+
+        if (unlikely(!has_impl)) {
+            luaL_error(L, "sha2 impl is not available: %s",
+                lua_tostring(L, 2));
+        }
+    }
+
+    ud_sha2 *ctx = luaF_new_ud_or_error(L, sizeof(ud_sha2), 0);
+    sha2_init(ctx, alg, impl);
+    luaL_setmetatable(L, MT_SHA2);
+
+    return 1;
+}
+
+// ctx:update(str) -> ctx
+static int sha2_update(lua_State *L) {
+    luaF_need_args(L, 2, "sha2 update");
+    ud_sha2 *ctx = luaL_checkudata(L, 1, MT_SHA2);
 
     size_t len;
-    const char *input = lua_tolstring(L, 1, &len);
+    const char *data = luaL_checklstring(L, 2, &len);
 
-    if (unlikely(len > 18446744073709551615ULL / 8)) {
-        luaL_error(L, "input is too long");
+    if (unlikely(ctx->done)) {
+        luaL_error(L, "sha2 update: digest was already taken");
     }
 
-    uint64_t hash[8];
-    char hex[128 + 1]; // 1 for sprintf nul byte
+    sha2_feed(ctx, (const uint8_t *)data, len);
+    lua_settop(L, 1);
+
+    return 1;
+}
+
+// ctx:digest(format?) -> hex string, or raw bytes for format "bin"
+// pads the kept last block only; the ctx is done after it
+static int sha2_digest(lua_State *L) {
+    luaF_min_max_args(L, 1, 2, "sha2 digest");
+    ud_sha2 *ctx = luaL_checkudata(L, 1, MT_SHA2);
 
-    int is_ok = sha512_hash((const uint8_t *)input, len, hash);
+    static const char *const formats[] = { "hex", "bin", NULL };
+    int is_bin = luaL_checkoption(L, 2, "hex", formats);
 
-    if (unlikely(!is_ok)) {
-        luaF_error_errno(L, "sha512 calloc failed");
+    if (unlikely(ctx->done)) {
+        luaL_error(L, "sha2 digest: digest was already taken");
     }
 
-    for (int i = 0; i < 8; ++i) {
-        sprintf(hex + i * 16, "%016" PRIx64, hash[i]);
+    uint8_t digest[SHA2_MAX_DIGEST_LEN];
+    sha2_final(ctx, digest);
+
+    if (is_bin) {
+        lua_pushlstring(L, (const char *)digest, ctx->digest_len);
+    } else {
+        sha2_push_hex(L, digest, ctx->digest_len);
     }
 
-    lua_pushlstring(L, hex, 128);
+    return 1;
+}
+
+int sha2_sha256(lua_State *L) {
+    return sha2_hash_string(L, SHA2_256, "sha256");
+}
+
+int sha512(lua_State *L) {
+    return sha2_hash_string(L, SHA2_512, "sha512");
+}
+
+// one shot hex digest of a string, the ctx is on the c stack
+static int sha2_hash_string(lua_State *L, int alg, const char *name) {
+    luaF_need_args(L, 1, name);
+    luaL_checktype(L, 1, LUA_TSTRING); // phrase to hash
+
+    size_t len;
+    const char *input = lua_tolstring(L, 1, &len);
+
+    ud_sha2 ctx;
+    uint8_t digest[SHA2_MAX_DIGEST_LEN];
+
+    sha2_init(&ctx, alg, sha2_best_impl(alg));
+    sha2_feed(&ctx, (const uint8_t *)input, len);
+    sha2_final(&ctx, digest);
+    sha2_push_hex(L, digest, ctx.digest_len);
 
     return 1;
 }
 
-static int sha512_hash(const uint8_t *input, size_t len, uint64_t *hash) {
-    // padding
+static int sha2_best_impl(int alg) {
+    #ifdef SHA2_HAS_SHA_NI
+        return alg == SHA2_256 ? SHA2_IMPL_SHA_NI : SHA2_IMPL_SCALAR;
+    #else
+        (void)alg;
+        return SHA2_IMPL_SCALAR;
+    #endif
+}
+
+int sha2_sha256_offload(lua_State *L) {
+    return sha2_offload(L, SHA2_256, "sha256_offload");
+}
+
+int sha2_sha512_offload(lua_State *L) {
+    return sha2_offload(L, SHA2_512, "sha512_offload");
+}
+
+// sha256_offload(str) -> thread, wait(thread) -> hex digest
+// hashed on the async.offload pool, worth it for large inputs only
+static int sha2_offload(lua_State *L, int alg, const char *name) {
+    luaF_need_args(L, 1, name);
+    luaL_checktype(L, 1, LUA_TSTRING);
+
+    lua_State *T = luaF_new_thread_or_error(L);
+
+    lua_insert(L, 1); // str, T -> T, str
+    lua_pushcfunction(T, sha2_job_start);
+    lua_xmove(L, T, 1); // str >> T
+    lua_pushinteger(T, alg);
+
+    lua_resume(T, L, 2, &(int){0}); // should yield, 0 nres
+
+    return 1; // T
+}
+
+static int sha2_job_start(lua_State *L) {
+    ud_sha2_job *job = luaF_new_ud_or_error(L, sizeof(ud_sha2_job), 0);
+    int alg = lua_tointeger(L, 2);
+
+    job->job.run = sha2_job_run;
+    job->data = (const uint8_t *)lua_tolstring(L, 1, &job->len);
+    sha2_init(&job->ctx, alg, sha2_best_impl(alg));
+
+    return luaF_offload(L, &job->job, sha2_job_continue);
+}
+
+static int sha2_job_continue(lua_State *L, int status, lua_KContext ctx) {
+    (void)status;
+
+    ud_sha2_job *job = (ud_sha2_job *)ctx;
+    sha2_push_hex(L, job->digest, job->ctx.digest_len);
+
+    return 1; // hex digest
+}
+
+// pool thread, no lua calls
+static void sha2_job_run(luaF_job *base) {
+    ud_sha2_job *job = (ud_sha2_job *)base;
 
-    uint64_t input_bits_n = len * 8;
-    uint64_t zero_bits_n = 1024 - ((input_bits_n + 1 + 128) % 1024);
-    uint64_t msg_bits_n = input_bits_n + 1 + zero_bits_n + 128;
-    uint64_t msg_len = msg_bits_n / 8;
+    sha2_feed(&job->ctx, job->data, job->len);
+    sha2_final(&job->ctx, job->digest);
+}
 
-    char *msg = calloc(msg_len, 1); // zerofilled
+static void sha2_push_hex(lua_State *L, const uint8_t *digest, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[SHA2_MAX_DIGEST_LEN * 2];
 
-    if (unlikely(msg == NULL)) {
-        return 0; // fail
+    for (size_t i = 0; i < len; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
     }
 
+    lua_pushlstring(L, hex, len * 2);
+}
+
+static uint32_t load_be32(const uint8_t *data) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+
     #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        input_bits_n = FLIP64(input_bits_n);
+        word = __builtin_bswap32(word);
     #endif
 
-    memcpy(msg, input, len); // orig input
-    msg[len] = 0b10000000; // single '1' bit
-    memcpy(msg + msg_len - 8, &input_bits_n, 8); // input len
+    return word;
+}
 
-    // init hash
+static uint64_t load_be64(const uint8_t *data) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
 
-    memcpy(hash, IHV, 64);
+    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap64(word);
+    #endif
 
-    // process
+    return word;
+}
 
-    uint64_t chunks_n = msg_len / 128;
+static void store_be(uint8_t *out, uint64_t word, int len) {
+    for (int i = len - 1; i >= 0; i--) {
+        out[i] = word & 0xff;
+        word >>= 8;
+    }
+}
 
-    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        uint64_t *w64 = (uint64_t *)msg;
-        for (uint64_t i = 0; i < chunks_n * 16; ++i) {
-            w64[i] = FLIP64(w64[i]);
+static void sha2_init(ud_sha2 *ctx, int alg, int impl) {
+    ctx->alg = alg;
+    ctx->impl = impl;
+    ctx->done = 0;
+    ctx->len = 0;
+    ctx->buf_n = 0;
+
+    if (alg == SHA2_512) {
+        ctx->block_len = 128;
+        ctx->digest_len = 64;
+        memcpy(ctx->h64, IHV, sizeof(IHV));
+    } else {
+        ctx->block_len = 64;
+        ctx->digest_len = 32;
+        memcpy(ctx->h32, IHV32, sizeof(IHV32));
+    }
+}
+
+static void sha2_blocks(ud_sha2 *ctx, const uint8_t *data, size_t blocks_n) {
+    if (ctx->alg == SHA2_512) {
+        sha512_blocks(ctx->h64, data, blocks_n);
+        return;
+    }
+
+    #ifdef SHA2_HAS_SHA_NI
+        if (ctx->impl == SHA2_IMPL_SHA_NI) {
+            sha256_blocks_ni(ctx->h32, data, blocks_n);
+            return;
         }
     #endif
 
-    for (uint64_t ci = 0; ci < chunks_n; ++ci) {
-        uint8_t *chunk = (uint8_t *)(msg + ci * 128);
+    sha256_blocks(ctx->h32, data, blocks_n);
+}
+
+// whole blocks are hashed straight from data, the tail is kept in buf
+static void sha2_feed(ud_sha2 *ctx, const uint8_t *data, size_t len) {
+    size_t block_len = ctx->block_len;
+    ctx->len += len;
+
+    if (ctx->buf_n > 0) {
+        size_t take = block_len - ctx->buf_n;
+        take = take < len ? take : len;
+
+        memcpy(ctx->buf + ctx->buf_n, data, take);
+        ctx->buf_n += take;
+        data += take;
+        len -= take;
+
+        if (ctx->buf_n < block_len) {
+            return;
+        }
+
+        sha2_blocks(ctx, ctx->buf, 1);
+        ctx->buf_n = 0;
+    }
+
+    size_t blocks_n = len / block_len;
+
+    if (blocks_n > 0) {
+        sha2_blocks(ctx, data, blocks_n);
+        data += blocks_n * block_len;
+        len -= blocks_n * block_len;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buf, data, len);
+        ctx->buf_n = len;
+    }
+}
+
+// '1' bit, zeros, bit length in the last 16 (sha512) or 8 (sha256) bytes
+static void sha2_final(ud_sha2 *ctx, uint8_t *digest) {
+    size_t block_len = ctx->block_len;
+    size_t len_field = ctx->alg == SHA2_512 ? 16 : 8;
+
+    ctx->buf[ctx->buf_n++] = 0x80;
+
+    if (ctx->buf_n > block_len - len_field) { // no room for the length
+        memset(ctx->buf + ctx->buf_n, 0, block_len - ctx->buf_n);
+        sha2_blocks(ctx, ctx->buf, 1);
+        ctx->buf_n = 0;
+    }
+
+    memset(ctx->buf + ctx->buf_n, 0, block_len - ctx->buf_n);
+    if (ctx->alg == SHA2_512) { // high 64 bits of the 128 bit length
+        store_be(ctx->buf + block_len - 16, ctx->len >> 61, 8);
+    }
+
+    store_be(ctx->buf + block_len - 8, ctx->len << 3, 8);
+    sha2_blocks(ctx, ctx->buf, 1);
+
+    if (ctx->alg == SHA2_512) {
+        for (int i = 0; i < 8; i++) {
+            store_be(digest + i * 8, ctx->h64[i], 8);
+        }
+    } else {
+        for (int i = 0; i < 8; i++) {
+            store_be(digest + i * 4, ctx->h32[i], 4);
+        }
+    }
+
+    ctx->done = 1;
+}
+
+static void sha512_blocks(uint64_t *hash, const uint8_t *data,
+    size_t blocks_n
+) {
+    for (size_t ci = 0; ci < blocks_n; ++ci, data += 128) {
         uint64_t w[80];
 
-        memcpy(w, chunk, 128); // w[0..15]
+        for (int wi = 0; wi < 16; ++wi) {
+            w[wi] = load_be64(data + wi * 8);
+        }
 
         for (int wi = 16; wi < 80; ++wi) {
             uint64_t s0 = SIGMA0(w[wi - 15]);
@@ -121,8 +388,115 @@ static int sha512_hash(const uint8_t *input, size_t len, uint64_t *hash) {
         hash[6] += g;
         hash[7] += h;
     }
+}
+
+static void sha256_blocks(uint32_t *hash, const uint8_t *data,
+    size_t blocks_n
+) {
+    for (size_t ci = 0; ci < blocks_n; ++ci, data += 64) {
+        uint32_t w[64];
+
+        for (int wi = 0; wi < 16; ++wi) {
+            w[wi] = load_be32(data + wi * 4);
+        }
+
+        for (int wi = 16; wi < 64; ++wi) {
+            uint32_t s0 = SIGMA0_32(w[wi - 15]);
+            uint32_t s1 = SIGMA1_32(w[wi - 2]);
+            w[wi] = w[wi - 16] + s0 + w[wi - 7] + s1;
+        }
+
+        uint32_t a = hash[0];
+        uint32_t b = hash[1];
+        uint32_t c = hash[2];
+        uint32_t d = hash[3];
+        uint32_t e = hash[4];
+        uint32_t f = hash[5];
+        uint32_t g = hash[6];
+        uint32_t h = hash[7];
+
+        for (int wi = 0; wi < 64; ++wi) {
+            uint32_t tmp1 = h + SUM1_32(e) + CH(e, f, g) + RC32[wi] + w[wi];
+            uint32_t tmp2 = SUM0_32(a) + MAJ(a, b, c);
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + tmp1;
+            d = c;
+            c = b;
+            b = a;
+            a = tmp1 + tmp2;
+        }
+
+        hash[0] += a;
+        hash[1] += b;
+        hash[2] += c;
+        hash[3] += d;
+        hash[4] += e;
+        hash[5] += f;
+        hash[6] += g;
+        hash[7] += h;
+    }
+}
+
+#ifdef SHA2_HAS_SHA_NI
+// sha256rnds2 does 2 rounds, state is kept as ABEF and CDGH
+// msgs[i % 4] holds words 4i .. 4i+3, the next 4 are derived in place
+static void sha256_blocks_ni(uint32_t *hash, const uint8_t *data,
+    size_t blocks_n
+) {
+    const __m128i be_mask = _mm_set_epi64x(
+        0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&hash[0]); // ABCD
+    __m128i state1 = _mm_loadu_si128((const __m128i *)&hash[4]); // EFGH
+
+    tmp = _mm_shuffle_epi32(tmp, 0xb1); // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1b); // HGFE
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0); // CDGH
+
+    for (size_t ci = 0; ci < blocks_n; ++ci, data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i msgs[4];
+
+        for (int i = 0; i < 4; i++) {
+            msgs[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i *)(data + i * 16)), be_mask);
+        }
+
+        #pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            __m128i wk = _mm_add_epi32(msgs[i & 3],
+                _mm_loadu_si128((const __m128i *)&RC32[i * 4]));
+
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1,
+                _mm_shuffle_epi32(wk, 0x0e));
+
+            if (i < 12) { // words 4i+16 .. 4i+19
+                __m128i next = _mm_sha256msg1_epu32(msgs[i & 3],
+                    msgs[(i + 1) & 3]);
+
+                next = _mm_add_epi32(next,
+                    _mm_alignr_epi8(msgs[(i + 3) & 3], msgs[(i + 2) & 3], 4));
+
+                msgs[i & 3] = _mm_sha256msg2_epu32(next, msgs[(i + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
 
-    free(msg);
+    tmp = _mm_shuffle_epi32(state0, 0x1b); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xb1); // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0); // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8); // HGFE
 
-    return 1; // ok
+    _mm_storeu_si128((__m128i *)&hash[0], state0);
+    _mm_storeu_si128((__m128i *)&hash[4], state1);
 }
+#endif
@@ -3,8 +3,27 @@
 
 // https://en.wikipedia.org/wiki/SHA-2
 
-#include <inttypes.h>
 #include <furiend/shared.h>
+#include <furiend/offload.h>
+#include <inttypes.h>
+
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define SHA2_HAS_SHA_NI
+#endif
+
+#define MT_SHA2 "sha2*"
+
+#define SHA2_256 0
+#define SHA2_512 1
+
+#define SHA2_IMPL_SCALAR 0
+#define SHA2_IMPL_SHA_NI 1 // sha256 only
+
+#define SHA2_MAX_BLOCK_LEN 128
+#define SHA2_MAX_DIGEST_LEN 64
+
+// sha512
 
 #define ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
 #define SUM0(a) (ROTR(a, 28) ^ ROTR(a, 34) ^ ROTR(a, 39))
@@ -14,15 +33,13 @@
 #define CH(e, f, g) (((e) & (f)) ^ (~(e) & (g)))
 #define MAJ(a, b, c) (((a) & (b)) ^ ((a) & (c)) ^ ((b) & (c)))
 
-#define FLIP64(x) ( \
-    (((x) >> 56) & 0x00000000000000FFULL) | \
-    (((x) >> 40) & 0x000000000000FF00ULL) | \
-    (((x) >> 24) & 0x0000000000FF0000ULL) | \
-    (((x) >>  8) & 0x00000000FF000000ULL) | \
-    (((x) <<  8) & 0x000000FF00000000ULL) | \
-    (((x) << 24) & 0x0000FF0000000000ULL) | \
-    (((x) << 40) & 0x00FF000000000000ULL) | \
-    (((x) << 56) & 0xFF00000000000000ULL))
+// sha256
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SUM0_32(a) (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22))
+#define SUM1_32(e) (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25))
+#define SIGMA0_32(x) (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define SIGMA1_32(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
 
 // round constants
 // first 64 bits of the fractional parts of the cube roots
@@ -71,14 +88,106 @@ static const uint64_t IHV[8] = {
     0x5be0cd19137e2179ULL,
 };
 
+// sha256 round constants
+// first 32 bits of the fractional parts of the cube roots
+// of the first 64 primes (2..311)
+static const uint32_t RC32[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// sha256 initial hash values
+// first 32 bits of the fractional parts
+// of the square roots of the first 8 primes (2..19)
+static const uint32_t IHV32[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+// only the last partial block is kept, input is hashed in place
+typedef struct {
+    int alg;
+    int impl;
+    int done; // digest was taken
+    size_t block_len;
+    size_t digest_len;
+    uint64_t len; // input bytes so far
+    size_t buf_n;
+    uint8_t buf[SHA2_MAX_BLOCK_LEN];
+    union {
+        uint32_t h32[8];
+        uint64_t h64[8];
+    };
+} ud_sha2;
+
+// sha256_offload and sha512_offload job, input is pinned by the thread stack
+typedef struct {
+    luaF_job job;
+    ud_sha2 ctx;
+    const uint8_t *data;
+    size_t len;
+    uint8_t digest[SHA2_MAX_DIGEST_LEN];
+} ud_sha2_job;
+
 LUAMOD_API int luaopen_sha2(lua_State *L);
 
+int sha2_new(lua_State *L);
+int sha2_sha256(lua_State *L);
 int sha512(lua_State *L);
+int sha2_sha256_offload(lua_State *L);
+int sha2_sha512_offload(lua_State *L);
+
+static int sha2_update(lua_State *L);
+static int sha2_digest(lua_State *L);
+
+static void sha2_init(ud_sha2 *ctx, int alg, int impl);
+static void sha2_feed(ud_sha2 *ctx, const uint8_t *data, size_t len);
+static void sha2_final(ud_sha2 *ctx, uint8_t *digest);
+static void sha2_blocks(ud_sha2 *ctx, const uint8_t *data, size_t blocks_n);
+static void sha2_push_hex(lua_State *L, const uint8_t *digest, size_t len);
+static int sha2_hash_string(lua_State *L, int alg, const char *name);
+static int sha2_best_impl(int alg);
+
+static int sha2_offload(lua_State *L, int alg, const char *name);
+static int sha2_job_start(lua_State *L);
+static int sha2_job_continue(lua_State *L, int status, lua_KContext ctx);
+static void sha2_job_run(luaF_job *job);
 
-static int sha512_hash(const uint8_t *input, size_t len, uint64_t *hash);
+static uint32_t load_be32(const uint8_t *data);
+static uint64_t load_be64(const uint8_t *data);
+static void store_be(uint8_t *out, uint64_t word, int len);
+
+static void sha512_blocks(uint64_t *hash, const uint8_t *data,
+    size_t blocks_n);
+static void sha256_blocks(uint32_t *hash, const uint8_t *data,
+    size_t blocks_n);
+
+#ifdef SHA2_HAS_SHA_NI
+static void sha256_blocks_ni(uint32_t *hash, const uint8_t *data,
+    size_t blocks_n);
+#endif
 
 static const luaL_Reg sha2_index[] = {
+    { "new", sha2_new },
+    { "sha256", sha2_sha256 },
     { "sha512", sha512 },
+    { "sha256_offload", sha2_sha256_offload },
+    { "sha512_offload", sha2_sha512_offload },
+    { NULL, NULL }
+};
+
+static const luaL_Reg sha2_methods[] = {
+    { "update", sha2_update },
+    { "digest", sha2_digest },
     { NULL, NULL }
 };
 
@@ -0,0 +1,535 @@
+#include "snapshot.h"
+
+LUAMOD_API int luaopen_snapshot(lua_State *L) {
+    if (likely(luaL_newmetatable(L, MT_SNAPSHOT_WRITER))) {
+        lua_pushcfunction(L, snapshot_writer_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    if (likely(luaL_newmetatable(L, MT_SNAPSHOT_MAP))) {
+        lua_pushcfunction(L, snapshot_map_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_pop(L, 2);
+
+    luaL_newlib(L, snapshot_index);
+    luaF_set_kv_int(L, -1, "VERSION", SNAPSHOT_VERSION);
+
+    return 1;
+}
+
+static int snapshot_writer_gc(lua_State *L) {
+    ud_snapshot_writer *w = luaL_checkudata(L, 1, MT_SNAPSHOT_WRITER);
+
+    luaF_strbuf_free_buf(&w->strings);
+    luaF_strbuf_free_buf(&w->tables);
+
+    return 0;
+}
+
+static int snapshot_map_gc(lua_State *L) {
+    snapshot_unmap(L, luaL_checkudata(L, 1, MT_SNAPSHOT_MAP));
+    return 0;
+}
+
+static void snapshot_unmap(lua_State *L, ud_snapshot_map *map) {
+    if (map->addr != NULL) {
+        if (unlikely(munmap(map->addr, map->size) != 0)) {
+            luaF_warning_errno(L, "munmap failed");
+        }
+
+        map->addr = NULL;
+    }
+}
+
+// snapshot.write(path, root, ts) -> bytes written
+// file is replaced atomically: written to path.tmp, then renamed
+int snapshot_write(lua_State *L) {
+    luaF_need_args(L, 3, "snapshot.write");
+    const char *path = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_Number ts = luaL_checknumber(L, 3);
+
+    ud_snapshot_writer *w = luaF_new_ud_or_error(L,
+        sizeof(ud_snapshot_writer), 0); // 4
+
+    w->strings = luaF_strbuf_create(SNAPSHOT_BUF_START_SIZE);
+    w->tables = luaF_strbuf_create(SNAPSHOT_BUF_START_SIZE);
+    w->strings_n = 0;
+    w->tables_n = 0;
+
+    luaL_setmetatable(L, MT_SNAPSHOT_WRITER);
+
+    lua_createtable(L, 0, 0); // 5: ids[string or table] = index
+    lua_createtable(L, 1, 0); // 6: queue[index + 1] = table
+
+    int ids_idx = 5;
+    int queue_idx = 6;
+
+    lua_pushvalue(L, 2); // root
+    lua_pushinteger(L, w->tables_n++);
+    lua_rawset(L, ids_idx);
+    lua_pushvalue(L, 2); // root
+    lua_rawseti(L, queue_idx, 1);
+
+    for (uint32_t i = 0; i < w->tables_n; ++i) { // grows while writing
+        lua_rawgeti(L, queue_idx, i + 1);
+        write_table(L, w, lua_gettop(L), ids_idx);
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    snapshot_header header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .ts = ts,
+        .strings_n = w->strings_n,
+        .tables_n = w->tables_n,
+        .strings_size = w->strings.filled,
+        .tables_size = w->tables.filled,
+    };
+
+    write_file(L, path, &header, w);
+
+    lua_pushinteger(L, sizeof(header) + header.strings_size
+        + header.tables_size);
+
+    return 1;
+}
+
+static void write_table(
+    lua_State *L,
+    ud_snapshot_writer *w,
+    int table_idx,
+    int ids_idx
+) {
+    luaF_strbuf *sb = &w->tables;
+    uint32_t arr_n = 0;
+
+    while (lua_rawgeti(L, table_idx, arr_n + 1) != LUA_TNIL) {
+        lua_pop(L, 1); // lua_rawgeti
+        ++arr_n;
+    }
+
+    lua_pop(L, 1); // lua_rawgeti
+
+    uint32_t hash_n = 0;
+    size_t hash_n_pos = sb->filled + sizeof(arr_n);
+
+    luaF_strbuf_append(L, sb, (const char *)&arr_n, sizeof(arr_n));
+    luaF_strbuf_append(L, sb, (const char *)&hash_n, sizeof(hash_n));
+
+    for (uint32_t i = 1; i <= arr_n; ++i) {
+        lua_rawgeti(L, table_idx, i);
+        write_value(L, w, lua_gettop(L), ids_idx);
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, table_idx)) {
+        if (lua_isinteger(L, -2)) {
+            lua_Integer key = lua_tointeger(L, -2);
+
+            if (key >= 1 && key <= arr_n) {
+                lua_pop(L, 1); // lua_next
+                continue; // array part
+            }
+        }
+
+        write_value(L, w, lua_gettop(L) - 1, ids_idx); // key
+        write_value(L, w, lua_gettop(L), ids_idx);
+        ++hash_n;
+
+        lua_pop(L, 1); // lua_next
+    }
+
+    memcpy(sb->buf + hash_n_pos, &hash_n, sizeof(hash_n));
+}
+
+// strings and tables are written once, then referenced by index;
+// new tables are queued at ids_idx + 1
+static void write_value(
+    lua_State *L,
+    ud_snapshot_writer *w,
+    int value_idx,
+    int ids_idx
+) {
+    luaF_strbuf *sb = &w->tables;
+    uint8_t tag;
+
+    switch (lua_type(L, value_idx)) {
+        case LUA_TBOOLEAN:
+            tag = lua_toboolean(L, value_idx)
+                ? SNAPSHOT_TAG_TRUE
+                : SNAPSHOT_TAG_FALSE;
+            luaF_strbuf_append(L, sb, (const char *)&tag, 1);
+            return;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, value_idx)) {
+                int64_t num = lua_tointeger(L, value_idx);
+                tag = SNAPSHOT_TAG_INT;
+                luaF_strbuf_append(L, sb, (const char *)&tag, 1);
+                luaF_strbuf_append(L, sb, (const char *)&num, sizeof(num));
+            } else {
+                double num = lua_tonumber(L, value_idx);
+                tag = SNAPSHOT_TAG_FLOAT;
+                luaF_strbuf_append(L, sb, (const char *)&tag, 1);
+                luaF_strbuf_append(L, sb, (const char *)&num, sizeof(num));
+            }
+            return;
+        case LUA_TSTRING:
+            tag = SNAPSHOT_TAG_STR;
+            break;
+        case LUA_TTABLE:
+            tag = SNAPSHOT_TAG_TABLE;
+            break;
+        case LUA_TUSERDATA: // written as the table its __snapshot returns
+            if (luaL_getmetafield(L, value_idx, "__snapshot") != LUA_TNIL) {
+                lua_pop(L, 1); // __snapshot
+                tag = SNAPSHOT_TAG_TABLE;
+                break;
+            }
+            // fallthrough
+        default:
+            luaL_error(L, "snapshot: unsupported value type: %s",
+                luaL_typename(L, value_idx));
+            return;
+    }
+
+    uint32_t id;
+
+    lua_pushvalue(L, value_idx);
+
+    if (lua_rawget(L, ids_idx) != LUA_TNIL) {
+        id = lua_tointeger(L, -1);
+        lua_pop(L, 1); // lua_rawget
+    } else if (tag == SNAPSHOT_TAG_STR) {
+        size_t len;
+        const char *str = lua_tolstring(L, value_idx, &len);
+        uint32_t len32 = len;
+
+        if (unlikely(len32 != len)) {
+            luaL_error(L, "snapshot: string is too long: %d", len);
+        }
+
+        luaF_strbuf_append(L, &w->strings, (const char *)&len32, sizeof(len32));
+
+        if (len > 0) {
+            luaF_strbuf_append(L, &w->strings, str, len);
+        }
+
+        id = w->strings_n++;
+    } else {
+        id = w->tables_n++;
+
+        if (lua_type(L, value_idx) == LUA_TUSERDATA) {
+            luaL_getmetafield(L, value_idx, "__snapshot");
+            lua_pushvalue(L, value_idx);
+            lua_call(L, 1, 1);
+
+            if (unlikely(!lua_istable(L, -1))) {
+                luaL_error(L, "snapshot: __snapshot must return a table");
+            }
+        } else {
+            lua_pushvalue(L, value_idx);
+        }
+
+        lua_rawseti(L, ids_idx + 1, id + 1); // queue[id + 1] = table
+    }
+
+    if (lua_isnil(L, -1)) { // new: ids[value] = id
+        lua_pop(L, 1); // lua_rawget
+        lua_pushvalue(L, value_idx);
+        lua_pushinteger(L, id);
+        lua_rawset(L, ids_idx);
+    }
+
+    luaF_strbuf_append(L, sb, (const char *)&tag, 1);
+    luaF_strbuf_append(L, sb, (const char *)&id, sizeof(id));
+}
+
+static void write_all(lua_State *L, int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+
+        if (unlikely(written < 0)) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            int write_errno = errno;
+
+            luaF_close_or_warning(L, fd);
+            errno = write_errno;
+            luaF_error_errno(L, "snapshot write failed");
+        }
+
+        buf += written;
+        len -= written;
+    }
+}
+
+static void write_file(
+    lua_State *L,
+    const char *path,
+    const snapshot_header *header,
+    ud_snapshot_writer *w
+) {
+    lua_pushstring(L, path);
+    lua_pushliteral(L, SNAPSHOT_TMP_SUFFIX);
+    lua_concat(L, 2);
+
+    const char *tmp_path = lua_tostring(L, -1);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "snapshot open failed; path: %s", tmp_path);
+    }
+
+    write_all(L, fd, (const char *)header, sizeof(*header));
+    write_all(L, fd, w->strings.buf, w->strings.filled);
+    write_all(L, fd, w->tables.buf, w->tables.filled);
+
+    if (unlikely(fsync(fd) != 0)) {
+        luaF_close_or_warning(L, fd);
+        luaF_error_errno(L, "snapshot fsync failed; path: %s", tmp_path);
+    }
+
+    if (unlikely(close(fd) != 0)) {
+        luaF_error_errno(L, "snapshot close failed; path: %s", tmp_path);
+    }
+
+    if (unlikely(rename(tmp_path, path) != 0)) {
+        luaF_error_errno(L, "snapshot rename failed; path: %s", path);
+    }
+
+    lua_pop(L, 1); // tmp_path
+}
+
+#define read_need(L, r, n) { \
+    if (unlikely((size_t)((r)->end - (r)->pos) < (size_t)(n))) { \
+        luaL_error(L, "snapshot is truncated"); \
+    } \
+}
+
+static uint32_t read_u32(lua_State *L, snapshot_reader *r) {
+    uint32_t value;
+
+    read_need(L, r, sizeof(value));
+    memcpy(&value, r->pos, sizeof(value));
+    r->pos += sizeof(value);
+
+    return value;
+}
+
+// snapshot.read(path) -> root, ts
+int snapshot_read(lua_State *L) {
+    luaF_need_args(L, 1, "snapshot.read");
+    const char *path = luaL_checkstring(L, 1);
+
+    ud_snapshot_map *map = luaF_new_ud_or_error(L,
+        sizeof(ud_snapshot_map), 0); // 2
+
+    map->addr = NULL;
+    map->size = 0;
+
+    luaL_setmetatable(L, MT_SNAPSHOT_MAP);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (unlikely(fd < 0)) {
+        luaF_error_errno(L, "snapshot open failed; path: %s", path);
+    }
+
+    struct stat st;
+
+    if (unlikely(fstat(fd, &st) != 0)) {
+        luaF_close_or_warning(L, fd);
+        luaF_error_errno(L, "snapshot fstat failed; path: %s", path);
+    }
+
+    if (unlikely((size_t)st.st_size < sizeof(snapshot_header))) {
+        luaF_close_or_warning(L, fd);
+        luaL_error(L, "snapshot is too small; path: %s", path);
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    luaF_close_or_warning(L, fd); // mapping holds the file
+
+    if (unlikely(addr == MAP_FAILED)) {
+        luaF_error_errno(L, "snapshot mmap failed; path: %s", path);
+    }
+
+    map->addr = addr;
+    map->size = st.st_size;
+
+    madvise(map->addr, map->size, MADV_SEQUENTIAL);
+
+    snapshot_header header;
+    memcpy(&header, map->addr, sizeof(header));
+
+    if (unlikely(header.magic != SNAPSHOT_MAGIC)) {
+        luaL_error(L, "not a snapshot; path: %s", path);
+    }
+
+    if (unlikely(header.version != SNAPSHOT_VERSION)) {
+        luaL_error(L, "snapshot version mismatch: %d; expected: %d",
+            header.version, SNAPSHOT_VERSION);
+    }
+
+    if (unlikely(header.tables_n == 0 || sizeof(header) + header.strings_size
+        + header.tables_size != map->size
+    )) {
+        luaL_error(L, "snapshot is corrupted; path: %s", path);
+    }
+
+    uint32_t strings_n = header.strings_n;
+    uint32_t tables_n = header.tables_n;
+
+    snapshot_reader r = {
+        .pos = map->addr + sizeof(header),
+        .end = map->addr + sizeof(header) + header.strings_size,
+    };
+
+    lua_createtable(L, strings_n, 0); // 3: strings
+
+    for (uint32_t i = 0; i < strings_n; ++i) {
+        uint32_t len = read_u32(L, &r);
+
+        read_need(L, &r, len);
+        lua_pushlstring(L, r.pos, len);
+        lua_rawseti(L, 3, i + 1);
+        r.pos += len;
+    }
+
+    r.end = map->addr + map->size;
+
+    // pass 1: create all tables presized, so links can point forward
+
+    lua_createtable(L, tables_n, 0); // 4: tables
+
+    size_t *offsets = lua_newuserdatauv(L, tables_n * sizeof(size_t), 0); // 5
+
+    for (uint32_t i = 0; i < tables_n; ++i) {
+        offsets[i] = r.pos - map->addr;
+
+        uint32_t arr_n = read_u32(L, &r);
+        uint32_t hash_n = read_u32(L, &r);
+
+        lua_createtable(L, arr_n, hash_n);
+        lua_rawseti(L, 4, i + 1);
+
+        for (uint64_t j = 0; j < arr_n + 2 * (uint64_t)hash_n; ++j) {
+            read_skip_value(L, &r);
+        }
+    }
+
+    // pass 2: fill
+
+    for (uint32_t i = 0; i < tables_n; ++i) {
+        r.pos = map->addr + offsets[i];
+
+        uint32_t arr_n = read_u32(L, &r);
+        uint32_t hash_n = read_u32(L, &r);
+
+        lua_rawgeti(L, 4, i + 1);
+
+        int table_idx = lua_gettop(L);
+
+        for (uint32_t j = 1; j <= arr_n; ++j) {
+            read_push_value(L, &r, 3, 4, strings_n, tables_n);
+            lua_rawseti(L, table_idx, j);
+        }
+
+        for (uint32_t j = 0; j < hash_n; ++j) {
+            read_push_value(L, &r, 3, 4, strings_n, tables_n); // key
+            read_push_value(L, &r, 3, 4, strings_n, tables_n);
+            lua_rawset(L, table_idx);
+        }
+
+        lua_pop(L, 1); // lua_rawgeti
+    }
+
+    snapshot_unmap(L, map);
+
+    lua_rawgeti(L, 4, 1); // root
+    lua_pushnumber(L, header.ts);
+
+    return 2; // root, ts
+}
+
+static void read_skip_value(lua_State *L, snapshot_reader *r) {
+    read_need(L, r, 1);
+
+    switch (*r->pos++) {
+        case SNAPSHOT_TAG_FALSE:
+        case SNAPSHOT_TAG_TRUE:
+            return;
+        case SNAPSHOT_TAG_INT:
+        case SNAPSHOT_TAG_FLOAT:
+            read_need(L, r, 8);
+            r->pos += 8;
+            return;
+        case SNAPSHOT_TAG_STR:
+        case SNAPSHOT_TAG_TABLE:
+            read_need(L, r, 4);
+            r->pos += 4;
+            return;
+        default:
+            luaL_error(L, "snapshot: unknown tag: %d", r->pos[-1]);
+    }
+}
+
+static void read_push_value(
+    lua_State *L,
+    snapshot_reader *r,
+    int strings_idx,
+    int tables_idx,
+    uint32_t strings_n,
+    uint32_t tables_n
+) {
+    uint8_t tag = *r->pos++; // checked by read_skip_value
+
+    switch (tag) {
+        case SNAPSHOT_TAG_FALSE:
+            lua_pushboolean(L, 0);
+            return;
+        case SNAPSHOT_TAG_TRUE:
+            lua_pushboolean(L, 1);
+            return;
+        case SNAPSHOT_TAG_INT: {
+            int64_t num;
+            memcpy(&num, r->pos, sizeof(num));
+            r->pos += sizeof(num);
+            lua_pushinteger(L, num);
+            return;
+        }
+        case SNAPSHOT_TAG_FLOAT: {
+            double num;
+            memcpy(&num, r->pos, sizeof(num));
+            r->pos += sizeof(num);
+            lua_pushnumber(L, num);
+            return;
+        }
+        default: { // STR or TABLE
+            uint32_t id;
+            memcpy(&id, r->pos, sizeof(id));
+            r->pos += sizeof(id);
+
+            if (tag == SNAPSHOT_TAG_STR) {
+                if (unlikely(id >= strings_n)) {
+                    luaL_error(L, "snapshot: bad string index: %d", id);
+                }
+
+                lua_rawgeti(L, strings_idx, id + 1);
+            } else {
+                if (unlikely(id >= tables_n)) {
+                    luaL_error(L, "snapshot: bad table index: %d", id);
+                }
+
+                lua_rawgeti(L, tables_idx, id + 1);
+            }
+        }
+    }
+}
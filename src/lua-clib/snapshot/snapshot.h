@@ -0,0 +1,110 @@
+#ifndef LUA_LIB_SNAPSHOT_H
+#define LUA_LIB_SNAPSHOT_H
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <furiend/shared.h>
+#include <furiend/strbuf.h>
+
+#define MT_SNAPSHOT_WRITER "snapshot.writer*"
+#define MT_SNAPSHOT_MAP "snapshot.map*"
+
+#define SNAPSHOT_MAGIC 0x53535746 // "FWSS", also rejects foreign byte order
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_TAG_FALSE 0
+#define SNAPSHOT_TAG_TRUE 1
+#define SNAPSHOT_TAG_INT 2 // int64
+#define SNAPSHOT_TAG_FLOAT 3 // double
+#define SNAPSHOT_TAG_STR 4 // uint32 string index
+#define SNAPSHOT_TAG_TABLE 5 // uint32 table index
+
+#define SNAPSHOT_BUF_START_SIZE 65536
+#define SNAPSHOT_TMP_SUFFIX ".tmp"
+
+// file: header, strings, tables in native byte order
+// string: uint32 len, bytes
+// table: uint32 arr_n, uint32 hash_n, arr_n values, hash_n key-value pairs
+// value: uint8 tag, payload
+// table 0 is the root; shared and cyclic links are kept as table indexes
+// userdata with a __snapshot metafield is written as the table it returns
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    double ts;
+    uint32_t strings_n;
+    uint32_t tables_n;
+    uint64_t strings_size;
+    uint64_t tables_size;
+} snapshot_header;
+
+typedef struct {
+    luaF_strbuf strings;
+    luaF_strbuf tables;
+    uint32_t strings_n;
+    uint32_t tables_n;
+} ud_snapshot_writer;
+
+typedef struct {
+    char *addr;
+    size_t size;
+} ud_snapshot_map;
+
+typedef struct {
+    const char *pos;
+    const char *end;
+} snapshot_reader;
+
+LUAMOD_API int luaopen_snapshot(lua_State *L);
+
+int snapshot_write(lua_State *L);
+int snapshot_read(lua_State *L);
+
+static int snapshot_writer_gc(lua_State *L);
+static int snapshot_map_gc(lua_State *L);
+static void snapshot_unmap(lua_State *L, ud_snapshot_map *map);
+
+static void write_table(
+    lua_State *L,
+    ud_snapshot_writer *w,
+    int table_idx,
+    int ids_idx);
+
+static void write_value(
+    lua_State *L,
+    ud_snapshot_writer *w,
+    int value_idx,
+    int ids_idx);
+
+static void write_all(lua_State *L, int fd, const char *buf, size_t len);
+
+static void write_file(
+    lua_State *L,
+    const char *path,
+    const snapshot_header *header,
+    ud_snapshot_writer *w);
+
+static uint32_t read_u32(lua_State *L, snapshot_reader *r);
+static void read_skip_value(lua_State *L, snapshot_reader *r);
+
+static void read_push_value(
+    lua_State *L,
+    snapshot_reader *r,
+    int strings_idx,
+    int tables_idx,
+    uint32_t strings_n,
+    uint32_t tables_n);
+
+static const luaL_Reg snapshot_index[] = {
+    { "write", snapshot_write },
+    { "read", snapshot_read },
+    { "VERSION", NULL }, // just reserve space
+    { NULL, NULL }
+};
+
+#endif
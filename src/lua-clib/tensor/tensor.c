@@ -1,40 +1,163 @@
 #include "tensor.h"
 
 LUAMOD_API int luaopen_tensor(lua_State *L) {
+    luaL_newmetatable(L, MT_TENSOR_PATH); // checked by unwrap, no methods
+    lua_pop(L, 1);
+
     luaL_newlib(L, tensor_index);
     return 1;
 }
 
-int tensor_gen_id(lua_State *L) {
-    luaF_need_args(L, 2, "gen_id");
-    luaL_checktype(L, 1, LUA_TSTRING); // prefix
-    luaL_checktype(L, 2, LUA_TTABLE); // db
+static const char *const gen_id_formats[] = {
+    "base36", "base62", "bin", NULL
+}; // GEN_ID_FORMAT_*
+
+static const char base62_digits[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// per process, the node id tells processes apart
+static int64_t gen_id_last_ms = 0;
+static int gen_id_seq = 0;
+static int gen_id_node = -1; // getpid based until id_node sets it
 
-    const char *prefix = lua_tostring(L, 1);
+// ids only grow: the same ms bumps seq, a full seq or a clock moved back
+// keeps counting on the last ms instead of waiting for the clock
+static uint64_t next_id(lua_State *L) {
     struct timespec ts;
 
-    while (1) {
-        if (unlikely(clock_gettime(CLOCK_REALTIME, &ts) < 0)) {
-            luaF_error_errno(L, "clock_gettime failed");
-        }
+    if (unlikely(clock_gettime(CLOCK_REALTIME, &ts) < 0)) {
+        luaF_error_errno(L, "clock_gettime failed");
+    }
+
+    if (unlikely(gen_id_node < 0)) {
+        gen_id_node = getpid() & GEN_ID_NODE_MAX;
+    }
+
+    int64_t ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000
+        - GEN_ID_EPOCH_MS;
+
+    if (ms > gen_id_last_ms) {
+        gen_id_last_ms = ms;
+        gen_id_seq = 0;
+    } else if (likely(gen_id_seq < GEN_ID_SEQ_MAX)) {
+        gen_id_seq++;
+    } else {
+        gen_id_last_ms++;
+        gen_id_seq = 0;
+    }
+
+    return ((uint64_t)gen_id_last_ms << (GEN_ID_NODE_BITS + GEN_ID_SEQ_BITS))
+        | ((uint64_t)gen_id_node << GEN_ID_SEQ_BITS)
+        | (uint64_t)gen_id_seq;
+}
 
-        lua_pushfstring(L, "%s" GEN_ID_SEP "%d" GEN_ID_SEP "%d",
-            prefix, ts.tv_sec, ts.tv_nsec);
-        lua_pushvalue(L, 3); // prefix, db, id, id
+// most significant digit first, returns length
+static int encode_id(uint64_t id, const char *digits, int base, char *buf) {
+    char tmp[GEN_ID_BUF_SIZE];
+    int n = 0;
 
-        if (lua_rawget(L, 2) != LUA_TTABLE) { // prefix, db, id, nil
-            lua_pop(L, 1); // prefix, db, id
-            return 1; // id
-        } else { // prefix, db, id, obj
-            // dup id, try again
-            lua_settop(L, 2); // prefix, db
+    do {
+        tmp[n++] = digits[id % base];
+        id /= base;
+    } while (id);
+
+    for (int i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+
+    return n;
+}
+
+// gen_id(prefix, format?) -> "prefix-id"
+// base36 (default) fits world id names, base62 is shorter,
+// bin is 8 big endian bytes; all sort by creation time for the same length
+int tensor_gen_id(lua_State *L) {
+    luaF_min_max_args(L, 1, 2, "gen_id");
+    const char *prefix = luaL_checkstring(L, 1);
+    int format = luaL_checkoption(L, 2, "base36", gen_id_formats);
+
+    uint64_t id = next_id(L);
+    char buf[GEN_ID_BUF_SIZE];
+    int len;
+
+    if (format == GEN_ID_FORMAT_BIN) {
+        for (int i = 0; i < 8; i++) {
+            buf[i] = (char)(id >> (56 - 8 * i));
         }
+
+        len = 8;
+    } else {
+        int base = format == GEN_ID_FORMAT_BASE36 ? 36 : 62;
+        len = encode_id(id, base62_digits, base, buf);
+    }
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+
+    if (*prefix) {
+        luaL_addstring(&b, prefix);
+        luaL_addstring(&b, GEN_ID_SEP);
+    }
+
+    luaL_addlstring(&b, buf, len);
+    luaL_pushresult(&b);
+
+    return 1;
+}
+
+// id_node(node?) -> node, sets the node id when given, 0 .. GEN_ID_NODE_MAX
+int tensor_id_node(lua_State *L) {
+    luaF_min_max_args(L, 0, 1, "id_node");
+
+    if (!lua_isnoneornil(L, 1)) {
+        lua_Integer node = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, node >= 0 && node <= GEN_ID_NODE_MAX, 1,
+            "node out of range");
+        gen_id_node = (int)node;
+    } else if (gen_id_node < 0) {
+        gen_id_node = getpid() & GEN_ID_NODE_MAX;
+    }
+
+    lua_pushinteger(L, gen_id_node);
+    return 1;
+}
+
+// tables, and userdata with __index such as world object proxies
+static int readable(lua_State *L, int idx) {
+    int type = lua_type(L, idx);
+
+    if (likely(type == LUA_TTABLE)) {
+        return 1;
+    }
+
+    if (type != LUA_TUSERDATA || luaL_getmetafield(L, idx, "__index")
+        == LUA_TNIL
+    ) {
+        return 0;
+    }
+
+    lua_pop(L, 1); // __index
+    return 1;
+}
+
+// key on top is replaced by the value, raw for tables
+static void get_field(lua_State *L, int idx) {
+    if (likely(lua_istable(L, idx))) {
+        lua_rawget(L, idx);
+    } else {
+        lua_gettable(L, idx);
     }
 }
 
 // unwrap(event, "payload.event.*.chat.id")
+// unwrap(event, compile("payload.event.*.chat.id"))
 int tensor_unwrap(lua_State *L) {
     luaF_need_args(L, 2, "unwrap"); // value, path
+
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        return unwrap_compiled(L);
+    }
+
     luaL_checktype(L, 2, LUA_TSTRING);
     lua_insert(L, 1); // path, value
 
@@ -44,7 +167,7 @@ int tensor_unwrap(lua_State *L) {
     const char *path = lua_tolstring(L, 1, &path_len);
 
     while (path_len > 0) {
-        if (unlikely(!lua_istable(L, value_idx))) {
+        if (unlikely(!readable(L, value_idx))) {
             return 0; // can read fields only from table. fail
         }
 
@@ -52,7 +175,7 @@ int tensor_unwrap(lua_State *L) {
 
         if (unlikely(!pos)) { // no dots
             lua_pushlstring(L, path, path_len);
-            lua_rawget(L, value_idx);
+            get_field(L, value_idx);
             return 1;
         }
 
@@ -63,9 +186,13 @@ int tensor_unwrap(lua_State *L) {
             path += 2;
             path_len -= 2;
 
+            if (unlikely(!lua_istable(L, value_idx))) {
+                return 0; // only tables are iterated. fail
+            }
+
             lua_pushnil(L);
             while (lua_next(L, value_idx)) {
-                if (path_len > 0 && !lua_istable(L, -1)) {
+                if (path_len > 0 && !readable(L, -1)) {
                     lua_pop(L, 1); // lua_next
                     continue; // can't read from value, skip
                 }
@@ -86,7 +213,7 @@ int tensor_unwrap(lua_State *L) {
         }
 
         lua_pushlstring(L, chunk, chunk_len);
-        lua_rawget(L, value_idx);
+        get_field(L, value_idx);
         lua_replace(L, value_idx);
 
         path += chunk_len + 1; // 1 for dot
@@ -95,3 +222,110 @@ int tensor_unwrap(lua_State *L) {
 
     return 1;
 }
+
+// compile("payload.event.*.chat.id") -> path for unwrap
+// split once, segments are interned; same rules as the string form:
+// "*" followed by a dot is a wildcard, the last segment is always a key
+int tensor_compile(lua_State *L) {
+    luaF_need_args(L, 1, "compile");
+
+    size_t path_len;
+    const char *path = luaL_checklstring(L, 1, &path_len);
+
+    ud_tensor_path *compiled = luaF_new_ud_or_error(L,
+        sizeof(ud_tensor_path), 1); // path, compiled
+
+    luaL_setmetatable(L, MT_TENSOR_PATH);
+    lua_newtable(L); // path, compiled, segments
+
+    int n = 0;
+
+    while (path_len > 0) {
+        const char *pos = memchr(path, '.', path_len);
+
+        if (!pos) { // last
+            lua_pushlstring(L, path, path_len);
+            lua_rawseti(L, -2, ++n);
+            break;
+        }
+
+        size_t chunk_len = pos - path;
+
+        if (chunk_len == 1 && *path == '*') {
+            lua_pushboolean(L, 0);
+        } else {
+            lua_pushlstring(L, path, chunk_len);
+        }
+
+        lua_rawseti(L, -2, ++n);
+
+        path += chunk_len + 1; // 1 for dot
+        path_len -= chunk_len + 1; // 1 for dot
+    }
+
+    lua_setiuservalue(L, -2, TENSOR_PATH_UV_IDX_SEGMENTS); // path, compiled
+    compiled->segments_n = n;
+
+    return 1;
+}
+
+static int unwrap_compiled(lua_State *L) {
+    ud_tensor_path *compiled = luaL_checkudata(L, 2, MT_TENSOR_PATH);
+
+    lua_getiuservalue(L, 2, TENSOR_PATH_UV_IDX_SEGMENTS); // value, path, segs
+    lua_pushvalue(L, 1); // value, path, segs, value
+
+    return unwrap_walk(L, 3, 1, compiled->segments_n);
+}
+
+// value on top is replaced by the result: returns 1
+// or popped when path can't be read: returns 0
+// keys are walked in a loop, only wildcards recurse
+static int unwrap_walk(lua_State *L, int segments_idx, int i, int n) {
+    for (; i <= n; ++i) {
+        if (unlikely(!readable(L, -1))) {
+            lua_pop(L, 1);
+            return 0; // can read fields only from table. fail
+        }
+
+        if (likely(lua_rawgeti(L, segments_idx, i) == LUA_TSTRING)) {
+            get_field(L, -2); // table, value
+            lua_remove(L, -2); // value
+            continue;
+        }
+
+        lua_pop(L, 1); // wildcard: table
+
+        if (unlikely(!lua_istable(L, -1))) {
+            lua_pop(L, 1);
+            return 0; // only tables are iterated. fail
+        }
+
+        luaL_checkstack(L, 3, "unwrap");
+
+        int table_idx = lua_gettop(L);
+
+        lua_pushnil(L);
+        while (lua_next(L, table_idx)) { // table, k, v
+            if (i < n && !readable(L, -1)) {
+                lua_pop(L, 1);
+                continue; // can't read from value, skip
+            }
+
+            if (unwrap_walk(L, segments_idx, i + 1, n)) { // table, k, result
+                if (!lua_isnil(L, -1)) {
+                    lua_replace(L, table_idx); // result, k
+                    lua_pop(L, 1); // result
+                    return 1; // found
+                }
+
+                lua_pop(L, 1); // table, k
+            }
+        }
+
+        lua_pop(L, 1);
+        return 0; // could not find. fail
+    }
+
+    return 1;
+}
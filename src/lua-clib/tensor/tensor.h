@@ -2,18 +2,47 @@
 #define LUA_LIB_TENSOR_H
 
 #include <furiend/shared.h>
+#include <stdint.h>
 
-#define GEN_ID_LOOP_LIMIT 1000
 #define GEN_ID_SEP "-"
 
+// snowflake: 41 bits ms since GEN_ID_EPOCH_MS, 10 bits node, 12 bits seq
+#define GEN_ID_EPOCH_MS 1704067200000LL // 2024-01-01
+#define GEN_ID_NODE_BITS 10
+#define GEN_ID_SEQ_BITS 12
+#define GEN_ID_NODE_MAX ((1 << GEN_ID_NODE_BITS) - 1)
+#define GEN_ID_SEQ_MAX ((1 << GEN_ID_SEQ_BITS) - 1)
+#define GEN_ID_BUF_SIZE 16 // 13 base36 digits at most
+#define GEN_ID_FORMAT_BASE36 0
+#define GEN_ID_FORMAT_BASE62 1
+#define GEN_ID_FORMAT_BIN 2
+
+#define MT_TENSOR_PATH "tensor.path*"
+#define TENSOR_PATH_UV_IDX_SEGMENTS 1 // { "a", false, "b" }, false is *
+
+typedef struct {
+    int segments_n;
+} ud_tensor_path;
+
 LUAMOD_API int luaopen_tensor(lua_State *L);
 
 int tensor_unwrap(lua_State *L);
+int tensor_compile(lua_State *L);
 int tensor_gen_id(lua_State *L);
+int tensor_id_node(lua_State *L);
+
+static int readable(lua_State *L, int idx);
+static void get_field(lua_State *L, int idx);
+static int unwrap_compiled(lua_State *L);
+static int unwrap_walk(lua_State *L, int segments_idx, int i, int n);
+static uint64_t next_id(lua_State *L);
+static int encode_id(uint64_t id, const char *digits, int base, char *buf);
 
 static const luaL_Reg tensor_index[] = {
     { "unwrap", tensor_unwrap },
+    { "compile", tensor_compile },
     { "gen_id", tensor_gen_id },
+    { "id_node", tensor_id_node },
     { NULL, NULL }
 };
 
@@ -12,18 +12,19 @@ static int trace(lua_State *L) {
         return 0;
     }
 
-    lua_createtable(L, 0, CACHE_MIN_SIZE);
-    lua_insert(L, CACHE_IDX); // must be 1
+    luaF_visited visited = { .n = 0 };
 
     for (int index = 1; index <= args_n; ++index) {
-        trace_value(L, index + 1, 0, MODE_VARIABLE);
+        trace_value(L, index, 0, MODE_VARIABLE, &visited);
         fputc(index == args_n ? '\n' : ' ', stderr);
     }
 
     return 0;
 }
 
-static void trace_value(lua_State *L, int index, int depth, int mode) {
+static void trace_value(lua_State *L, int index, int depth, int mode,
+    luaF_visited *visited
+) {
     FILE *stream = stderr;
 
     if (depth > 0 && mode != MODE_TABLE_VALUE) {
@@ -49,7 +50,7 @@ static void trace_value(lua_State *L, int index, int depth, int mode) {
     } else if (type == LUA_TNUMBER) {
         fprintf(stream, RESET);
     } else if (type == LUA_TTABLE) {
-        trace_table(L, index, depth);
+        trace_table(L, index, depth, visited);
     }
 
     if (type == LUA_TTABLE || type == LUA_TUSERDATA) {
@@ -67,16 +68,15 @@ static void trace_value(lua_State *L, int index, int depth, int mode) {
     }
 }
 
-static void trace_table(lua_State *L, int index, int depth) {
+// a table already on the path (cycle) is printed as { ... }
+static void trace_table(lua_State *L, int index, int depth,
+    luaF_visited *visited
+) {
     FILE *stream = stderr;
 
     luaL_checkstack(L, 4, "trace");
 
-    if (cache_get(L, index) == LUA_TNIL) {
-        lua_pop(L, 1); // cache_get
-        cache_set(L, index);
-    } else {
-        lua_pop(L, 1); // cache_get
+    if (luaF_visit(visited, lua_topointer(L, index)) <= 0) {
         fprintf(stream, " { ... }");
         return;
     }
@@ -97,8 +97,8 @@ static void trace_table(lua_State *L, int index, int depth) {
         if (depth >= MAX_DEPTH) {
             luaF_warning(L, "trace: max depth exceeded: %d", MAX_DEPTH);
         } else {
-            trace_value(L, k_index, depth + 1, MODE_TABLE_KEY);
-            trace_value(L, v_index, depth + 1, MODE_TABLE_VALUE);
+            trace_value(L, k_index, depth + 1, MODE_TABLE_KEY, visited);
+            trace_value(L, v_index, depth + 1, MODE_TABLE_VALUE, visited);
         }
 
         lua_pop(L, 1); // lua_next
@@ -109,4 +109,5 @@ static void trace_table(lua_State *L, int index, int depth) {
     }
 
     fputc('}', stream);
+    luaF_unvisit(visited);
 }
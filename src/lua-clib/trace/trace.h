@@ -15,21 +15,13 @@
 
 #define INDENT_LEN 4
 #define MAX_DEPTH 16
-#define CACHE_IDX 1 // must be 1
-#define CACHE_MIN_SIZE 4
-
-#define cache_get(L, table_idx) \
-    lua_rawgetp(L, CACHE_IDX, lua_topointer(L, table_idx))
-
-#define cache_set(L, table_idx) { \
-    lua_pushboolean(L, 1); \
-    lua_rawsetp(L, CACHE_IDX, lua_topointer(L, table_idx)); \
-}
 
 LUAMOD_API int luaopen_trace(lua_State *L);
 
 static int trace(lua_State *L);
-static void trace_value(lua_State *L, int index, int depth, int mode);
-static void trace_table(lua_State *L, int index, int depth);
+static void trace_value(lua_State *L, int index, int depth, int mode,
+    luaF_visited *visited);
+static void trace_table(lua_State *L, int index, int depth,
+    luaF_visited *visited);
 
 #endif
@@ -0,0 +1,31 @@
+local compress = require "compress"
+
+-- typical events between fe1, fe2 and dc, repeated keys are packed as
+-- references into it; every side needs the same text under the same id,
+-- so a changed dict gets a new id
+local DICT_ID = 1
+local DICT = table.concat({
+    '{"type":"cmd","from":"dc","cmd":"sendChatAction","cmd_id":1,',
+    '"payload":{"chat_id":1,"action":"typing"}}',
+    '{"type":"cmd_ok","from":"fe2","payload":{"cmd_id":1,',
+    '"result":{"ok":true,"result":true}}}',
+    '{"type":"tg_bot_event","from":"fe2","payload":{"update_id":1,',
+    '"message":{"message_id":1,"from":{"id":1,"is_bot":false,',
+    '"first_name":"","last_name":"","username":"","language_code":"en"},',
+    '"chat":{"id":1,"first_name":"","last_name":"","username":"",',
+    '"type":"private"},"date":1,"text":"","entities":[{"offset":0,',
+    '"length":1,"type":"bot_command"}]}}}',
+})
+
+-- conf: config.compress; nil - events are published plain,
+-- { min_len } - events from min_len bytes are packed
+-- frames are unpacked either way, so readers are rolled out first
+-- returns compress codec: codec:pack(msg), codec:unpack(msg), codec:stat()
+return function(conf)
+    return compress.codec({
+        dict = DICT,
+        dict_id = DICT_ID,
+        min_len = conf and conf.min_len,
+        pack = conf ~= nil,
+    })
+end
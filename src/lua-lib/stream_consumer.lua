@@ -0,0 +1,151 @@
+local async = require "async"
+local sleep = require "sleep"
+local wait = async.wait
+
+local DEFAULT_COUNT = 256
+local DEFAULT_BLOCK_MS = 1000
+local DEFAULT_CLAIM_EVERY = 64 -- reads
+local DEFAULT_MAX_FAILS = 3 -- per entry, then dead-lettered
+local MIN_BACKOFF = 0.1 -- seconds, doubled per failed read up to max
+local MAX_BACKOFF = 10
+
+-- config: { stream, group, consumer, count, block_ms, claim_idle_ms,
+--     claim_every, max_fails, dead_letter }
+-- on_entry(id, fields) is called per entry and the entry is acked after it
+-- returns, so one failure does not re-run its neighbours. A failed entry
+-- stays pending and is claimed again after claim_idle_ms; after max_fails
+-- failures it is added to dead_letter (stream .. ":dead" by default) with
+-- its id and error, and acked.
+-- Redis errors are warned and retried with backoff, the consumer then
+-- rereads its own pending entries.
+-- rc should be a dedicated redis.client: XREADGROUP BLOCK holds connection.
+-- returns a thread, wait it to supervise the consumer; it returns the last
+-- error once rc is closed
+return function(rc, config, on_entry)
+    local stream, group = config.stream, config.group
+    local consumer = config.consumer
+    local count = config.count or DEFAULT_COUNT
+    local block_ms = config.block_ms or DEFAULT_BLOCK_MS
+    local claim_idle_ms = config.claim_idle_ms
+    local claim_every = config.claim_every or DEFAULT_CLAIM_EVERY
+    local max_fails = config.max_fails or DEFAULT_MAX_FAILS
+    local dead_letter = config.dead_letter or stream .. ":dead"
+
+    local fails = {} -- fails[id] = n, forgotten when the entry is acked
+
+    local function bury(id, fields, err)
+        local record = { dead_id = id, dead_error = tostring(err) }
+
+        for key, value in pairs(fields) do
+            record[key] = value
+        end
+
+        wait(rc:xadd(dead_letter, record))
+    end
+
+    local function process(entries)
+        local ids = {}
+
+        for _, entry in ipairs(entries) do
+            local id, fields = entry[1], entry[2]
+            local ok, err = true, nil
+
+            if fields then -- nil: entry was deleted while pending
+                ok, err = pcall(on_entry, id, fields)
+            end
+
+            if ok then
+                ids[#ids + 1] = id
+                fails[id] = nil
+            else
+                local n = (fails[id] or 0) + 1
+
+                warn("stream consumer: " .. id .. ": " .. tostring(err))
+
+                if n >= max_fails then
+                    bury(id, fields, err)
+                    ids[#ids + 1] = id
+                    fails[id] = nil
+                else
+                    fails[id] = n -- retried by claim
+                end
+            end
+        end
+
+        if #ids == 0 then
+            return nil
+        end
+
+        return rc:xack(stream, group, ids) -- waited after next read is sent
+    end
+
+    local ack
+    local ready = false -- group exists and own pending entries were read
+    local claim_start = "0-0"
+    local reads = 0
+
+    local function step()
+        if not ready then
+            wait(rc:xgroup(stream, group, "0"))
+
+            ack = process(wait(rc:xreadgroup(group, consumer, stream,
+                count, nil, "0"))) -- own pending entries after restart
+
+            ready = true
+        end
+
+        if claim_idle_ms and reads % claim_every == 0 then
+            local next_start, entries = wait(rc:xautoclaim(stream, group,
+                consumer, claim_idle_ms, claim_start, count))
+
+            claim_start = next_start
+
+            if ack then
+                wait(ack)
+            end
+
+            ack = process(entries)
+        end
+
+        local read = rc:xreadgroup(group, consumer, stream,
+            count, block_ms)
+
+        if ack then
+            wait(ack)
+        end
+
+        reads = reads + 1
+        ack = process(wait(read))
+    end
+
+    local co = coroutine.create(function()
+        local backoff = MIN_BACKOFF
+
+        while true do
+            local ok, err = pcall(step)
+
+            if ok then
+                backoff = MIN_BACKOFF
+            elseif rc:stat().closed then -- no reconnect can follow
+                return err
+            else
+                warn("stream consumer: " .. tostring(err)
+                    .. "; retry in " .. backoff .. "s")
+
+                ack = nil -- unacked entries stay pending
+                ready = false
+
+                wait(sleep(backoff))
+                backoff = math.min(backoff * 2, MAX_BACKOFF)
+            end
+        end
+    end)
+
+    local ok, err = coroutine.resume(co)
+
+    if not ok then
+        error(err)
+    end
+
+    return co
+end
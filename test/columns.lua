@@ -0,0 +1,177 @@
+local perf = require "test.perf"
+local columns = require "columns"
+local snapshot = require "snapshot"
+
+local path = "/tmp/test-columns.snap"
+
+local keys = {
+    n = "int",
+    f = "float",
+    on = "bool",
+    name = "str",
+    owner = "rel",
+    tags = "any",
+}
+
+local function make_fields(i, owner)
+    return {
+        id = "e" .. i,
+        n = i,
+        f = i / 2,
+        on = i % 2 == 0,
+        name = "name" .. (i % 10),
+        owner = owner,
+        tags = { "t" .. i },
+    }
+end
+
+return function()
+    do
+        local user = { id = "u1" }
+        local class = { id = "event" }
+        local objects = { u1 = user }
+        local store = columns.new(class, keys, objects)
+
+        local e1 = store:insert(make_fields(1, user))
+        local e2 = store:insert(make_fields(2, "u1")) -- rel by id
+
+        assert(store:get("e1") == e1, "proxy identity is not kept")
+        assert(e1.id == "e1" and e1.class == class, "bad id or class")
+        assert(e1.n == 1 and math.type(e1.n) == "integer", "bad int")
+        assert(e1.f == 0.5 and e1.on == false and e2.on == true, "bad values")
+        assert(e1.name == "name1" and e1.owner == user and e2.owner == user,
+            "bad str or rel")
+        assert(e1.tags[1] == "t1" and e1.nope == nil, "bad any")
+
+        e1.n = nil
+        e1.name = "x"
+        assert(e1.n == nil and e1.name == "x", "set failed")
+        assert(not pcall(function() e1.n = "str" end), "int type not checked")
+        assert(not pcall(function() e1.id = "x" end), "id is not read only")
+        assert(not pcall(function() e1.nope = 1 end), "unknown key set")
+        assert(not pcall(store.insert, store, make_fields(1)), "dup id")
+
+        local seen = {}
+
+        for key, value in pairs(e1) do
+            seen[key] = value
+        end
+
+        assert(seen.id == "e1" and seen.class == class and seen.n == nil
+            and seen.name == "x" and seen.owner == user, "bad pairs")
+
+        assert(#store:scan("on", "eq", true) == 1, "bool scan failed")
+        assert(#store:scan("name", "eq", "name2") == 1, "str scan failed")
+        assert(#store:scan("name", "neq", "nope") == 2, "str neq failed")
+        assert(#store:scan("n", "gte", 2) == 1, "int scan failed")
+        assert(#store:scan("n", "eq", 2.0) == 0, "int vs float eq")
+        assert(#store:scan("owner", "eq", user) == 2, "rel scan failed")
+
+        snapshot.write(path, { objects = { e1 = e1 } }, 0)
+        local root = snapshot.read(path)
+        local saved = root.objects.e1
+        os.remove(path)
+
+        assert(type(saved) == "table" and saved.id == "e1"
+            and saved.name == "x" and saved.owner.id == "u1",
+            "proxy snapshot failed")
+
+        assert(store:remove("e1") and not store:remove("e1"), "remove failed")
+        assert(not pcall(function() return e1.n end), "removed proxy is live")
+        assert(store:count() == 1, "bad count")
+
+        local e3 = store:insert(make_fields(3)) -- reuses the row of e1
+        assert(e3 ~= e1 and e3.n == 3 and e3.name == "name3",
+            "row reuse failed")
+    end
+
+    do
+        local store = columns.new({ id = "event" }, { text = "str" }, {})
+
+        store:insert { id = "a", text = "shared" }
+        store:insert { id = "b", text = "shared" }
+
+        for i = 1, 1000 do
+            store:insert { id = "u" .. i, text = "unique" .. i }
+            store:remove("u" .. i)
+        end
+
+        assert(store:stat().strings == 1, "released strings are kept")
+
+        local a = store:get("a")
+        a.text = "other"
+        store:remove("b")
+        assert(store:stat().strings == 1, "last reference did not free")
+        assert(#store:scan("text", "eq", "shared") == 0, "freed string found")
+        assert(a.text == "other", "reused pool index is stale")
+    end
+
+    local objects_n = 200000
+    local class = { id = "event" }
+    local owner = { id = "u1" }
+    local half = objects_n // 2
+
+    collectgarbage()
+    collectgarbage()
+    local mem0 = collectgarbage("count")
+
+    perf()
+        local tables = {}
+
+        for i = 1, objects_n do
+            local fields = make_fields(i, owner)
+            fields.tags = nil
+            fields.class = class
+            tables[i] = fields
+        end
+    perf("tables insert " .. objects_n)
+
+    collectgarbage()
+    local tables_kb = collectgarbage("count") - mem0
+
+    perf()
+        collectgarbage()
+    perf("tables gc")
+
+    local found_tables = {}
+
+    perf()
+        for _, obj in ipairs(tables) do
+            if obj.n > half then
+                table.insert(found_tables, obj)
+            end
+        end
+    perf("tables scan")
+
+    tables, found_tables = nil, nil
+    collectgarbage()
+    collectgarbage()
+    mem0 = collectgarbage("count")
+
+    perf()
+        local store = columns.new(class, keys, { u1 = owner })
+
+        for i = 1, objects_n do
+            local fields = make_fields(i, owner)
+            fields.tags = nil
+            store:insert(fields)
+        end
+    perf("columns insert " .. objects_n)
+
+    collectgarbage()
+    local columns_kb = collectgarbage("count") - mem0
+        + store:stat().bytes / 1024
+
+    perf()
+        collectgarbage()
+    perf("columns gc")
+
+    perf()
+        local found = store:scan("n", "gt", half)
+    perf("columns scan")
+
+    assert(#found == objects_n - half, "scan mismatch")
+
+    print("tables kb", math.floor(tables_kb),
+        "columns kb", math.floor(columns_kb))
+end
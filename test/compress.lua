@@ -0,0 +1,115 @@
+local perf = require "test.perf"
+local compress = require "compress"
+local json = require "json"
+
+local dict = table.concat({
+    '{"type":"tg_bot_event","from":"fe2","payload":{"update_id":1,',
+    '"message":{"message_id":1,"from":{"id":1,"is_bot":false,',
+    '"first_name":"","username":"","language_code":"en"},',
+    '"chat":{"id":1,"first_name":"","username":"","type":"private"},',
+    '"date":1,"text":""}}}',
+})
+
+local function make_event(i)
+    return json.stringify({
+        type = "tg_bot_event",
+        from = "fe2",
+        payload = {
+            update_id = 902173440 + i,
+            message = {
+                message_id = 5121 + i,
+                date = 1717171717 + i,
+                text = "message number " .. i,
+                from = {
+                    id = 123456789,
+                    is_bot = false,
+                    first_name = "Name",
+                    username = "username",
+                    language_code = "en",
+                },
+                chat = {
+                    id = 123456789,
+                    type = "private",
+                    first_name = "Name",
+                    username = "username",
+                },
+            },
+        },
+    })
+end
+
+return function()
+    local codec = compress.codec({ dict = dict, dict_id = 1, min_len = 16 })
+    local plain_codec = compress.codec({ min_len = 16 })
+    local reader = compress.codec({ dict = dict, dict_id = 1, pack = false })
+
+    local samples = {
+        make_event(1),
+        string.rep("a", 1000),
+        string.rep("abc", 7) .. "xyz" .. string.rep("abc", 300),
+        string.rep("\0", 70000) .. "end",
+        "short",
+    }
+
+    for _ = 1, 20 do
+        local bytes = {}
+
+        for i = 1, math.random(16, 2000) do
+            bytes[i] = string.char(math.random(97, 100)) -- compressible
+        end
+
+        table.insert(samples, table.concat(bytes))
+    end
+
+    for _, msg in ipairs(samples) do
+        for _, c in ipairs({ codec, plain_codec }) do
+            local packed = c:pack(msg)
+
+            assert(c:unpack(packed) == msg, "round trip failed")
+            assert(#packed <= #msg, "frame is larger than msg")
+        end
+
+        assert(reader:unpack(codec:pack(msg)) == msg, "reader failed")
+        assert(reader:pack(msg) == msg, "reader packs")
+    end
+
+    local event = make_event(2)
+    local packed = codec:pack(event)
+
+    assert(compress.is_frame(packed) and not compress.is_frame(event),
+        "is_frame failed")
+    assert(#packed < #plain_codec:pack(event), "dict does not help")
+    assert(codec:unpack(event) == event, "plain message is changed")
+    assert(codec:pack("short") == "short", "short message packed")
+    assert(not pcall(plain_codec.unpack, plain_codec, packed),
+        "unknown dict id accepted")
+
+    assert(not pcall(codec.unpack, codec, packed:sub(1, -3)),
+        "truncated frame read")
+    assert(not pcall(compress.codec, { dict = dict, dict_id = 0 }),
+        "bad dict id accepted")
+
+    local stat = codec:stat()
+    assert(stat.packed > 0 and stat.plain > 0 and stat.ratio > 1,
+        "bad stat")
+
+    local events = {}
+
+    for i = 1, 1000 do
+        events[i] = make_event(i)
+    end
+
+    local reps = 100
+
+    perf()
+        for _ = 1, reps do
+            for _, msg in ipairs(events) do
+                codec:unpack(codec:pack(msg))
+            end
+        end
+    perf("compress events " .. reps * #events)
+
+    stat = codec:stat()
+    print("event ratio", stat.ratio, "pack sec", stat.pack_sec,
+        "unpack sec", stat.unpack_sec)
+end
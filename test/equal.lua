@@ -1,5 +1,6 @@
 local trace = require "trace"
 local equal = require "equal"
+local perf = require "test.perf"
 
 local t1 = coroutine.create(print)
 local t2 = coroutine.create(print)
@@ -73,6 +74,7 @@ return function()
 
         trace("equal:", a, b)
         assert(equal(a, b), "not equal")
+        assert(equal.hash(a) == equal.hash(b), "equal values hash differs")
     end
 
     for i = 1, #bad, 2 do
@@ -82,4 +84,53 @@ return function()
         trace("not equal:", a, b)
         assert(not equal(a, b), "equal")
     end
+
+    local loop_a, loop_b = {}, {}
+    loop_a.x, loop_b.x = { up = loop_a }, { up = loop_b }
+    assert(equal.hash(loop_a) == equal.hash(loop_b), "loops hash differs")
+    assert(equal.hash({ a = 1, b = 2 }) ~= equal.hash({ a = 2, b = 1 }),
+        "entries are not paired")
+
+    local set = equal.valueset({ { 1, { x = "y" } }, "s", 1, 1.0, { 1 } })
+    assert(#set == 5, "bad len")
+    assert(set:has({ 1, { x = "y" } }) and set:has("s") and set:has(1.0),
+        "deep value not found")
+    assert(not set:has({ 1, { x = "z" } }) and not set:has(2),
+        "missing value found")
+    assert(not set:add({ 1 }) and set:add({ 2 }) and #set == 6, "bad add")
+    assert(set:remove({ 1 }) and not set:remove({ 1 }) and #set == 5,
+        "bad remove")
+    assert(not set:has({ 1 }) and set:has({ 2 }), "remove broke the set")
+    assert(not pcall(set.add, set, nil), "nil added")
+
+    local empty = equal.valueset()
+    assert(#empty == 0 and empty:add({ 1 }) and empty:has({ 1 }),
+        "bad empty set")
+
+    local values = {}
+
+    for i = 1, 1000 do
+        values[i] = { chat = { id = i }, tags = { "a", "b" } }
+    end
+
+    local probe = { chat = { id = 1000 }, tags = { "a", "b" } }
+    local reps = 1000
+
+    perf()
+        for _ = 1, reps do
+            for _, value in ipairs(values) do
+                if equal(probe, value) then
+                    break
+                end
+            end
+        end
+    perf("deep find: equal " .. reps)
+
+    set = equal.valueset(values)
+
+    perf()
+        for _ = 1, reps do
+            assert(set:has(probe))
+        end
+    perf("deep find: valueset " .. reps)
 end
@@ -0,0 +1,100 @@
+local perf = require "test.perf"
+local evlog = require "evlog"
+
+local path = "/tmp/test.evlog"
+
+return function()
+    os.remove(path)
+
+    perf()
+    do
+        local log = evlog.open(path, 4)
+
+        for i = 1, 10 do
+            log:append("event " .. i)
+        end
+
+        log:append("")
+
+        local stat = log:stat() -- syncs: header, 2 batches
+        assert(stat.records == 11 and stat.syncs == 3 and stat.pending == 3,
+            "incorrect batching")
+        assert(log:flush() == 3, "incorrect flush")
+
+        log:close()
+
+        local events = {}
+
+        for payload in evlog.replay(path) do
+            table.insert(events, payload)
+        end
+
+        assert(#events == 11 and events[10] == "event 10" and events[11] == "",
+            "incorrect replay")
+
+        local file = io.open(path, "ab")
+        file:write("\20\0\0\0torn") -- header of a record that never made it
+        file:close()
+
+        log = evlog.open(path) -- cuts torn tail
+        log:append("after crash")
+        log:close()
+
+        events = {}
+
+        for payload in evlog.replay(path) do
+            table.insert(events, payload)
+        end
+
+        assert(#events == 12 and events[12] == "after crash",
+            "torn tail is not cut")
+
+        log = evlog.open(path, 4)
+        log:append("before checkpoint")
+        assert(log:truncate() == 1, "incorrect truncate count")
+        log:append("after checkpoint")
+        log:close()
+
+        events = {}
+
+        for payload in evlog.replay(path) do
+            table.insert(events, payload)
+        end
+
+        assert(#events == 1 and events[1] == "after checkpoint",
+            "log is not truncated")
+
+        os.remove(path)
+    end
+    perf("evlog")
+
+    local events_n = 1000000
+    local event = '{"type":"tg_bot_event","from":"fe2","time":1700000000.123,'
+        .. '"payload":{"event":{"message":{"chat":{"id":123456789}}}}}'
+
+    perf()
+    do
+        local log = evlog.open(path, 256)
+
+        for _ = 1, events_n do
+            log:append(event)
+        end
+
+        log:close()
+    end
+    perf("evlog append 1M, batch 256")
+
+    perf()
+    do
+        local n = 0
+
+        for _ in evlog.replay(path) do
+            n = n + 1
+        end
+
+        assert(n == events_n, "incorrect replay count")
+    end
+    perf("evlog replay 1M")
+
+    os.remove(path)
+end
@@ -0,0 +1,65 @@
+local fs = require "fs"
+local sleep = require "sleep"
+local async = require "async"
+local wait = async.wait
+
+local function write(path, data)
+    local file = assert(io.open(path, "wb"))
+    file:write(data)
+    file:close()
+end
+
+local function test_cache()
+    local dir = os.tmpname()
+    os.remove(dir)
+    assert(os.execute("mkdir -p " .. dir .. "/sub"))
+
+    write(dir .. "/index.html", "<p>one</p>")
+    write(dir .. "/big.js", string.rep("x", 100))
+    write(dir .. "/sub/app.css", "a {}")
+
+    local cache = fs.cache { dir = dir, max_bytes = 64 }
+
+    assert(cache:readfile("/index.html") == "<p>one</p>")
+    assert(cache:readfile("index.html") == "<p>one</p>")
+
+    local stat = cache:stat()
+    assert(stat.hits == 1 and stat.misses == 1, "hit after miss")
+    assert(stat.files == 1 and stat.bytes == 10)
+    assert(stat.watching)
+
+    -- over max_bytes and nested paths are read every time
+    assert(#cache:readfile("/big.js") == 100)
+    assert(cache:readfile("/sub/app.css") == "a {}")
+    assert(#cache:readfile("/big.js") == 100)
+    assert(cache:stat().files == 1)
+    assert(cache:stat().misses == 4)
+
+    write(dir .. "/index.html", "<p>two</p>")
+    wait(sleep(0.05)) -- inotify events are read on the loop
+
+    assert(cache:stat().invalidations == 1, "invalidated on write")
+    assert(cache:readfile("/index.html") == "<p>two</p>")
+
+    os.remove(dir .. "/index.html")
+    wait(sleep(0.05))
+
+    assert(not pcall(cache.readfile, cache, "/index.html"), "removed")
+
+    write(dir .. "/index.html", "<p>three</p>")
+    assert(cache:readfile("/index.html") == "<p>three</p>")
+
+    cache:close()
+    assert(not cache:stat().watching)
+    assert(cache:stat().files == 0)
+    assert(cache:readfile("/index.html") == "<p>three</p>")
+    assert(cache:stat().files == 0, "closed cache reads as is")
+
+    assert(not pcall(fs.cache, { dir = dir .. "/missing" }))
+
+    os.execute("rm -rf " .. dir)
+end
+
+return function()
+    test_cache()
+end
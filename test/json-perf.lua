@@ -43,11 +43,19 @@ return function()
     local cjson_encode = cjson.encode
     local cjson_decode = cjson.decode
 
+    local json_stringify_yyjson = json.stringify_yyjson
+
     perf()
         for _ = 1, reps do
             json_stringify(value)
         end
-    perf("stringify: yyjson")
+    perf("stringify: direct")
+
+    perf()
+        for _ = 1, reps do
+            json_stringify_yyjson(value)
+        end
+    perf("stringify: yyjson doc")
 
     perf()
         for _ = 1, reps do
@@ -55,6 +63,26 @@ return function()
         end
     perf("stringify: cjson")
 
+    local long = { text = string.rep("plain ascii text, no escapes. ", 400) }
+
+    perf()
+        for _ = 1, reps // 10 do
+            json_stringify(long)
+        end
+    perf("stringify long string: direct")
+
+    perf()
+        for _ = 1, reps // 10 do
+            json_stringify_yyjson(long)
+        end
+    perf("stringify long string: yyjson doc")
+
+    perf()
+        for _ = 1, reps // 10 do
+            cjson_encode(long)
+        end
+    perf("stringify long string: cjson")
+
     perf()
         for _ = 1, reps do
             json_parse(string)
@@ -66,4 +94,58 @@ return function()
             cjson_decode(string)
         end
     perf("parse: cjson")
+
+    -- a large payload where only one field is read
+    local big = '{"items":[' .. string.rep(test_json, 50, ",")
+        .. '],"chat":{"id":1}}'
+    local path = "chat.id"
+    local json_parse_lazy = json.parse_lazy
+    local json_get = json.get
+
+    reps = reps // 50
+
+    perf()
+        for _ = 1, reps do
+            local _ = json_parse(big).chat.id
+        end
+    perf("read one field: parse")
+
+    perf()
+        for _ = 1, reps do
+            local _ = json_parse_lazy(big).chat.id
+        end
+    perf("read one field: parse_lazy")
+
+    perf()
+        for _ = 1, reps do
+            json_get(big, path)
+        end
+    perf("read one field: get")
+
+    -- a large array received in socket sized chunks
+    local chunk_len = 16 * 1024
+    local items = '[' .. string.rep(test_json, 50, ",") .. ']'
+    local chunks = {}
+
+    for i = 1, #items, chunk_len do
+        table.insert(chunks, items:sub(i, i + chunk_len - 1))
+    end
+
+    perf()
+        for _ = 1, reps do
+            local _ = json_parse(table.concat(chunks))
+        end
+    perf("chunked array: concat and parse")
+
+    perf()
+        for _ = 1, reps do
+            local parser = json.parser("array")
+
+            for _, chunk in ipairs(chunks) do
+                parser:feed(chunk)
+            end
+
+            parser:finish()
+        end
+    perf("chunked array: parser")
 end
@@ -207,7 +207,193 @@ local bad_json = {
     "123.0456E0789",
 }
 
+local lazy_json = [=[
+{"payload":{"event":{"message":{"chat":{"id":42},"text":"hi"}},"n":null},
+"list":[1,"two",{"three":3},[4]],"empty":{}}
+]=]
+
+local function test_lazy()
+    local doc = json.parse_lazy(lazy_json)
+    local payload = doc.payload
+
+    assert(type(doc) == "userdata", "root is not lazy")
+    assert(payload.event.message.chat.id == 42, "bad nested index")
+    assert(payload.n == nil and doc.nope == nil and doc[1] == nil, "bad miss")
+    assert(#doc.list == 4 and #doc == 0, "bad len")
+    assert(doc.list[2] == "two" and doc.list[3].three == 3, "bad arr index")
+    assert(doc.list[0] == nil and doc.list[5] == nil, "bad arr bounds")
+    assert(not pcall(function() doc.x = 1 end), "lazy is not read only")
+
+    local keys, items = {}, {}
+
+    for key in pairs(doc) do
+        table.insert(keys, key)
+    end
+
+    for i, value in ipairs(doc.list) do
+        items[i] = value
+    end
+
+    assert(equal(keys, { "payload", "list", "empty" }), "bad obj pairs")
+    assert(#items == 4 and items[4][1] == 4, "bad arr pairs")
+
+    doc, payload = nil, doc.payload -- proxies keep the doc alive
+    collectgarbage()
+    assert(payload.event.message.text == "hi", "doc freed too early")
+
+    assert(json.get(lazy_json, "payload.event.*.chat.id") == 42, "bad get")
+    assert(json.get(lazy_json, "list.3.three") == 3, "bad get index")
+    assert(json.get(lazy_json, "list.*.three") == 3, "bad get arr *")
+    assert(json.get(lazy_json, "payload.*.nope") == nil, "bad get miss")
+    assert(equal(json.get(lazy_json, "list.4"), { 4 }), "get not a table")
+    assert(json.get(payload, "event.message.chat.id") == 42, "bad lazy get")
+    assert(type(json.get(payload, "event")) == "userdata", "get not lazy")
+    assert(select("#", json.get(payload, "nope")) == 1
+        and select("#", json.get(lazy_json, "nope")) == 1,
+        "get miss is not nil")
+
+    assert(equal(json.materialize(payload), json.parse(lazy_json).payload),
+        "bad materialize")
+    assert(equal(json.parse(json.stringify(payload)),
+        json.materialize(payload)), "bad lazy stringify")
+    assert(json.parse_lazy("1") == 1, "bad scalar root")
+    assert(not pcall(json.parse_lazy, "{"), "failed to fail parse_lazy")
+end
+
+-- stringify writes directly, stringify_yyjson builds a yyjson doc;
+-- strings must be escaped byte for byte the same
+local function test_encoders()
+    local chars = { "a", "\"", "\\", "\n", "\x01", "\x7f", "/", " ",
+        utf8.char(0xe9), utf8.char(0x2705), utf8.char(0x1f600) }
+
+    math.randomseed(42)
+
+    for _ = 1, 2000 do
+        local parts = {}
+
+        for i = 1, math.random(0, 40) do
+            parts[i] = chars[math.random(#chars)]
+        end
+
+        local str = table.concat(parts)
+        local value = { str, { [str] = math.random(-1000, 1000) } }
+
+        assert(json.stringify(value) == json.stringify_yyjson(value),
+            "encoders differ")
+    end
+
+    for _ = 1, 2000 do
+        local num = (math.random() - 0.5) * 10 ^ math.random(-30, 30)
+        assert(json.parse(json.stringify(num)) == num, "bad real read back")
+    end
+
+    assert(not pcall(json.stringify, "\xff"), "invalid utf-8 not checked")
+    assert(not pcall(json.stringify, 0/0), "nan not checked")
+end
+
+local function test_table_kind()
+    local hashed = {} -- integer keys in the hash part
+    hashed[3], hashed[2], hashed[1] = "c", "b", "a"
+
+    local shared = { 1 }
+    local array_mt = { __jsontype = "array" }
+
+    for _, stringify in ipairs({ json.stringify, json.stringify_yyjson }) do
+        assert(stringify(hashed) == '["a","b","c"]', "hash part array")
+        assert(stringify({ shared, shared }) == "[[1],[1]]",
+            "shared table is not a cycle")
+        assert(stringify(setmetatable({}, array_mt)) == "[]", "array hint")
+        assert(stringify(setmetatable({ 1, nil, 3 }, array_mt))
+            == "[1,null,3]", "array hint with holes")
+        assert(not pcall(stringify, { 1, 2, x = 3 }), "mixed is not a map")
+    end
+end
+
+local function feed_chunks(parser, stream, chunk_len)
+    local values = {}
+
+    for i = 1, #stream, chunk_len do
+        local chunk_values, n = parser:feed(stream:sub(i, i + chunk_len - 1))
+
+        for j = 1, n do
+            table.insert(values, chunk_values[j])
+        end
+    end
+
+    local last_values, n = parser:finish()
+
+    for j = 1, n do
+        table.insert(values, last_values[j])
+    end
+
+    return values
+end
+
+local function test_parser()
+    local items = {
+        '{"a":"x]}\\"y","b":[1,{"c":[]}]}',
+        '"str\\\"ing"',
+        "-12.5e3",
+        "true",
+        '[{"d":"}"}]',
+        "7",
+    }
+
+    local ndjson = table.concat(items, "\n") -- no newline after the last
+    local array = " [ " .. table.concat(items, " ,\n") .. " ] \n"
+    local need = {}
+
+    for i, item in ipairs(items) do
+        need[i] = json.parse(item)
+    end
+
+    for chunk_len = 1, #array do
+        assert(equal(feed_chunks(json.parser(), ndjson, chunk_len), need),
+            "values mode failed on chunk len " .. chunk_len)
+        assert(equal(feed_chunks(json.parser("array"), array, chunk_len), need),
+            "array mode failed on chunk len " .. chunk_len)
+    end
+
+    local parser = json.parser("array")
+    local values, n = parser:feed('[1, null, 3')
+    assert(n == 2 and values[1] == 1 and values[2] == nil, "null not counted")
+    values, n = parser:feed("]")
+    assert(n == 1 and values[1] == 3, "last array value lost")
+    assert(select(2, parser:finish()) == 0, "values after the array")
+    assert(select(2, parser:feed("[]")) == 0, "parser is not reset")
+    assert(select(2, parser:finish()) == 0, "empty array failed")
+
+    local broken = {
+        { "values", "1,2" },
+        { "values", '{"a":1' },
+        { "values", "tru" },
+        { "array", '{"a":1}' },
+        { "array", "[1 2]" },
+        { "array", "[1,]" },
+        { "array", "[1] 2" },
+        { "array", "[1" },
+    }
+
+    for _, pair in ipairs(broken) do
+        parser = json.parser(pair[1])
+        local ok = pcall(function()
+            parser:feed(pair[2])
+            parser:finish()
+        end)
+
+        assert(not ok, "broken stream parsed: " .. pair[2])
+        assert(not pcall(parser.feed, parser, "1"), "broken parser is fed")
+    end
+
+    assert(not pcall(json.parser, "lines"), "mode not checked")
+end
+
 return function()
+    test_lazy()
+    test_encoders()
+    test_table_kind()
+    test_parser()
+
     for _, pair in ipairs(samples) do
         local value, string = pair[1], pair[2]
 
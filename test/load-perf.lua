@@ -0,0 +1,93 @@
+local perf = require "test.perf"
+local redis = require "redis"
+local async = require "async"
+local wait = async.wait
+
+-- dc startup: world.load_objects over 1M object hashes
+local objects_n = 1000000
+local prefix = "test:perf:o:"
+local window = 4096 -- queries in flight while seeding
+
+local function run_window(rc, make_query)
+    local reqs = {}
+
+    for from = 1, objects_n, window do
+        local to = math.min(from + window - 1, objects_n)
+
+        for i = from, to do
+            reqs[i - from + 1] = rc:query(make_query(i))
+        end
+
+        for i = 1, to - from + 1 do
+            wait(reqs[i])
+            reqs[i] = nil
+        end
+    end
+end
+
+local function keys_hgetall(rc)
+    local keys = wait(rc:query("keys " .. prefix .. "*\r\n"))
+    local prefix_sub = 1 + #prefix
+    local entities = {}
+
+    for _, key in ipairs(keys) do
+        entities[key:sub(prefix_sub)] = rc:query("hgetall " .. key .. "\r\n")
+    end
+
+    for id, query in pairs(entities) do
+        entities[id] = wait(query)
+    end
+
+    return entities
+end
+
+local function count(entities)
+    local n = 0
+
+    for _ in pairs(entities) do
+        n = n + 1
+    end
+
+    return n
+end
+
+return function()
+    local rc = redis.client {
+        ip4 = "172.20.0.3",
+        port = 30303,
+    }
+
+    wait(rc:connect())
+    wait(rc:hello {
+        protocol_version = 3,
+        username = "default",
+        password = "LocalPassword123",
+        client_name = "test-load-perf",
+    })
+
+    perf()
+        run_window(rc, function(i)
+            return ("hset %s%d class c:%d name obj%d\r\n")
+                :format(prefix, i, i % 100, i)
+        end)
+    perf("load seed " .. objects_n)
+
+    perf()
+        assert(count(keys_hgetall(rc)) == objects_n, "incorrect keys count")
+    perf("load keys + hgetall")
+
+    for _, batch in ipairs { 64, 512, 4096 } do
+        perf()
+            assert(count(wait(rc:load_hashes(prefix, batch))) == objects_n,
+                "incorrect load_hashes count")
+        perf("load_hashes batch " .. batch)
+    end
+
+    perf()
+        run_window(rc, function(i)
+            return ("del %s%d\r\n"):format(prefix, i)
+        end)
+    perf("load cleanup")
+
+    rc:close()
+end
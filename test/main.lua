@@ -1,6 +1,6 @@
 warn "@on"
 
-package.path = "/furiend/src/lua-lib/?.lua;/furiend/?.lua"
+package.path = "/furiend/src/lua-lib/?.lua;/furiend/src/dc/?.lua;/furiend/?.lua"
 package.cpath = "/furiend/src/lua-clib/?/?.so"
 
 local async = require "async"
@@ -9,12 +9,35 @@ local loop = async.loop
 loop(function()
     require "test.url" ()
     require "test.sha2" ()
+    require "test.fs" ()
     require "test.equal" ()
+    require "test.tensor" ()
+    require "test.snapshot" ()
+    require "test.evlog" ()
+    require "test.object-index" ()
+    require "test.mutator-index" ()
+    require "test.columns" ()
     require "test.json" ()
+    require "test.msgpack" ()
+    require "test.compress" ()
+    require "test.offload" ()
     require "test.sleep" ()
+    require "test.signal" ()
     require "test.resp" ()
     require "test.redis" ()
+    require "test.redis-pool" ()
+    require "test.world" ()
     require "test.dns" ()
     require "test.http" ()
     require "test.json-perf" ()
+    require "test.msgpack-perf" ()
+    require "test.sha2-perf" ()
+    require "test.offload-perf" ()
+
+    if os.getenv("FURIEND_LOAD_PERF") then -- seeds 1M hashes, minutes
+        require "test.load-perf" ()
+    end
+
+    require "test.mutators-perf" ()
+    require "test.validate-perf" ()
 end)
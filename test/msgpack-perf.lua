@@ -0,0 +1,70 @@
+local perf = require "test.perf"
+local json = require "json"
+local msgpack = require "msgpack"
+
+-- what fe2 publishes to dc for a telegram message
+local event = {
+    type = "tg",
+    from = "fe2",
+    payload = {
+        update_id = 902173440,
+        message = {
+            message_id = 5121,
+            date = 1717171717,
+            text = "/start hello, это тест",
+            from = {
+                id = 123456789,
+                is_bot = false,
+                first_name = "Name",
+                username = "username",
+                language_code = "en",
+            },
+            chat = {
+                id = 123456789,
+                type = "private",
+                first_name = "Name",
+                username = "username",
+            },
+            entities = {
+                { offset = 0, length = 6, type = "bot_command" },
+            },
+        },
+    },
+}
+
+return function()
+    local reps = 250000
+    local json_stringify = json.stringify
+    local json_parse = json.parse
+    local msgpack_pack = msgpack.pack
+    local msgpack_unpack = msgpack.unpack
+
+    local json_event = json_stringify(event)
+    local msgpack_event = msgpack_pack(event)
+
+    print("event size: json", #json_event, "msgpack", #msgpack_event)
+
+    perf()
+        for _ = 1, reps do
+            json_stringify(event)
+        end
+    perf("event encode: json")
+
+    perf()
+        for _ = 1, reps do
+            msgpack_pack(event)
+        end
+    perf("event encode: msgpack")
+
+    perf()
+        for _ = 1, reps do
+            json_parse(json_event)
+        end
+    perf("event decode: json")
+
+    perf()
+        for _ = 1, reps do
+            msgpack_unpack(msgpack_event)
+        end
+    perf("event decode: msgpack")
+end
@@ -0,0 +1,87 @@
+local msgpack = require "msgpack"
+local equal = require "equal"
+
+local samples = {
+    { nil, "\xc0" },
+    { true, "\xc3" },
+    { false, "\xc2" },
+    { 0, "\x00" },
+    { 127, "\x7f" },
+    { 128, "\xcc\x80" },
+    { 65535, "\xcd\xff\xff" },
+    { 65536, "\xce\x00\x01\x00\x00" },
+    { 4294967296, "\xcf\x00\x00\x00\x01\x00\x00\x00\x00" },
+    { -1, "\xff" },
+    { -32, "\xe0" },
+    { -33, "\xd0\xdf" },
+    { -129, "\xd1\xff\x7f" },
+    { math.mininteger, "\xd3\x80\x00\x00\x00\x00\x00\x00\x00" },
+    { 1.0, "\xcb\x3f\xf0\x00\x00\x00\x00\x00\x00" },
+    { -0.5, "\xcb\xbf\xe0\x00\x00\x00\x00\x00\x00" },
+    { "", "\xa0" },
+    { "abc", "\xa3abc" },
+    { string.rep("x", 32), "\xd9\x20" .. string.rep("x", 32) },
+    { string.rep("x", 256), "\xda\x01\x00" .. string.rep("x", 256) },
+    { {}, "\x80" },
+    { { 1, "a", false }, "\x93\x01\xa1a\xc2" },
+    { { a = { 1.5 } }, "\x81\xa1a\x91\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00" },
+}
+
+return function()
+    for _, pair in ipairs(samples) do
+        local value, packed = pair[1], pair[2]
+
+        assert(msgpack.pack(value) == packed, "bad pack")
+
+        local unpacked, pos = msgpack.unpack(packed)
+        assert(equal(unpacked, value), "bad unpack")
+        assert(math.type(unpacked) == math.type(value), "number subtype lost")
+        assert(pos == #packed + 1, "bad next pos")
+    end
+
+    local event = {
+        type = "tg",
+        from = "fe2",
+        payload = {
+            update_id = 42,
+            message = { text = "hi \0 там", entities = { { offset = 0 } } },
+        },
+    }
+
+    assert(equal(msgpack.unpack(msgpack.pack(event)), event), "event mismatch")
+
+    local array = {}
+
+    for i = 1, 70000 do
+        array[i] = i % 3 == 0 and -i or i * 0.5
+    end
+
+    assert(equal(msgpack.unpack(msgpack.pack(array)), array), "array32 failed")
+
+    local stream = msgpack.pack(1) .. msgpack.pack("two") .. msgpack.pack({})
+    local one, pos = msgpack.unpack(stream)
+    local two, pos2 = msgpack.unpack(stream, pos)
+    local three, pos3 = msgpack.unpack(stream, pos2)
+    assert(one == 1 and two == "two" and next(three) == nil
+        and pos3 == #stream + 1, "stream read failed")
+
+    -- other encoders: floats as float32, strings as bin, int keys
+    assert(msgpack.unpack("\xca\x3f\xc0\x00\x00") == 1.5, "float32 failed")
+    assert(msgpack.unpack("\xc4\x02\x00\xff") == "\x00\xff", "bin8 failed")
+    assert(msgpack.unpack("\xcf\xff\xff\xff\xff\xff\xff\xff\xff")
+        == 2.0 ^ 64, "uint64 over maxinteger failed")
+    assert(msgpack.unpack("\x81\x01\xa1x")[1] == "x", "int key failed")
+
+    local circular = {}
+    circular.self = circular
+
+    assert(not pcall(msgpack.pack, circular), "cycle not detected")
+    assert(not pcall(msgpack.pack, { [true] = 1 }), "bool key packed")
+    assert(not pcall(msgpack.unpack, "\xa3ab"), "truncated string read")
+    assert(not pcall(msgpack.unpack, "\xdd\xff\xff\xff\xff"), "huge array")
+    assert(not pcall(msgpack.unpack, "\xd4\x01\x00"), "ext type read")
+    assert(not pcall(msgpack.unpack, ""), "empty data read")
+    assert(not pcall(msgpack.unpack, "\xc0", 1, 2), "extra arg ignored")
+    assert(not pcall(msgpack.unpack, string.rep("\x91", 300) .. "\xc0"),
+        "depth not checked")
+end
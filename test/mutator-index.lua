@@ -0,0 +1,114 @@
+local tensor = require "tensor"
+local to_set = require "to_set"
+local ops = require "lib.world.ops"
+local mutator_index = require "lib.world.mutator_index"
+
+local nan = 0 / 0
+local paths = { "a", "b.c" }
+local range_ops = { "gt", "gte", "lt", "lte" }
+local numbers = { 1, 2, 3, 1.0, 2.5, nan }
+
+local values = { 1, 2, 1.0, 2.5, nan, "x", "y", true,
+    { k = 1 }, { k = 1 }, { k = 2 } } -- deep equal, not identical
+
+local function pick(list)
+    return list[math.random(#list)]
+end
+
+-- what mutate_any did before the index
+local function linear(mutators, obj)
+    for _, mut in ipairs(mutators) do
+        local ok = true
+
+        for _, ifx in ipairs(mut.ifs) do
+            if not ops[ifx.op](tensor.unwrap(obj, ifx.path), ifx.values) then
+                ok = false
+                break
+            end
+        end
+
+        if ok then
+            return mut
+        end
+    end
+end
+
+local function random_if()
+    local path = pick(paths)
+    local kind = math.random(4)
+
+    if kind == 1 then
+        return { path = path, op = pick(range_ops),
+            values = { pick(numbers), pick(numbers) } }
+    elseif kind == 2 then
+        local set = {}
+
+        for _ = 1, math.random(3) do
+            local value = pick(values)
+
+            if value == value then -- NaN is not a key
+                table.insert(set, value)
+            end
+        end
+
+        return { path = path, op = "in", values = to_set(set) }
+    end
+
+    local list = { pick(values) }
+
+    if math.random(2) == 1 then
+        table.insert(list, pick(values))
+    end
+
+    return { path = path, op = kind == 3 and "eq" or "neq", values = list }
+end
+
+local function random_object()
+    return { a = pick(values), b = { c = pick(values) } }
+end
+
+local function check(mutators, objects)
+    local index = mutator_index.build(mutators)
+
+    for _, obj in ipairs(objects) do
+        assert(mutator_index.match(index, obj) == linear(mutators, obj),
+            "index and linear mismatch")
+    end
+end
+
+return function()
+    do
+        local gt = { id = 1, ifs = { { path = "a", op = "gt", values = { 1 } } } }
+        local eq = { id = 2, ifs = {
+            { path = "a", op = "eq", values = { { k = 1 }, { k = 1 } } },
+        } }
+
+        check({ gt }, { { a = nan } }) -- NaN passes range ops
+        check({ eq }, { { a = { k = 1 } }, { a = { k = 2 } } })
+
+        assert(mutator_index.match(mutator_index.build({ eq }),
+            { a = { k = 1 } }) == eq, "deep equal eq is never matched")
+    end
+
+    math.randomseed(1)
+
+    for _ = 1, 50 do
+        local mutators, objects = {}, {}
+
+        for i = 1, 40 do
+            local ifs = {}
+
+            for j = 1, math.random(0, 3) do
+                ifs[j] = random_if()
+            end
+
+            mutators[i] = { id = i, ifs = ifs }
+        end
+
+        for i = 1, 100 do
+            objects[i] = random_object()
+        end
+
+        check(mutators, objects)
+    end
+end
@@ -0,0 +1,139 @@
+local perf = require "test.perf"
+local tensor = require "tensor"
+local to_set = require "to_set"
+local ops = require "lib.world.ops"
+local mutator_index = require "lib.world.mutator_index"
+
+-- dc event routing: one class with many mutators, first match wins
+local mutators_n = 5000
+local objects_n = 2000
+local kinds_n = 1000
+local sources = { "web", "mobile", "bot", "api" }
+
+local function make_mutators()
+    local mutators = {}
+
+    for i = 1, mutators_n do
+        local ifs = {
+            { path = "kind", op = "eq", values = { "k" .. (i % kinds_n) } },
+            {
+                path = "meta.source",
+                op = "in",
+                values = to_set { sources[i % 4 + 1], sources[(i + 1) % 4 + 1] },
+            },
+        }
+
+        if i % 3 == 0 then
+            table.insert(ifs, {
+                path = "payload.n",
+                op = "gte",
+                values = { i % 100 },
+            })
+        end
+
+        if i % 7 == 0 then
+            table.insert(ifs, {
+                path = "payload.n",
+                op = "lt",
+                values = { 50 + i % 50 },
+            })
+        end
+
+        if i % 11 == 0 then
+            table.insert(ifs, {
+                path = "meta.source",
+                op = "neq",
+                values = { "bot" },
+            })
+        end
+
+        mutators[i] = { id = i, ifs = ifs }
+    end
+
+    return mutators
+end
+
+local function make_objects()
+    local objects = {}
+
+    for i = 1, objects_n do
+        objects[i] = {
+            kind = "k" .. (i * 7 % (kinds_n + 100)), -- some kinds unmatched
+            meta = { source = sources[i % 4 + 1] },
+            payload = { n = i % 100 },
+        }
+    end
+
+    return objects
+end
+
+-- what mutate_any did before the index
+local function linear(mutators, obj)
+    for _, mut in ipairs(mutators) do
+        local ok = true
+
+        for _, ifx in ipairs(mut.ifs) do
+            local from = tensor.unwrap(obj, ifx.path)
+
+            if not ops[ifx.op](from, ifx.values) then
+                ok = false
+                break
+            end
+        end
+
+        if ok then
+            return mut
+        end
+    end
+end
+
+return function()
+    local mutators = make_mutators()
+    local objects = make_objects()
+
+    perf()
+        local index = mutator_index.build(mutators)
+    perf("mutators index build " .. mutators_n)
+
+    local linear_found = {}
+    local matched_n = 0
+
+    perf()
+        for i, obj in ipairs(objects) do
+            linear_found[i] = linear(mutators, obj) or false
+        end
+    perf("mutators linear " .. objects_n)
+
+    perf()
+        for i, obj in ipairs(objects) do
+            local mut = mutator_index.match(index, obj) or false
+
+            assert(mut == linear_found[i], "index and linear mismatch")
+
+            if mut then
+                matched_n = matched_n + 1
+            end
+        end
+    perf("mutators index " .. objects_n)
+
+    assert(matched_n > 0 and matched_n < objects_n, "bad matched count")
+
+    local path = "meta.*.source"
+    local path_c = tensor.compile(path)
+    local obj = { meta = { { kind = "k1" }, { source = "web" } } }
+
+    assert(tensor.unwrap(obj, path_c) == tensor.unwrap(obj, path),
+        "compiled unwrap mismatch")
+
+    perf()
+        for _ = 1, 1000000 do
+            tensor.unwrap(obj, path)
+        end
+    perf("unwrap string 1M")
+
+    perf()
+        for _ = 1, 1000000 do
+            tensor.unwrap(obj, path_c)
+        end
+    perf("unwrap compiled 1M")
+end
@@ -0,0 +1,128 @@
+local perf = require "test.perf"
+local object_index = require "lib.world.object_index"
+
+local function ids(objects)
+    local list = {}
+
+    for i, obj in ipairs(objects) do
+        list[i] = obj.id
+    end
+
+    table.sort(list)
+    return table.concat(list, ",")
+end
+
+-- objects_n users, with hash, ordered and plain keys
+local function make_objects(objects_n)
+    local user = {
+        id = "user",
+        name = { type = "str" },
+        city = { type = "str", index = "hash" },
+        age = { type = "int", index = "ordered" },
+    }
+
+    local item = { id = "item", name = { type = "str" } }
+    local objects = {}
+
+    for i = 1, objects_n do
+        local id = "u" .. i
+
+        objects[id] = {
+            id = id,
+            class = user,
+            name = "user" .. i,
+            city = "c" .. (i % 100),
+            age = i % 90,
+        }
+    end
+
+    objects.i1 = { id = "i1", class = item, name = "sword" }
+
+    return objects, user
+end
+
+return function()
+    do
+        local objects = make_objects(10)
+        local index = object_index(objects)
+        local u1, u2 = objects.u1, objects.u2
+
+        assert(index:count("user") == 10 and index:count("item") == 1,
+            "incorrect counts")
+        assert(index.objects_n == 11, "incorrect objects count")
+
+        assert(ids(index:query("user", {
+            { path = "city", op = "eq", values = { "c1" } },
+        })) == "u1", "hash eq failed")
+
+        assert(ids(index:query("user", {
+            { path = "city", op = "in", values = { "c1", "c2", "nope" } },
+        })) == "u1,u2", "hash in failed")
+
+        assert(ids(index:query("user", {
+            { path = "age", op = "gte", values = { 8 } },
+        })) == "u10,u8,u9", "ordered gte failed")
+
+        assert(ids(index:query("user", {
+            { path = "age", op = "lt", values = { 3 } },
+            { path = "name", op = "neq", values = { "user1" } },
+        })) == "u2", "ordered lt + scan filter failed")
+
+        assert(ids(index:query("user", {
+            { path = "name", op = "eq", values = { "user3" } },
+        })) == "u3", "class scan failed")
+
+        assert(#index:query("user") == 10, "no filters failed")
+        assert(#index:query("nope", {}) == 0, "unknown class failed")
+
+        u1.age = 50
+        u1.city = "c2"
+        index:update(u1, { "age" }) -- city is stale until updated
+
+        assert(ids(index:query("user", {
+            { path = "age", op = "eq", values = { 50 } },
+        })) == "u1", "ordered update failed")
+
+        index:update(u1)
+
+        assert(ids(index:query("user", {
+            { path = "city", op = "eq", values = { "c2" } },
+        })) == "u1,u2", "hash update failed")
+
+        index:remove(u2)
+
+        assert(index:count("user") == 9, "remove count failed")
+        assert(ids(index:query("user", {
+            { path = "city", op = "eq", values = { "c2" } },
+        })) == "u1", "hash remove failed")
+    end
+
+    perf()
+    local objects_n = 100000
+    local objects = make_objects(objects_n)
+    local index = object_index(objects)
+    perf("object index build " .. objects_n)
+
+    local filters = {
+        { path = "city", op = "eq", values = { "c7" } },
+        { path = "age", op = "gt", values = { 80 } },
+    }
+
+    local scanned
+
+    perf()
+        for _ = 1, 10 do
+            index.fields = {} -- no indexes: class scan
+            scanned = index:query("user", filters)
+        end
+    perf("object query scan x10")
+
+    index = object_index(objects)
+
+    perf()
+        for _ = 1, 10 do
+            assert(ids(index:query("user", filters)) == ids(scanned),
+                "index and scan mismatch")
+        end
+    perf("object query index x10")
+end
@@ -0,0 +1,101 @@
+local fs = require "fs"
+local sha2 = require "sha2"
+local json = require "json"
+local time = require "time"
+local sleep = require "sleep"
+local async = require "async"
+local wait = async.wait
+
+local TICK = 0.001 -- loop latency probe period, s
+
+local function percentile(sorted, p)
+    return sorted[math.max(1, math.ceil(#sorted * p))]
+end
+
+-- how late a probe sleep wakes up while work runs
+local function probe(state)
+    local late = {}
+
+    while not state.done do
+        local ts1 = time()
+        wait(sleep(TICK))
+        table.insert(late, (time() - ts1 - TICK) * 1000)
+    end
+
+    table.sort(late)
+    return late
+end
+
+local function report(label, late, work_sec)
+    print(string.format(
+        "loop lateness %s: p50 %.2fms p99 %.2fms max %.2fms; work %.3fs",
+        label,
+        percentile(late, 0.5),
+        percentile(late, 0.99),
+        late[#late],
+        work_sec))
+end
+
+local function run(label, work)
+    local state = { done = false }
+    local prober = coroutine.create(probe)
+    assert(coroutine.resume(prober, state))
+
+    local ts1 = time()
+    work()
+    local work_sec = time() - ts1
+
+    state.done = true
+    report(label, wait(prober), work_sec)
+end
+
+return function()
+    local reps = 10
+    local data = string.rep("0123456789abcdef", 256 * 1024) -- 4 MiB
+    local path = os.tmpname()
+
+    local file = assert(io.open(path, "wb"))
+    file:write(data)
+    file:close()
+
+    local rows = {}
+
+    for i = 1, 20000 do
+        rows[i] = { id = i, name = "row " .. i, tags = { "a", "b" } }
+    end
+
+    local body = json.stringify(rows)
+
+    print("offload load: sha512 and readfile of 4 MiB, json of "
+        .. #body .. " bytes")
+
+    run("idle", function()
+        wait(sleep(0.1))
+    end)
+
+    local jobs = {
+        { "sha512", sha2.sha512, sha2.sha512_offload, data },
+        { "readfile", fs.readfile, fs.readfile_offload, path },
+        { "json.parse", json.parse, json.parse_offload, body },
+    }
+
+    for _, job in ipairs(jobs) do
+        local name, inline, offload, arg = table.unpack(job)
+
+        run(name .. " inline", function()
+            for _ = 1, reps do
+                inline(arg)
+                wait(sleep(TICK)) -- let the probe run between jobs
+            end
+        end)
+
+        run(name .. " offload", function()
+            for _ = 1, reps do
+                wait(offload(arg))
+                wait(sleep(TICK))
+            end
+        end)
+    end
+
+    os.remove(path)
+end
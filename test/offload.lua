@@ -0,0 +1,57 @@
+local fs = require "fs"
+local sha2 = require "sha2"
+local json = require "json"
+local equal = require "equal"
+local async = require "async"
+local wait, pwait = async.wait, async.pwait
+
+local function test_jobs()
+    local path = os.tmpname()
+    local data = string.rep("offload ", 100000)
+    local file = assert(io.open(path, "wb"))
+    file:write(data)
+    file:close()
+
+    assert(wait(fs.readfile_offload(path)) == data)
+    assert(wait(fs.readfile_offload(path)) == fs.readfile(path))
+
+    assert(wait(sha2.sha256_offload(data)) == sha2.sha256(data))
+    assert(wait(sha2.sha512_offload(data)) == sha2.sha512(data))
+    assert(wait(sha2.sha256_offload("")) == sha2.sha256(""))
+
+    local value = { a = { 1, 2, 3 }, b = "text", c = { d = true } }
+    local body = json.stringify(value)
+    assert(equal(wait(json.parse_offload(body)), value))
+
+    -- errors are raised by wait
+    assert(not pwait(fs.readfile_offload(path .. ".missing")))
+    assert(not pwait(fs.readfile_offload("/tmp")), "not a regular file")
+    assert(not pwait(json.parse_offload("{ broken")))
+
+    os.remove(path)
+end
+
+local function test_concurrent()
+    local inputs, threads = {}, {}
+
+    for i = 1, 32 do
+        inputs[i] = string.rep(tostring(i), 10000 + i)
+        threads[i] = sha2.sha256_offload(inputs[i])
+    end
+
+    for i = 1, 32 do
+        assert(wait(threads[i]) == sha2.sha256(inputs[i]), i)
+    end
+
+    local stat = async.offload_stat()
+    assert(stat.threads > 0)
+    assert(stat.queued == 0 and stat.running == 0)
+    assert(stat.submitted == stat.completed)
+
+    assert(not pcall(async.offload, { threads = 2 }), "started once")
+end
+
+return function()
+    test_jobs()
+    test_concurrent()
+end
@@ -0,0 +1,116 @@
+local perf = require "test.perf"
+local redis = require "redis"
+local async = require "async"
+local sleep = require "sleep"
+local wait = async.wait
+
+return function()
+    local pool = redis.pool {
+        size = 3,
+        ip4 = "172.20.0.3",
+        port = 30303,
+        username = "default",
+        password = "LocalPassword123",
+        client_name = "test-pool",
+        tracking = { bcast = true, prefixes = { "test:pool:" } },
+    }
+
+    perf()
+        wait(pool:connect())
+    perf("redis pool connect")
+
+    perf()
+    do
+        local reqs = {}
+
+        for i = 1, 9 do
+            reqs[i] = pool:query("ping\r\n")
+        end
+
+        for _, req in ipairs(reqs) do
+            assert(wait(req) == "PONG", "incorrect round-robin answer")
+        end
+    end
+    perf("redis pool round-robin")
+
+    perf()
+    do
+        for i = 1, 16 do
+            local key = "test:pool:" .. i
+            wait(pool:query("set " .. key .. " " .. i .. "\r\n", key))
+            assert(wait(pool:query("get " .. key .. "\r\n", key)) == tostring(i),
+                "incorrect keyed answer")
+        end
+    end
+    perf("redis pool keyed")
+
+    perf()
+    do
+        local key = "test:pool:hash"
+        wait(pool:query("hset " .. key .. " a 1\r\n", key))
+
+        for _ = 1, 3 do
+            assert(wait(pool:cached("hgetall", key)).a == "1", "cached failed")
+        end
+
+        wait(pool:query("hset " .. key .. " a 2\r\n", key))
+        wait(pool:query("ping\r\n", key))
+        assert(wait(pool:cached("hgetall", key)).a == "2", "stale cache")
+
+        local stat = pool:cache_stat()
+        assert(stat.hits == 2 and stat.misses == 2, "incorrect cache stat")
+    end
+    perf("redis pool cache")
+
+    perf()
+    do
+        local prefix = "test:pool:load:"
+
+        for i = 1, 3 do
+            local key = prefix .. i
+            wait(pool:query("hset " .. key .. " n " .. i .. "\r\n", key))
+        end
+
+        local before = pool:cache_stat()
+
+        for _ = 1, 3 do -- same member every time, so loads after first hit
+            local loaded = wait(pool:load_hashes(prefix))
+            assert(loaded["2"].n == "2", "load failed")
+        end
+
+        local stat = pool:cache_stat()
+        assert(stat.misses - before.misses == 3
+            and stat.hits - before.hits == 6, "load is not pinned")
+
+        for i = 1, 3 do
+            local key = prefix .. i
+            wait(pool:query("del " .. key .. "\r\n", key))
+        end
+    end
+    perf("redis pool load cache")
+
+    perf()
+    do
+        local got
+        wait(pool:subscribe("test:pool:ch", function(payload)
+            got = payload
+        end))
+        wait(pool:publish("test:pool:ch", "hello"))
+        wait(sleep(0.05))
+        assert(got == "hello", "push not received")
+        wait(pool:unsubscribe("test:pool:ch"))
+    end
+    perf("redis pool pub/sub")
+
+    perf()
+    do -- member drops connection, next keyed query reconnects it
+        local key = "test:pool:1"
+        pcall(wait, pool:query("quit\r\n", key))
+        wait(sleep(0.05))
+        assert(wait(pool:query("get " .. key .. "\r\n", key)) == "1",
+            "reconnect failed")
+    end
+    perf("redis pool reconnect")
+
+    pool:close()
+end
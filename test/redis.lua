@@ -2,6 +2,8 @@ local perf = require "test.perf"
 local trace = require "trace"
 local redis = require "redis"
 local async = require "async"
+local sleep = require "sleep"
+local stream_consumer = require "stream_consumer"
 local wait, pwait = async.wait, async.pwait
 
 return function()
@@ -124,5 +126,261 @@ return function()
     end
     perf("redis big packet")
 
+    perf()
+    do
+        wait(client:tracking {})
+        wait(client:query("set test:cached 1\r\n"))
+
+        assert(wait(client:cached("get", "test:cached")) == "1", "miss failed")
+        assert(wait(client:cached("get", "test:cached")) == "1", "hit failed")
+
+        wait(client:query("set test:cached 2\r\n"))
+        wait(client:ping()) -- invalidate push comes before pong
+
+        assert(wait(client:cached("get", "test:cached")) == "2",
+            "invalidation failed")
+
+        local stat = client:cache_stat()
+        trace(stat)
+        assert(stat.hits == 1 and stat.misses == 2, "incorrect cache stat")
+        assert(stat.invalidations == 1 and stat.entries == 1,
+            "incorrect cache stat")
+    end
+    perf("redis cache")
+
+    perf()
+    do
+        local config = {
+            ip4 = "172.20.0.3",
+            port = 30303,
+            password = "LocalPassword123",
+            cache = { max_entries = 2 },
+        }
+
+        local rc = redis.client(config)
+        wait(rc:connect())
+        wait(rc:hello(config))
+        wait(rc:tracking {})
+
+        for i = 1, 3 do
+            wait(rc:query("set test:lru:" .. i .. " " .. i .. "\r\n"))
+        end
+
+        wait(rc:cached("get", "test:lru:1"))
+        wait(rc:cached("get", "test:lru:2"))
+        wait(rc:cached("get", "test:lru:1")) -- 2 is least recently used now
+        wait(rc:cached("get", "test:lru:3"))
+
+        local stat = rc:cache_stat()
+        trace(stat)
+        assert(stat.entries == 2 and stat.evictions == 1,
+            "incorrect cache stat")
+
+        assert(wait(rc:cached("get", "test:lru:1")) == "1", "lru failed")
+        assert(rc:cache_stat().hits == 2, "recently used key was evicted")
+
+        rc:close()
+    end
+    perf("redis cache lru")
+
+    perf()
+    do
+        local status, errmsg = pwait(client:query("blpop test:nokey 1\r\n", 0.1))
+        trace(status, errmsg)
+        assert(not status and errmsg:find("timeout"), "query did not time out")
+        assert(wait(client:ping()) == "PONG", "late answer was not dropped")
+        assert(client:stat().timeouts == 1, "incorrect timeouts stat")
+    end
+    perf("redis query timeout")
+
+    perf()
+    do
+        local config = {
+            ip4 = "172.20.0.3",
+            port = 30303,
+            password = "LocalPassword123",
+            reconnect = { min_delay = 0.01, max_delay = 0.1 },
+        }
+
+        local rc = redis.client(config)
+        wait(rc:connect())
+        wait(rc:hello(config))
+
+        local pushes = {}
+        wait(rc:subscribe("test:reconnect", function(push)
+            table.insert(pushes, push)
+        end))
+
+        wait(rc:query("set test:reconnect 1\r\n"))
+        local id = wait(rc:query("client id\r\n"))
+
+        wait(client:query("client kill id " .. id .. "\r\n"))
+
+        assert(wait(rc:query("get test:reconnect\r\n")) == "1",
+            "idempotent query failed on reconnect")
+
+        wait(client:publish("test:reconnect", "after"))
+        wait(rc:ping())
+        assert(pushes[1] == "after", "channel was not resubscribed")
+
+        local stat = rc:stat()
+        trace(stat)
+        assert(stat.reconnects == 1, "incorrect reconnects stat")
+
+        rc:close()
+    end
+    perf("redis reconnect")
+
+    perf()
+    do
+        local config = {
+            ip4 = "172.20.0.3",
+            port = 30303,
+            password = "LocalPassword123",
+            push = { concurrency = 2, queue_size = 4, batch = 3 },
+        }
+
+        local rc = redis.client(config)
+        wait(rc:connect())
+        wait(rc:hello(config))
+
+        local received, running, max_running = 0, 0, 0
+
+        wait(rc:subscribe("test:push", function(batch)
+            running = running + 1
+            max_running = math.max(max_running, running)
+            wait(sleep(0.01))
+            received = received + #batch
+            running = running - 1
+        end))
+
+        local reqs = {}
+
+        for i = 1, 50 do
+            reqs[i] = client:publish("test:push", tostring(i))
+        end
+
+        for _, req in ipairs(reqs) do
+            wait(req)
+        end
+
+        wait(sleep(0.3))
+        wait(rc:ping())
+
+        assert(received == 50, "pushes were lost")
+        assert(max_running <= 2, "concurrency limit exceeded")
+
+        rc:close()
+    end
+    perf("redis push queue")
+
+    perf()
+    do
+        local stream = "test:stream"
+
+        wait(client:query("del " .. stream .. "\r\n"))
+        local created = { wait(client:xgroup(stream, "g")) }
+        local busy = { wait(client:xgroup(stream, "g")) }
+        assert(#created == 1 and created[1] == true
+            and #busy == 1 and busy[1] == true, "create and BUSYGROUP differ")
+
+        for i = 1, 5 do
+            wait(client:xadd(stream, { n = i }, 1000))
+        end
+
+        local entries = wait(client:xreadgroup("g", "c1", stream, 3, 100))
+        trace(entries)
+        assert(#entries == 3 and entries[3][2].n == "3", "incorrect entries")
+
+        local ids = {}
+
+        for i, entry in ipairs(entries) do
+            ids[i] = entry[1]
+        end
+
+        assert(wait(client:xack(stream, "g", ids)) == 3, "incorrect ack")
+        assert(#wait(client:xreadgroup("g", "c1", stream, 10, 100)) == 2,
+            "incorrect rest")
+
+        local next_start, claimed = wait(client:xautoclaim(stream, "g", "c2",
+            0, "0-0", 10))
+
+        assert(next_start == "0-0" and #claimed == 2, "incorrect claim")
+    end
+    perf("redis stream")
+
+    perf()
+    do
+        local stream = "test:stream-consumer"
+        local config = {
+            ip4 = "172.20.0.3",
+            port = 30303,
+            password = "LocalPassword123",
+        }
+
+        wait(client:query("del " .. stream .. "\r\n"))
+
+        local sc = redis.client(config)
+        wait(sc:connect())
+        wait(sc:hello(config))
+
+        local seen = {}
+        local consumer = stream_consumer(sc, {
+            stream = stream, group = "g", consumer = "c1", block_ms = 50,
+        }, function(_, fields)
+            seen[#seen + 1] = fields.n
+        end)
+
+        wait(client:xadd(stream, { n = "1" }))
+        wait(sleep(0.2))
+        assert(seen[1] == "1", "entry not consumed")
+
+        sc:close()
+        local ok, err = pwait(consumer)
+        assert(ok and err, "consumer did not stop on close")
+        assert(sc:stat().closed, "closed not reported")
+
+        wait(client:query("del " .. stream .. "\r\n"))
+    end
+    perf("redis stream consumer close")
+
+    perf()
+    do
+        local prefix = "test:load:"
+        local reqs = {}
+
+        for i = 1, 100 do
+            reqs[i] = client:query(("hset %s%d n %d\r\n"):format(prefix, i, i))
+        end
+
+        for _, req in ipairs(reqs) do
+            wait(req)
+        end
+
+        local hashes = wait(client:load_hashes(prefix, 8))
+        local n = 0
+
+        for id, fields in pairs(hashes) do
+            assert(fields.n == id, "incorrect hash")
+            n = n + 1
+        end
+
+        assert(n == 100, "incorrect hashes count")
+
+        wait(client:query("set " .. prefix .. "str 1\r\n"))
+        assert(not pwait(client:load_hashes(prefix)), "WRONGTYPE not raised")
+
+        for i = 1, 100 do
+            reqs[i] = client:query(("del %s%d\r\n"):format(prefix, i))
+        end
+
+        reqs[101] = client:query("del " .. prefix .. "str\r\n")
+
+        for _, req in ipairs(reqs) do
+            wait(req)
+        end
+    end
+    perf("redis load_hashes")
+
     client:close()
 end
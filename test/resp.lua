@@ -139,4 +139,20 @@ return function()
         trace(packet_sample)
         assert(equal(packet, packet_sample))
     perf("resp pack")
+
+    local hashed = {} -- integer keys in the hash part
+    hashed[3], hashed[2], hashed[1] = "c", "b", "a"
+    assert(redis:pack(hashed) == redis:pack({ "a", "b", "c" }),
+        "hash part array packed as map")
+
+    local shared = { 1 }
+    assert(redis:pack({ shared, shared }) == "*2\r\n*1\r\n:1\r\n*1\r\n:1\r\n",
+        "shared table is not a cycle")
+
+    local looped = {}
+    looped[1] = looped
+    assert(not pcall(redis.pack, redis, looped), "cycle not detected")
+
+    local hinted = setmetatable({}, { __jsontype = "object" })
+    assert(redis:pack(hinted) == "%0\r\n", "hint ignored")
 end
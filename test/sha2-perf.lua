@@ -0,0 +1,39 @@
+local perf = require "test.perf"
+local sha2 = require "sha2"
+
+local function hash(alg, impl, data, reps)
+    for _ = 1, reps do
+        sha2.new(alg, impl):update(data):digest()
+    end
+end
+
+return function()
+    local reps = 20
+    local data = string.rep("0123456789abcdef", 64 * 1024) -- 1 MiB
+
+    perf()
+        hash("sha512", "scalar", data, reps)
+    perf("sha512 20 MiB: scalar")
+
+    perf()
+        hash("sha256", "scalar", data, reps)
+    perf("sha256 20 MiB: scalar")
+
+    if sha2.sha256_impl == "sha-ni" then
+        perf()
+            hash("sha256", "sha-ni", data, reps)
+        perf("sha256 20 MiB: sha-ni")
+    end
+
+    local events = {}
+
+    for i = 1, 100000 do
+        events[i] = "event " .. i
+    end
+
+    perf()
+        for i = 1, #events do
+            sha2.sha256(events[i])
+        end
+    perf("sha256 100k short strings")
+end
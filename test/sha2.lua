@@ -13,7 +13,95 @@ local samples = {
     "543d79ccec281ba30536d5245929c1fbcde05167f34968936ed89202135e007a41125f0a3a19b81a8cfe95be962585bb39c628f2e05c2595ed059e33ded1c8a2",
 }
 
+local samples256 = {
+    "",
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+
+    "The quick brown fox jumps over the lazy dog",
+    "d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592",
+
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. 1234567890",
+    "f2c466658f18372152772b8aa47380430154a146d21db3203021d085f67c4b64",
+
+    -- 56 bytes, the length goes to an extra block
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+}
+
+local million_a = {
+    sha256 = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+    sha512 = "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b",
+}
+
+local function test_sha256()
+    for i = 1, #samples256, 2 do
+        local input = samples256[i]
+        local answer = samples256[i + 1]
+
+        assert(sha2.sha256(input) == answer, input)
+        assert(sha2.new("sha256", "scalar"):update(input):digest() == answer)
+    end
+end
+
+local function hash_chunked(alg, impl, input, chunk_len)
+    local ctx = sha2.new(alg, impl)
+
+    for pos = 1, #input, chunk_len do
+        ctx:update(input:sub(pos, pos + chunk_len - 1))
+    end
+
+    return ctx:digest()
+end
+
+local function test_stream()
+    local chunk_lens = { 1, 3, 55, 63, 64, 65, 111, 127, 128, 129, 1000 }
+    local impls = { sha256 = { "scalar" }, sha512 = { "scalar" } }
+
+    if sha2.sha256_impl == "sha-ni" then
+        table.insert(impls.sha256, "sha-ni")
+    end
+
+    print("sha256 impl:", sha2.sha256_impl)
+
+    local parts = {}
+
+    for i = 0, 2999 do
+        table.insert(parts, string.char(i % 251))
+    end
+
+    local input = table.concat(parts)
+
+    for alg, alg_impls in pairs(impls) do
+        local answer = sha2[alg](input)
+
+        for _, impl in ipairs(alg_impls) do
+            for _, chunk_len in ipairs(chunk_lens) do
+                local result = hash_chunked(alg, impl, input, chunk_len)
+                assert(result == answer, alg .. " " .. impl .. " " .. chunk_len)
+            end
+
+            local a = string.rep("a", 1000000)
+            assert(hash_chunked(alg, impl, a, 4096) == million_a[alg])
+        end
+
+        assert(sha2.new(alg):update(""):digest() == sha2[alg](""))
+    end
+
+    local ctx = sha2.new("sha256"):update("abc")
+    local bin = ctx:digest("bin")
+    assert(#bin == 32)
+    assert(not pcall(ctx.update, ctx, "more"), "update after digest")
+    assert(not pcall(ctx.digest, ctx), "digest twice")
+
+    assert(#sha2.new("sha512"):update("abc"):digest("bin") == 64)
+    assert(not pcall(sha2.new, "md5"))
+    assert(not pcall(sha2.new, "sha512", "sha-ni"))
+end
+
 return function()
+    test_sha256()
+    test_stream()
+
     for i = 1, #samples, 2 do
         local input = samples[i]
         local result = sha2.sha512(input)
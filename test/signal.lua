@@ -0,0 +1,21 @@
+local perf = require "test.perf"
+local async = require "async"
+local wait = async.wait
+
+local function pid()
+    local stat = assert(io.open("/proc/self/stat"))
+    local id = stat:read("n")
+    stat:close()
+    return id
+end
+
+return function()
+    perf()
+        local t = async.signal("USR1", "USR2")
+        os.execute("kill -USR2 " .. pid())
+        assert(wait(t) == "USR2", "incorrect signal name")
+    perf("signal usr2")
+
+    assert(not pcall(async.signal, "KILL"), "KILL should not be accepted")
+    assert(not pcall(async.signal), "no signals should not be accepted")
+end
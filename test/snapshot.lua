@@ -0,0 +1,80 @@
+local perf = require "test.perf"
+local snapshot = require "snapshot"
+
+local path = "/tmp/test.snap"
+
+return function()
+    perf()
+    do
+        local class = { id = "c", name = { type = "str" } }
+        local a = { id = "a", class = class, n = 1, f = 1.5, on = true,
+            off = false, list = { 1, 2, "x" } }
+        local b = { id = "b", class = class, rel = a, [10] = "ten" }
+
+        a.rels = { b }
+        a.self = a
+
+        snapshot.write(path, {
+            classes = { c = class },
+            objects = { a = a, b = b },
+        }, 123.5)
+
+        local root, ts = snapshot.read(path)
+        local ra, rb = root.objects.a, root.objects.b
+
+        assert(ts == 123.5, "incorrect ts")
+        assert(ra.self == ra and ra.rels[1] == rb and rb.rel == ra,
+            "links are not restored")
+        assert(ra.class == root.classes.c and rb.class == ra.class,
+            "shared table is copied")
+        assert(math.type(ra.n) == "integer" and ra.f == 1.5,
+            "incorrect numbers")
+        assert(ra.on == true and ra.off == false, "incorrect booleans")
+        assert(#ra.list == 3 and ra.list[3] == "x" and rb[10] == "ten",
+            "incorrect array")
+
+        assert(not pcall(snapshot.write, path, { print }, 0),
+            "function is written")
+        assert(not pcall(snapshot.read, path .. ".missing"),
+            "missing file is read")
+
+        local file = io.open(path, "rb")
+        local data = file:read("a")
+        file:close()
+
+        file = io.open(path, "wb")
+        file:write(data:sub(1, -2))
+        file:close()
+
+        assert(not pcall(snapshot.read, path), "truncated file is read")
+
+        os.remove(path)
+    end
+    perf("snapshot")
+
+    perf()
+    do
+        local classes, objects = {}, {}
+
+        for i = 1, 100 do
+            classes[i] = { id = "c" .. i, name = { type = "str" } }
+        end
+
+        for i = 1, 1000000 do
+            objects["o" .. i] = { id = "o" .. i, class = classes[i % 100 + 1],
+                name = "object", n = i }
+        end
+
+        perf()
+            snapshot.write(path, { classes = classes, objects = objects }, 0)
+        perf("snapshot write 1M objects")
+
+        perf()
+            local root = snapshot.read(path)
+        perf("snapshot read 1M objects")
+
+        assert(root.objects.o5.class == root.classes[6], "incorrect link")
+
+        os.remove(path)
+    end
+end
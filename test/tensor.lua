@@ -0,0 +1,37 @@
+local perf = require "test.perf"
+local tensor = require "tensor"
+
+local ids_n = 1000000
+
+return function()
+    local node = tensor.id_node()
+    assert(node >= 0 and node <= 1023, "bad default node")
+    assert(tensor.id_node(7) == 7 and tensor.id_node() == 7, "node not set")
+    assert(not pcall(tensor.id_node, 1024), "node range not checked")
+    assert(not pcall(tensor.gen_id, "e", "base64"), "format not checked")
+
+    local id = tensor.gen_id("event")
+    assert(id:match("^event%-[a-z0-9]+$"), "bad base36 id")
+    assert(tensor.gen_id("e", "base62"):match("^e%-[%w]+$"), "bad base62 id")
+    assert(#tensor.gen_id("", "bin") == 8, "bad bin id")
+
+    local prev = tensor.gen_id("", "bin")
+
+    for _ = 1, 10000 do
+        local next_id = tensor.gen_id("", "bin")
+        assert(next_id > prev, "bin ids do not grow")
+        prev = next_id
+    end
+
+    local seen = {}
+
+    perf()
+        for _ = 1, ids_n do
+            local burst_id = tensor.gen_id("event")
+            assert(not seen[burst_id], "dup id")
+            seen[burst_id] = true
+        end
+    perf("gen_id burst " .. ids_n)
+
+    tensor.id_node(node)
+end
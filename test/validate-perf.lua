@@ -0,0 +1,105 @@
+local perf = require "test.perf"
+local check_id = require "lib.world.check_id"
+local check_key_name = require "lib.world.check_key_name"
+local check_obj_key = require "lib.world.check_obj_key"
+local compile_validators = require "lib.world.compile_validators"
+
+-- world:create_object validation of incoming events
+local objects_n = 200000
+
+local user = { id = "user", name = { type = "str" } }
+
+local event = {
+    id = "event",
+    type = { type = "str" },
+    from = { type = "str" },
+    n = { type = "int" },
+    score = { type = "float" },
+    ok = { type = "bool" },
+    payload = { type = "table" },
+    user = { type = "rel", class = user },
+}
+
+local classes = { user = user, event = event }
+local u1 = { id = "u1", class = user, name = "alice" }
+local objects = { u1 = u1 }
+
+local function make_event(i)
+    return {
+        id = "event-" .. i,
+        class = event,
+        type = "tg_bot_event",
+        from = "fe2",
+        n = i,
+        score = i / 3,
+        ok = true,
+        payload = { i },
+        user = u1,
+    }
+end
+
+-- what validate_object did before: pcall and dynamic dispatch per key
+local function validate_key(obj, key)
+    if key == "id" then
+        return check_id(obj.id)
+    end
+
+    if key == "class" then
+        return check_id(obj.class.id)
+    end
+
+    check_key_name(key)
+
+    local schema = obj.class[key]
+    assert(schema, "key not found in class definition")
+    assert(not check_obj_key[schema.type](obj[key], objects, classes))
+end
+
+local function validate_dynamic(obj)
+    for key in pairs(obj) do
+        local ok, err = pcall(validate_key, obj, key)
+
+        if not ok then
+            error(err)
+        end
+    end
+end
+
+return function()
+    local validators = compile_validators(classes)
+    local validate = validators.event
+    local events = {}
+
+    for i = 1, objects_n do
+        events[i] = make_event(i)
+    end
+
+    local bad = make_event(0)
+    bad.n = 1.5
+    local err, key = validate(bad, objects, classes)
+    assert(err == "invalid int" and key == "n", "bad int not caught")
+
+    bad = make_event(0)
+    bad.nope = 1
+    assert(validate(bad, objects, classes), "unknown key not caught")
+
+    bad = make_event(0)
+    bad.id = "Bad Id"
+    assert(validate(bad, objects, classes), "bad id not caught")
+
+    bad = make_event(0)
+    bad.user = { id = "u1" }
+    assert(validate(bad, objects, classes), "foreign rel not caught")
+
+    perf()
+        for i = 1, objects_n do
+            validate_dynamic(events[i])
+        end
+    perf("validate dynamic " .. objects_n)
+
+    perf()
+        for i = 1, objects_n do
+            assert(not validate(events[i], objects, classes))
+        end
+    perf("validate compiled " .. objects_n)
+end
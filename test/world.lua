@@ -0,0 +1,172 @@
+local perf = require "test.perf"
+local redis = require "redis"
+local async = require "async"
+local time = require "time"
+local world = require "lib.world"
+local changes = require "lib.world.changes"
+local wait = async.wait
+
+local config = {
+    ip4 = "172.20.0.3",
+    port = 30303,
+    password = "LocalPassword123",
+    size = 2,
+}
+
+local path = "/tmp/test-world.snap"
+local class_key, object_key = "c:test_wb", "o:test_wb1"
+local keys = { class_key, object_key, "c:test_wb_item", "o:test_wb2",
+    "o:test_wb_i1" }
+
+local function query(rc, parts)
+    return wait(rc:query(redis:pack(parts), parts[2]))
+end
+
+local function cleanup(rc)
+    for _, key in ipairs(keys) do
+        query(rc, { "del", key })
+        query(rc, { "zrem", changes.key, key })
+    end
+end
+
+return function()
+    local rc = redis.pool(config)
+    wait(rc:connect())
+
+    cleanup(rc)
+    query(rc, { "hset", class_key,
+        "name", '{"type":"str"}', "age", '{"type":"int"}' })
+    query(rc, { "hset", object_key, "class", "test_wb",
+        "name", "alice", "age", "3" })
+    query(rc, { "hset", "c:test_wb_item",
+        "owner", '{"type":"rel","class":"test_wb"}',
+        "friends", '{"type":"rels","class":"test_wb"}' })
+    query(rc, { "hset", "o:test_wb2", "class", "test_wb", "name", "bo" })
+    query(rc, { "hset", "o:test_wb_i1", "class", "test_wb_item",
+        "owner", "test_wb1", "friends", '["test_wb1","test_wb2"]' })
+
+    local w = world { rc = rc, flush_interval = 0.05 }
+    local obj = w.objects.test_wb1
+
+    perf()
+    do
+        obj.name = "bob"
+        w:save_object(obj)
+        assert(w.dirty[obj] == true, "whole object is not dirty")
+        assert(w:flush() == 1 and next(w.dirty) == nil, "flush failed")
+
+        local fields = query(rc, { "hgetall", object_key })
+        assert(fields.name == "bob" and fields.age == "3"
+            and fields.class == "test_wb", "save failed")
+    end
+    perf("world save object")
+
+    perf()
+    do
+        w:set_key(obj, "name", "carol")
+        obj.age = nil
+        w:save_object(obj, nil, { "age" })
+
+        local keys = w.dirty[obj]
+        assert(keys.name and keys.age and not keys.class, "bad dirty keys")
+
+        w:flush()
+
+        local fields = query(rc, { "hgetall", object_key })
+        assert(fields.name == "carol" and fields.age == nil, "hdel failed")
+    end
+    perf("world set and delete keys")
+
+    perf()
+    do
+        w:save_object(obj, 100, { "name" })
+        w:flush()
+
+        local ttl = query(rc, { "ttl", object_key })
+        assert(ttl > 0 and ttl <= 100, "expire failed")
+        query(rc, { "persist", object_key })
+    end
+    perf("world expire")
+
+    perf()
+    do
+        obj.age = 7
+        w:save_object(obj, nil, { "age" })
+
+        w.rc = { query = function() error("test: redis down") end }
+        local ok = pcall(w.flush, w)
+        w.rc = rc
+
+        assert(not ok, "flush did not fail")
+        assert(type(w.dirty[obj]) == "table" and w.dirty[obj].age,
+            "failed batch is not merged back")
+
+        w:set_key(obj, "name", "dave") -- merges with the failed key set
+        assert(w.dirty[obj].age and w.dirty[obj].name, "key sets not united")
+
+        assert(w:flush() == 1, "resend failed")
+
+        local fields = query(rc, { "hgetall", object_key })
+        assert(fields.age == "7" and fields.name == "dave", "resend lost keys")
+    end
+    perf("world failed flush")
+
+    perf()
+    do
+        w:set_key(obj, "name", "erin")
+        assert(w:close() == 1 and w.closed, "close did not flush")
+        assert(query(rc, { "hget", object_key, "name" }) == "erin",
+            "pending write lost on close")
+    end
+    perf("world close")
+
+    perf()
+    do
+        local w2 = world { rc = rc, flush_interval = 0.05 }
+        w2:save_snapshot(path, time())
+
+        -- changed and deleted after the snapshot, as marked by fe1
+        query(rc, { "hset", "o:test_wb2", "name", "cy" })
+        query(rc, { "del", object_key })
+        query(rc, { "zadd", changes.key, tostring(time()), "o:test_wb2" })
+        query(rc, { "zadd", changes.key, tostring(time()), object_key })
+
+        assert(w2:load_snapshot(path), "snapshot not loaded")
+
+        local objects = w2.objects
+        local u2, item = objects.test_wb2, objects.test_wb_i1
+
+        assert(u2.name == "cy", "changed object not caught up")
+        assert(objects.test_wb1 == nil, "deleted object kept")
+        assert(item.owner == nil and #item.friends == 1
+            and item.friends[1] == u2, "deleted object not unlinked")
+        assert(w2.dirty[item].owner and w2.dirty[item].friends,
+            "unlinked keys not dirty")
+
+        w2:close()
+
+        local fields = query(rc, { "hgetall", "o:test_wb_i1" })
+        assert(fields.owner == nil and not fields.friends:find("test_wb1"),
+            "unlinked keys not saved")
+
+        -- a newer snapshot trimmed marks this one would need
+        local trimmed = query(rc, { "zscore", changes.trimmed_key, "ts" })
+        query(rc, { "zadd", changes.trimmed_key, tostring(time() + 10),
+            "ts" })
+
+        local loaded = w2:load_snapshot(path)
+
+        if trimmed then
+            query(rc, { "zadd", changes.trimmed_key, tostring(trimmed), "ts" })
+        else
+            query(rc, { "zrem", changes.trimmed_key, "ts" })
+        end
+
+        assert(not loaded, "snapshot with trimmed marks loaded")
+        os.remove(path)
+    end
+    perf("world snapshot catch-up")
+
+    cleanup(rc)
+    rc:close()
+end